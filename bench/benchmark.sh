@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# Measures simulated cycles per second on the sample workloads.
+#
+# Usage: bench/benchmark.sh simulator [baseline-simulator ...]
+#
+# The first simulator is used to determine the number of cycles of
+# each workload (via --statistics). Every simulator given is then
+# timed on every workload, so an older build can be passed as a
+# second argument to compare against it. A simulator may carry
+# options, e.g. "bin/rcpu_simulator --mode threaded".
+
+RUNS=${RUNS:-3}
+ROOT=$(dirname "$0")/..
+WORKLOADS="$ROOT/sample/fib.binary $ROOT/sample/loop.binary"
+
+if [ $# -lt 1 ]; then
+    echo "[Usage:] $0 simulator [baseline-simulator ...]"
+    exit 1
+fi
+
+now() {
+    date +%s.%N
+}
+
+for workload in $WORKLOADS; do
+    cycles=$($1 --program-kind binary --program "$workload" --statistics 2>&1 >/dev/null \
+             | awk '/^cycles:/ { print $2 }')
+    echo "$(basename "$workload"): $cycles cycles"
+
+    for simulator in "$@"; do
+        best=""
+        i=0
+        while [ $i -lt $RUNS ]; do
+            start=$(now)
+            $simulator --program-kind binary --program "$workload" >/dev/null
+            end=$(now)
+            best=$(echo "$start $end $best" | awk '{ t = $2 - $1; if ($3 == "" || t < $3) print t; else print $3 }')
+            i=$((i + 1))
+        done
+        echo "$best $cycles" | awk -v name="$simulator" '{ printf "\t%-40s %10.4f s %14.0f cycles/sec\n", name, $1, $2 / $1 }'
+    done
+done
@@ -0,0 +1,253 @@
+#!/bin/sh
+#
+# Checks that every execution mode gives exactly the same results as
+# the pipeline on the sample workloads and on generated programs (see
+# bench/generate.sh).
+#
+# Usage: bench/equivalence.sh simulator aot
+#
+# aot is the ahead-of-time compiler, bin/rcpu-aot. The C it generates
+# is built with $CC (cc by default).
+#
+# Every mode, the threaded engine also with --fuse, is compared against
+# --mode pipeline on every workload: the memory protocol, the cycle
+# count (via --statistics), the final contents of data memory (via
+# --dump-memory) and the STOREs traced (via --store-trace) of a single
+# run, also from a data image (via --data-image), as well as the
+# registers, memory protocol, cycle count and status of a batch run
+# (via --batch), also in lockstep and after a warm-up. Single runs and
+# lockstep are also compared with data memory in a guard region (via
+# --data-size 1G). The program compiled by aot, once built, has to
+# print the same memory protocol and cycle count.
+#
+# Runs that are interrupted and continued have to end exactly like one
+# that is not: checkpoints taken halfway and restored (also via --mmap),
+# delta checkpoints applied to them (via --apply), going back while
+# single stepping (also the STOREs traced), sampled runs (via --sample)
+# and runs that switch to the pipeline for a region (via --detail-from
+# and --detail-until).
+#
+# Prints every difference found and exits with status 1 if there is any.
+
+ROOT=$(dirname "$0")/..
+SAMPLES=$(ls "$ROOT"/sample/*.binary)
+GENERATED="1 2 3 4 5 6 7 8"
+MODES="functional threaded jit tiered"
+
+if [ $# -ne 2 ]; then
+    echo "[Usage:] $0 simulator aot"
+    exit 1
+fi
+
+simulator=$1
+aot=$2
+CC=${CC:-cc}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+WORKLOADS=$SAMPLES
+for seed in $GENERATED; do
+    "$ROOT"/bench/generate.sh "$seed" >"$work/generated-$seed.textual"
+    WORKLOADS="$WORKLOADS $work/generated-$seed.textual"
+done
+
+# Prints the program kind of a workload, from its extension
+kind_of() {
+    case $1 in
+        *.textual) echo textual ;;
+        *) echo binary ;;
+    esac
+}
+
+# Runs the simulator, leaving the memory protocol and the cycle count
+# in $work/$1.out and data memory in $work/$1.mem
+run() {
+    name=$1
+    shift
+
+    $simulator --statistics --dump-memory "$work/$name.mem" "$@" >"$work/$name.out" 2>"$work/$name.err"
+    awk '/^cycles:/' "$work/$name.err" >>"$work/$name.out"
+}
+
+# Runs a workload once, also leaving its STOREs in $work/$2.trace
+run_single() {
+    workload=$1
+    name=$2
+    shift 2
+
+    run "$name" --program-kind "$(kind_of "$workload")" --program "$workload" \
+        --store-trace "$work/$name.trace" "$@"
+}
+
+# Compiles a workload ahead of time, builds and runs it, leaving the
+# memory protocol and the cycle count in $work/$2.out
+run_aot() {
+    workload=$1
+    name=$2
+
+    if ! $aot --program-kind "$(kind_of "$workload")" --program "$workload" --output "$work/$name.c" \
+         || ! $CC -O1 -o "$work/$name" "$work/$name.c"; then
+        echo "$(basename "$workload"): $aot or $CC failed" >"$work/$name.out"
+        return
+    fi
+
+    "$work/$name" --statistics >"$work/$name.out" 2>"$work/$name.err"
+    awk '/^cycles:/' "$work/$name.err" >>"$work/$name.out"
+}
+
+# Runs a workload as a batch of two jobs, leaving the results in $work/$2.json
+run_batch() {
+    workload=$1
+    name=$2
+    shift 2
+
+    printf '%s\n%s\n' "$workload" "$workload" >"$work/manifest"
+    $simulator --program-kind "$(kind_of "$workload")" --batch "$work/manifest" \
+               --output "$work/$name.json" "$@"
+}
+
+# Single steps through a workload, going back and forth, then runs it
+# to the end, leaving its STOREs in $work/$2.trace. Only what is printed
+# once single stepping ends is kept.
+run_stepped() {
+    workload=$1
+    name=$2
+    shift 2
+
+    {
+        # Far enough for STOREs to be replayed when going back
+        step=0
+        while [ $step -lt 100 ]; do
+            echo s
+            step=$((step + 1))
+        done
+        echo "b 7"
+        echo s
+        echo "break 5"
+        echo rc
+        echo s
+        echo "w 64"
+        echo "b 1000"
+        echo c
+    } | run "$name" --program-kind "$(kind_of "$workload")" --program "$workload" \
+            --store-trace "$work/$name.trace" --single-stepping "$@"
+
+    sed -n 's/^.*Printing results/Printing results/; /^Printing results/,$p' "$work/$name.out" >"$work/$name.tail"
+    mv "$work/$name.tail" "$work/$name.out"
+}
+
+failures=0
+
+# Reports a difference between the results of the pipeline and a mode
+compare() {
+    if ! cmp -s "$work/$1" "$work/$2"; then
+        echo "$(basename "$workload"): $3 differs from --mode pipeline ($4)"
+        failures=$((failures + 1))
+    fi
+}
+
+# Compares a run continued in some way with the uninterrupted one
+compare_run() {
+    compare reference.out "$1.out" "$2" "memory protocol or cycles"
+    compare reference.mem "$1.mem" "$2" "data memory"
+}
+
+for workload in $WORKLOADS; do
+    run_single "$workload" reference --mode pipeline
+    run_single "$workload" image-reference --mode pipeline --data-image "$work/reference.mem"
+    run_batch "$workload" reference --mode pipeline
+
+    cycles=$(awk '{ print $2 }' "$work/reference.out" | tail -n 1)
+    quarter=$((cycles / 4))
+    half=$((cycles / 2))
+
+    for options in $MODES "threaded --fuse"; do
+        # $options is split into words on purpose
+        run_single "$workload" mode --mode $options
+        compare reference.out mode.out "--mode $options" "memory protocol or cycles"
+        compare reference.mem mode.mem "--mode $options" "data memory"
+        compare reference.trace mode.trace "--mode $options" "STOREs traced"
+
+        run_single "$workload" mode --mode $options --data-image "$work/reference.mem"
+        compare image-reference.out mode.out "--mode $options --data-image" "memory protocol or cycles"
+        compare image-reference.mem mode.mem "--mode $options --data-image" "data memory"
+
+        run_batch "$workload" mode --mode $options
+        compare reference.json mode.json "--mode $options --batch" "registers, protocol, cycles or status"
+    done
+
+    run_aot "$workload" aot
+    compare reference.out aot.out "$aot" "memory protocol or cycles"
+
+    run_batch "$workload" mode --lockstep
+    compare reference.json mode.json "--lockstep --batch" "registers, protocol, cycles or status"
+
+    # Data memory of 1 GB lies in a guard region, so accesses are not checked
+    for options in pipeline $MODES "threaded --fuse"; do
+        run_single "$workload" mode --mode $options --data-size 1G
+        compare reference.out mode.out "--mode $options --data-size 1G" "memory protocol or cycles"
+        compare reference.trace mode.trace "--mode $options --data-size 1G" "STOREs traced"
+    done
+
+    run_batch "$workload" mode --lockstep --data-size 1G
+    compare reference.json mode.json "--lockstep --batch --data-size 1G" "registers, protocol, cycles or status"
+
+    for options in "" --lockstep; do
+        run_batch "$workload" mode --mode functional --warmup "$half" $options
+        compare reference.json mode.json "--warmup $options --batch" "registers, protocol, cycles or status"
+    done
+
+    # Checkpoints taken by every mode, restored by the pipeline and
+    # mapped by the same mode
+    for options in pipeline $MODES "threaded --fuse"; do
+        run_single "$workload" ignored --mode $options --checkpoint "$work/checkpoint" --checkpoint-cycle "$half"
+
+        run restored --restore "$work/checkpoint" --mode pipeline
+        compare_run restored "--checkpoint from --mode $options, --restore"
+
+        run restored --restore "$work/checkpoint" --mmap --mode $options
+        compare_run restored "--checkpoint from --mode $options, --restore --mmap"
+    done
+
+    # A base checkpoint with two deltas, the second one taken after
+    # applying the first
+    run_single "$workload" ignored --mode functional --checkpoint "$work/checkpoint" --checkpoint-cycle "$quarter" \
+               --delta-checkpoint "$work/delta1" --delta-cycle "$half"
+    run ignored --restore "$work/checkpoint" --apply "$work/delta1" --mode functional \
+        --delta-checkpoint "$work/delta2" --delta-cycle "$((half + quarter))"
+
+    run restored --restore "$work/checkpoint" --apply "$work/delta1" --mode threaded
+    compare_run restored "--restore --apply"
+    run restored --restore "$work/checkpoint" --apply "$work/delta1" --apply "$work/delta2" --mode jit
+    compare_run restored "--restore --apply --apply"
+
+    run_stepped "$workload" stepped --mode pipeline
+    compare_run stepped "--single-stepping going back"
+    compare reference.trace stepped.trace "--single-stepping going back" "STOREs traced"
+
+    for options in functional threaded jit; do
+        run_single "$workload" sampled --mode $options --sample "$((cycles / 16 + 1))" --sample-every 2 \
+                   --sample-warmup 20 --threads 2
+        compare_run sampled "--mode $options --sample"
+    done
+
+    for options in $MODES; do
+        run_single "$workload" detailed --mode $options --detail-from "cycle:$quarter" --detail-until "cycle:$half"
+        compare_run detailed "--mode $options --detail-from cycle --detail-until cycle"
+
+        run_single "$workload" detailed --mode $options --detail-from "instructions:$quarter" --detail-until "pc:5"
+        compare_run detailed "--mode $options --detail-from instructions --detail-until pc"
+
+        run_single "$workload" detailed --mode $options --detail-from "pc:12"
+        compare_run detailed "--mode $options --detail-from pc"
+    done
+
+    echo "$(basename "$workload"): checked"
+done
+
+if [ $failures -ne 0 ]; then
+    echo "$failures differences found"
+    exit 1
+fi
+
+echo "All modes match the pipeline"
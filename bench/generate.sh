@@ -0,0 +1,230 @@
+#!/bin/sh
+#
+# Generates a random program in the textual format, e.g. for
+# bench/equivalence.sh to run beyond the samples.
+#
+# Usage: bench/generate.sh seed
+#
+# The same seed always gives the same program. Registers r0 to r20 are
+# set to random values, then random ALU, compare, LOAD and STORE
+# instructions work on them, partly within counted loops, without any
+# NOPs in between, so they race through the pipeline's hazards. Data
+# memory is accessed at words 64 to 127.
+#
+# In between, JMP, JMPR, BRA, BRR and writes to the PC (r31) skip ahead
+# over a few instructions. Their delay slots, and those of the branches
+# closing the loops, hold live instructions, MOVIs, NOPs or HALT, which
+# stops the program early unless the PC changes. All targets lie ahead,
+# so every program terminates. At the end, all
+# registers are stored to words 200 and onwards, and the program halts.
+
+if [ $# -ne 1 ]; then
+    echo "[Usage:] $0 seed"
+    exit 1
+fi
+
+awk -v seed="$1" '
+function rand_int(low, high) {
+    return low + int(rand() * (high - low + 1))
+}
+
+# Appends an instruction word, given its opcode and fields. The loader
+# skips whatever follows the bits, so the mnemonic has to be there.
+function emit(opcode, a, b, c,    word, bits, i) {
+    word = opcode + a * 64 + b * 2048 + c * 65536
+    bits = ""
+    for (i = 0; i < 32; ++i) {
+        bits = (word % 2) bits
+        word = int(word / 2)
+    }
+    printf "%d\t%s\t%s\n", ninstructions++, bits, mnemonic[opcode]
+}
+
+function nops(n,    i) {
+    for (i = 0; i < n; ++i)
+        emit(18, 0, 0, 0)
+}
+
+# Immediate values are stored in two complement at the top of the word
+function immediate(value, width) {
+    return (value < 0) ? value + 2 ^ width : value
+}
+
+function source() {
+    return rand_int(0, 20)
+}
+
+# One instruction without control flow, writing r0 to r20 only
+function compare(    opcode) {
+    opcode = rand_int(4, 13)
+    if (opcode % 2)
+        emit(opcode, source(), immediate(rand_int(-300, 300), 21), 0)
+    else
+        emit(opcode, source(), source(), 0)
+}
+
+function random_instruction(    kind, opcode) {
+    kind = rand()
+
+    if (kind < 0.15) {
+        emit(18, 0, 0, 0)
+    } else if (kind < 0.45) {
+        opcode = binary[rand_int(1, nbinary)]
+        if (opcode % 2)
+            emit(opcode, source(), source(), immediate(rand_int(-300, 300), 16))
+        else
+            emit(opcode, source(), source(), source())
+    } else if (kind < 0.55) {
+        opcode = unary[rand_int(1, nunary)]
+        if (opcode == 15)
+            emit(opcode, source(), immediate(rand_int(-5000, 5000), 21), 0)
+        else
+            emit(opcode, source(), source(), 0)
+    } else if (kind < 0.7) {
+        compare()
+    } else if (kind < 0.85) {
+        emit(16, source(), 26, rand_int(0, 63))
+    } else {
+        emit(17, source(), 26, rand_int(0, 63))
+    }
+}
+
+# Fills a delay slot. HALT is only chosen if halt is set.
+function delay_slot(halt,    kind) {
+    kind = rand()
+
+    if (halt && (kind < 0.1))
+        emit(19, 0, 0, 0)                       # HALT
+    else if (kind < 0.3)
+        emit(18, 0, 0, 0)
+    else if (kind < 0.5)
+        emit(15, source(), immediate(rand_int(-5000, 5000), 21), 0)
+    else
+        random_instruction()
+}
+
+# The instructions skipped by a taken branch, which run if it is not taken
+function skipped(n) {
+    while (ninstructions < n) {
+        if (rand() < 0.2)
+            nops(rand_int(1, 6))
+        else
+            random_instruction()
+    }
+}
+
+# A jump, branch or write to the PC to a target up to skip instructions
+# past its delay slots
+function forward_branch(    kind, skip, at, landing, compare_nops) {
+    kind = rand_int(1, 6)
+    skip = rand_int(0, 8)
+    compare_nops = rand_int(0, 5)
+
+    if ((kind == 3) || (kind == 4)) {
+        # The absolute target is loaded into r27 first
+        at = ninstructions + 6 + ((kind == 4) ? 1 + compare_nops : 0)
+        landing = at + 3 + skip
+        emit(15, 27, rand_int(at + 3, landing), 0)      # MOVI r27, target
+        nops(5)
+    }
+
+    # A compare right before a conditional branch, possibly fused with it
+    if ((kind == 2) || (kind == 4)) {
+        compare()
+        nops(compare_nops)
+    }
+
+    at = ninstructions
+    landing = at + 3 + skip
+
+    if (kind == 1) {
+        emit(1, immediate(rand_int(2, skip + 2), 26), 0, 0)     # JMPR
+    } else if (kind == 2) {
+        emit(3, immediate(rand_int(2, skip + 2), 26), 0, 0)     # BRR
+    } else if (kind == 3) {
+        emit(0, 27, 0, 0)                                       # JMP r27
+    } else if (kind == 4) {
+        emit(2, 27, 0, 0)                                       # BRA r27
+    } else {
+        # Written back after three more instructions have been fetched,
+        # ADDI reads the address of the next instruction
+        landing = at + 4 + skip
+        if (kind == 5)
+            emit(15, 31, rand_int(at + 4, landing), 0)          # MOVI r31, target
+        else
+            emit(33, 31, 31, rand_int(3, skip + 3))             # ADDI r31, r31, offset
+        delay_slot(1)
+    }
+
+    # Conditional branches may not be taken, so only jumps halt there
+    delay_slot((kind % 2) || (kind >= 5))
+    delay_slot((kind % 2) || (kind >= 5))
+    skipped(landing)
+}
+
+BEGIN {
+    srand(seed)
+    split("JMP JMPR BRA BRR CEQ CEQI CLTU CLTUI CLTS CLTSI CGTU CGTUI CGTS CGTSI MOVE MOVI LOAD STORE NOP HALT", names)
+    for (i = 1; i <= 20; ++i)
+        mnemonic[i - 1] = names[i]
+    split("ADD ADDI SUB SUBI AND ANDI OR ORI NOT - SHL SHLI SHRA SHRAI SHRL SHRLI", names)
+    for (i = 1; i <= 16; ++i)
+        mnemonic[i + 31] = names[i]
+
+    split("32 33 34 35 36 37 38 39 42 43 44 45 46 47", binary)
+    nbinary = 14
+    split("40 14 15", unary)
+    nunary = 3
+
+    # MOVI r26, 64 as the base of all LOADs and STOREs
+    emit(15, 26, 64, 0)
+    for (r = 0; r <= 20; ++r)
+        emit(15, r, immediate(rand_int(-1000, 1000), 21), 0)
+    nops(5)
+
+    nblocks = rand_int(5, 15)
+    for (block = 0; block < nblocks; ++block) {
+        kind = rand()
+
+        if (kind < 0.35) {
+            for (i = rand_int(1, 20); i > 0; --i)
+                random_instruction()
+            continue
+        }
+
+        if (kind < 0.65) {
+            for (i = rand_int(1, 3); i > 0; --i)
+                forward_branch()
+            continue
+        }
+
+        # A counted loop on a counter of its own, r21 to r25
+        counter = rand_int(21, 25)
+        emit(15, counter, rand_int(1, 200), 0)
+        nops(5)
+
+        top = ninstructions
+        for (i = rand_int(2, 12); i > 0; --i) {
+            if (rand() < 0.1)
+                forward_branch()
+            else
+                random_instruction()
+        }
+
+        emit(35, counter, counter, 1)           # SUBI counter, counter, 1
+        nops(5)
+        emit(11, counter, 0, 0)                 # CGTUI counter, 0
+        nops(5)
+        emit(3, immediate(top - ninstructions - 1, 26), 0, 0) # BRR top
+        delay_slot(0)
+        delay_slot(0)
+        nops(3)
+    }
+
+    nops(5)
+    for (r = 0; r < 26; ++r)
+        emit(17, r, 26, 136 + r)                # STORE r, r26, 136 + r
+    nops(5)
+    emit(19, 0, 0, 0)                           # HALT
+    nops(5)
+}'
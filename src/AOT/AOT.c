@@ -0,0 +1,103 @@
+#include "CodeGenerator.h"
+
+#include "../Instruction/Predecode.h"
+#include "../Machine/Machine.h" // MACHINE_DEFAULT_DATA_SIZE, machine_parse_data_size
+#include "../ProgramLoading.h"
+
+#include <stdlib.h> // EXIT_SUCCESS
+
+#ifdef __linux__
+#include <string.h> // strcmp
+#endif
+
+/*
+    rcpu-aot translates a program to a standalone C file,
+    see CodeGenerator.h.
+*/
+
+void print_usage(const char *program)
+{
+    printf("[Usage:] %s --program-kind [textual | binary] --program binary [--data-size bytes] [--output file.c]\n", program);
+}
+
+int main(int argc, char *argv[])
+{
+    bool programKindSet = false;
+    LOAD_OPTION programKind = OPT_BINARY;
+    char *programString = NULL;
+    char *outputString = NULL;
+    char *dataSizeString = NULL;
+    size_t dataSize = MACHINE_DEFAULT_DATA_SIZE;
+
+    for (unsigned int i = 1; i < argc; ++i) {
+        if (strcmp("--program-kind", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                if (strcmp("binary", argv[i+1]) == 0) {
+                    programKindSet = true;
+                    programKind = OPT_BINARY;
+                } else if (strcmp("textual", argv[i+1]) == 0) {
+                    programKindSet = true;
+                    programKind = OPT_TEXTUAL;
+                } else {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        else if (strcmp("--program", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                programString = argv[i+1];
+            }
+        }
+        else if (strcmp("--data-size", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                dataSizeString = argv[i+1];
+            }
+        }
+        else if (strcmp("--output", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                outputString = argv[i+1];
+            }
+        }
+    }
+
+    // If not all required parameters have been set
+    if (!programKindSet || !programString || (dataSizeString && (machine_parse_data_size(dataSizeString, &dataSize) != 0))) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint32_t *code;
+    size_t code_size;
+
+    if (load_program_from_path(programKind, programString, &code, &code_size) != 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const size_t ninstructions = code_size / sizeof(*code);
+    decoded_instruction_t * const decoded = instruction_predecode_program(code, ninstructions);
+    if (decoded == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE * const out = outputString ? fopen(outputString, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "Cannot open %s for writing\n", outputString);
+        return EXIT_FAILURE;
+    }
+
+    // Same amount of data memory as the simulator
+    const int result = aot_generate(out, programString, decoded, ninstructions, dataSize);
+
+    if ((fclose(out) != 0) || (result != 0)) {
+        fprintf(stderr, "Failed to write the generated program\n");
+        return EXIT_FAILURE;
+    }
+
+    free(decoded);
+    free(code);
+
+    return EXIT_SUCCESS;
+}
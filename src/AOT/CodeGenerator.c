@@ -0,0 +1,749 @@
+#include "CodeGenerator.h"
+
+#include "../Instruction/BasicBlock.h"
+#include "../Instruction/Disassemble.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#define AOT_MAX_BLOCK_LENGTH 256
+
+// Names of the handlers in the generated code
+static const char * const handler_names[HANDLER_COUNT] = {
+    [HANDLER_INVALID] = "INVALID",
+#define NAME_ENTRY(name, opcode, type, alu, rd, op1, op2) [HANDLER_##name] = #name,
+    INSTRUCTION_SET(NAME_ENTRY)
+#undef NAME_ENTRY
+
+    // Superinstructions never appear in the generated code
+    [HANDLER_CEQ_BRR]    = "CEQ_BRR",
+    [HANDLER_CEQI_BRR]   = "CEQI_BRR",
+    [HANDLER_CLTU_BRR]   = "CLTU_BRR",
+    [HANDLER_CLTUI_BRR]  = "CLTUI_BRR",
+    [HANDLER_CLTS_BRR]   = "CLTS_BRR",
+    [HANDLER_CLTSI_BRR]  = "CLTSI_BRR",
+    [HANDLER_CGTU_BRR]   = "CGTU_BRR",
+    [HANDLER_CGTUI_BRR]  = "CGTUI_BRR",
+    [HANDLER_CGTS_BRR]   = "CGTS_BRR",
+    [HANDLER_CGTSI_BRR]  = "CGTSI_BRR",
+    [HANDLER_MOVI_CHAIN] = "MOVI_CHAIN"
+};
+
+/*
+    Everything of the generated program that does not depend on the
+    guest program: memory, the memory protocol, ALU operations and
+    the interpreter.
+*/
+static const char runtime[] =
+    "typedef struct {\n"
+    "    uint8_t  handler;\n"
+    "    uint8_t  rd, rs1, rs2;\n"
+    "    bool     is_immediate;\n"
+    "    uint32_t imm;\n"
+    "} instruction_t;\n"
+    "\n"
+    "static const instruction_t code[NINSTRUCTIONS];\n"
+    "\n"
+    "static uint32_t registers[32];\n"
+    "static uint32_t data[DATA_WORDS];\n"
+    "static bool     flag;\n"
+    "static uint64_t cycles;\n"
+    "\n"
+    "// Addresses of all words stored to, each one once\n"
+    "static uint64_t   stored[(DATA_WORDS + 63) / 64];\n"
+    "static uint32_t * protocol;\n"
+    "static size_t     protocol_length;\n"
+    "static size_t     protocol_capacity;\n"
+    "\n"
+    "static void store(const uint32_t address, const uint32_t value)\n"
+    "{\n"
+    "    data[address] = value;\n"
+    "\n"
+    "    const uint64_t bit = (uint64_t)1 << (address % 64);\n"
+    "    if (stored[address / 64] & bit)\n"
+    "        return;\n"
+    "    stored[address / 64] |= bit;\n"
+    "\n"
+    "    if (protocol_length == protocol_capacity) {\n"
+    "        protocol_capacity = protocol_capacity ? 2 * protocol_capacity : 1024;\n"
+    "        protocol = realloc(protocol, protocol_capacity * sizeof(*protocol));\n"
+    "        if (protocol == NULL) {\n"
+    "            fprintf(stderr, \"Failed to allocate memory\\n\");\n"
+    "            exit(EXIT_FAILURE);\n"
+    "        }\n"
+    "    }\n"
+    "    protocol[protocol_length++] = address;\n"
+    "}\n"
+    "\n"
+    "static int compare_addresses(const void * const a, const void * const b)\n"
+    "{\n"
+    "    const uint32_t x = *(const uint32_t *)a;\n"
+    "    const uint32_t y = *(const uint32_t *)b;\n"
+    "    return (x > y) - (x < y);\n"
+    "}\n"
+    "\n"
+    "static uint32_t io_address(const uint32_t address)\n"
+    "{\n"
+    "    if (address >= DATA_WORDS) {\n"
+    "        fprintf(stderr, \"Illegal offset: 0x%x\\n\", address);\n"
+    "        abort();\n"
+    "    }\n"
+    "    return address;\n"
+    "}\n"
+    "\n"
+    "// Shifts by one bit if b is zero, by eight bits otherwise\n"
+    "static inline uint32_t shl(const uint32_t a, const uint32_t b)\n"
+    "{\n"
+    "    return b ? a << 8 : a << 1;\n"
+    "}\n"
+    "\n"
+    "static inline uint32_t shrl(const uint32_t a, const uint32_t b)\n"
+    "{\n"
+    "    return b ? a >> 8 : a >> 1;\n"
+    "}\n"
+    "\n"
+    "static inline uint32_t shra(const uint32_t a, const uint32_t b)\n"
+    "{\n"
+    "    return b ? (a >> 8) | (~((a >> 31) - 1) << 23)\n"
+    "             : (a >> 1) | (a & 0x80000000u);\n"
+    "}\n"
+    "\n"
+    "// Interpreter for everything outside of blocks\n"
+    "\n"
+    "enum { EFFECT_NONE = 0, EFFECT_WRITE, EFFECT_BRANCH };\n"
+    "\n"
+    "// Slot (c & 3) holds the instruction fetched in cycle c\n"
+    "typedef struct {\n"
+    "    const instruction_t * inst;\n"
+    "    uint32_t n_pc;\n"
+    "    uint8_t  effect;\n"
+    "    uint8_t  rd;\n"
+    "    uint32_t value;\n"
+    "} slot_t;\n"
+    "\n"
+    "static slot_t  slots[4];\n"
+    "static uint8_t in_flight;\n"
+    "\n"
+    "static void execute(slot_t * const slot)\n"
+    "{\n"
+    "    const instruction_t * const i = slot->inst;\n"
+    "    const uint32_t a = registers[i->rs1];\n"
+    "    const uint32_t b = i->is_immediate ? i->imm : registers[i->rs2];\n"
+    "    uint32_t result;\n"
+    "\n"
+    "    switch (i->handler) {\n"
+    "        case H_ADD:  case H_ADDI:  result = a + b; break;\n"
+    "        case H_SUB:  case H_SUBI:  result = a - b; break;\n"
+    "        case H_AND:  case H_ANDI:  result = a & b; break;\n"
+    "        case H_OR:   case H_ORI:   result = a | b; break;\n"
+    "        case H_SHL:  case H_SHLI:  result = shl(a, b); break;\n"
+    "        case H_SHRA: case H_SHRAI: result = shra(a, b); break;\n"
+    "        case H_SHRL: case H_SHRLI: result = shrl(a, b); break;\n"
+    "        case H_NOT:                result = ~a; break;\n"
+    "        case H_MOVE:               result = a; break;\n"
+    "        case H_MOVI:               result = i->imm; break;\n"
+    "        case H_LOAD:               result = data[io_address(a + i->imm)]; break;\n"
+    "\n"
+    "        case H_CEQ:  case H_CEQI:  flag = (a == b); return;\n"
+    "        case H_CLTU: case H_CLTUI: flag = (a < b); return;\n"
+    "        case H_CLTS: case H_CLTSI: flag = ((int32_t)a < (int32_t)b); return;\n"
+    "        case H_CGTU: case H_CGTUI: flag = (a > b); return;\n"
+    "        case H_CGTS: case H_CGTSI: flag = ((int32_t)a > (int32_t)b); return;\n"
+    "\n"
+    "        case H_BRA:\n"
+    "            if (!flag)\n"
+    "                return;\n"
+    "            // fall through\n"
+    "        case H_JMP:\n"
+    "            slot->effect = EFFECT_BRANCH;\n"
+    "            slot->value = a;\n"
+    "            return;\n"
+    "        case H_BRR:\n"
+    "            if (!flag)\n"
+    "                return;\n"
+    "            // fall through\n"
+    "        case H_JMPR:\n"
+    "            slot->effect = EFFECT_BRANCH;\n"
+    "            slot->value = i->imm + slot->n_pc;\n"
+    "            return;\n"
+    "\n"
+    "        case H_STORE:\n"
+    "            store(io_address(a + i->imm), registers[i->rd]);\n"
+    "            return;\n"
+    "        case H_NOP:\n"
+    "            return;\n"
+    "\n"
+    "        default:\n"
+    "            fprintf(stderr, \"Instruction not supported.\\n\");\n"
+    "            abort();\n"
+    "    }\n"
+    "\n"
+    "    slot->effect = EFFECT_WRITE;\n"
+    "    slot->rd = i->rd;\n"
+    "    slot->value = result;\n"
+    "}\n"
+    "\n"
+    "static void fetch(slot_t * const slot)\n"
+    "{\n"
+    "    const uint32_t address = registers[PC];\n"
+    "\n"
+    "    if (address >= NINSTRUCTIONS) {\n"
+    "        fprintf(stderr, \"Fetch outside of the program: 0x%x\\n\", address);\n"
+    "        abort();\n"
+    "    }\n"
+    "\n"
+    "    slot->effect = EFFECT_NONE;\n"
+    "    if (code[address].handler != H_HALT) {\n"
+    "        slot->inst = &code[address];\n"
+    "        slot->n_pc = ++registers[PC];\n"
+    "        in_flight = ((in_flight << 1) | 1) & 0xf;\n"
+    "    } else {\n"
+    "        slot->inst = NULL;\n"
+    "        in_flight = (in_flight << 1) & 0xf;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// Simulates one cycle, returns false once the program has finished\n"
+    "static bool step(void)\n"
+    "{\n"
+    "    const uint64_t cycle = cycles++;\n"
+    "\n"
+    "    slot_t * const wb = &slots[cycle & 3];\n"
+    "    if (wb->effect == EFFECT_WRITE)\n"
+    "        registers[wb->rd] = wb->value;\n"
+    "\n"
+    "    const slot_t * const mem = &slots[(cycle + 1) & 3];\n"
+    "    if (mem->effect == EFFECT_BRANCH)\n"
+    "        registers[PC] = mem->value;\n"
+    "\n"
+    "    slot_t * const id = &slots[(cycle + 3) & 3];\n"
+    "    if (id->inst != NULL)\n"
+    "        execute(id);\n"
+    "\n"
+    "    fetch(wb);\n"
+    "    return in_flight != 0;\n"
+    "}\n"
+    "\n"
+    "// True if the instruction in slot is about to change the PC\n"
+    "static bool changes_pc(const slot_t * const slot, const bool branch)\n"
+    "{\n"
+    "    return (branch && (slot->effect == EFFECT_BRANCH))\n"
+    "        || ((slot->effect == EFFECT_WRITE) && (slot->rd == PC));\n"
+    "}\n"
+    "\n";
+
+/*
+    The beginning of main, up to the switch selecting the block the
+    interpreter can hand over to.
+*/
+static const char main_prologue[] =
+    "int main(int argc, char *argv[])\n"
+    "{\n"
+    "    const bool statistics = (argc > 1) && (strcmp(argv[1], \"--statistics\") == 0);\n"
+    "\n"
+    "    // Results of the last three instructions before a block, oldest\n"
+    "    // first, which still have to be written back.\n"
+    "    uint32_t * pending_dst[3];\n"
+    "    uint32_t   pending_value[3];\n"
+    "    uint32_t   sink;\n"
+    "\n"
+    "    // Results written back later inside a block\n"
+    "    uint32_t   t0, t1, t2;\n"
+    "\n"
+    "    // Address of the next instruction after a block\n"
+    "    uint32_t   next_pc;\n"
+    "\n"
+    "    (void)t0; (void)t1; (void)t2;\n"
+    "\n"
+    "    for (;;) {\n"
+    "        // Blocks can only be entered if no fetch was skipped because\n"
+    "        // of a HALT and neither a branch nor a pending write to the\n"
+    "        // PC register is about to change the PC.\n"
+    "        if ((in_flight == 0xf)\n"
+    "            && !changes_pc(&slots[cycles & 3], false)\n"
+    "            && !changes_pc(&slots[(cycles + 1) & 3], true)\n"
+    "            && !changes_pc(&slots[(cycles + 2) & 3], true)) {\n"
+    "            next_pc = (uint32_t)(slots[(cycles + 3) & 3].inst - code);\n"
+    "\n"
+    "            switch (next_pc) {\n";
+
+static const char main_interpreter[] =
+    "                    goto enter;\n"
+    "            }\n"
+    "        }\n"
+    "\n"
+    "resume:\n"
+    "        if (!step())\n"
+    "            goto done;\n"
+    "    }\n"
+    "\n"
+    "enter:\n"
+    "    // The instructions fetched four, three and two cycles ago\n"
+    "    // may not have been written back yet.\n"
+    "    for (int i = 0; i < 3; ++i) {\n"
+    "        const slot_t * const slot = &slots[(cycles + i) & 3];\n"
+    "\n"
+    "        pending_dst[i] = (slot->effect == EFFECT_WRITE) ? &registers[slot->rd] : &sink;\n"
+    "        pending_value[i] = slot->value;\n"
+    "    }\n"
+    "    goto dispatch;\n"
+    "\n"
+    "leave:\n"
+    "    // Hand the state back to the interpreter, which still\n"
+    "    // has to fetch next_pc.\n"
+    "    for (int i = 0; i < 3; ++i) {\n"
+    "        slot_t * const slot = &slots[(cycles + i) & 3];\n"
+    "\n"
+    "        if (pending_dst[i] == &sink) {\n"
+    "            slot->effect = EFFECT_NONE;\n"
+    "        } else {\n"
+    "            slot->effect = EFFECT_WRITE;\n"
+    "            slot->rd = (uint8_t)(pending_dst[i] - registers);\n"
+    "            slot->value = pending_value[i];\n"
+    "        }\n"
+    "    }\n"
+    "    registers[PC] = next_pc;\n"
+    "    fetch(&slots[(cycles + 3) & 3]);\n"
+    "    goto resume;\n"
+    "\n";
+
+static const char main_epilogue[] =
+    "done:\n"
+    "    printf(\"Printing results: \\n\");\n"
+    "    qsort(protocol, protocol_length, sizeof(*protocol), compare_addresses);\n"
+    "    for (size_t i = 0; i < protocol_length; ++i)\n"
+    "        printf(\"[0x%x]: 0x%x\\n\", protocol[i], data[protocol[i]]);\n"
+    "\n"
+    "    if (statistics)\n"
+    "        fprintf(stderr, \"cycles:      %llu\\n\", (unsigned long long)cycles);\n"
+    "\n"
+    "    return EXIT_SUCCESS;\n"
+    "}\n";
+
+/*
+    Information about the blocks of the program, by guest address.
+*/
+typedef struct aot_program {
+    const decoded_instruction_t * code;
+    size_t   ninstructions;
+
+    bool *   leader;    // reachable from a known address
+    size_t * length;    // length of the block starting here, 0 if none
+} aot_program_t;
+
+#pragma mark Block discovery
+
+/*
+    Returns the address following the control flow instruction at
+    address, if it has a static target, or address otherwise.
+*/
+static uint32_t static_target(const decoded_instruction_t * const inst, const uint32_t address)
+{
+    if ((inst->handler == HANDLER_JMPR) || (inst->handler == HANDLER_BRR))
+        return inst->imm + address + 1;
+
+    return address;
+}
+
+static void mark_leader(aot_program_t * const program, const uint32_t address)
+{
+    if (address < program->ninstructions)
+        program->leader[address] = true;
+}
+
+/*
+    Finds all addresses blocks can start at: static branch targets,
+    the instructions after branches and their delay slots, constants
+    that could be addresses of indirect jumps, and instructions after
+    ones that have to be interpreted.
+*/
+static void find_blocks(aot_program_t * const program)
+{
+    const decoded_instruction_t * const code = program->code;
+    const size_t n = program->ninstructions;
+
+    mark_leader(program, 0);
+
+    for (uint32_t address = 0; address < n; ++address) {
+        const decoded_instruction_t * const inst = &code[address];
+
+        if (instruction_is_control_flow(inst)) {
+            mark_leader(program, static_target(inst, address));
+            mark_leader(program, address + 3);
+        } else if (inst->handler == HANDLER_MOVI) {
+            mark_leader(program, inst->imm);
+        }
+
+        if (!instruction_is_translatable(inst))
+            mark_leader(program, address + 1);
+    }
+
+    // Blocks ending before an instruction that can not be translated,
+    // or because they are too long, continue at another leader.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (uint32_t address = 0; address < n; ++address) {
+            if (!program->leader[address] || (program->length[address] != 0))
+                continue;
+
+            const size_t length = block_length(code, n, address, AOT_MAX_BLOCK_LENGTH);
+            if (length < 3) {
+                // Left to the interpreter. Marking it as visited
+                // requires a length, so use an impossible one.
+                program->length[address] = SIZE_MAX;
+                continue;
+            }
+
+            program->length[address] = length;
+
+            const uint32_t end = address + (uint32_t)length;
+            if (!instruction_is_control_flow(&code[end - 3]) && (end < n) && !program->leader[end]) {
+                program->leader[end] = true;
+                changed = true;
+            }
+        }
+    }
+
+    for (uint32_t address = 0; address < n; ++address) {
+        if (program->length[address] == SIZE_MAX)
+            program->length[address] = 0;
+    }
+
+    // To avoid generating the same code twice, blocks end early at
+    // the next block, unless that would split a branch from its
+    // delay slots or leave less than three instructions.
+    for (uint32_t address = 0; address < n; ++address) {
+        const size_t length = program->length[address];
+
+        for (size_t k = 3; k + 3 <= length; ++k) {
+            if (program->length[address + k] != 0) {
+                program->length[address] = k;
+                break;
+            }
+        }
+    }
+}
+
+#pragma mark Code generation
+
+static void emit_register(FILE * const out, const uint8_t reg)
+{
+    fprintf(out, "registers[%u]", reg);
+}
+
+/*
+    Emits the second operand of binary and compare instructions.
+*/
+static void emit_operand2(FILE * const out, const decoded_instruction_t * const inst)
+{
+    if (inst->is_immediate)
+        fprintf(out, "0x%08" PRIx32 "u", inst->imm);
+    else
+        emit_register(out, inst->rs2);
+}
+
+static void emit_binary(FILE * const out, const char * const op, const decoded_instruction_t * const inst)
+{
+    emit_register(out, inst->rs1);
+    fprintf(out, " %s ", op);
+    emit_operand2(out, inst);
+}
+
+static void emit_call(FILE * const out, const char * const function, const decoded_instruction_t * const inst)
+{
+    fprintf(out, "%s(", function);
+    emit_register(out, inst->rs1);
+    fprintf(out, ", ");
+    emit_operand2(out, inst);
+    fprintf(out, ")");
+}
+
+static void emit_compare(FILE * const out, const char * const op, const bool is_signed,
+                         const decoded_instruction_t * const inst)
+{
+    const char * const cast = is_signed ? "(int32_t)" : "";
+
+    fprintf(out, "flag = (%s", cast);
+    emit_register(out, inst->rs1);
+    fprintf(out, " %s %s", op, cast);
+    emit_operand2(out, inst);
+    fprintf(out, ");\n");
+}
+
+static void emit_io_address(FILE * const out, const decoded_instruction_t * const inst)
+{
+    fprintf(out, "io_address(");
+    emit_register(out, inst->rs1);
+    fprintf(out, " + 0x%08" PRIx32 "u)", inst->imm);
+}
+
+/*
+    Emits a statement computing the result of inst into dst, or
+    carrying out its other effects. Control flow instructions set
+    next_pc to the address following their delay slots.
+*/
+static void emit_instruction(FILE * const out, const decoded_instruction_t * const inst,
+                             const uint32_t address, const char * const dst)
+{
+    const uint32_t n_pc = address + 1;
+
+    fprintf(out, "    ");
+
+    if (instruction_writes_register(inst))
+        fprintf(out, "%s = ", dst);
+
+    switch (inst->handler) {
+        case HANDLER_ADD:   case HANDLER_ADDI:  emit_binary(out, "+", inst); break;
+        case HANDLER_SUB:   case HANDLER_SUBI:  emit_binary(out, "-", inst); break;
+        case HANDLER_AND:   case HANDLER_ANDI:  emit_binary(out, "&", inst); break;
+        case HANDLER_OR:    case HANDLER_ORI:   emit_binary(out, "|", inst); break;
+        case HANDLER_SHL:   case HANDLER_SHLI:  emit_call(out, "shl", inst); break;
+        case HANDLER_SHRA:  case HANDLER_SHRAI: emit_call(out, "shra", inst); break;
+        case HANDLER_SHRL:  case HANDLER_SHRLI: emit_call(out, "shrl", inst); break;
+
+        case HANDLER_NOT:
+            fprintf(out, "~");
+            emit_register(out, inst->rs1);
+            break;
+        case HANDLER_MOVE:
+            emit_register(out, inst->rs1);
+            break;
+        case HANDLER_MOVI:
+            fprintf(out, "0x%08" PRIx32 "u", inst->imm);
+            break;
+        case HANDLER_LOAD:
+            fprintf(out, "data[");
+            emit_io_address(out, inst);
+            fprintf(out, "]");
+            break;
+
+        case HANDLER_CEQ:   case HANDLER_CEQI:  emit_compare(out, "==", false, inst); return;
+        case HANDLER_CLTU:  case HANDLER_CLTUI: emit_compare(out, "<", false, inst); return;
+        case HANDLER_CLTS:  case HANDLER_CLTSI: emit_compare(out, "<", true, inst); return;
+        case HANDLER_CGTU:  case HANDLER_CGTUI: emit_compare(out, ">", false, inst); return;
+        case HANDLER_CGTS:  case HANDLER_CGTSI: emit_compare(out, ">", true, inst); return;
+
+        case HANDLER_JMP:
+            fprintf(out, "next_pc = ");
+            emit_register(out, inst->rs1);
+            break;
+        case HANDLER_JMPR:
+            fprintf(out, "next_pc = 0x%" PRIx32, inst->imm + n_pc);
+            break;
+        case HANDLER_BRA:
+            fprintf(out, "next_pc = flag ? ");
+            emit_register(out, inst->rs1);
+            fprintf(out, " : 0x%" PRIx32, address + 3);
+            break;
+        case HANDLER_BRR:
+            fprintf(out, "next_pc = flag ? 0x%" PRIx32 " : 0x%" PRIx32, inst->imm + n_pc, address + 3);
+            break;
+
+        case HANDLER_STORE:
+            fprintf(out, "store(");
+            emit_io_address(out, inst);
+            fprintf(out, ", ");
+            emit_register(out, inst->rd);
+            fprintf(out, ")");
+            break;
+
+        case HANDLER_NOP:
+            fprintf(out, "/* NOP */\n");
+            return;
+
+        default:
+            break;
+    }
+
+    fprintf(out, ";\n");
+}
+
+/*
+    Continues at target, directly if there is a block starting there.
+*/
+static void emit_static_exit(FILE * const out, const aot_program_t * const program,
+                             const uint32_t target)
+{
+    if ((target < program->ninstructions) && (program->length[target] != 0))
+        fprintf(out, "goto block_%" PRIx32 ";\n", target);
+    else
+        fprintf(out, "{ next_pc = 0x%" PRIx32 "; goto leave; }\n", target);
+}
+
+static void emit_block(FILE * const out, const aot_program_t * const program, const uint32_t start)
+{
+    const decoded_instruction_t * const code = &program->code[start];
+    const size_t n = program->length[start];
+    char dst[32];
+
+    bool delayed[AOT_MAX_BLOCK_LENGTH];
+    block_schedule_write_backs(code, n, delayed);
+
+    fprintf(out, "block_%" PRIx32 ":\n", start);
+    fprintf(out, "    cycles += %zu;\n", n);
+
+    for (size_t j = 0; j < n; ++j) {
+        const decoded_instruction_t * const inst = &code[j];
+        const uint32_t address = start + (uint32_t)j;
+
+        // Write back the result of the instruction three before this one
+        if (j < 3)
+            fprintf(out, "    *pending_dst[%zu] = pending_value[%zu];\n", j, j);
+        else if (delayed[j - 3])
+            fprintf(out, "    registers[%u] = t%zu;\n", code[j - 3].rd, (j - 3) % 3);
+
+        if (inst->handler != HANDLER_INVALID) {
+            char * const text = instruction_disassemble(inst->word);
+            fprintf(out, "    // 0x%04" PRIx32 ": %s\n", address, text);
+            free(text);
+        }
+
+        if (!delayed[j])
+            snprintf(dst, sizeof(dst), "registers[%u]", inst->rd);
+        else if (j + 3 >= n)
+            snprintf(dst, sizeof(dst), "pending_value[%zu]", j + 3 - n);
+        else
+            snprintf(dst, sizeof(dst), "t%zu", j % 3);
+
+        emit_instruction(out, inst, address, dst);
+    }
+
+    // Hand the outstanding write backs to the next block
+    for (size_t i = 0; i < 3; ++i) {
+        const decoded_instruction_t * const inst = &code[n - 3 + i];
+
+        if (instruction_writes_register(inst))
+            fprintf(out, "    pending_dst[%zu] = &registers[%u];\n", i, inst->rd);
+        else
+            fprintf(out, "    pending_dst[%zu] = &sink;\n", i);
+    }
+
+    // Control flow can only be the third last instruction
+    const decoded_instruction_t * const last = &code[n - 3];
+    const uint32_t fallthrough = start + (uint32_t)n;
+
+    switch (last->handler) {
+        case HANDLER_JMPR:
+            fprintf(out, "    ");
+            emit_static_exit(out, program, static_target(last, fallthrough - 3));
+            break;
+        case HANDLER_BRR:
+            {
+                const uint32_t target = static_target(last, fallthrough - 3);
+
+                fprintf(out, "    if (next_pc == 0x%" PRIx32 ")\n        ", target);
+                emit_static_exit(out, program, target);
+                fprintf(out, "    ");
+                emit_static_exit(out, program, fallthrough);
+                break;
+            }
+        case HANDLER_JMP:
+        case HANDLER_BRA:
+            fprintf(out, "    goto dispatch;\n");
+            break;
+        default:
+            fprintf(out, "    ");
+            emit_static_exit(out, program, fallthrough);
+            break;
+    }
+
+    fprintf(out, "\n");
+}
+
+/*
+    Emits one case label per block.
+*/
+static void emit_block_cases(FILE * const out, const aot_program_t * const program,
+                             const char * const indentation, const bool with_goto)
+{
+    for (uint32_t address = 0; address < program->ninstructions; ++address) {
+        if (program->length[address] == 0)
+            continue;
+
+        fprintf(out, "%scase 0x%" PRIx32 ":", indentation, address);
+        if (with_goto)
+            fprintf(out, " goto block_%" PRIx32 ";", address);
+        fprintf(out, "\n");
+    }
+}
+
+static void emit_program(FILE * const out, const char * const name,
+                         const aot_program_t * const program, const size_t data_size)
+{
+    fprintf(out, "/*\n");
+    fprintf(out, "    Generated by rcpu-aot from %s.\n", name);
+    fprintf(out, "    Do not edit.\n");
+    fprintf(out, "*/\n");
+    fprintf(out, "#include <stdio.h>\n");
+    fprintf(out, "#include <stdlib.h>\n");
+    fprintf(out, "#include <stdint.h>\n");
+    fprintf(out, "#include <stdbool.h>\n");
+    fprintf(out, "#include <string.h>\n");
+    fprintf(out, "\n");
+    fprintf(out, "#define NINSTRUCTIONS   %zu\n", program->ninstructions);
+    fprintf(out, "#define DATA_WORDS      %zu\n", data_size / sizeof(uint32_t));
+    fprintf(out, "#define PC              %u\n", pc);
+    fprintf(out, "\n");
+
+    for (int handler = 0; handler < HANDLER_COUNT; ++handler)
+        fprintf(out, "#define H_%-12s %d\n", handler_names[handler], handler);
+    fprintf(out, "\n");
+
+    fputs(runtime, out);
+
+    fprintf(out, "static const instruction_t code[NINSTRUCTIONS] = {\n");
+    for (uint32_t address = 0; address < program->ninstructions; ++address) {
+        const decoded_instruction_t * const inst = &program->code[address];
+
+        fprintf(out, "    /* 0x%04" PRIx32 " */ { H_%s, %u, %u, %u, %s, 0x%08" PRIx32 "u },\n",
+                address, handler_names[inst->handler], inst->rd, inst->rs1, inst->rs2,
+                inst->is_immediate ? "true" : "false", inst->imm);
+    }
+    fprintf(out, "};\n\n");
+
+    fputs(main_prologue, out);
+    emit_block_cases(out, program, "                ", false);
+    fputs(main_interpreter, out);
+
+    for (uint32_t address = 0; address < program->ninstructions; ++address) {
+        if (program->length[address] != 0)
+            emit_block(out, program, address);
+    }
+
+    fprintf(out, "dispatch:\n");
+    fprintf(out, "    switch (next_pc) {\n");
+    emit_block_cases(out, program, "        ", true);
+    fprintf(out, "        default: goto leave;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+
+    fputs(main_epilogue, out);
+}
+
+int aot_generate(FILE * const out, const char * const name,
+                 const decoded_instruction_t * const code, const size_t ninstructions,
+                 const size_t data_size)
+{
+    aot_program_t program = {
+        .code = code,
+        .ninstructions = ninstructions,
+        .leader = calloc(ninstructions + 1, sizeof(bool)),
+        .length = calloc(ninstructions + 1, sizeof(size_t))
+    };
+
+    if ((program.leader == NULL) || (program.length == NULL)) {
+        free(program.leader);
+        free(program.length);
+        return -1;
+    }
+
+    find_blocks(&program);
+    emit_program(out, name, &program, data_size);
+
+    free(program.leader);
+    free(program.length);
+
+    return ferror(out) ? -1 : 0;
+}
@@ -0,0 +1,55 @@
+/*!
+    @header Ahead-of-time compilation to C
+    Translates a whole program into a standalone C file, which can be
+    compiled and optimized by any C compiler. Running the result prints
+    the same memory protocol as the simulator.
+
+    Every guest basic block (see BasicBlock.h) that can be reached
+    from a known address becomes a labelled region of code. Blocks
+    with a statically known successor jump to it directly, indirect
+    jumps (JMP, BRA) dispatch through a switch over all block addresses,
+    which the C compiler turns into a jump table.
+
+    The generated program also contains an interpreter with the exact
+    semantics of the functional engine (see Functional.h). It runs
+    everything that is not part of a block, e.g. HALT, instructions
+    accessing the PC register or code only reached through computed
+    addresses, and hands back to the blocks as soon as possible.
+
+    The generated program accepts a single option, --statistics, which
+    prints the number of simulated cycles to stderr.
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef AOT__CODEGENERATOR_H
+#define AOT__CODEGENERATOR_H
+
+#include "../Instruction/Predecode.h"
+
+#include <stdio.h>
+
+/*!
+    @abstract
+        Writes a C program simulating the given program.
+
+    @param out
+        The file to write the C program to.
+    @param name
+        The name of the program, which is mentioned in a comment.
+    @param code
+        The predecoded program.
+    @param ninstructions
+        The number of instructions of the program.
+    @param data_size
+        The size of data memory in bytes.
+
+    @return
+        0 on success, or -1 if writing failed or memory could not
+        be allocated.
+*/
+int aot_generate(FILE * const out, const char * const name,
+                 const decoded_instruction_t * const code, const size_t ninstructions,
+                 const size_t data_size);
+
+#endif /* AOT__CODEGENERATOR_H */
@@ -0,0 +1,636 @@
+#define _POSIX_C_SOURCE 200809L // getline, open_memstream, must precede all includes
+#include "Batch.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> // sysconf
+
+typedef enum {
+    BATCH_HALTED = 0,
+    BATCH_CYCLE_LIMIT,
+    BATCH_LOAD_ERROR,
+    BATCH_FAULT
+} batch_status_t;
+
+static const char * const status_names[] = {
+    [BATCH_HALTED]      = "halted",
+    [BATCH_CYCLE_LIMIT] = "cycle-limit",
+    [BATCH_LOAD_ERROR]  = "load-error",
+    [BATCH_FAULT]       = "guest-fault"
+};
+
+/*
+    A program of the manifest with a warm-up. Its snapshot is taken once
+    the first of its jobs is loaded and released once the last one has
+    finished, so only programs that are being run hold one.
+*/
+typedef struct batch_program {
+    pthread_mutex_t lock;
+    rcpu_snapshot_t * snapshot;     // NULL if it could not be taken
+    bool warm;                      // set once the snapshot has been taken
+    size_t pending;                 // jobs that have not finished yet
+} batch_program_t;
+
+typedef struct batch_job {
+    char * program;
+    char * input;           // NULL if the program has no input
+
+    // The warm program all jobs with the same program are forked from,
+    // with a warm-up only
+    batch_program_t * warm;
+
+    // Set once the job has run
+    batch_status_t status;
+    uint64_t cycles;
+    char * result;          // the line of output
+    size_t result_size;
+
+    // Set once the result is complete, guarded by the lock of the output
+    bool finished;
+} batch_job_t;
+
+/*
+    Jobs first to first + count - 1, which are run together.
+    Without lockstep execution, every job is an item of its own.
+*/
+typedef struct batch_item {
+    size_t first;
+    size_t count;
+} batch_item_t;
+
+/*
+    The items a worker has not started yet, item head to item tail - 1.
+    The worker takes jobs from the head, other workers steal from the tail.
+*/
+typedef struct batch_queue {
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} batch_queue_t;
+
+struct batch;
+
+typedef struct batch_worker {
+    struct batch * batch;
+    unsigned int index;
+    batch_queue_t queue;
+    size_t steals;
+    size_t groups;          // lockstep groups run
+} batch_worker_t;
+
+typedef struct batch {
+    const batch_options_t * options;
+
+    batch_job_t * jobs;
+    size_t njobs;
+
+    batch_item_t * items;
+    size_t nitems;
+
+    // Every program once, with a warm-up only
+    batch_program_t * programs;
+    size_t nprograms;
+
+    batch_worker_t * workers;
+    unsigned int nworkers;
+
+    // Results are written as soon as those of all jobs before are,
+    // so jobs that have finished are not lost should the process end
+    pthread_mutex_t output_lock;
+    FILE * output;
+    size_t nwritten;
+} batch_t;
+
+#pragma mark Manifest
+
+/*
+    Reads all jobs of a manifest. Returns -1 if it could not be read.
+*/
+static int read_manifest(const char * const path, batch_t * const batch)
+{
+    FILE * const fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+
+    size_t capacity = 0;
+    char * line = NULL;
+    size_t line_size = 0;
+
+    while (getline(&line, &line_size, fp) != -1) {
+        char * saveptr;
+        const char * const program = strtok_r(line, " \t\r\n", &saveptr);
+        if ((program == NULL) || (program[0] == '#'))
+            continue;
+
+        const char * const input = strtok_r(NULL, " \t\r\n", &saveptr);
+
+        if (batch->njobs == capacity) {
+            capacity = (capacity == 0) ? 1024 : 2 * capacity;
+            batch->jobs = realloc(batch->jobs, capacity * sizeof(*batch->jobs));
+            assert((batch->jobs != NULL) && "Failed to allocate memory");
+        }
+
+        batch->jobs[batch->njobs++] = (batch_job_t){
+            .program = strdup(program),
+            .input = (input != NULL) ? strdup(input) : NULL
+        };
+    }
+
+    free(line);
+    fclose(fp);
+
+    return 0;
+}
+
+#pragma mark Jobs
+
+/*
+    Prints a string as a JSON string, or null.
+*/
+static void print_string(FILE * const out, const char * s)
+{
+    if (s == NULL) {
+        fputs("null", out);
+        return;
+    }
+
+    fputc('"', out);
+    for (; *s != '\0'; ++s) {
+        if ((*s == '"') || (*s == '\\'))
+            fprintf(out, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char)*s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+/*
+    Runs a program through the warm-up and takes a snapshot of it.
+    Returns NULL if it could not be loaded or the snapshot not be taken.
+*/
+static rcpu_snapshot_t * warm_up(const batch_options_t * const options, const char * const path)
+{
+    rcpu_t * const rcpu = rcpu_create(&options->machine);
+    assert((rcpu != NULL) && "Failed to allocate memory");
+
+    rcpu_snapshot_t * snapshot = NULL;
+    if (rcpu_load_file(rcpu, path, options->format) == 0) {
+        rcpu_run(rcpu, options->warmup);
+        snapshot = rcpu_snapshot_create(rcpu);
+    }
+
+    rcpu_destroy(rcpu);
+    return snapshot;
+}
+
+/*
+    Loads a job into a machine of its own, or forks it from the warm
+    program, which the first job to get here warms up. Returns NULL if
+    the program, its snapshot or its input could not be loaded.
+*/
+static rcpu_t * load_job(const batch_options_t * const options, batch_job_t * const job)
+{
+    rcpu_t * rcpu;
+
+    if (options->warmup == 0) {
+        rcpu = rcpu_create(&options->machine);
+        assert((rcpu != NULL) && "Failed to allocate memory");
+
+        if (rcpu_load_file(rcpu, job->program, options->format) != 0) {
+            rcpu_destroy(rcpu);
+            rcpu = NULL;
+        }
+    } else {
+        batch_program_t * const program = job->warm;
+
+        // Other jobs of the program wait for the warm-up to finish
+        pthread_mutex_lock(&program->lock);
+        if (!program->warm) {
+            program->snapshot = warm_up(options, job->program);
+            program->warm = true;
+        }
+        pthread_mutex_unlock(&program->lock);
+
+        rcpu = (program->snapshot != NULL) ? rcpu_fork(program->snapshot, &options->machine) : NULL;
+    }
+
+    if ((rcpu == NULL)
+        || ((job->input != NULL) && (rcpu_load_data_file(rcpu, job->input, options->format) != 0))) {
+        rcpu_destroy(rcpu);
+        job->status = BATCH_LOAD_ERROR;
+        return NULL;
+    }
+
+    return rcpu;
+}
+
+/*
+    Prints the words of data memory a job changed, compared to a fresh
+    fork of its snapshot or to zeros.
+*/
+static void print_changes(FILE * const out, const batch_options_t * const options,
+                          const batch_job_t * const job, const rcpu_t * const rcpu)
+{
+    const rcpu_snapshot_t * const snapshot = (job->warm != NULL) ? job->warm->snapshot : NULL;
+
+    rcpu_t * const reference = (snapshot != NULL) ? rcpu_fork(snapshot, &options->machine) : NULL;
+    assert(((reference != NULL) || (snapshot == NULL)) && "Failed to allocate memory");
+
+    const size_t nchanged = rcpu_memory_diff(rcpu, reference, NULL, 0);
+    uint32_t * const addresses = malloc(nchanged * sizeof(*addresses));
+    assert(((addresses != NULL) || (nchanged == 0)) && "Failed to allocate memory");
+
+    rcpu_memory_diff(rcpu, reference, addresses, nchanged);
+    const uint32_t * const data = rcpu_data(rcpu, NULL);
+
+    fputs(", \"memory\": [", out);
+    for (size_t i = 0; i < nchanged; ++i)
+        fprintf(out, (i == 0) ? "[%u, %u]" : ", [%u, %u]", addresses[i], data[addresses[i]]);
+    fputs("]", out);
+
+    free(addresses);
+    rcpu_destroy(reference);
+}
+
+/*
+    Prints the access that stopped a job.
+*/
+static void print_fault(FILE * const out, const rcpu_fault_t * const fault)
+{
+    fprintf(out, ", \"fault\": {\"instruction\": %u, \"cycle\": %llu, \"word\": %llu, \"store\": %s, \"report\": ",
+            fault->address, (unsigned long long)fault->cycle, (unsigned long long)fault->word,
+            fault->store ? "true" : "false");
+    print_string(out, fault->report);
+    fputs("}", out);
+}
+
+/*
+    Formats the result of a job and releases its machine, if any.
+*/
+static void finish_job(const batch_options_t * const options, const size_t index,
+                       batch_job_t * const job, rcpu_t * const rcpu)
+{
+    const rcpu_fault_t * const fault = (rcpu != NULL) ? rcpu_fault(rcpu) : NULL;
+
+    if (fault != NULL)
+        job->status = BATCH_FAULT;
+    else if (rcpu != NULL)
+        job->status = rcpu_run(rcpu, 0) ? BATCH_CYCLE_LIMIT : BATCH_HALTED;
+
+    FILE * const out = open_memstream(&job->result, &job->result_size);
+    assert((out != NULL) && "Failed to allocate memory");
+
+    fprintf(out, "{\"job\": %zu, \"program\": ", index);
+    print_string(out, job->program);
+    fputs(", \"input\": ", out);
+    print_string(out, job->input);
+    fprintf(out, ", \"status\": \"%s\"", status_names[job->status]);
+
+    if (fault != NULL) {
+        print_fault(out, fault);
+        rcpu_destroy(rcpu);
+    } else if (rcpu != NULL) {
+        job->cycles = rcpu_cycles(rcpu);
+        fprintf(out, ", \"cycles\": %llu, \"registers\": [", (unsigned long long)job->cycles);
+
+        for (unsigned int i = 0; i < 32; ++i)
+            fprintf(out, (i == 0) ? "%u" : ", %u", rcpu_register(rcpu, i));
+
+        const size_t nstores = rcpu_memory_protocol(rcpu, NULL, 0);
+        uint32_t * const addresses = malloc(nstores * sizeof(*addresses));
+        assert(((addresses != NULL) || (nstores == 0)) && "Failed to allocate memory");
+
+        rcpu_memory_protocol(rcpu, addresses, nstores);
+        const uint32_t * const data = rcpu_data(rcpu, NULL);
+
+        fputs("], \"protocol\": [", out);
+        for (size_t i = 0; i < nstores; ++i)
+            fprintf(out, (i == 0) ? "[%u, %u]" : ", [%u, %u]", addresses[i], data[addresses[i]]);
+        fputs("]", out);
+
+        if (options->changes)
+            print_changes(out, options, job, rcpu);
+
+        free(addresses);
+        rcpu_destroy(rcpu);
+    }
+
+    fputs("}\n", out);
+    fclose(out);
+
+    // The last job of a program releases its snapshot
+    batch_program_t * const program = job->warm;
+    if (program != NULL) {
+        pthread_mutex_lock(&program->lock);
+        const bool last = (--program->pending == 0);
+        pthread_mutex_unlock(&program->lock);
+
+        if (last) {
+            rcpu_snapshot_destroy(program->snapshot);
+            program->snapshot = NULL;
+        }
+    }
+}
+
+/*
+    Marks the jobs of an item as finished and writes all results that
+    are next in manifest order.
+*/
+static void write_results(batch_t * const batch, const batch_item_t * const item)
+{
+    pthread_mutex_lock(&batch->output_lock);
+
+    for (size_t i = 0; i < item->count; ++i)
+        batch->jobs[item->first + i].finished = true;
+
+    const size_t first = batch->nwritten;
+
+    while ((batch->nwritten < batch->njobs) && batch->jobs[batch->nwritten].finished) {
+        batch_job_t * const job = &batch->jobs[batch->nwritten++];
+
+        fwrite(job->result, 1, job->result_size, batch->output);
+        free(job->result);
+        job->result = NULL;
+    }
+
+    if (batch->nwritten != first)
+        fflush(batch->output);
+
+    pthread_mutex_unlock(&batch->output_lock);
+}
+
+/*
+    Runs the jobs of an item, in lockstep if there are several.
+*/
+static void run_item(batch_worker_t * const worker, const batch_item_t * const item)
+{
+    const batch_t * const batch = worker->batch;
+    const batch_options_t * const options = batch->options;
+
+    rcpu_t * rcpus[RCPU_LOCKSTEP_LANES];
+    rcpu_t * loaded[RCPU_LOCKSTEP_LANES];
+    size_t nloaded = 0;
+
+    assert((item->count <= RCPU_LOCKSTEP_LANES) && "Too many jobs in lockstep.");
+
+    for (size_t i = 0; i < item->count; ++i) {
+        rcpus[i] = load_job(options, &batch->jobs[item->first + i]);
+        if (rcpus[i] != NULL)
+            loaded[nloaded++] = rcpus[i];
+    }
+
+    const long groups = (nloaded > 1) ? rcpu_run_lockstep(loaded, nloaded, options->max_cycles) : -1;
+
+    if (groups < 0) {
+        // A job that faulted in lockstep leaves the others in an
+        // undefined state, so they are loaded again and run on their own
+        bool reload = false;
+        for (size_t i = 0; i < nloaded; ++i)
+            reload |= (rcpu_fault(loaded[i]) != NULL);
+
+        for (size_t i = 0; i < item->count; ++i) {
+            if ((rcpus[i] == NULL) || (rcpu_fault(rcpus[i]) != NULL))
+                continue;
+
+            if (reload) {
+                rcpu_destroy(rcpus[i]);
+                rcpus[i] = load_job(options, &batch->jobs[item->first + i]);
+            }
+
+            if (rcpus[i] != NULL)
+                rcpu_run(rcpus[i], options->max_cycles);
+        }
+    } else {
+        worker->groups += groups;
+    }
+
+    for (size_t i = 0; i < item->count; ++i)
+        finish_job(options, item->first + i, &batch->jobs[item->first + i], rcpus[i]);
+
+    write_results(worker->batch, item);
+}
+
+#pragma mark Workers
+
+/*
+    Takes the next item of a worker's own queue. Returns false if it is empty.
+*/
+static bool take_item(batch_worker_t * const worker, size_t * const item)
+{
+    batch_queue_t * const queue = &worker->queue;
+
+    pthread_mutex_lock(&queue->lock);
+    const bool found = (queue->head < queue->tail);
+    if (found)
+        *item = queue->head++;
+    pthread_mutex_unlock(&queue->lock);
+
+    return found;
+}
+
+/*
+    Moves half of the items left to the first other worker that has any
+    into the queue of a worker. Returns false if there are none left.
+*/
+static bool steal_items(batch_worker_t * const thief)
+{
+    batch_t * const batch = thief->batch;
+
+    for (unsigned int i = 1; i < batch->nworkers; ++i) {
+        batch_queue_t * const victim = &batch->workers[(thief->index + i) % batch->nworkers].queue;
+
+        pthread_mutex_lock(&victim->lock);
+        const size_t stolen = (victim->tail - victim->head + 1) / 2;
+        victim->tail -= stolen;
+        const size_t first = victim->tail;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (stolen == 0)
+            continue;
+
+        // The stolen items are not in any queue for a moment, so a worker
+        // may give up while there are still items left to this one.
+        pthread_mutex_lock(&thief->queue.lock);
+        thief->queue.head = first;
+        thief->queue.tail = first + stolen;
+        pthread_mutex_unlock(&thief->queue.lock);
+
+        thief->steals++;
+        return true;
+    }
+
+    return false;
+}
+
+static void * worker_main(void * const argument)
+{
+    batch_worker_t * const worker = argument;
+    batch_t * const batch = worker->batch;
+
+    size_t item;
+    while (take_item(worker, &item) || (steal_items(worker) && take_item(worker, &item)))
+        run_item(worker, &batch->items[item]);
+
+    return NULL;
+}
+
+#pragma mark Warm-up
+
+/*
+    Orders jobs by program, and jobs with the same program by their
+    position in the manifest.
+*/
+static int compare_programs(const void * const a, const void * const b)
+{
+    const batch_job_t * const job_a = *(const batch_job_t * const *)a;
+    const batch_job_t * const job_b = *(const batch_job_t * const *)b;
+
+    const int order = strcmp(job_a->program, job_b->program);
+    if (order != 0)
+        return order;
+
+    return (job_a > job_b) - (job_a < job_b);
+}
+
+/*
+    Finds the jobs of every program of a manifest by sorting them, so
+    they share one warm program, which is not warmed up yet.
+*/
+static void find_programs(batch_t * const batch)
+{
+    batch_job_t ** const sorted = malloc(batch->njobs * sizeof(*sorted));
+    batch->programs = malloc(batch->njobs * sizeof(*batch->programs));
+    assert((((sorted != NULL) && (batch->programs != NULL)) || (batch->njobs == 0))
+           && "Failed to allocate memory");
+
+    for (size_t i = 0; i < batch->njobs; ++i)
+        sorted[i] = &batch->jobs[i];
+
+    qsort(sorted, batch->njobs, sizeof(*sorted), compare_programs);
+
+    for (size_t i = 0; i < batch->njobs; ++i) {
+        if ((i == 0) || (strcmp(sorted[i - 1]->program, sorted[i]->program) != 0)) {
+            batch_program_t * const program = &batch->programs[batch->nprograms++];
+
+            *program = (batch_program_t){ 0 };
+            pthread_mutex_init(&program->lock, NULL);
+        }
+
+        batch_program_t * const program = &batch->programs[batch->nprograms - 1];
+        program->pending++;
+        sorted[i]->warm = program;
+    }
+
+    free(sorted);
+}
+
+#pragma mark Batch runs
+
+int batch_run(const char * const manifest, FILE * const output,
+              const batch_options_t * const options, batch_statistics_t * const statistics)
+{
+    batch_t batch = { .options = options, .output = output };
+
+    if (read_manifest(manifest, &batch) != 0)
+        return -1;
+
+    if (options->warmup != 0)
+        find_programs(&batch);
+
+    // Runs of jobs with the same program make up one item in lockstep,
+    // which needs machines that have not run yet
+    batch.items = malloc(batch.njobs * sizeof(*batch.items));
+    assert(((batch.items != NULL) || (batch.njobs == 0)) && "Failed to allocate memory");
+
+    for (size_t i = 0; i < batch.njobs; ++i) {
+        batch_item_t * const last = (batch.nitems > 0) ? &batch.items[batch.nitems - 1] : NULL;
+
+        if (options->lockstep && (options->warmup == 0) && (last != NULL) && (last->count < RCPU_LOCKSTEP_LANES)
+            && (strcmp(batch.jobs[last->first].program, batch.jobs[i].program) == 0))
+            last->count++;
+        else
+            batch.items[batch.nitems++] = (batch_item_t){ .first = i, .count = 1 };
+    }
+
+    // One worker per core, but never more than there are items
+    long nworkers = (options->threads != 0) ? options->threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers > batch.nitems)
+        nworkers = batch.nitems;
+    if (nworkers < 1)
+        nworkers = 1;
+
+    batch.nworkers = (unsigned int)nworkers;
+    batch.workers = calloc(batch.nworkers, sizeof(*batch.workers));
+    assert((batch.workers != NULL) && "Failed to allocate memory");
+
+    // Every worker starts out with an equal share of the manifest
+    for (unsigned int i = 0; i < batch.nworkers; ++i) {
+        batch_worker_t * const worker = &batch.workers[i];
+
+        worker->batch = &batch;
+        worker->index = i;
+        worker->queue.head = batch.nitems * i / batch.nworkers;
+        worker->queue.tail = batch.nitems * (i + 1) / batch.nworkers;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+    }
+
+    pthread_mutex_init(&batch.output_lock, NULL);
+
+    // The calling thread is worker 0. Should a thread not be created,
+    // the jobs of its worker are stolen by the others.
+    pthread_t * const threads = calloc(batch.nworkers, sizeof(*threads));
+    bool * const started = calloc(batch.nworkers, sizeof(*started));
+    assert((threads != NULL) && (started != NULL) && "Failed to allocate memory");
+
+    for (unsigned int i = 1; i < batch.nworkers; ++i)
+        started[i] = (pthread_create(&threads[i], NULL, worker_main, &batch.workers[i]) == 0);
+
+    worker_main(&batch.workers[0]);
+
+    for (unsigned int i = 1; i < batch.nworkers; ++i) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    // All results have been written by now
+    batch_statistics_t totals = { .jobs = batch.njobs, .threads = batch.nworkers };
+
+    for (size_t i = 0; i < batch.njobs; ++i) {
+        batch_job_t * const job = &batch.jobs[i];
+
+        totals.cycles += job->cycles;
+        totals.failed += (job->status == BATCH_LOAD_ERROR);
+        totals.stopped += (job->status == BATCH_CYCLE_LIMIT);
+        totals.faulted += (job->status == BATCH_FAULT);
+
+        free(job->program);
+        free(job->input);
+    }
+
+    pthread_mutex_destroy(&batch.output_lock);
+
+    for (unsigned int i = 0; i < batch.nworkers; ++i) {
+        totals.steals += batch.workers[i].steals;
+        totals.groups += batch.workers[i].groups;
+        pthread_mutex_destroy(&batch.workers[i].queue.lock);
+    }
+
+    if (statistics != NULL)
+        *statistics = totals;
+
+    free(started);
+    free(threads);
+    free(batch.workers);
+    for (size_t i = 0; i < batch.nprograms; ++i)
+        pthread_mutex_destroy(&batch.programs[i].lock);
+
+    free(batch.programs);
+    free(batch.items);
+    free(batch.jobs);
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*!
+    @header Batch runs
+    Runs many short programs in one process, spread over all cores.
+
+    A manifest lists one job per line: the path to a program and,
+    optionally, the path to its input, which is loaded into data memory
+    starting at address 0 before the program runs. Both files have the
+    format given by --program-kind. Empty lines and lines starting with
+    '#' are ignored.
+
+    Every job runs on a machine of its own (see rcpu.h). Jobs are
+    handed to a pool of worker threads, each of which starts out with an
+    equal share of the manifest and steals half of the remaining jobs
+    of another worker once it runs out of work, so a few long jobs do
+    not hold up the rest.
+
+    With a warm-up, every program is run for the given number of
+    cycles once, without input. Its jobs are then forked from a
+    snapshot of it (see rcpu_fork) and get their input written to data
+    memory at that point, so an initialization phase every job shares
+    is only simulated once. All forks share the pages of data memory
+    they do not write to. A program is warmed up once its first job is
+    started, and its snapshot released once its last job has finished,
+    so only the programs being run hold one.
+
+    With lockstep execution, runs of up to RCPU_LOCKSTEP_LANES
+    consecutive jobs with the same program are handed to a worker
+    together and run in lockstep (see rcpu_run_lockstep), unless there
+    is a warm-up.
+
+    The results are written to a single file in manifest order, one
+    JSON object per line, each as soon as it and those of all jobs
+    before it are complete, and flushed right away, e.g.
+        {"job": 0, "program": "fib.binary", "input": null, "status": "halted",
+         "cycles": 2689, "registers": [0, ...], "protocol": [[200, 0], ...]}
+    where protocol lists the address of every word stored to together
+    with its final contents, just as the memory protocol printed by the
+    simulator, but in the order the words were first written to. With
+    changes, the result also holds
+        "memory": [[200, 1], ...]
+    which lists the address and contents of every word of data memory
+    that differs from memory before the input was loaded, i.e. from
+    zero or, with a warm-up, from the snapshot. Only the pages the job
+    wrote to are compared (see rcpu_memory_diff). status is one of
+        - "halted": the program ran until HALT,
+        - "cycle-limit": the program was stopped after the maximum
+          number of cycles,
+        - "load-error": the program, its input or, with a warm-up, its
+          snapshot could not be loaded; no cycles, registers or
+          protocol are given,
+        - "guest-fault": a LOAD or STORE accessed a word beyond the end
+          of data memory (see rcpu_fault). Instead of cycles, registers
+          and protocol, the result holds the fault, e.g.
+              "fault": {"instruction": 6, "cycle": 9, "word": 4294967295,
+                        "store": true, "report": "Illegal offset: ..."}
+          The other jobs are not affected; jobs that ran in lockstep
+          with it are run again on their own.
+
+    @related rcpu.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef BATCH__BATCH_H
+#define BATCH__BATCH_H
+
+#include "../Library/rcpu.h"
+
+/*!
+    @abstract
+        Settings of a batch run.
+*/
+typedef struct batch_options {
+    rcpu_options_t machine;         // options of the machine of every job
+    rcpu_format_t format;           // format of all programs and inputs
+    uint64_t max_cycles;            // maximum number of cycles per job after the warm-up, or RCPU_RUN_UNTIL_HALT
+    uint64_t warmup;                // cycles every program runs before its jobs are forked, 0 for none
+    unsigned int threads;           // number of worker threads, 0 for one per core
+    bool lockstep;                  // run jobs with the same program in lockstep
+    bool changes;                   // list the words of data memory each job changed
+} batch_options_t;
+
+/*!
+    @abstract
+        Statistics of a batch run.
+*/
+typedef struct batch_statistics {
+    size_t jobs;
+    size_t failed;                  // jobs that could not be loaded
+    size_t stopped;                 // jobs that reached the cycle limit
+    size_t faulted;                 // jobs that accessed memory beyond data memory
+    uint64_t cycles;                // cycles simulated by all jobs
+    size_t steals;                  // number of times a worker stole jobs
+    size_t groups;                  // number of groups run in lockstep
+    unsigned int threads;
+} batch_statistics_t;
+
+/*!
+    @abstract
+        Runs all jobs of a manifest.
+
+    @param manifest
+        The path to the manifest.
+    @param output
+        The file to write the results to.
+    @param options
+        The settings of the batch run.
+    @param statistics
+        Output parameter for the statistics, may be NULL.
+
+    @return
+        0 on success, -1 if the manifest could not be read.
+*/
+int batch_run(const char * const manifest, FILE * const output,
+              const batch_options_t * const options, batch_statistics_t * const statistics);
+
+#endif /* BATCH__BATCH_H */
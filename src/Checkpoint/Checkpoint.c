@@ -0,0 +1,520 @@
+#define _GNU_SOURCE // MAP_ANONYMOUS, memfd_create, must precede all includes
+#include "Checkpoint.h"
+
+#include <assert.h>
+#include <fcntl.h> // open
+#include <stdlib.h>
+#include <string.h> // memcmp, memcpy
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h> // close, sysconf
+
+// Number of stages, i.e. pipeline latches or functional slots
+#define CHECKPOINT_STAGES 4
+
+#define PAGE_WORDS (CHECKPOINT_PAGE_SIZE / sizeof(uint32_t))
+
+_Static_assert(PAGE_WORDS == MACHINE_PAGE_WORDS, "Checkpoint pages must be pages of data memory.");
+
+/*
+    Rounds an offset within a checkpoint file up to the next page.
+*/
+static inline uint64_t page_align(const uint64_t offset)
+{
+    return (offset + CHECKPOINT_PAGE_SIZE - 1) & ~(uint64_t)(CHECKPOINT_PAGE_SIZE - 1);
+}
+
+static bool page_is_zero(const uint32_t * const words)
+{
+    for (size_t i = 0; i < PAGE_WORDS; ++i) {
+        if (words[i] != 0)
+            return false;
+    }
+
+    return true;
+}
+
+#pragma mark Saving
+
+static checkpoint_stage_t save_stage(const memory_image_t * const memory, const decoded_instruction_t * const inst,
+                                     const uint32_t n_pc, const uint32_t a, const uint32_t b, const uint32_t c)
+{
+    return (checkpoint_stage_t){
+        .inst = (inst != NULL) ? (uint32_t)(inst - memory->decoded) : CHECKPOINT_EMPTY,
+        .n_pc = n_pc,
+        .values = { a, b, c }
+    };
+}
+
+/*
+    Fills in the stages and the fields of the header describing them.
+*/
+static void save_stages(const rcpu_machine_t * const machine, const pipeline_state_t * const pipeline,
+                        const functional_state_t * const functional,
+                        checkpoint_header_t * const header, checkpoint_stage_t * const stages)
+{
+    const memory_image_t * const memory = &machine->memory;
+
+    if (pipeline != NULL) {
+        const if_result_t * const r1 = pipeline_if_id(pipeline);
+        const id_result_t * const r2 = pipeline_id_ex(pipeline);
+        const ex_result_t * const r3 = pipeline_ex_mem(pipeline);
+        const mem_result_t * const r4 = pipeline_mem_wb(pipeline);
+
+        header->flags |= CHECKPOINT_PIPELINE;
+        header->cycles = pipeline->cycles;
+
+        stages[0] = r1 ? save_stage(memory, r1->inst, r1->n_pc, 0, 0, 0)
+                       : save_stage(memory, NULL, 0, 0, 0, 0);
+        stages[1] = r2 ? save_stage(memory, r2->inst, r2->n_pc, r2->op1, r2->op2, r2->io_op)
+                       : save_stage(memory, NULL, 0, 0, 0, 0);
+        stages[2] = r3 ? save_stage(memory, r3->inst, r3->n_pc, r3->branch_taken, r3->result, r3->io_op)
+                       : save_stage(memory, NULL, 0, 0, 0, 0);
+        stages[3] = r4 ? save_stage(memory, r4->inst, r4->n_pc, r4->result, r4->io_op, 0)
+                       : save_stage(memory, NULL, 0, 0, 0, 0);
+    } else {
+        header->cycles = functional->cycles;
+        header->in_flight = functional->in_flight;
+
+        for (unsigned int i = 0; i < CHECKPOINT_STAGES; ++i) {
+            const functional_slot_t * const slot = &functional->slots[i];
+            stages[i] = save_stage(memory, slot->inst, slot->n_pc, slot->effect, slot->rd, slot->value);
+        }
+    }
+}
+
+int checkpoint_write(FILE * const out, const rcpu_machine_t * const machine,
+                     const pipeline_state_t * const pipeline, const functional_state_t * const functional,
+                     const bool running, const checkpoint_base_t * const base)
+{
+    const memory_image_t * const memory = &machine->memory;
+    const size_t npages_total = memory->data_size / CHECKPOINT_PAGE_SIZE;
+
+    assert(((memory->data_size % CHECKPOINT_PAGE_SIZE) == 0) && "Data memory is not made of whole pages.");
+
+    checkpoint_header_t header = {
+        .version = CHECKPOINT_VERSION,
+        .flags = (running ? CHECKPOINT_RUNNING : 0) | ((base != NULL) ? CHECKPOINT_DELTA : 0),
+        .base_cycles = (base != NULL) ? base->cycles : 0,
+        .base_stores = (base != NULL) ? base->nstores : 0,
+        .flag = machine->flag,
+        .ninstructions = memory->code_size / sizeof(*memory->code),
+        .data_size = memory->data_size
+    };
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    memcpy(header.registers, machine->registers, sizeof(header.registers));
+
+    checkpoint_stage_t stages[CHECKPOINT_STAGES];
+    save_stages(machine, pipeline, functional, &header, stages);
+
+    // A delta only holds the words first stored to since its base
+    const store_log_t * const protocol = &machine->memory_protocol;
+    assert((protocol->count >= header.base_stores) && "Protocol is shorter than that of the base.");
+    header.nstores = protocol->count - header.base_stores;
+
+    uint32_t * const pages = malloc(npages_total * sizeof(*pages));
+    if ((pages == NULL) && (npages_total > 0))
+        return -1;
+
+    // Pages of zeroes need not be saved, most of data memory never is written to
+    // (or even touched, so it is not read either). A delta holds all pages written
+    // to since its base instead, zero or not.
+    for (size_t page = 0; page < npages_total; ++page) {
+        if ((base != NULL) ? machine_page_dirty(machine, page)
+                           : (machine_page_used(machine, page) && !page_is_zero(&memory->data[page * PAGE_WORDS])))
+            pages[header.npages++] = (uint32_t)page;
+    }
+
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(stages, sizeof(stages), 1, out);
+    fwrite(memory->code, sizeof(*memory->code), header.ninstructions, out);
+    fwrite(protocol->addresses + header.base_stores, sizeof(*protocol->addresses), header.nstores, out);
+    fwrite(pages, sizeof(*pages), header.npages, out);
+
+    // Pages start at a multiple of CHECKPOINT_PAGE_SIZE, so they can be mapped
+    const long offset = ftell(out);
+    for (uint64_t padding = page_align(offset) - offset; padding > 0; --padding)
+        fputc(0, out);
+
+    for (size_t page = 0; page < header.npages; ++page)
+        fwrite(&memory->data[pages[page] * PAGE_WORDS], CHECKPOINT_PAGE_SIZE, 1, out);
+
+    free(pages);
+
+    return ((fflush(out) != 0) || ferror(out)) ? -1 : 0;
+}
+
+int checkpoint_save(const char * const path, const rcpu_machine_t * const machine,
+                    const pipeline_state_t * const pipeline, const functional_state_t * const functional,
+                    const bool running, const checkpoint_base_t * const base)
+{
+    FILE * const out = fopen(path, "wb");
+    if (out == NULL)
+        return -1;
+
+    const int result = checkpoint_write(out, machine, pipeline, functional, running, base);
+    return ((fclose(out) != 0) || (result != 0)) ? -1 : 0;
+}
+
+int checkpoint_save_anonymous(const rcpu_machine_t * const machine, const pipeline_state_t * const pipeline,
+                              const functional_state_t * const functional, const bool running)
+{
+#ifdef __linux__
+    const int fd = memfd_create("rcpu-checkpoint", MFD_CLOEXEC);
+#else
+    // An unlinked temporary file serves just as well, only slower
+    FILE * const tmp = tmpfile();
+    const int fd = (tmp != NULL) ? dup(fileno(tmp)) : -1;
+    if (tmp != NULL)
+        fclose(tmp);
+#endif
+    if (fd < 0)
+        return -1;
+
+    // The stream gets a descriptor of its own, so closing it leaves fd open
+    const int stream_fd = dup(fd);
+    FILE * const out = (stream_fd >= 0) ? fdopen(stream_fd, "wb") : NULL;
+    if (out == NULL) {
+        if (stream_fd >= 0)
+            close(stream_fd);
+        close(fd);
+        return -1;
+    }
+
+    const int result = checkpoint_write(out, machine, pipeline, functional, running, NULL);
+    if ((fclose(out) != 0) || (result != 0)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+#pragma mark Restoring
+
+/*
+    Checks the header against the size of the file.
+    Returns the offset of the first page, or 0 if the file is invalid.
+*/
+static uint64_t check_header(const checkpoint_header_t * const header, const uint64_t file_size)
+{
+    if ((memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0)
+        || (header->version != CHECKPOINT_VERSION))
+        return 0;
+
+    if ((header->data_size == 0) || ((header->data_size % CHECKPOINT_PAGE_SIZE) != 0)
+        || (header->data_size / sizeof(uint32_t) > (uint64_t)UINT32_MAX + 1))
+        return 0;
+
+    // No count can be larger than the file, which rules out overflows below
+    if ((header->ninstructions > file_size) || (header->ninstructions > UINT32_MAX)
+        || (header->nstores > file_size) || (header->npages > file_size))
+        return 0;
+
+    const uint64_t tables = sizeof(*header) + CHECKPOINT_STAGES * sizeof(checkpoint_stage_t)
+                            + (header->ninstructions + header->nstores + header->npages) * sizeof(uint32_t);
+    const uint64_t pages_offset = page_align(tables);
+
+    if ((header->npages > header->data_size / CHECKPOINT_PAGE_SIZE)
+        || (pages_offset + header->npages * CHECKPOINT_PAGE_SIZE > file_size))
+        return 0;
+
+    return pages_offset;
+}
+
+/*
+    Fills the data memory allocated when loading the code image with
+    the pages saved in a checkpoint, which are marked as dirty.
+    Returns -1 if memory could not be mapped.
+*/
+static int restore_data(const int fd, const uint8_t * const file, const checkpoint_header_t * const header,
+                        const uint32_t * const pages, const uint64_t pages_offset,
+                        const bool map, rcpu_machine_t * const machine)
+{
+    memory_image_t * const memory = &machine->memory;
+
+    for (size_t i = 0; i < header->npages; ++i)
+        machine_mark_dirty(machine, pages[i] * PAGE_WORDS, PAGE_WORDS);
+
+    const long host_page_size = sysconf(_SC_PAGESIZE);
+
+    if (!map || (host_page_size <= 0) || ((CHECKPOINT_PAGE_SIZE % host_page_size) != 0)) {
+        for (size_t i = 0; i < header->npages; ++i)
+            memcpy(&memory->data[pages[i] * PAGE_WORDS], file + pages_offset + i * CHECKPOINT_PAGE_SIZE,
+                   CHECKPOINT_PAGE_SIZE);
+
+        return 0;
+    }
+
+    // Pages of zeroes are left to the kernel, the others are mapped from the file
+    uint8_t * const data = (uint8_t *)memory->data;
+
+    for (size_t first = 0, last; first < header->npages; first = last) {
+        // Consecutive pages are stored consecutively and need only one mapping
+        for (last = first + 1; (last < header->npages) && (pages[last] == pages[last - 1] + 1); ++last)
+            ;
+
+        void * const mapped = mmap(data + (size_t)pages[first] * CHECKPOINT_PAGE_SIZE,
+                                   (last - first) * CHECKPOINT_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_FIXED, fd, pages_offset + first * CHECKPOINT_PAGE_SIZE);
+        if (mapped == MAP_FAILED)
+            return -1;
+    }
+
+    return 0;
+}
+
+static bool restore_stages(const checkpoint_header_t * const header, const checkpoint_stage_t * const stages,
+                           const decoded_instruction_t * const decoded,
+                           pipeline_state_t * const pipeline, functional_state_t * const functional)
+{
+    const decoded_instruction_t * inst[CHECKPOINT_STAGES];
+
+    for (unsigned int i = 0; i < CHECKPOINT_STAGES; ++i) {
+        if ((stages[i].inst != CHECKPOINT_EMPTY) && (stages[i].inst >= header->ninstructions))
+            return false;
+
+        inst[i] = (stages[i].inst != CHECKPOINT_EMPTY) ? &decoded[stages[i].inst] : NULL;
+    }
+
+    if (header->flags & CHECKPOINT_PIPELINE) {
+        pipeline_init(pipeline);
+        pipeline->cycles = header->cycles;
+
+        pipeline->if_id_valid[0] = (inst[0] != NULL);
+        pipeline->if_id[0] = (if_result_t){ .n_pc = stages[0].n_pc, .inst = inst[0] };
+
+        pipeline->id_ex_valid[0] = (inst[1] != NULL);
+        pipeline->id_ex[0] = (id_result_t){
+            .n_pc = stages[1].n_pc, .inst = inst[1],
+            .op1 = stages[1].values[0], .op2 = stages[1].values[1], .io_op = stages[1].values[2]
+        };
+
+        pipeline->ex_mem_valid[0] = (inst[2] != NULL);
+        pipeline->ex_mem[0] = (ex_result_t){
+            .n_pc = stages[2].n_pc, .inst = inst[2],
+            .branch_taken = stages[2].values[0], .result = stages[2].values[1], .io_op = stages[2].values[2]
+        };
+
+        pipeline->mem_wb_valid[0] = (inst[3] != NULL);
+        pipeline->mem_wb[0] = (mem_result_t){
+            .n_pc = stages[3].n_pc, .inst = inst[3],
+            .result = stages[3].values[0], .io_op = stages[3].values[1]
+        };
+    } else {
+        functional_init(functional);
+        functional->cycles = header->cycles;
+        functional->in_flight = header->in_flight;
+
+        for (unsigned int i = 0; i < CHECKPOINT_STAGES; ++i) {
+            if ((stages[i].values[0] > EFFECT_BRANCH) || (stages[i].values[1] >= 32))
+                return false;
+
+            functional->slots[i] = (functional_slot_t){
+                .inst = inst[i],
+                .n_pc = stages[i].n_pc,
+                .effect = stages[i].values[0],
+                .rd = stages[i].values[1],
+                .value = stages[i].values[2]
+            };
+        }
+    }
+
+    return true;
+}
+
+/*
+    Checks that all STOREs and pages are within data memory, and that
+    the pages are in ascending order.
+*/
+static bool check_tables(const checkpoint_header_t * const header, const uint32_t * const stores,
+                         const uint32_t * const pages)
+{
+    const uint64_t data_words = header->data_size / sizeof(uint32_t);
+    const uint64_t data_pages = header->data_size / CHECKPOINT_PAGE_SIZE;
+
+    for (size_t i = 0; i < header->nstores; ++i) {
+        if (stores[i] >= data_words)
+            return false;
+    }
+
+    for (size_t i = 0; i < header->npages; ++i) {
+        if ((pages[i] >= data_pages) || ((i > 0) && (pages[i] <= pages[i - 1])))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+    Restores the registers, the flag and the STOREs of a checkpoint.
+*/
+static int restore_registers(const checkpoint_header_t * const header, const uint32_t * const stores,
+                             rcpu_machine_t * const machine)
+{
+    memcpy(machine->registers, header->registers, sizeof(machine->registers));
+    machine->flag = (header->flag != 0);
+
+    // In the order the words were first written to
+    for (size_t i = 0; i < header->nstores; ++i)
+        store_log_add(&machine->memory_protocol, stores[i]);
+
+    return 0;
+}
+
+/*
+    Maps a checkpoint file, checks its header and hands it to a function
+    restoring it. Returns the result of that function, or -1.
+*/
+typedef int (*restore_function_t)(const int fd, const uint8_t * const file, const uint64_t pages_offset,
+                                  void * const context);
+
+static int with_checkpoint(const int fd, const restore_function_t function, void * const context,
+                           bool * const in_pipeline, bool * const running)
+{
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(checkpoint_header_t)))
+        return -1;
+
+    // Mapping the whole file spares reading the tables, and copying the pages twice
+    const uint8_t * const file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (file == MAP_FAILED)
+        return -1;
+
+    const checkpoint_header_t * const header = (const checkpoint_header_t *)file;
+    const uint64_t pages_offset = check_header(header, st.st_size);
+
+    const int result = (pages_offset != 0) ? function(fd, file, pages_offset, context) : -1;
+
+    if (result == 0) {
+        *in_pipeline = (header->flags & CHECKPOINT_PIPELINE) != 0;
+        *running = (header->flags & CHECKPOINT_RUNNING) != 0;
+    }
+
+    munmap((void *)file, st.st_size);
+    return result;
+}
+
+// What restore needs besides the file
+typedef struct restore_context {
+    bool map;
+    rcpu_machine_t * machine;
+    pipeline_state_t * pipeline;
+    functional_state_t * functional;
+    const checkpoint_base_t * base;     // only used by apply
+} restore_context_t;
+
+/*
+    Restores a full checkpoint from a file mapped at file.
+*/
+static int restore(const int fd, const uint8_t * const file, const uint64_t pages_offset, void * const context)
+{
+    const restore_context_t * const ctx = context;
+    const checkpoint_header_t * const header = (const checkpoint_header_t *)file;
+
+    if (header->flags & CHECKPOINT_DELTA)
+        return -1;
+
+    const checkpoint_stage_t * const stages = (const checkpoint_stage_t *)(header + 1);
+    const uint32_t * const code = (const uint32_t *)(stages + CHECKPOINT_STAGES);
+    const uint32_t * const stores = code + header->ninstructions;
+    const uint32_t * const pages = stores + header->nstores;
+
+    if (!check_tables(header, stores, pages))
+        return -1;
+
+    uint32_t * const copy = malloc(header->ninstructions * sizeof(*copy));
+    if ((copy == NULL) && (header->ninstructions > 0))
+        return -1;
+
+    memcpy(copy, code, header->ninstructions * sizeof(*copy));
+
+    if ((machine_load_code(ctx->machine, copy, header->ninstructions, header->data_size) != 0)
+        || (restore_data(fd, file, header, pages, pages_offset, ctx->map, ctx->machine) != 0)
+        || !restore_stages(header, stages, ctx->machine->memory.decoded, ctx->pipeline, ctx->functional))
+        return -1;
+
+    return restore_registers(header, stores, ctx->machine);
+}
+
+/*
+    Applies a delta checkpoint from a file mapped at file.
+*/
+static int apply(const int fd, const uint8_t * const file, const uint64_t pages_offset, void * const context)
+{
+    (void)fd;
+    const restore_context_t * const ctx = context;
+    const checkpoint_header_t * const header = (const checkpoint_header_t *)file;
+    rcpu_machine_t * const machine = ctx->machine;
+    memory_image_t * const memory = &machine->memory;
+
+    if (!(header->flags & CHECKPOINT_DELTA)
+        || (header->base_cycles != ctx->base->cycles) || (header->base_stores != ctx->base->nstores)
+        || (header->data_size != memory->data_size)
+        || (header->ninstructions * sizeof(*memory->code) != memory->code_size))
+        return -1;
+
+    const checkpoint_stage_t * const stages = (const checkpoint_stage_t *)(header + 1);
+    const uint32_t * const code = (const uint32_t *)(stages + CHECKPOINT_STAGES);
+    const uint32_t * const stores = code + header->ninstructions;
+    const uint32_t * const pages = stores + header->nstores;
+
+    if ((memcmp(code, memory->code, memory->code_size) != 0) || !check_tables(header, stores, pages))
+        return -1;
+
+    if (!restore_stages(header, stages, memory->decoded, ctx->pipeline, ctx->functional))
+        return -1;
+
+    // Copying keeps mapped data memory copy-on-write, and the file may go away
+    for (size_t i = 0; i < header->npages; ++i) {
+        memcpy(&memory->data[pages[i] * PAGE_WORDS], file + pages_offset + i * CHECKPOINT_PAGE_SIZE,
+               CHECKPOINT_PAGE_SIZE);
+        machine_mark_dirty(machine, pages[i] * PAGE_WORDS, PAGE_WORDS);
+    }
+
+    machine_clear_dirty(machine);
+    return restore_registers(header, stores, machine);
+}
+
+int checkpoint_read(const int fd, const bool map, rcpu_machine_t * const machine,
+                    pipeline_state_t * const pipeline, functional_state_t * const functional,
+                    bool * const in_pipeline, bool * const running)
+{
+    restore_context_t context = {
+        .map = map, .machine = machine, .pipeline = pipeline, .functional = functional
+    };
+
+    return with_checkpoint(fd, &restore, &context, in_pipeline, running);
+}
+
+int checkpoint_restore(const char * const path, const bool map, rcpu_machine_t * const machine,
+                       pipeline_state_t * const pipeline, functional_state_t * const functional,
+                       bool * const in_pipeline, bool * const running)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    const int result = checkpoint_read(fd, map, machine, pipeline, functional, in_pipeline, running);
+    close(fd);
+
+    return result;
+}
+
+int checkpoint_apply(const char * const path, const checkpoint_base_t * const base,
+                     rcpu_machine_t * const machine, pipeline_state_t * const pipeline,
+                     functional_state_t * const functional, bool * const in_pipeline, bool * const running)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    restore_context_t context = {
+        .machine = machine, .pipeline = pipeline, .functional = functional, .base = base
+    };
+
+    const int result = with_checkpoint(fd, &apply, &context, in_pipeline, running);
+    close(fd);
+
+    return result;
+}
@@ -0,0 +1,262 @@
+/*!
+    @header Checkpoints
+    A checkpoint holds the complete state of a running program at the
+    end of some cycle: the code image, the register bank, the flag, the
+    instructions in flight, data memory and the memory protocol. A
+    program restored from a checkpoint continues exactly as if it had
+    never been interrupted, on any engine.
+
+    The instructions in flight are saved the way the engine that ran
+    the program keeps them, either as the four pipeline latches (see
+    PipelineState.h) or as the four slots of the functional engine (see
+    Functional.h).
+
+    A checkpoint file consists of
+        - a header (checkpoint_header_t),
+        - four stages (checkpoint_stage_t), i.e. latches or slots,
+        - the code image,
+        - the memory protocol, the address of every word stored to, in
+          the order the words were first written to,
+        - the indices of all pages of data memory that are not all zero,
+          in ascending order,
+        - padding up to a multiple of CHECKPOINT_PAGE_SIZE,
+        - the contents of these pages, in the same order.
+    All numbers are stored in host byte order, just like binary
+    programs. As the pages are aligned within the file, restoring a
+    checkpoint can map them into data memory copy-on-write instead of
+    copying them.
+
+    A delta checkpoint only holds what changed since an earlier
+    checkpoint of the same program, its base: the pages written to since
+    then (see machine_mark_dirty), whether or not they are all zero, and
+    the words first stored to since then. It can only be applied on top of its
+    base (see checkpoint_apply), so a chain of deltas costs time and
+    space proportional to the pages actually written to, not to data
+    memory.
+
+    Checkpoints kept in anonymous files in memory (see
+    checkpoint_save_anonymous) let any number of machines continue the
+    same program: all of them map the same pages, and only get a copy
+    of a page once they store to it.
+
+    @related Machine.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef CHECKPOINT__CHECKPOINT_H
+#define CHECKPOINT__CHECKPOINT_H
+
+#include "../Functional/Functional.h"
+#include "../Pipeline/PipelineState.h"
+
+#define CHECKPOINT_MAGIC "RCPUCKPT"
+#define CHECKPOINT_VERSION 3
+
+// Granularity at which data memory is saved, in bytes
+#define CHECKPOINT_PAGE_SIZE 4096
+
+// Index of the instruction of an empty stage
+#define CHECKPOINT_EMPTY UINT32_MAX
+
+// Flags of a checkpoint
+#define CHECKPOINT_RUNNING  (1 << 0)    // the program has not finished yet
+#define CHECKPOINT_PIPELINE (1 << 1)    // the stages are pipeline latches
+#define CHECKPOINT_DELTA    (1 << 2)    // only pages and STOREs since the base are saved
+
+/*!
+    @abstract
+        Header of a checkpoint file.
+*/
+typedef struct checkpoint_header {
+    char     magic[8];              // CHECKPOINT_MAGIC, not terminated
+    uint32_t version;               // CHECKPOINT_VERSION
+    uint32_t flags;
+    uint64_t cycles;
+    uint64_t base_cycles;           // cycles of the base of a delta, 0 otherwise
+    uint64_t base_stores;           // STOREs in the protocol of the base of a delta, 0 otherwise
+    uint32_t registers[32];
+    uint32_t flag;
+    uint32_t in_flight;             // see functional_state_t, 0 for the pipeline
+    uint64_t ninstructions;
+    uint64_t data_size;             // in bytes
+    uint64_t nstores;
+    uint64_t npages;
+} checkpoint_header_t;
+
+/*!
+    @abstract
+        A pipeline latch or a slot of the functional engine.
+    @discussion
+        Which values are meaningful depends on the stage:
+            - IF/ID:  none
+            - ID/EX:  op1, op2, io_op
+            - EX/MEM: branch_taken, result, io_op
+            - MEM/WB: result, io_op
+            - slot:   effect, rd, value
+*/
+typedef struct checkpoint_stage {
+    uint32_t inst;                  // index into the code image, or CHECKPOINT_EMPTY
+    uint32_t n_pc;
+    uint32_t values[3];
+} checkpoint_stage_t;
+
+/*!
+    @abstract
+        Identifies the base of a delta checkpoint.
+*/
+typedef struct checkpoint_base {
+    uint64_t cycles;                // cycles at the time the base was saved
+    uint64_t nstores;               // length of the memory protocol at that time
+} checkpoint_base_t;
+
+/*!
+    @abstract
+        Saves the state of a program to a checkpoint file.
+
+    @param path
+        The path to the file, which is overwritten.
+    @param machine
+        The machine the program runs on.
+    @param pipeline
+        The state of the pipeline if the program runs on it, or NULL.
+    @param functional
+        The state of the functional engine if the program runs on it
+        (or on any engine working on its state), or NULL if pipeline
+        is given.
+    @param running
+        false iff the program has finished.
+    @param base
+        NULL to save a full checkpoint, or the base of a delta
+        checkpoint. The dirty pages of the machine must be exactly the
+        pages written to since the base was saved.
+
+    @return
+        0 on success, -1 if the file could not be written.
+*/
+int checkpoint_save(const char * const path, const rcpu_machine_t * const machine,
+                    const pipeline_state_t * const pipeline, const functional_state_t * const functional,
+                    const bool running, const checkpoint_base_t * const base);
+
+/*!
+    @abstract
+        Writes the state of a program to a stream.
+    @see checkpoint_save
+
+    @param out
+        The stream, positioned at the start of the file, as pages are
+        aligned relative to it.
+
+    @return
+        0 on success, -1 if the stream could not be written.
+*/
+int checkpoint_write(FILE * const out, const rcpu_machine_t * const machine,
+                     const pipeline_state_t * const pipeline, const functional_state_t * const functional,
+                     const bool running, const checkpoint_base_t * const base);
+
+/*!
+    @abstract
+        Saves the state of a program to an anonymous file in memory.
+    @see checkpoint_save
+    @discussion
+        The checkpoint is always a full one.
+    @discussion
+
+        On hosts without anonymous files in memory, an unlinked
+        temporary file is used instead.
+
+    @return
+        The file descriptor of the file, which the caller has to close,
+        or -1 on error.
+*/
+int checkpoint_save_anonymous(const rcpu_machine_t * const machine, const pipeline_state_t * const pipeline,
+                              const functional_state_t * const functional, const bool running);
+
+/*!
+    @abstract
+        Restores the state of a program from a checkpoint file.
+    @discussion
+        The checkpoint must not be a delta. The code image is loaded
+        into the machine and the dirty pages are cleared. If data memory is
+        mapped, the file must not be changed as long as the machine
+        uses it; pages are only copied once the program stores to them.
+
+    @param path
+        The path to the file.
+    @param map
+        true to map data memory from the file, false to copy it. Data
+        memory is copied anyway if the page size of the host does not
+        divide CHECKPOINT_PAGE_SIZE.
+    @param machine
+        The machine, which must have been reset using machine_init.
+    @param pipeline
+        The state of the pipeline, which is reset and restored iff the
+        checkpoint holds pipeline latches.
+    @param functional
+        The state of the functional engine, which is reset and restored
+        iff the checkpoint holds slots of the functional engine.
+    @param in_pipeline
+        Output parameter, true iff pipeline has been restored.
+    @param running
+        Output parameter, false iff the program has finished.
+
+    @return
+        0 on success, -1 if the file could not be read or is no valid
+        checkpoint. The machine must be released using machine_free
+        either way.
+*/
+int checkpoint_restore(const char * const path, const bool map, rcpu_machine_t * const machine,
+                       pipeline_state_t * const pipeline, functional_state_t * const functional,
+                       bool * const in_pipeline, bool * const running);
+
+/*!
+    @abstract
+        Restores the state of a program from an open checkpoint file.
+    @see checkpoint_restore
+
+    @param fd
+        A file descriptor of the file, which stays open. It may be
+        closed once the checkpoint has been restored, even if data
+        memory has been mapped.
+*/
+int checkpoint_read(const int fd, const bool map, rcpu_machine_t * const machine,
+                    pipeline_state_t * const pipeline, functional_state_t * const functional,
+                    bool * const in_pipeline, bool * const running);
+
+/*!
+    @abstract
+        Applies a delta checkpoint to a program restored or saved at its base.
+    @discussion
+        The pages, STOREs, registers, flag and instructions in flight of
+        the delta replace those of the program, which continues at the
+        cycle the delta was saved at. Pages are always copied. The dirty
+        pages are cleared afterwards.
+
+    @param path
+        The path to the file.
+    @param base
+        The base the program is at, which must be the base of the delta.
+    @param machine
+        The machine, which must run the code image of the delta.
+    @param pipeline
+        The state of the pipeline, which is reset and restored iff the
+        checkpoint holds pipeline latches.
+    @param functional
+        The state of the functional engine, which is reset and restored
+        iff the checkpoint holds slots of the functional engine.
+    @param in_pipeline
+        Output parameter, true iff pipeline has been restored.
+    @param running
+        Output parameter, false iff the program has finished.
+
+    @return
+        0 on success, -1 if the file could not be read, is no valid delta
+        checkpoint or does not apply to the program. The program is
+        unchanged if the delta does not apply to its code image or base;
+        after any other error, it must not be continued.
+*/
+int checkpoint_apply(const char * const path, const checkpoint_base_t * const base,
+                     rcpu_machine_t * const machine, pipeline_state_t * const pipeline,
+                     functional_state_t * const functional, bool * const in_pipeline, bool * const running);
+
+#endif /* CHECKPOINT__CHECKPOINT_H */
@@ -0,0 +1,184 @@
+#include "Functional.h"
+
+#include "../Instruction/ALUOps.h"
+
+#include <stdlib.h>
+#include <strings.h> // bzero
+#include <assert.h>
+
+void functional_init(functional_state_t * const state)
+{
+    bzero(state, sizeof(*state));
+}
+
+/*
+    Executes the instruction in slot completely, as far as this is
+    visible at the time the pipeline would decode it. Register writes
+    and PC changes are only recorded in the slot. LOADs and STOREs are
+    checked against the end of data memory iff checked is true.
+*/
+static inline void execute_slot(rcpu_machine_t * const machine, functional_slot_t * const slot,
+                                const bool checked)
+{
+    const uint32_t * const registers = machine->registers;
+    const decoded_instruction_t * const inst = slot->inst;
+
+    switch (inst->type) {
+        case BINARY_ARITHMETIC:
+            {
+                const uint32_t op2 = inst->is_immediate ? inst->imm : registers[inst->rs2];
+
+                slot->effect = EFFECT_WRITE;
+                slot->rd = inst->rd;
+                slot->value = binary_functions[inst->opcode](registers[inst->rs1], op2);
+                break;
+            }
+        case UNARY_ARITHMETIC:
+            {
+                const uint32_t op1 = inst->is_immediate ? inst->imm : registers[inst->rs1];
+
+                slot->effect = EFFECT_WRITE;
+                slot->rd = inst->rd;
+                slot->value = unary_functions[inst->opcode](op1);
+                break;
+            }
+        case COMPARE:
+            {
+                const uint32_t op2 = inst->is_immediate ? inst->imm : registers[inst->rs2];
+
+                machine->flag = compare_functions[inst->opcode](registers[inst->rs1], op2);
+                break;
+            }
+        case BRANCH:
+            if (!machine->flag)
+                break;
+            else
+                ; // fall-through into jump section
+        case JUMP:
+            {
+                slot->effect = EFFECT_BRANCH;
+                slot->value = inst->is_immediate ? inst->imm + slot->n_pc : registers[inst->rs1];
+                break;
+            }
+        case IO:
+            {
+                const uint32_t address = registers[inst->rs1] + inst->imm;
+                if (checked && (address >= machine->memory.limit))
+                    machine_access_fault(machine, address);
+
+                if (inst->opcode == OPCODE_LOAD) {
+                    slot->effect = EFFECT_WRITE;
+                    slot->rd = inst->rd;
+                    slot->value = machine->memory.data[address];
+                } else if (inst->opcode == OPCODE_STORE) {
+                    memory_store(machine, address, registers[inst->rd]);
+                } else {
+                    assert(false && "Instruction not supported.");
+                }
+                break;
+            }
+        case MISC:
+            ; // NOP
+              // HALT never gets past the fetch stage.
+            break;
+        case UNKNOWN:
+        default:
+            assert(false && "Instruction not supported.");
+    }
+}
+
+static inline bool step(rcpu_machine_t * const machine, functional_state_t * const state, const bool checked)
+{
+    uint32_t * const registers = machine->registers;
+    const uint64_t cycle = state->cycles++;
+
+    // WB of the instruction fetched four cycles ago
+    functional_slot_t * const wb = &state->slots[cycle & 3];
+    if (wb->effect == EFFECT_WRITE)
+        registers[wb->rd] = wb->value;
+
+    // MEM of the instruction fetched three cycles ago
+    const functional_slot_t * const mem = &state->slots[(cycle + 1) & 3];
+    if (mem->effect == EFFECT_BRANCH)
+        registers[pc] = mem->value;
+
+    // ID of the instruction fetched during the last cycle
+    functional_slot_t * const id = &state->slots[(cycle + 3) & 3];
+    if (id->inst != NULL)
+        execute_slot(machine, id, checked);
+
+    // IF reuses the slot that has just been written back
+    const decoded_instruction_t * const inst = &machine->memory.decoded[registers[pc]];
+
+    if (inst->opcode != OPCODE_HALT) {
+        wb->inst = inst;
+        wb->n_pc = registers[pc] + 1;
+        wb->effect = EFFECT_NONE;
+
+        registers[pc]++;
+        state->in_flight = ((state->in_flight << 1) | 1) & 0xf;
+    } else {
+        wb->inst = NULL;
+        wb->effect = EFFECT_NONE;
+
+        state->in_flight = (state->in_flight << 1) & 0xf;
+        state->halts++;
+    }
+
+    return state->in_flight != 0;
+}
+
+/*
+    Locates the instruction executed by step, which has already counted
+    the cycle it is decoded in. The pipeline would access memory two
+    cycles later.
+*/
+static machine_location_t locate_access(const rcpu_machine_t * const machine, const void * const state)
+{
+    const functional_state_t * const functional = state;
+
+    return (machine_location_t){
+        .address = functional->slots[(functional->cycles + 2) & 3].n_pc - 1,
+        .cycle = functional->cycles + 1
+    };
+}
+
+void functional_set_locator(rcpu_machine_t * const machine, const functional_state_t * const state)
+{
+    machine_set_locator(machine, locate_access, state);
+}
+
+static bool step_guarded(rcpu_machine_t * const machine, functional_state_t * const state)
+{
+    return step(machine, state, false);
+}
+
+static bool step_checked(rcpu_machine_t * const machine, functional_state_t * const state)
+{
+    return step(machine, state, true);
+}
+
+bool functional_step(rcpu_machine_t * const machine, functional_state_t * const state)
+{
+    return machine->memory.guarded ? step_guarded(machine, state) : step_checked(machine, state);
+}
+
+functional_step_t functional_select_step(const rcpu_machine_t * const machine)
+{
+    return machine->memory.guarded ? step_guarded : step_checked;
+}
+
+void functional_run(rcpu_machine_t * const machine, functional_state_t * const state)
+{
+    functional_set_locator(machine, state);
+
+    if (machine->memory.guarded) {
+        while (step(machine, state, false))
+            ;
+    } else {
+        while (step(machine, state, true))
+            ;
+    }
+
+    machine_set_locator(machine, NULL, NULL);
+}
@@ -0,0 +1,161 @@
+/*!
+    @header Functional execution
+    The functional engine computes the same results as the five stage
+    pipeline, but without passing every instruction through the four
+    pipeline latches. Instead, each instruction is executed completely
+    at the point where the pipeline would decode it.
+
+    This is possible because everything the pipeline makes visible
+    depends only on a few fixed delays, which are modelled exactly:
+        - Registers are read when an instruction is decoded (ID), one
+          cycle after it was fetched. Results are only written three
+          cycles later (WB), so the two following instructions still
+          see the old register contents. There is no forwarding.
+        - The flag is set and tested in program order (EX).
+        - Loads and stores are carried out in program order (MEM).
+        - The PC is set by taken branches and jumps two cycles after
+          they were decoded (MEM), so the two instructions following
+          them are executed anyway (delay slots).
+        - Fetching HALT inserts a bubble and does not advance the PC.
+          The program ends once the pipeline would be empty.
+
+    Pending register writes and PC changes are kept in a small ring of
+    in-flight slots, one per instruction fetched during the last four
+    cycles. The cycle count is the same as the one of the pipeline.
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef FUNCTIONAL__FUNCTIONAL_H
+#define FUNCTIONAL__FUNCTIONAL_H
+
+#include "../Pipeline/Pipeline.h"
+
+/*!
+    @abstract
+        The effect an executed instruction still has to take.
+*/
+typedef enum {
+    EFFECT_NONE = 0,
+    EFFECT_WRITE,   // write value to register rd in WB
+    EFFECT_BRANCH   // set the PC to value in MEM
+} functional_effect_t;
+
+/*!
+    @abstract
+        An instruction fetched during one of the last four cycles.
+*/
+typedef struct functional_slot {
+    const decoded_instruction_t * inst; // NULL for a bubble
+    uint32_t n_pc;
+    uint8_t  effect;                    // functional_effect_t
+    uint8_t  rd;
+    uint32_t value;
+} functional_slot_t;
+
+/*!
+    @abstract
+        State of the functional engine.
+    @discussion
+        Slot (c & 3) holds the instruction fetched in cycle c.
+        Registers, the flag and memory are those of the machine.
+*/
+typedef struct functional_state {
+    functional_slot_t slots[4];
+
+    // Bit i is set iff an instruction was fetched i cycles ago.
+    // The program has finished once no bit is set anymore.
+    uint8_t in_flight;
+
+    // Number of cycles simulated so far
+    uint64_t cycles;
+
+    // Number of those cycles in which HALT was fetched, so no
+    // instruction was
+    uint64_t halts;
+
+    // Number of NOPs skipped as part of a superinstruction, without
+    // being dispatched on their own (threaded engine only)
+    uint64_t fused;
+} functional_state_t;
+
+/*!
+    @abstract
+        Resets the state of the functional engine.
+
+    @param state
+        The state to reset. Afterwards, no instruction is in flight.
+*/
+void functional_init(functional_state_t * const state);
+
+/*!
+    @abstract
+        Lets a machine find the LOAD or STORE functional_step carries
+        out, should it fault or be traced (see machine_set_locator).
+    @discussion
+        Whoever steps through a program sets the locator once before
+        the first cycle and clears it once it stops, instead of on
+        every cycle.
+
+    @param machine
+        The machine the program runs on.
+    @param state
+        The state of the functional engine, which has to stay valid
+        until the locator is cleared.
+*/
+void functional_set_locator(rcpu_machine_t * const machine, const functional_state_t * const state);
+
+/*!
+    @abstract
+        Simulates a single cycle.
+    @discussion
+        The locator of the machine has to be set using
+        functional_set_locator.
+
+    @param machine
+        The machine the program runs on.
+    @param state
+        The state of the functional engine.
+
+    @return
+        true iff the program has not finished yet.
+*/
+bool functional_step(rcpu_machine_t * const machine, functional_state_t * const state);
+
+/*!
+    @abstract
+        Type of functional_step and its variants.
+*/
+typedef bool (*functional_step_t)(rcpu_machine_t * const machine, functional_state_t * const state);
+
+/*!
+    @abstract
+        Picks the variant of functional_step for a machine.
+    @discussion
+        functional_step tells on every cycle whether LOADs and STOREs
+        have to be checked against the end of data memory, which is only
+        the case without a guard region (see memory_image_t). The variant
+        returned is specialised on that instead, so whoever steps through
+        many cycles picks it once before the first one.
+
+    @param machine
+        The machine the program runs on. The variant stays valid until
+        its data memory is replaced.
+
+    @return
+        A function simulating a single cycle just like functional_step.
+*/
+functional_step_t functional_select_step(const rcpu_machine_t * const machine);
+
+/*!
+    @abstract
+        Runs the program until it has finished.
+
+    @param machine
+        The machine the program runs on.
+    @param state
+        The state of the functional engine.
+*/
+void functional_run(rcpu_machine_t * const machine, functional_state_t * const state);
+
+#endif /* FUNCTIONAL__FUNCTIONAL_H */
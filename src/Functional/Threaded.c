@@ -0,0 +1,372 @@
+#include "Threaded.h"
+
+#include "../Instruction/Opcodes.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(RCPU_NO_COMPUTED_GOTO)
+#define THREADED_COMPUTED_GOTO 1
+#endif
+
+// Decoded in place of the bubble HALT leaves behind
+static const decoded_instruction_t bubble = {
+    .type = MISC,
+    .opcode = OPCODE_NOP,
+    .handler = HANDLER_NOP
+};
+
+/*
+    Computes the word address accessed by a LOAD or STORE. It is only
+    checked against the end of data memory if checked is true, which
+    is only needed for machines without a guard region (see Machine.h).
+*/
+static inline uint32_t io_address(rcpu_machine_t * const machine,
+                                  const decoded_instruction_t * const inst, const bool checked)
+{
+    const uint32_t address = machine->registers[inst->rs1] + inst->imm;
+    if (checked && (address >= machine->memory.limit))
+        machine_access_fault(machine, address);
+
+    return address;
+}
+
+/*
+    Locates the instruction being decoded, as the cycle is only counted
+    at its end. The pipeline would access memory two cycles later.
+*/
+static machine_location_t locate_access(const rcpu_machine_t * const machine, const void * const state)
+{
+    const functional_state_t * const functional = state;
+
+    return (machine_location_t){
+        .address = functional->slots[(functional->cycles + 3) & 3].n_pc - 1,
+        .cycle = functional->cycles + 2
+    };
+}
+
+#pragma mark Cycle boundaries
+
+/*
+    Carries out WB and MEM of the instructions fetched four and three
+    cycles ago and selects the instruction that is decoded next.
+*/
+#define BEGIN_CYCLE()                                                           \
+    do {                                                                        \
+        const functional_slot_t * const wb = &state->slots[state->cycles & 3];  \
+        if (wb->effect == EFFECT_WRITE)                                         \
+            registers[wb->rd] = wb->value;                                      \
+                                                                                \
+        const functional_slot_t * const mem = &state->slots[(state->cycles + 1) & 3]; \
+        if (mem->effect == EFFECT_BRANCH)                                       \
+            registers[pc] = mem->value;                                         \
+                                                                                \
+        slot = &state->slots[(state->cycles + 3) & 3];                          \
+        inst = (slot->inst != NULL) ? slot->inst : &bubble;                     \
+    } while (0)
+
+/*
+    Fetches the next instruction into the slot that has just been
+    written back. Returns once the pipeline would have drained, or
+    once the next instruction fetched would lie outside of the range
+    of addresses the engine should stay in, unless a branch is about
+    to change the PC, or once end_cycle has been reached.
+*/
+#define END_CYCLE()                                                             \
+    do {                                                                        \
+        functional_slot_t * const next = &state->slots[state->cycles & 3];      \
+        const decoded_instruction_t * const fetched = &decoded[registers[pc]];  \
+                                                                                \
+        next->effect = EFFECT_NONE;                                             \
+        if (fetched->opcode != OPCODE_HALT) {                                   \
+            next->inst = fetched;                                               \
+            next->n_pc = ++registers[pc];                                       \
+            state->in_flight = ((state->in_flight << 1) | 1) & 0xf;             \
+        } else {                                                                \
+            next->inst = NULL;                                                  \
+            state->in_flight = (state->in_flight << 1) & 0xf;                   \
+            state->halts++;                                                     \
+        }                                                                       \
+                                                                                \
+        state->cycles++;                                                        \
+        if ((state->in_flight == 0) || (state->cycles == end_cycle))            \
+            return;                                                             \
+                                                                                \
+        if ((registers[pc] - first > span)                                      \
+            && (state->slots[(state->cycles + 1) & 3].effect != EFFECT_BRANCH)) \
+            return;                                                             \
+    } while (0)
+
+#pragma mark Superinstructions
+
+/*
+    Runs the NOPs following a superinstruction (see Fusion.h), up to the
+    instruction ending its sequence, in a single step instead of cycle
+    by cycle: writes back what the pipeline would write back meanwhile,
+    fetches the rest of the sequence into the slots and counts all of
+    its cycles at once. The instruction ending the sequence is decoded
+    next, as usual.
+
+    This is only possible if nothing in flight is about to change the
+    PC, so the sequence is fetched just as it is in the code image, and
+    the engine would not return before its end. Returns false, leaving
+    the state unchanged, otherwise.
+*/
+static inline bool skip_fused_nops(rcpu_machine_t * const machine, functional_state_t * const state,
+                                   const functional_slot_t * const slot, const uint64_t end_cycle,
+                                   const uint32_t first, const uint32_t span)
+{
+    uint32_t * const registers = machine->registers;
+    const uint64_t cycle = state->cycles;
+
+    // The superinstruction is at n_pc - 1, the NOPs follow it
+    const uint32_t n_pc = slot->n_pc;
+    const uint32_t nops = machine->memory.nop_runs[n_pc];
+
+    // The range may wrap around, so the NOPs must not leave it in between
+    if ((nops == 0) || (registers[pc] != n_pc) || (end_cycle - cycle <= nops + 1)
+        || (n_pc + 1 - first > span) || (n_pc + nops + 1 - first > span)
+        || (n_pc + nops + 1 - first < n_pc + 1 - first))
+        return false;
+
+    // The instruction decoded in the cycle before would branch during the
+    // NOPs, those before it and the superinstruction write back meanwhile
+    if (state->slots[(cycle + 2) & 3].effect == EFFECT_BRANCH)
+        return false;
+
+    for (unsigned int i = 1; i <= 3; ++i) {
+        const functional_slot_t * const older = &state->slots[(cycle + i) & 3];
+
+        if ((older->effect == EFFECT_WRITE) && (older->rd == pc))
+            return false;
+    }
+
+    // The slot of the instruction decoded in cycle + i - 3 is written back
+    // at the start of cycle + i
+    for (unsigned int i = 1; (i <= 3) && (i <= nops); ++i) {
+        const functional_slot_t * const wb = &state->slots[(cycle + i) & 3];
+
+        if (wb->effect == EFFECT_WRITE)
+            registers[wb->rd] = wb->value;
+    }
+
+    // The NOPs and the instruction ending the sequence are fetched at the
+    // end of cycle to cycle + nops, only the last four stay in flight
+    for (uint32_t i = (nops > 3) ? nops - 3 : 0; i <= nops; ++i) {
+        state->slots[(cycle + i) & 3] = (functional_slot_t){
+            .inst = &machine->memory.decoded[n_pc + i],
+            .n_pc = n_pc + i + 1,
+            .effect = EFFECT_NONE
+        };
+    }
+
+    registers[pc] = n_pc + nops + 1;
+    state->in_flight = (nops >= 3) ? 0xf : ((state->in_flight << (nops + 1)) | ((1 << (nops + 1)) - 1)) & 0xf;
+    state->cycles += nops + 1;
+    state->fused += nops;
+
+    return true;
+}
+
+#pragma mark Dispatch
+
+/*
+    Machines without a guard region check every LOAD and STORE. With
+    computed gotos, they get a table of their own, whose LOAD and STORE
+    handlers check; those of the other table do not. The switch only
+    has one set of handlers, which test CHECKED, the same for the whole
+    run.
+*/
+#ifdef THREADED_COMPUTED_GOTO
+#   define DISPATCH         goto *handlers[inst->handler];
+#   define HANDLER(name)    do_##name
+#   define NEXT             END_CYCLE(); BEGIN_CYCLE(); goto *handlers[inst->handler]
+#   define CHECKED          false
+#else
+#   define DISPATCH         switch (inst->handler)
+#   define HANDLER(name)    case HANDLER_##name
+#   define NEXT             break
+#   define CHECKED          checked
+#endif
+
+#pragma mark Operands and effects
+
+#define R1          registers[inst->rs1]
+#define R2          registers[inst->rs2]
+#define IMM         inst->imm
+
+#define WRITE(v)                                                                \
+    do {                                                                        \
+        slot->effect = EFFECT_WRITE;                                            \
+        slot->rd = inst->rd;                                                    \
+        slot->value = (v);                                                      \
+    } while (0)
+
+#define BRANCH_TO(target)                                                       \
+    do {                                                                        \
+        slot->effect = EFFECT_BRANCH;                                           \
+        slot->value = (target);                                                 \
+    } while (0)
+
+/*
+    The shift operations of the ALU only support shifting by one bit
+    (second operand zero) or by eight bits (anything else).
+    See ALUOps.c.
+*/
+#define SHL(a, b)   ((b) ? (a) << 8 : (a) << 1)
+#define SHRL(a, b)  ((b) ? (a) >> 8 : (a) >> 1)
+#define SHRA(a, b)  ((b) ? ((a) >> 8) | (~(((a) >> 31) - 1) << (31 - 8))             \
+                         : ((a) >> 1) | ((a) & (1u << 31)))
+
+void threaded_run(rcpu_machine_t * const machine, functional_state_t * const state)
+{
+    threaded_run_range(machine, state, 0, UINT32_MAX, UINT64_MAX);
+}
+
+/*
+    Runs the program like threaded_run_range, with the locator of the
+    machine already set.
+*/
+static void run_range(rcpu_machine_t * const machine, functional_state_t * const state,
+                      const uint32_t first, const uint32_t last, const uint64_t end_cycle)
+{
+    uint32_t * const registers = machine->registers;
+    const decoded_instruction_t * const decoded = machine->memory.decoded;
+
+    // Number of addresses in the range minus one, so
+    // the whole address space does not overflow
+    const uint32_t span = last - first;
+
+#ifdef THREADED_COMPUTED_GOTO
+#define LABEL_ENTRY(name, opcode, type, alu, rd, op1, op2) [HANDLER_##name] = &&do_##name,
+#define CHECKED_ENTRY(name, opcode, type, alu, rd, op1, op2) [HANDLER_##name] = &&checked_##name,
+#define HANDLER_TABLE(IO_ENTRY) {                   \
+        [HANDLER_INVALID]    = &&do_INVALID,        \
+        ISA_BINARY_ARITHMETIC(LABEL_ENTRY)          \
+        ISA_UNARY_ARITHMETIC(LABEL_ENTRY)           \
+        ISA_JUMP(LABEL_ENTRY)                       \
+        ISA_BRANCH(LABEL_ENTRY)                     \
+        ISA_COMPARE(LABEL_ENTRY)                    \
+        ISA_IO(IO_ENTRY)                            \
+        ISA_MISC(LABEL_ENTRY)                       \
+                                                    \
+        [HANDLER_CEQ_BRR]    = &&do_CEQ_BRR,        \
+        [HANDLER_CEQI_BRR]   = &&do_CEQI_BRR,       \
+        [HANDLER_CLTU_BRR]   = &&do_CLTU_BRR,       \
+        [HANDLER_CLTUI_BRR]  = &&do_CLTUI_BRR,      \
+        [HANDLER_CLTS_BRR]   = &&do_CLTS_BRR,       \
+        [HANDLER_CLTSI_BRR]  = &&do_CLTSI_BRR,      \
+        [HANDLER_CGTU_BRR]   = &&do_CGTU_BRR,       \
+        [HANDLER_CGTUI_BRR]  = &&do_CGTUI_BRR,      \
+        [HANDLER_CGTS_BRR]   = &&do_CGTS_BRR,       \
+        [HANDLER_CGTSI_BRR]  = &&do_CGTSI_BRR,      \
+        [HANDLER_MOVI_CHAIN] = &&do_MOVI_CHAIN      \
+    }
+
+    // The lists of ISA.h make up INSTRUCTION_SET
+    static const void * const guarded_handlers[HANDLER_COUNT] = HANDLER_TABLE(LABEL_ENTRY);
+    static const void * const checked_handlers[HANDLER_COUNT] = HANDLER_TABLE(CHECKED_ENTRY);
+
+#undef HANDLER_TABLE
+#undef CHECKED_ENTRY
+#undef LABEL_ENTRY
+
+    const void * const * const handlers = machine->memory.guarded ? guarded_handlers : checked_handlers;
+#else
+    const bool checked = !machine->memory.guarded;
+#endif
+
+    functional_slot_t * slot;               // slot of the instruction in ID
+    const decoded_instruction_t * inst;     // the instruction in ID
+
+    for (;;) {
+        BEGIN_CYCLE();
+
+    dispatch:
+        DISPATCH {
+            HANDLER(ADD):   WRITE(R1 + R2);         NEXT;
+            HANDLER(ADDI):  WRITE(R1 + IMM);        NEXT;
+            HANDLER(SUB):   WRITE(R1 - R2);         NEXT;
+            HANDLER(SUBI):  WRITE(R1 - IMM);        NEXT;
+            HANDLER(AND):   WRITE(R1 & R2);         NEXT;
+            HANDLER(ANDI):  WRITE(R1 & IMM);        NEXT;
+            HANDLER(OR):    WRITE(R1 | R2);         NEXT;
+            HANDLER(ORI):   WRITE(R1 | IMM);        NEXT;
+            HANDLER(NOT):   WRITE(~R1);             NEXT;
+            HANDLER(SHL):   WRITE(SHL(R1, R2));     NEXT;
+            HANDLER(SHLI):  WRITE(SHL(R1, IMM));    NEXT;
+            HANDLER(SHRA):  WRITE(SHRA(R1, R2));    NEXT;
+            HANDLER(SHRAI): WRITE(SHRA(R1, IMM));   NEXT;
+            HANDLER(SHRL):  WRITE(SHRL(R1, R2));    NEXT;
+            HANDLER(SHRLI): WRITE(SHRL(R1, IMM));   NEXT;
+            HANDLER(MOVE):  WRITE(R1);              NEXT;
+            HANDLER(MOVI):  WRITE(IMM);             NEXT;
+
+            HANDLER(JMP):   BRANCH_TO(R1);                  NEXT;
+            HANDLER(JMPR):  BRANCH_TO(IMM + slot->n_pc);    NEXT;
+            HANDLER(BRA):   if (machine->flag) BRANCH_TO(R1);               NEXT;
+            HANDLER(BRR):   if (machine->flag) BRANCH_TO(IMM + slot->n_pc); NEXT;
+
+            HANDLER(CEQ):   machine->flag = (R1 == R2);                     NEXT;
+            HANDLER(CEQI):  machine->flag = (R1 == IMM);                    NEXT;
+            HANDLER(CLTU):  machine->flag = (R1 < R2);                      NEXT;
+            HANDLER(CLTUI): machine->flag = (R1 < IMM);                     NEXT;
+            HANDLER(CLTS):  machine->flag = ((int32_t)R1 < (int32_t)R2);    NEXT;
+            HANDLER(CLTSI): machine->flag = ((int32_t)R1 < (int32_t)IMM);   NEXT;
+            HANDLER(CGTU):  machine->flag = (R1 > R2);                      NEXT;
+            HANDLER(CGTUI): machine->flag = (R1 > IMM);                     NEXT;
+            HANDLER(CGTS):  machine->flag = ((int32_t)R1 > (int32_t)R2);    NEXT;
+            HANDLER(CGTSI): machine->flag = ((int32_t)R1 > (int32_t)IMM);   NEXT;
+
+            HANDLER(LOAD):  WRITE(machine->memory.data[io_address(machine, inst, CHECKED)]);               NEXT;
+            HANDLER(STORE): memory_store(machine, io_address(machine, inst, CHECKED), registers[inst->rd]); NEXT;
+
+#ifdef THREADED_COMPUTED_GOTO
+            // Only reached through checked_handlers
+            checked_LOAD:   WRITE(machine->memory.data[io_address(machine, inst, true)]);                  NEXT;
+            checked_STORE:  memory_store(machine, io_address(machine, inst, true), registers[inst->rd]);    NEXT;
+#endif
+
+            HANDLER(NOP):   NEXT;
+
+            // HALT never gets past the fetch stage.
+            HANDLER(HALT):
+            HANDLER(INVALID):
+                assert(false && "Instruction not supported.");
+                NEXT;
+
+            // Superinstructions (see Fusion.h) execute their first instruction
+            // and skip the NOPs up to the last one, which is dispatched next.
+            // Should that not be possible, the NOPs are run one by one.
+            HANDLER(CEQ_BRR):   machine->flag = (R1 == R2);                     goto fused;
+            HANDLER(CEQI_BRR):  machine->flag = (R1 == IMM);                    goto fused;
+            HANDLER(CLTU_BRR):  machine->flag = (R1 < R2);                      goto fused;
+            HANDLER(CLTUI_BRR): machine->flag = (R1 < IMM);                     goto fused;
+            HANDLER(CLTS_BRR):  machine->flag = ((int32_t)R1 < (int32_t)R2);    goto fused;
+            HANDLER(CLTSI_BRR): machine->flag = ((int32_t)R1 < (int32_t)IMM);   goto fused;
+            HANDLER(CGTU_BRR):  machine->flag = (R1 > R2);                      goto fused;
+            HANDLER(CGTUI_BRR): machine->flag = (R1 > IMM);                     goto fused;
+            HANDLER(CGTS_BRR):  machine->flag = ((int32_t)R1 > (int32_t)R2);    goto fused;
+            HANDLER(CGTSI_BRR): machine->flag = ((int32_t)R1 > (int32_t)IMM);   goto fused;
+
+            HANDLER(MOVI_CHAIN): WRITE(IMM);                                    goto fused;
+
+            fused:
+                if (skip_fused_nops(machine, state, slot, end_cycle, first, span)) {
+                    BEGIN_CYCLE();
+                    goto dispatch;
+                }
+                NEXT;
+        }
+
+        END_CYCLE();
+    }
+}
+
+void threaded_run_range(rcpu_machine_t * const machine, functional_state_t * const state,
+                        const uint32_t first, const uint32_t last, const uint64_t end_cycle)
+{
+    machine_set_locator(machine, locate_access, state);
+    run_range(machine, state, first, last, end_cycle);
+    machine_set_locator(machine, NULL, NULL);
+}
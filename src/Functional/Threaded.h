@@ -0,0 +1,63 @@
+/*!
+    @header Threaded execution
+    The threaded engine has the same semantics as the functional engine
+    (see Functional.h) and works on the same state, but is built for
+    speed: instead of switching on the instruction type and calling the
+    ALU through function pointers, every opcode has its own handler
+    with the ALU operation written out inline.
+
+    When compiled with GCC or Clang, handlers are reached through a
+    table of label addresses (computed goto) and every handler ends
+    with its own copy of the dispatch code, so the host's branch
+    predictor can learn which handler usually follows which.
+    Other compilers, or defining RCPU_NO_COMPUTED_GOTO, fall back to
+    a portable switch over the handler index.
+
+    @related Functional.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef FUNCTIONAL__THREADED_H
+#define FUNCTIONAL__THREADED_H
+
+#include "Functional.h"
+
+/*!
+    @abstract
+        Runs the program until it has finished.
+
+    @param machine
+        The machine the program runs on.
+    @param state
+        The state of the functional engine, which must have been
+        initialized using functional_init.
+*/
+void threaded_run(rcpu_machine_t * const machine, functional_state_t * const state);
+
+/*!
+    @abstract
+        Runs the program until it has finished, leaves a range of
+        addresses, e.g. a loop, or a given cycle has been reached.
+    @discussion
+        The program has left the range once the next instruction to
+        be fetched lies outside of it and no branch is about to change
+        the PC. In any case, the state is then the one between two
+        cycles. The range may wrap around the end of the address space,
+        so e.g. first = a + 1 and last = a - 1 leave out only a.
+
+    @param machine
+        The machine the program runs on.
+    @param state
+        The state of the functional engine.
+    @param first
+        The first address of the range.
+    @param last
+        The last address of the range.
+    @param end_cycle
+        The cycle counter at which to stop at the latest.
+*/
+void threaded_run_range(rcpu_machine_t * const machine, functional_state_t * const state,
+                        const uint32_t first, const uint32_t last, const uint64_t end_cycle);
+
+#endif /* FUNCTIONAL__THREADED_H */
@@ -0,0 +1,173 @@
+#include "Transfer.h"
+
+#include "../Instruction/BasicBlock.h"
+
+/*
+    Records the register write still pending for an instruction
+    that has passed the MEM stage.
+*/
+static void record_accessed(const mem_result_t * const in, functional_slot_t * const slot)
+{
+    const decoded_instruction_t * const inst = in->inst;
+
+    slot->inst = inst;
+    slot->n_pc = in->n_pc;
+    slot->effect = EFFECT_NONE;
+
+    if ((inst->type == BINARY_ARITHMETIC) || (inst->type == UNARY_ARITHMETIC)) {
+        slot->effect = EFFECT_WRITE;
+        slot->rd = inst->rd;
+        slot->value = in->result;
+    } else if (inst->opcode == OPCODE_LOAD) {
+        slot->effect = EFFECT_WRITE;
+        slot->rd = in->io_op;
+        slot->value = in->result;
+    }
+}
+
+/*
+    Carries out the memory access of an instruction that has passed
+    the EX stage, which the pipeline would run in cycle, and records
+    what is still pending afterwards.
+*/
+static void record_executed(rcpu_machine_t * const machine, const ex_result_t * const in,
+                            functional_slot_t * const slot, const uint64_t cycle)
+{
+    const decoded_instruction_t * const inst = in->inst;
+
+    slot->inst = inst;
+    slot->n_pc = in->n_pc;
+    slot->effect = EFFECT_NONE;
+
+    switch (inst->type) {
+        case BINARY_ARITHMETIC:
+        case UNARY_ARITHMETIC:
+            slot->effect = EFFECT_WRITE;
+            slot->rd = inst->rd;
+            slot->value = in->result;
+            break;
+        case BRANCH:
+        case JUMP:
+            // The PC is only changed in the MEM stage
+            if (in->branch_taken) {
+                slot->effect = EFFECT_BRANCH;
+                slot->value = in->result;
+            }
+            break;
+        case IO:
+            {
+                mem_result_t out;
+                memory_access_at(machine, in, &out, cycle);
+
+                if (inst->opcode == OPCODE_LOAD) {
+                    slot->effect = EFFECT_WRITE;
+                    slot->rd = in->io_op;
+                    slot->value = out.result;
+                }
+                break;
+            }
+        default:
+            break;
+    }
+}
+
+void transfer_to_functional(rcpu_machine_t * const machine,
+                            const pipeline_state_t * const from, functional_state_t * const to)
+{
+    const uint64_t cycle = from->cycles;
+    const uint64_t halts = from->halts;
+
+    const if_result_t * const fetched = pipeline_if_id(from);
+    const id_result_t * const decoded = pipeline_id_ex(from);
+    const ex_result_t * const executed = pipeline_ex_mem(from);
+    const mem_result_t * const accessed = pipeline_mem_wb(from);
+
+    functional_init(to);
+    to->cycles = cycle;
+    to->halts = halts;
+
+    // Slot (c & 3) holds the instruction fetched in cycle c. Older
+    // instructions have to go first, as they access memory first.
+    if (accessed) {
+        record_accessed(accessed, &to->slots[cycle & 3]);
+        to->in_flight |= 8;
+    }
+
+    if (executed) {
+        record_executed(machine, executed, &to->slots[(cycle + 1) & 3], cycle);
+        to->in_flight |= 4;
+    }
+
+    if (decoded) {
+        ex_result_t out;
+        execute(machine, decoded, &out);
+
+        record_executed(machine, &out, &to->slots[(cycle + 2) & 3], cycle + 1);
+        to->in_flight |= 2;
+    }
+
+    if (fetched) {
+        functional_slot_t * const slot = &to->slots[(cycle + 3) & 3];
+
+        slot->inst = fetched->inst;
+        slot->n_pc = fetched->n_pc;
+        to->in_flight |= 1;
+    }
+}
+
+bool transfer_to_pipeline(const rcpu_machine_t * const machine,
+                          const functional_state_t * const from, pipeline_state_t * const to)
+{
+    const uint64_t cycle = from->cycles;
+
+    const functional_slot_t * const accessed = &from->slots[cycle & 3];
+    const functional_slot_t * const executed = &from->slots[(cycle + 1) & 3];
+    const functional_slot_t * const decoded = &from->slots[(cycle + 2) & 3];
+    const functional_slot_t * const fetched = &from->slots[(cycle + 3) & 3];
+
+    if (executed->inst && (executed->inst->type == IO))
+        return false;
+
+    if (decoded->inst && ((decoded->inst->type == IO) || instruction_reads_register(decoded->inst, pc)))
+        return false;
+
+    pipeline_init(to);
+    to->cycles = cycle;
+    to->halts = from->halts;
+
+    const unsigned int cur = to->current;
+
+    if (accessed->inst) {
+        to->mem_wb[cur] = (mem_result_t){
+            .n_pc = accessed->n_pc,
+            .inst = accessed->inst,
+            .result = accessed->value,
+            .io_op = accessed->rd
+        };
+        to->mem_wb_valid[cur] = true;
+    }
+
+    if (executed->inst) {
+        to->ex_mem[cur] = (ex_result_t){
+            .n_pc = executed->n_pc,
+            .inst = executed->inst,
+            .branch_taken = (executed->effect == EFFECT_BRANCH),
+            .result = executed->value
+        };
+        to->ex_mem_valid[cur] = true;
+    }
+
+    // Decoding once more reads the same registers, as
+    // nothing has been written back since.
+    if (decoded->inst) {
+        const if_result_t in = { .n_pc = decoded->n_pc, .inst = decoded->inst };
+        to->id_ex_valid[cur] = instruction_decode(machine, &in, &to->id_ex[cur]);
+    }
+
+    if (fetched->inst) {
+        to->if_id[cur] = (if_result_t){ .n_pc = fetched->n_pc, .inst = fetched->inst };
+        to->if_id_valid[cur] = true;
+    }
+
+    return true;
+}
@@ -0,0 +1,70 @@
+/*!
+    @header Transferring state between engines
+    The pipeline and the functional engine (see Functional.h) compute
+    exactly the same results, so a running program can be handed from
+    one to the other between two cycles.
+
+    Both engines keep the four instructions fetched during the last four
+    cycles, but they are not equally far along: the pipeline executes
+    an instruction stage by stage, while the functional engine carries
+    out everything but the register write and the change of the PC as
+    soon as the instruction is decoded.
+
+    @related Functional.h
+    @related PipelineState.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef FUNCTIONAL__TRANSFER_H
+#define FUNCTIONAL__TRANSFER_H
+
+#include "Functional.h"
+#include "../Pipeline/PipelineState.h"
+
+/*!
+    @abstract
+        Hands a program from the pipeline to the functional engine.
+    @discussion
+        The stages the pipeline has yet to carry out for the decoded
+        instructions in its latches, except for register writes and
+        changes of the PC, are carried out right away. This is always
+        possible.
+
+    @param machine
+        The machine the program runs on.
+    @param from
+        The state of the pipeline, which must not be used afterwards.
+    @param to
+        The state of the functional engine, which is overwritten.
+*/
+void transfer_to_functional(rcpu_machine_t * const machine,
+                            const pipeline_state_t * const from, functional_state_t * const to);
+
+/*!
+    @abstract
+        Hands a program from the functional engine to the pipeline.
+    @discussion
+        The pipeline would still load from or store to memory for the
+        instructions decoded during the last two cycles, which the
+        functional engine has already done. Transferring is therefore
+        only possible if neither of them is a LOAD or STORE, and the
+        most recently decoded instruction does not read the PC, which
+        has already been incremented since.
+
+    @param machine
+        The machine the program runs on.
+    @param from
+        The state of the functional engine.
+    @param to
+        The state of the pipeline, which is overwritten.
+
+    @return
+        true iff the program has been transferred. Otherwise, to is
+        unchanged and the functional engine has to be run for some
+        more cycles.
+*/
+bool transfer_to_pipeline(const rcpu_machine_t * const machine,
+                          const functional_state_t * const from, pipeline_state_t * const to);
+
+#endif /* FUNCTIONAL__TRANSFER_H */
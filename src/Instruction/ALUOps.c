@@ -1,25 +1,15 @@
 #include "ALUOps.h"
 #include "Opcodes.h"
 
+// Each table takes the functions of one list of the instruction set
+#define ALU_ENTRY(name, opcode, type, alu, rd, op1, op2) [OPCODE_##name] = &alu,
+
 /**
     @brief Lookup table for binary functions. All elements
     that are not specified are NULL.
 */
 const binary_arithmetic_func_t binary_functions[2 << 6] = {
-    [OPCODE_ADD]    = &add,
-    [OPCODE_ADDI]   = &add,
-    [OPCODE_SUB]    = &sub,
-    [OPCODE_SUBI]   = &sub,
-    [OPCODE_AND]    = &and,
-    [OPCODE_ANDI]   = &and,
-    [OPCODE_OR]     = &or,
-    [OPCODE_ORI]    = &or,
-    [OPCODE_SHL]    = &shl,
-    [OPCODE_SHLI]   = &shl,
-    [OPCODE_SHRA]   = &shra,
-    [OPCODE_SHRAI]  = &shra,
-    [OPCODE_SHRL]   = &shrl,
-    [OPCODE_SHRLI]  = &shrl,
+    ISA_BINARY_ARITHMETIC(ALU_ENTRY)
 };
 
 /**
@@ -27,9 +17,7 @@ const binary_arithmetic_func_t binary_functions[2 << 6] = {
     that are not explicitly specified are NULL.
 */
 const unary_arithmetic_func_t unary_functions[2 << 6] = {
-    [OPCODE_NOT]    = &not,
-    [OPCODE_MOVE]   = &mov,
-    [OPCODE_MOVI]   = &mov,
+    ISA_UNARY_ARITHMETIC(ALU_ENTRY)
 };
 
 /**
@@ -38,18 +26,11 @@ const unary_arithmetic_func_t unary_functions[2 << 6] = {
     @see unary_functions, binary_functions
 */
 const compare_func_t compare_functions[2 << 6] = {
-    [OPCODE_CEQ]    = &ceq,
-    [OPCODE_CEQI]   = &ceq,
-    [OPCODE_CLTU]   = &cltu,
-    [OPCODE_CLTUI]  = &cltu,
-    [OPCODE_CLTS]   = &clts,
-    [OPCODE_CLTSI]  = &clts,
-    [OPCODE_CGTU]   = &cgtu,
-    [OPCODE_CGTUI]  = &cgtu,
-    [OPCODE_CGTS]   = &cgts,
-    [OPCODE_CGTSI]  = &cgts
+    ISA_COMPARE(ALU_ENTRY)
 };
 
+#undef ALU_ENTRY
+
 /**
     @brief Definition for both ADD and ADDI,
     different behaviour in main loop
@@ -0,0 +1,87 @@
+#include "BasicBlock.h"
+#include "Opcodes.h"
+
+bool instruction_is_control_flow(const decoded_instruction_t * const inst)
+{
+    return (inst->type == BRANCH) || (inst->type == JUMP);
+}
+
+bool instruction_writes_register(const decoded_instruction_t * const inst)
+{
+    return (inst->type == BINARY_ARITHMETIC)
+        || (inst->type == UNARY_ARITHMETIC)
+        || (inst->opcode == OPCODE_LOAD);
+}
+
+bool instruction_reads_register(const decoded_instruction_t * const inst, const uint8_t reg)
+{
+    switch (inst->type) {
+        case BINARY_ARITHMETIC:
+        case COMPARE:
+            return (inst->rs1 == reg) || (!inst->is_immediate && (inst->rs2 == reg));
+        case UNARY_ARITHMETIC:
+        case BRANCH:
+        case JUMP:
+            return !inst->is_immediate && (inst->rs1 == reg);
+        case IO:
+            return (inst->rs1 == reg) || ((inst->opcode == OPCODE_STORE) && (inst->rd == reg));
+        default:
+            return false;
+    }
+}
+
+bool instruction_is_translatable(const decoded_instruction_t * const inst)
+{
+    if ((inst->handler == HANDLER_INVALID) || (inst->handler == HANDLER_HALT))
+        return false;
+
+    if (instruction_writes_register(inst) && (inst->rd == pc))
+        return false;
+
+    return !instruction_reads_register(inst, pc);
+}
+
+size_t block_length(const decoded_instruction_t * const code, const size_t ninstructions,
+                    const uint32_t start, const size_t max_length)
+{
+    const decoded_instruction_t * const block = &code[start];
+    const size_t available = (start < ninstructions) ? ninstructions - start : 0;
+    size_t n = 0;
+
+    while ((n < available) && (n + 3 <= max_length)) {
+        if (!instruction_is_translatable(&block[n]))
+            break;
+
+        if (instruction_is_control_flow(&block[n])) {
+            // Include both delay slots, which must be plain instructions
+            for (size_t i = n + 1; i <= n + 2; ++i) {
+                if ((i >= available)
+                    || !instruction_is_translatable(&block[i])
+                    || instruction_is_control_flow(&block[i]))
+                    return n;
+            }
+            return n + 3;
+        }
+
+        n++;
+    }
+
+    return n;
+}
+
+void block_schedule_write_backs(const decoded_instruction_t * const block, const size_t n,
+                                bool * const delayed)
+{
+    for (size_t j = 0; j < n; ++j) {
+        const decoded_instruction_t * const inst = &block[j];
+        delayed[j] = instruction_writes_register(inst);
+
+        if (!delayed[j] || (j < 2) || (j + 3 >= n))
+            continue;
+
+        delayed[j] = instruction_reads_register(&block[j + 1], inst->rd)
+                  || instruction_reads_register(&block[j + 2], inst->rd)
+                  || (delayed[j - 1] && (block[j - 1].rd == inst->rd))
+                  || (delayed[j - 2] && (block[j - 2].rd == inst->rd));
+    }
+}
@@ -0,0 +1,96 @@
+/*!
+    @header Basic blocks
+    Analysis of straight-line instruction sequences, shared by the
+    translators (JIT and AOT compiler).
+
+    A block starts at an arbitrary address and runs until the first
+    control flow instruction, which is included together with its two
+    delay slots. Every instruction of a block is decoded one cycle
+    after the previous one, so the delays of the pipeline (see
+    Functional.h) are known when the block is translated.
+
+    @related Predecode.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef INSTRUCTION__BASICBLOCK_H
+#define INSTRUCTION__BASICBLOCK_H
+
+#include "Predecode.h"
+
+/*!
+    @abstract
+        Checks whether an instruction can change the PC.
+*/
+bool instruction_is_control_flow(const decoded_instruction_t * const inst);
+
+/*!
+    @abstract
+        Checks whether an instruction writes a result to register rd.
+*/
+bool instruction_writes_register(const decoded_instruction_t * const inst);
+
+/*!
+    @abstract
+        Checks whether an instruction reads register reg.
+*/
+bool instruction_reads_register(const decoded_instruction_t * const inst, const uint8_t reg);
+
+/*!
+    @abstract
+        Checks whether an instruction can be part of a block.
+    @discussion
+        HALT, unknown instructions and instructions accessing the PC
+        register depend on the exact timing of fetches and have to be
+        left to an interpreter.
+*/
+bool instruction_is_translatable(const decoded_instruction_t * const inst);
+
+/*!
+    @abstract
+        Determines the length of the block starting at start.
+
+    @param code
+        The predecoded code image.
+    @param ninstructions
+        The number of instructions in code.
+    @param start
+        The address of the first instruction of the block.
+    @param max_length
+        The maximum number of instructions of a block.
+
+    @return
+        The number of instructions of the block, which may be 0.
+        Only the third last instruction of a block can be a control
+        flow instruction.
+*/
+size_t block_length(const decoded_instruction_t * const code, const size_t ninstructions,
+                    const uint32_t start, const size_t max_length);
+
+/*!
+    @abstract
+        Decides when the results of the instructions of a block are
+        written back.
+    @discussion
+        Results are visible to the third instruction after the one
+        producing them. A result can however be written immediately if
+        none of the next two instructions read it and no write back to
+        the same register is still outstanding. The results of the
+        first two instructions and of the last three are always written
+        back late, as results from before or after the block may still
+        be outstanding then.
+
+    @param block
+        The instructions of the block.
+    @param n
+        The number of instructions of the block.
+    @param delayed
+        Output parameter: delayed[j] is true iff the result of
+        instruction j has to be written back before instruction j + 3
+        (or after the block).
+*/
+void block_schedule_write_backs(const decoded_instruction_t * const block, const size_t n,
+                                bool * const delayed);
+
+#endif /* INSTRUCTION__BASICBLOCK_H */
@@ -3,46 +3,45 @@
 
 #include <assert.h>
 
-// lookup table from opcode to type
-// every undefined instruction has type UNKNOWN (= 0)
-static const instruction_type_t instruction_types[2 << 6] = {
-    [OPCODE_ADD]    = BINARY_ARITHMETIC,
-    [OPCODE_ADDI]   = BINARY_ARITHMETIC,
-    [OPCODE_SUB]    = BINARY_ARITHMETIC,
-    [OPCODE_SUBI]   = BINARY_ARITHMETIC,
-    [OPCODE_AND]    = BINARY_ARITHMETIC,
-    [OPCODE_ANDI]   = BINARY_ARITHMETIC,
-    [OPCODE_OR]     = BINARY_ARITHMETIC,
-    [OPCODE_ORI]    = BINARY_ARITHMETIC,
-    [OPCODE_NOT]    = UNARY_ARITHMETIC,
-    [OPCODE_SHL]    = BINARY_ARITHMETIC,
-    [OPCODE_SHLI]   = BINARY_ARITHMETIC,
-    [OPCODE_SHRA]   = BINARY_ARITHMETIC,
-    [OPCODE_SHRAI]  = BINARY_ARITHMETIC,
-    [OPCODE_SHRL]   = BINARY_ARITHMETIC,
-    [OPCODE_SHRLI]  = BINARY_ARITHMETIC,
-    [OPCODE_JMP]    = JUMP,
-    [OPCODE_JMPR]   = JUMP,
-    [OPCODE_BRA]    = BRANCH,
-    [OPCODE_BRR]    = BRANCH,
-    [OPCODE_CEQ]    = COMPARE,
-    [OPCODE_CEQI]   = COMPARE,
-    [OPCODE_CLTU]   = COMPARE,
-    [OPCODE_CLTUI]  = COMPARE,
-    [OPCODE_CLTS]   = COMPARE,
-    [OPCODE_CLTSI]  = COMPARE,
-    [OPCODE_CGTU]   = COMPARE,
-    [OPCODE_CGTUI]  = COMPARE,
-    [OPCODE_CGTS]   = COMPARE,
-    [OPCODE_CGTSI]  = COMPARE,
-    [OPCODE_MOVE]   = UNARY_ARITHMETIC,
-    [OPCODE_MOVI]   = UNARY_ARITHMETIC,
-    [OPCODE_LOAD]   = IO,
-    [OPCODE_STORE]  = IO,
-    [OPCODE_NOP]    = MISC,
-    [OPCODE_HALT]   = MISC
+/*
+    Location of a field in the instruction word. Shifting the word
+    right arithmetically and masking the result yields register
+    indices as well as sign-extended immediate values.
+    Unused fields have a mask of 0.
+*/
+typedef struct {
+    uint8_t  shift;
+    uint32_t mask;
+    bool     is_immediate;
+} instruction_field_t;
+
+/*
+    Everything there is to know about decoding an instruction
+    with a given opcode. See ISA.h.
+*/
+typedef struct {
+    instruction_type_t  type;
+    instruction_field_t destination;
+    instruction_field_t operands[2];
+} instruction_format_t;
+
+// lookup table from opcode to format
+// every undefined instruction has type UNKNOWN (= 0) and no fields
+static const instruction_format_t instruction_formats[2 << 6] = {
+#define FORMAT_ENTRY(name, opcode, type, alu, rd, op1, op2) \
+    [OPCODE_##name] = { type, rd, { op1, op2 } },
+    INSTRUCTION_SET(FORMAT_ENTRY)
+#undef FORMAT_ENTRY
 };
 
+/*
+    Extracts a field from the instruction word without branching.
+*/
+static inline uint32_t decode_field(const instruction_field_t field, const instruction_t inst)
+{
+    return (uint32_t)((int32_t)inst >> field.shift) & field.mask;
+}
+
 /**
     @brief Decodes the type of an instruction.
 
@@ -54,7 +53,7 @@ static const instruction_type_t instruction_types[2 << 6] = {
 instruction_type_t instruction_decode_type(const instruction_t inst)
 {
     uint32_t opcode = inst & 0b00111111;
-    instruction_type_t ret = instruction_types[opcode];
+    instruction_type_t ret = instruction_formats[opcode].type;
 
     return ret;
 }
@@ -86,7 +85,10 @@ uint8_t instruction_decode_opcode(const instruction_t inst) {
 */
 bool instruction_is_immediate_variant(const instruction_t inst)
 {
-    return ((bool)(inst & 0x1) && (inst != OPCODE_STORE));
+    const instruction_format_t * const format = &instruction_formats[instruction_decode_opcode(inst)];
+
+    // No instruction has more than one immediate operand
+    return format->operands[0].is_immediate || format->operands[1].is_immediate;
 }
 
 /*!
@@ -107,10 +109,10 @@ bool instruction_is_immediate_variant(const instruction_t inst)
 */
 uint32_t instruction_decode_destination(const instruction_t inst)
 {
-    const uint32_t type = instruction_decode_type(inst);
-    assert((type == BINARY_ARITHMETIC) || (type == UNARY_ARITHMETIC) || (type == IO));
+    const instruction_field_t field = instruction_formats[instruction_decode_opcode(inst)].destination;
+    assert(field.mask != 0);
 
-    uint32_t dest = (inst & 0x000007c0) >> 6;
+    uint32_t dest = decode_field(field, inst);
 
     // destination should always be a register
     // (in the case of str, destination is the register to store)
@@ -119,20 +121,6 @@ uint32_t instruction_decode_destination(const instruction_t inst)
     return dest;
 }
 
-/*
-    sign_extent returns the first argument with its top (32 - nbits)
-    bits set to 1 iff the current top bit is 1. Otherwise, the
-    input is not changed.
-*/
-static uint32_t sign_extent(const uint32_t a, const uint32_t nbits)
-{
-    // bit pattern of all 1s iff the highest bit is set. Otherwise, this bit pattern is all 0s.
-    const uint32_t mask = 0 - ((a & (1 << (nbits - 1))) >> (nbits - 1));
-
-    // set all top bits to the highest bit
-    return a | (mask << (nbits - 1));
-}
-
 /*!
     @abstract Decode the `operandn`-th operand for the specified instruction `inst`.
 
@@ -150,73 +138,10 @@ static uint32_t sign_extent(const uint32_t a, const uint32_t nbits)
 */
 uint32_t instruction_decode_operand(const uint32_t operandn, const instruction_t inst)
 {
-    const instruction_type_t type = instruction_decode_type(inst);
-
-    switch(type) {
-        case BINARY_ARITHMETIC:
-            assert((operandn == 1) || (operandn == 2));
-
-            // in the case of binary arithmetic instructions,
-            // the first operand is always a register!
-            if (operandn == 1) {
-                return (0x0000f800 & inst) >> 11;
-            } else {
-                // and the second operand can be a register or an immediate value.
-                if (instruction_is_immediate_variant(inst)) {
-                    return sign_extent((0xffff0000 & inst) >> 16, 32 - 16);
-                } else {
-                    return (0x001f0000 & inst) >> 16;
-                }
-            }
-            break;
-        case UNARY_ARITHMETIC:
-            assert(operandn == 1);
-
-            if (instruction_is_immediate_variant(inst)) {
-                // special case for MOVI, NOTI(?)
-                return sign_extent((0xfffff800 & inst) >> 11, 21);
-            } else {
-                return (0x0000f800 & inst) >> 11;
-            }
-            break;
-        case COMPARE:
-            assert((operandn == 1) || (operandn == 2));
-
-            // The first operand is always a register.
-            if (operandn == 1) {
-                return (inst & 0x000007c0) >> 6;
-            } else {
-                // The second operand can be either a register or an immediate value
-                if (instruction_is_immediate_variant(inst)) {
-                    return sign_extent((0xfffff800 & inst) >> 11, 32 - 11);
-                } else {
-                    return (0x0000f800 & inst) >> 11;
-                }
-            }
-            break;
-        case BRANCH:
-            // fallthrough -> JUMP handling
-        case JUMP:
-            if (instruction_is_immediate_variant(inst)) {
-                // Immediate value (offset)
-                return sign_extent((0xffffffc0 & inst) >> 6, 32 - 6);
-            } else {
-                // register
-                return (0x000007c0 & inst) >> 6;
-            }
-            break;
-        case IO:
-            assert((operandn == 1) || (operandn == 2));
-
-            // The first operand is always a register.
-            if (operandn == 1) {
-                return (0x0000f800 & inst) >> 11;
-            } else {
-                return sign_extent((0xffff0000 & inst) >> 16, 32 - 16);
-            }
-        case MISC:
-        case UNKNOWN:
-        default:
-            assert(false && "Instruction not supported or invalid arguments.");
-    }
+    assert((operandn == 1) || (operandn == 2));
+
+    const instruction_field_t field = instruction_formats[instruction_decode_opcode(inst)].operands[operandn - 1];
+    assert((field.mask != 0) && "Instruction not supported or invalid arguments.");
+
+    return decode_field(field, inst);
 }
@@ -1,51 +1,19 @@
-#include "Disassemble.h" // Instruction/Disassemble.h
-#include "Opcodes.h"
-
 #ifdef __linux__
-#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE // strndup, must precede all includes
 #endif
 
+#include "Disassemble.h" // Instruction/Disassemble.h
+#include "Opcodes.h"
+
 #include <stdio.h>   // snprintf
 #include <strings.h> // bzero
 #include <string.h>  // strdup
 #include <assert.h>  // assert
 
 static const char *instruction_identifiers[2 << 6] = {
-    [OPCODE_ADD]    = "ADD",
-    [OPCODE_ADDI]   = "ADDI",
-    [OPCODE_SUB]    = "SUB",
-    [OPCODE_SUBI]   = "SUBI",
-    [OPCODE_AND]    = "AND",
-    [OPCODE_ANDI]   = "ANDI",
-    [OPCODE_OR]     = "OR",
-    [OPCODE_ORI]    = "ORI",
-    [OPCODE_NOT]    = "NOT",
-    [OPCODE_SHL]    = "SHL",
-    [OPCODE_SHLI]   = "SHLI",
-    [OPCODE_SHRA]   = "SHRA",
-    [OPCODE_SHRAI]  = "SHRAI",
-    [OPCODE_SHRL]   = "SHRL",
-    [OPCODE_SHRLI]  = "SHRLI",
-    [OPCODE_JMP]    = "JMP",
-    [OPCODE_JMPR]   = "JMPR",
-    [OPCODE_BRA]    = "BRA",
-    [OPCODE_BRR]    = "BRR",
-    [OPCODE_CEQ]    = "CEQ",
-    [OPCODE_CEQI]   = "CEQI",
-    [OPCODE_CLTU]   = "CLTU",
-    [OPCODE_CLTUI]  = "CLTUI",
-    [OPCODE_CLTS]   = "CLTS",
-    [OPCODE_CLTSI]  = "CLTSI",
-    [OPCODE_CGTU]   = "CGTU",
-    [OPCODE_CGTUI]  = "CGTUI",
-    [OPCODE_CGTS]   = "CGTS",
-    [OPCODE_CGTSI]  = "CGTSI",
-    [OPCODE_MOVE]   = "MOVE",
-    [OPCODE_MOVI]   = "MOVI",
-    [OPCODE_LOAD]   = "LOAD",
-    [OPCODE_STORE]  = "STORE",
-    [OPCODE_NOP]    = "NOP",
-    [OPCODE_HALT]   = "HALT"
+#define IDENTIFIER_ENTRY(name, opcode, type, alu, rd, op1, op2) [OPCODE_##name] = #name,
+    INSTRUCTION_SET(IDENTIFIER_ENTRY)
+#undef IDENTIFIER_ENTRY
 };
 
 /**
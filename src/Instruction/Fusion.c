@@ -0,0 +1,41 @@
+#include "Fusion.h"
+
+/*
+    Returns the address of the first instruction
+    at or after address that is not a NOP.
+*/
+static size_t skip_nops(const decoded_instruction_t * const code, const size_t ninstructions,
+                        size_t address)
+{
+    while ((address < ninstructions) && (code[address].handler == HANDLER_NOP))
+        address++;
+
+    return address;
+}
+
+size_t instruction_fuse_program(decoded_instruction_t * const code, const size_t ninstructions)
+{
+    size_t fused = 0;
+
+    for (size_t address = 0; address < ninstructions; ++address) {
+        decoded_instruction_t * const inst = &code[address];
+        const size_t next = skip_nops(code, ninstructions, address + 1);
+
+        if (next >= ninstructions)
+            break;
+
+        const uint8_t successor = code[next].handler;
+
+        if ((inst->handler >= HANDLER_CEQ) && (inst->handler <= HANDLER_CGTSI)
+            && (successor == HANDLER_BRR)) {
+            // The compare handlers are in the same order as their fused versions
+            inst->handler = HANDLER_CEQ_BRR + (inst->handler - HANDLER_CEQ);
+            fused++;
+        } else if ((inst->handler == HANDLER_MOVI) && (successor == HANDLER_MOVI)) {
+            inst->handler = HANDLER_MOVI_CHAIN;
+            fused++;
+        }
+    }
+
+    return fused;
+}
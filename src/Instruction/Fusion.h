@@ -0,0 +1,53 @@
+/*!
+    @header Superinstruction fusion
+    An optional pass over the predecoded code image that replaces the
+    handlers of the first instruction of common sequences with
+    superinstructions. An engine dispatching on handlers can then run
+    the first instruction of the sequence and skip the NOPs up to its
+    last one in a single step, dispatching only the two of them.
+
+    Two kinds of sequences are fused:
+        - A compare, followed by any number of NOPs and a BRR. The
+          compare gets the handler HANDLER_<compare>_BRR.
+        - A MOVI, followed by any number of NOPs and another MOVI,
+          which gets the handler HANDLER_MOVI_CHAIN. As the second
+          MOVI may be the start of another chain, whole runs of
+          constants are loaded one step per MOVI.
+
+    Fusion does not change what the instructions do or when they do it:
+    the skipped NOPs still count one cycle each, so delay slots and the
+    flag behave exactly as before. Only the handler is replaced, the
+    type, opcode and operands of an instruction are left untouched, so
+    engines that do not know about superinstructions must not be run on
+    a fused image.
+
+    A superinstruction does not guarantee that the rest of its sequence
+    follows: a branch still in flight may redirect the fetch while its
+    NOPs run. Engines have to check that nothing in flight changes the
+    PC before skipping them, and otherwise run the NOPs one by one.
+
+    @related Predecode.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef INSTRUCTION__FUSION_H
+#define INSTRUCTION__FUSION_H
+
+#include "Predecode.h"
+
+/*!
+    @abstract
+        Fuses all sequences of a predecoded code image.
+
+    @param code
+        The predecoded code image, which is modified in place.
+    @param ninstructions
+        The number of instructions in the code image.
+
+    @return
+        The number of superinstructions in the code image.
+*/
+size_t instruction_fuse_program(decoded_instruction_t * const code, const size_t ninstructions);
+
+#endif /* INSTRUCTION__FUSION_H */
@@ -0,0 +1,116 @@
+/*!
+    @header Instruction set
+    This header is the single description of all instructions of our
+    toy CPU. Opcodes (Opcodes.h), instruction types and operand
+    decoding (Decode.c), the ALU lookup tables (ALUOps.c), mnemonics
+    (Disassemble.c) and handlers (Predecode.h) are all generated
+    from the lists below, so they can not drift apart.
+
+    Every list takes a macro X, which is invoked once per instruction as
+        X(name, opcode, type, alu, rd, op1, op2)
+    where
+        - name is the mnemonic, which also names OPCODE_name and
+          HANDLER_name,
+        - opcode is the 6-bit opcode,
+        - type is the instruction_type_t of the instruction,
+        - alu is the function of ALUOps.h carrying out the operation,
+          or none,
+        - rd, op1 and op2 describe where the destination register and
+          both operands are located in the instruction word.
+
+    Adding an instruction only requires adding it to the list of its
+    type, and a handler to each engine.
+
+    @related Opcodes.h
+    @related Decode.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef INSTRUCTION__ISA_H
+#define INSTRUCTION__ISA_H
+
+/*
+    Fields of the instruction word. A register index is 5 bits wide,
+    an immediate value always extends up to the top bit and is
+    sign-extended. ISA_NONE marks a field the instruction does not have.
+*/
+#define ISA_REGISTER(shift)     { (shift), 0x1fu, false }
+#define ISA_IMMEDIATE(shift)    { (shift), 0xffffffffu, true }
+#define ISA_NONE                { 0, 0, false }
+
+#pragma mark ALU operations
+
+#define ISA_BINARY_ARITHMETIC(X)                                                                      \
+    X(ADD,    0b100000, BINARY_ARITHMETIC, add,  ISA_REGISTER(6), ISA_REGISTER(11), ISA_REGISTER(16))  \
+    X(ADDI,   0b100001, BINARY_ARITHMETIC, add,  ISA_REGISTER(6), ISA_REGISTER(11), ISA_IMMEDIATE(16)) \
+    X(SUB,    0b100010, BINARY_ARITHMETIC, sub,  ISA_REGISTER(6), ISA_REGISTER(11), ISA_REGISTER(16))  \
+    X(SUBI,   0b100011, BINARY_ARITHMETIC, sub,  ISA_REGISTER(6), ISA_REGISTER(11), ISA_IMMEDIATE(16)) \
+    X(AND,    0b100100, BINARY_ARITHMETIC, and,  ISA_REGISTER(6), ISA_REGISTER(11), ISA_REGISTER(16))  \
+    X(ANDI,   0b100101, BINARY_ARITHMETIC, and,  ISA_REGISTER(6), ISA_REGISTER(11), ISA_IMMEDIATE(16)) \
+    X(OR,     0b100110, BINARY_ARITHMETIC, or,   ISA_REGISTER(6), ISA_REGISTER(11), ISA_REGISTER(16))  \
+    X(ORI,    0b100111, BINARY_ARITHMETIC, or,   ISA_REGISTER(6), ISA_REGISTER(11), ISA_IMMEDIATE(16)) \
+    X(SHL,    0b101010, BINARY_ARITHMETIC, shl,  ISA_REGISTER(6), ISA_REGISTER(11), ISA_REGISTER(16))  \
+    X(SHLI,   0b101011, BINARY_ARITHMETIC, shl,  ISA_REGISTER(6), ISA_REGISTER(11), ISA_IMMEDIATE(16)) \
+    X(SHRA,   0b101100, BINARY_ARITHMETIC, shra, ISA_REGISTER(6), ISA_REGISTER(11), ISA_REGISTER(16))  \
+    X(SHRAI,  0b101101, BINARY_ARITHMETIC, shra, ISA_REGISTER(6), ISA_REGISTER(11), ISA_IMMEDIATE(16)) \
+    X(SHRL,   0b101110, BINARY_ARITHMETIC, shrl, ISA_REGISTER(6), ISA_REGISTER(11), ISA_REGISTER(16))  \
+    X(SHRLI,  0b101111, BINARY_ARITHMETIC, shrl, ISA_REGISTER(6), ISA_REGISTER(11), ISA_IMMEDIATE(16))
+
+#define ISA_UNARY_ARITHMETIC(X)                                                                       \
+    X(NOT,    0b101000, UNARY_ARITHMETIC,  not,  ISA_REGISTER(6), ISA_REGISTER(11),  ISA_NONE)         \
+    X(MOVE,   0b001110, UNARY_ARITHMETIC,  mov,  ISA_REGISTER(6), ISA_REGISTER(11),  ISA_NONE)         \
+    X(MOVI,   0b001111, UNARY_ARITHMETIC,  mov,  ISA_REGISTER(6), ISA_IMMEDIATE(11), ISA_NONE)
+
+#pragma mark Control flow instructions
+
+#define ISA_JUMP(X)                                                                                   \
+    X(JMP,    0b000000, JUMP,              none, ISA_NONE,        ISA_REGISTER(6),   ISA_NONE)         \
+    X(JMPR,   0b000001, JUMP,              none, ISA_NONE,        ISA_IMMEDIATE(6),  ISA_NONE)
+
+#define ISA_BRANCH(X)                                                                                 \
+    X(BRA,    0b000010, BRANCH,            none, ISA_NONE,        ISA_REGISTER(6),   ISA_NONE)         \
+    X(BRR,    0b000011, BRANCH,            none, ISA_NONE,        ISA_IMMEDIATE(6),  ISA_NONE)
+
+#pragma mark Compare instructions
+
+#define ISA_COMPARE(X)                                                                                \
+    X(CEQ,    0b000100, COMPARE,           ceq,  ISA_NONE,        ISA_REGISTER(6),  ISA_REGISTER(11))  \
+    X(CEQI,   0b000101, COMPARE,           ceq,  ISA_NONE,        ISA_REGISTER(6),  ISA_IMMEDIATE(11)) \
+    X(CLTU,   0b000110, COMPARE,           cltu, ISA_NONE,        ISA_REGISTER(6),  ISA_REGISTER(11))  \
+    X(CLTUI,  0b000111, COMPARE,           cltu, ISA_NONE,        ISA_REGISTER(6),  ISA_IMMEDIATE(11)) \
+    X(CLTS,   0b001000, COMPARE,           clts, ISA_NONE,        ISA_REGISTER(6),  ISA_REGISTER(11))  \
+    X(CLTSI,  0b001001, COMPARE,           clts, ISA_NONE,        ISA_REGISTER(6),  ISA_IMMEDIATE(11)) \
+    X(CGTU,   0b001010, COMPARE,           cgtu, ISA_NONE,        ISA_REGISTER(6),  ISA_REGISTER(11))  \
+    X(CGTUI,  0b001011, COMPARE,           cgtu, ISA_NONE,        ISA_REGISTER(6),  ISA_IMMEDIATE(11)) \
+    X(CGTS,   0b001100, COMPARE,           cgts, ISA_NONE,        ISA_REGISTER(6),  ISA_REGISTER(11))  \
+    X(CGTSI,  0b001101, COMPARE,           cgts, ISA_NONE,        ISA_REGISTER(6),  ISA_IMMEDIATE(11))
+
+#pragma mark IO instructions
+
+// The offset is always an immediate value. The "destination"
+// of STORE is the register to store.
+#define ISA_IO(X)                                                                                     \
+    X(LOAD,   0b010000, IO,                none, ISA_REGISTER(6), ISA_REGISTER(11), ISA_IMMEDIATE(16)) \
+    X(STORE,  0b010001, IO,                none, ISA_REGISTER(6), ISA_REGISTER(11), ISA_IMMEDIATE(16))
+
+#pragma mark MISC instructions
+
+#define ISA_MISC(X)                                                                                   \
+    X(NOP,    0b010010, MISC,              none, ISA_NONE,        ISA_NONE,         ISA_NONE)          \
+    X(HALT,   0b010011, MISC,              none, ISA_NONE,        ISA_NONE,         ISA_NONE)
+
+/*
+    All instructions. The order is the order of the handlers; the
+    compare instructions have to stay contiguous (see Fusion.h).
+*/
+#define INSTRUCTION_SET(X)      \
+    ISA_BINARY_ARITHMETIC(X)    \
+    ISA_UNARY_ARITHMETIC(X)     \
+    ISA_JUMP(X)                 \
+    ISA_BRANCH(X)               \
+    ISA_COMPARE(X)              \
+    ISA_IO(X)                   \
+    ISA_MISC(X)
+
+#endif /* INSTRUCTION__ISA_H */
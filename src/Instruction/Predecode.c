@@ -0,0 +1,114 @@
+#include "Predecode.h"
+#include "Opcodes.h"
+
+#include <stdlib.h>
+#include <strings.h> // bzero
+
+#ifdef __linux__
+#include <malloc.h>
+#endif
+
+// lookup table from opcode to handler
+// every undefined instruction has HANDLER_INVALID (= 0)
+static const uint8_t instruction_handlers[2 << 6] = {
+#define HANDLER_ENTRY(name, opcode, type, alu, rd, op1, op2) [OPCODE_##name] = HANDLER_##name,
+    INSTRUCTION_SET(HANDLER_ENTRY)
+#undef HANDLER_ENTRY
+};
+
+void instruction_predecode(const instruction_t inst, decoded_instruction_t * const out)
+{
+    bzero(out, sizeof(*out));
+
+    out->word = inst;
+    out->type = instruction_decode_type(inst);
+    out->opcode = instruction_decode_opcode(inst);
+    out->handler = instruction_handlers[out->opcode];
+
+    switch (out->type) {
+        case BINARY_ARITHMETIC:
+            {
+                out->rd = instruction_decode_destination(inst);
+                out->rs1 = instruction_decode_operand(1, inst);
+                out->is_immediate = instruction_is_immediate_variant(inst);
+                if (out->is_immediate)
+                    out->imm = instruction_decode_operand(2, inst);
+                else
+                    out->rs2 = instruction_decode_operand(2, inst);
+                break;
+            }
+        case UNARY_ARITHMETIC:
+            {
+                out->rd = instruction_decode_destination(inst);
+                out->is_immediate = instruction_is_immediate_variant(inst);
+                if (out->is_immediate)
+                    out->imm = instruction_decode_operand(1, inst);
+                else
+                    out->rs1 = instruction_decode_operand(1, inst);
+                break;
+            }
+        case COMPARE:
+            {
+                out->rs1 = instruction_decode_operand(1, inst);
+                out->is_immediate = instruction_is_immediate_variant(inst);
+                if (out->is_immediate)
+                    out->imm = instruction_decode_operand(2, inst);
+                else
+                    out->rs2 = instruction_decode_operand(2, inst);
+                break;
+            }
+        case BRANCH:
+        case JUMP:
+            {
+                out->is_immediate = instruction_is_immediate_variant(inst);
+                if (out->is_immediate)
+                    out->imm = instruction_decode_operand(1, inst);
+                else
+                    out->rs1 = instruction_decode_operand(1, inst);
+                break;
+            }
+        case IO:
+            {
+                // The offset is always an immediate value
+                out->rd = instruction_decode_destination(inst);
+                out->rs1 = instruction_decode_operand(1, inst);
+                out->is_immediate = true;
+                out->imm = instruction_decode_operand(2, inst);
+                break;
+            }
+        case MISC:
+        case UNKNOWN:
+        default:
+            // Nothing to decode. Unknown instructions are only
+            // rejected once they are actually executed.
+            break;
+    }
+}
+
+decoded_instruction_t * instruction_predecode_program(const instruction_t * const code,
+                                                      const size_t ninstructions)
+{
+    decoded_instruction_t * const decoded = malloc(ninstructions * sizeof(decoded_instruction_t));
+    if (decoded == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < ninstructions; ++i)
+        instruction_predecode(code[i], &decoded[i]);
+
+    return decoded;
+}
+
+uint32_t * instruction_find_nop_runs(const decoded_instruction_t * const decoded,
+                                     const size_t ninstructions)
+{
+    uint32_t * const runs = malloc((ninstructions + 1) * sizeof(uint32_t));
+    if (runs == NULL)
+        return NULL;
+
+    // Every run ends where the next one starts
+    runs[ninstructions] = 0;
+    for (size_t i = ninstructions; i-- > 0; )
+        runs[i] = (decoded[i].handler == HANDLER_NOP) ? runs[i + 1] + 1 : 0;
+
+    return runs;
+}
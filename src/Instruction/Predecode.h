@@ -0,0 +1,130 @@
+/*!
+    @header Predecoding instructions
+    Code and data are separated (see Pipeline.h), so the code image can
+    never change while a program is running. This allows decoding every
+    instruction word exactly once when the program is loaded. The
+    pipeline stages then only look at the predecoded form and never
+    have to extract bit fields from the raw instruction words again.
+
+    @related Decode.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef INSTRUCTION__PREDECODE_H
+#define INSTRUCTION__PREDECODE_H
+
+#include "Decode.h"
+#include "ISA.h"
+
+#include <stddef.h>
+
+/*!
+    @abstract
+        Dense index of the operation carried out by an instruction.
+    @discussion
+        There is one handler per opcode, in the order of the
+        instruction set (see ISA.h). In contrast to the opcode
+        itself, handler indices are contiguous, so they can be used to
+        index small dispatch tables. Undefined opcodes map to
+        HANDLER_INVALID.
+
+        The handlers following HANDLER_HALT are superinstructions,
+        which predecoding never produces (see Fusion.h).
+*/
+typedef enum {
+    HANDLER_INVALID = 0,
+#define HANDLER_ENTRY(name, opcode, type, alu, rd, op1, op2) HANDLER_##name,
+    INSTRUCTION_SET(HANDLER_ENTRY)
+#undef HANDLER_ENTRY
+    HANDLER_CEQ_BRR,
+    HANDLER_CEQI_BRR,
+    HANDLER_CLTU_BRR,
+    HANDLER_CLTUI_BRR,
+    HANDLER_CLTS_BRR,
+    HANDLER_CLTSI_BRR,
+    HANDLER_CGTU_BRR,
+    HANDLER_CGTUI_BRR,
+    HANDLER_CGTS_BRR,
+    HANDLER_CGTSI_BRR,
+    HANDLER_MOVI_CHAIN,
+    HANDLER_COUNT
+} instruction_handler_t;
+
+/*!
+    @abstract
+        A single predecoded instruction.
+    @discussion
+        Which of the register fields are meaningful depends on the type
+        of the instruction:
+            - BINARY_ARITHMETIC: rd = op(rs1, rs2 or imm)
+            - UNARY_ARITHMETIC:  rd = op(rs1 or imm)
+            - COMPARE:           flag = op(rs1, rs2 or imm)
+            - BRANCH, JUMP:      target is rs1 or the PC-relative offset imm
+            - IO:                LOAD rd, [rs1 + imm] / STORE rd, [rs1 + imm]
+        Immediate values have already been sign-extended.
+*/
+typedef struct decoded_instruction {
+    instruction_t word;     // The raw instruction word, for disassembly only
+    uint8_t       type;     // instruction_type_t
+    uint8_t       opcode;
+    uint8_t       handler;  // instruction_handler_t
+    uint8_t       rd;
+    uint8_t       rs1;
+    uint8_t       rs2;
+    bool          is_immediate; // true iff imm replaces the last register operand
+    uint32_t      imm;
+} decoded_instruction_t;
+
+/*!
+    @abstract
+        Predecodes a single instruction word.
+
+    @param inst
+        The instruction to decode. Invalid instructions are not
+        rejected, but get the type UNKNOWN and HANDLER_INVALID.
+    @param out
+        The predecoded instruction.
+*/
+void instruction_predecode(const instruction_t inst, decoded_instruction_t * const out);
+
+/*!
+    @abstract
+        Predecodes a whole code image.
+
+    @param code
+        The code image
+    @param ninstructions
+        The number of instructions in the code image
+
+    @return
+        An array of ninstructions predecoded instructions, or NULL
+        if the memory could not be allocated. The caller is responsible
+        to release the returned memory.
+*/
+decoded_instruction_t * instruction_predecode_program(const instruction_t * const code,
+                                                      const size_t ninstructions);
+
+/*!
+    @abstract
+        Finds all runs of consecutive NOPs in a predecoded code image.
+    @discussion
+        Compilers pad programs with NOPs, as the pipeline has no
+        forwarding. Knowing the length of a run ahead of time allows
+        to skip it in a single step.
+
+    @param decoded
+        The predecoded code image
+    @param ninstructions
+        The number of instructions in the code image
+
+    @return
+        An array of ninstructions + 1 entries, or NULL if the memory
+        could not be allocated. Entry i is the number of consecutive
+        NOPs starting at address i, the last entry is always 0.
+        The caller is responsible to release the returned memory.
+*/
+uint32_t * instruction_find_nop_runs(const decoded_instruction_t * const decoded,
+                                     const size_t ninstructions);
+
+#endif /* INSTRUCTION__PREDECODE_H */
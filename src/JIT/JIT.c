@@ -0,0 +1,654 @@
+#include "JIT.h"
+
+#include <stdlib.h>
+#include <stddef.h> // offsetof
+#include <assert.h>
+
+#if defined(__x86_64__)
+
+#include "X86Emitter.h"
+#include "../Instruction/BasicBlock.h"
+
+#define JIT_CODE_BUFFER_SIZE        (16 * 1024 * 1024)
+#define JIT_MAX_BLOCK_LENGTH        256
+
+// Upper bounds for the size of the generated code, in bytes
+#define JIT_MAX_INSTRUCTION_SIZE    96
+#define JIT_MAX_BLOCK_OVERHEAD      256
+
+/*
+    State shared between generated code and the dispatcher.
+*/
+typedef struct jit_context {
+    rcpu_machine_t * machine;
+
+    // Results of the last three instructions of the previous block,
+    // oldest first, which still have to be written back.
+    uint32_t * pending_dst[3];
+    uint32_t   pending_value[3];
+
+    // Results of instructions inside a block that are written back later
+    uint32_t   temp[3];
+
+    // Guest address of the next instruction, set when a block is left
+    uint32_t   next_pc;
+    uint8_t    flag;
+    uint64_t   cycles;
+
+    // The jump of a block exit that could be chained to next_pc,
+    // or NULL if the exit can not be chained.
+    uint8_t *  exit_site;
+
+    // Destination of pending write backs of instructions without a result
+    uint32_t   sink;
+
+    // Guest address of the last LOAD or STORE and the number of
+    // instructions from it to the end of its block, for reporting
+    // faults and tracing STOREs
+    uint32_t   io_pc;
+    uint32_t   io_remaining;
+
+    // Word addresses from here on are beyond data memory (see Machine.h)
+    uint64_t   limit;
+} jit_context_t;
+
+#define CONTEXT_OFFSET(field)   ((int32_t)offsetof(jit_context_t, field))
+#define REGISTER_OFFSET(r)      ((int32_t)((r) * sizeof(uint32_t)))
+
+/*
+    Fixed roles of host registers inside generated code. All of them
+    are callee-saved, so they survive calls to memory_store.
+*/
+#define CONTEXT     RBX     // jit_context_t *
+#define REGS        R12     // machine->registers
+#define DATA        R13     // machine->memory.data
+#define NEXT        R15     // guest address after a control flow instruction
+
+typedef void (*jit_enter_t)(jit_context_t * const context, const uint8_t * const block);
+
+/*
+    Translation cache of one machine. Generated code only refers to
+    the machine through the context, but blocks are chained to each
+    other directly, so the cache can not be shared between machines.
+*/
+struct jit {
+    code_buffer_t   code;
+
+    jit_enter_t     enter;  // calls a block
+    const uint8_t * exit;   // returns from the block to the dispatcher
+
+    // True if LOADs and STOREs are checked against the end of data
+    // memory, as the machine has no guard region
+    bool            checked;
+
+    // Translated blocks by guest address
+    const decoded_instruction_t * decoded;
+    size_t          ninstructions;
+    uint8_t **      blocks;
+    bool *          untranslatable;
+};
+
+#pragma mark Code generation
+
+/*
+    Calls function from generated code.
+*/
+static void emit_call(code_buffer_t * const b, const void * const function)
+{
+    x86_mov_imm64(b, RAX, (uint64_t)function);
+    x86_emit_reg(b, false, 0xff, 2, RAX);   // call rax
+}
+
+/*
+    Computes the word address of a LOAD or STORE in eax. Accesses
+    beyond data memory fault (see Machine.h), so the location of the
+    instruction is recorded first. Only without a guard region is the
+    word address checked, and only those below the limit get past it.
+*/
+static void emit_io_address(const struct jit * const jit, code_buffer_t * const b,
+                            const decoded_instruction_t * const inst,
+                            const uint32_t address, const uint32_t remaining)
+{
+    x86_emit_mem(b, false, 0xc7, 0, CONTEXT, CONTEXT_OFFSET(io_pc));
+    x86_emit_u32(b, address);                   // mov dword [io_pc], address
+    x86_emit_mem(b, false, 0xc7, 0, CONTEXT, CONTEXT_OFFSET(io_remaining));
+    x86_emit_u32(b, remaining);                 // mov dword [io_remaining], remaining
+
+    x86_load32(b, RAX, REGS, REGISTER_OFFSET(inst->rs1));
+    if (inst->imm != 0)
+        x86_alu_imm(b, X86_ADD, RAX, inst->imm);
+
+    if (!jit->checked)
+        return;
+
+    x86_emit_mem(b, true, 0x3b, RAX, CONTEXT, CONTEXT_OFFSET(limit));  // cmp rax, [limit]
+    uint8_t * const within = x86_jcc(b, X86_CC_B, NULL);
+
+    x86_emit_reg(b, false, 0x89, RAX, RSI);     // mov esi, eax
+    x86_load64(b, RDI, CONTEXT, CONTEXT_OFFSET(machine));
+    emit_call(b, &machine_access_fault);        // does not return
+
+    x86_patch_jump(within, b->cursor);
+}
+
+/*
+    Emits a shift by one bit (if the second operand is zero) or by
+    eight bits (otherwise), as implemented by the ALU.
+*/
+static void emit_shift(code_buffer_t * const b, const x86_shift_t op,
+                       const decoded_instruction_t * const inst)
+{
+    x86_load32(b, RAX, REGS, REGISTER_OFFSET(inst->rs1));
+
+    if (inst->is_immediate) {
+        x86_shift_imm(b, op, RAX, inst->imm ? 8 : 1);
+    } else {
+        x86_emit_reg(b, false, 0x89, RAX, RDX);                     // mov edx, eax
+        x86_shift_imm(b, op, RAX, 8);
+        x86_shift_imm(b, op, RDX, 1);
+        x86_emit_mem(b, false, 0x83, X86_CMP, REGS, REGISTER_OFFSET(inst->rs2));
+        x86_emit_u8(b, 0);                                          // cmp [rs2], 0
+        x86_emit_reg(b, false, 0x0f40 | X86_CC_E, RAX, RDX);        // cmove eax, edx
+    }
+}
+
+static void emit_binary_alu(code_buffer_t * const b, const x86_alu_t op,
+                            const decoded_instruction_t * const inst)
+{
+    x86_load32(b, RAX, REGS, REGISTER_OFFSET(inst->rs1));
+
+    if (inst->is_immediate)
+        x86_alu_imm(b, op, RAX, inst->imm);
+    else
+        x86_alu_mem(b, op, RAX, REGS, REGISTER_OFFSET(inst->rs2));
+}
+
+static void emit_compare(code_buffer_t * const b, const x86_condition_t cc,
+                         const decoded_instruction_t * const inst)
+{
+    emit_binary_alu(b, X86_CMP, inst);
+    x86_emit_mem(b, false, 0x0f90 | cc, 0, CONTEXT, CONTEXT_OFFSET(flag));  // setcc [flag]
+}
+
+/*
+    Emits the code of a single instruction. Results are left in eax,
+    control flow instructions leave the address of the next
+    instruction to fetch after their delay slots in r15d.
+
+    @param address
+        The guest address of the instruction.
+    @param remaining
+        The number of instructions from this one to the end of the
+        block, including this one.
+*/
+static void emit_instruction(const struct jit * const jit, code_buffer_t * const b,
+                             const decoded_instruction_t * const inst,
+                             const uint32_t address, const uint32_t remaining)
+{
+    const uint32_t n_pc = address + 1;
+
+    switch (inst->handler) {
+        case HANDLER_ADD:
+        case HANDLER_ADDI:  emit_binary_alu(b, X86_ADD, inst); break;
+        case HANDLER_SUB:
+        case HANDLER_SUBI:  emit_binary_alu(b, X86_SUB, inst); break;
+        case HANDLER_AND:
+        case HANDLER_ANDI:  emit_binary_alu(b, X86_AND, inst); break;
+        case HANDLER_OR:
+        case HANDLER_ORI:   emit_binary_alu(b, X86_OR, inst); break;
+
+        case HANDLER_SHL:
+        case HANDLER_SHLI:  emit_shift(b, X86_SHL, inst); break;
+        case HANDLER_SHRA:
+        case HANDLER_SHRAI: emit_shift(b, X86_SAR, inst); break;
+        case HANDLER_SHRL:
+        case HANDLER_SHRLI: emit_shift(b, X86_SHR, inst); break;
+
+        case HANDLER_NOT:
+            x86_load32(b, RAX, REGS, REGISTER_OFFSET(inst->rs1));
+            x86_emit_reg(b, false, 0xf7, 2, RAX);  // not eax
+            break;
+        case HANDLER_MOVE:
+            x86_load32(b, RAX, REGS, REGISTER_OFFSET(inst->rs1));
+            break;
+        case HANDLER_MOVI:
+            x86_mov_imm32(b, RAX, inst->imm);
+            break;
+
+        case HANDLER_CEQ:
+        case HANDLER_CEQI:  emit_compare(b, X86_CC_E, inst); break;
+        case HANDLER_CLTU:
+        case HANDLER_CLTUI: emit_compare(b, X86_CC_B, inst); break;
+        case HANDLER_CLTS:
+        case HANDLER_CLTSI: emit_compare(b, X86_CC_L, inst); break;
+        case HANDLER_CGTU:
+        case HANDLER_CGTUI: emit_compare(b, X86_CC_A, inst); break;
+        case HANDLER_CGTS:
+        case HANDLER_CGTSI: emit_compare(b, X86_CC_G, inst); break;
+
+        case HANDLER_JMP:
+            x86_load32(b, NEXT, REGS, REGISTER_OFFSET(inst->rs1));
+            break;
+        case HANDLER_JMPR:
+            x86_mov_imm32(b, NEXT, inst->imm + n_pc);
+            break;
+        case HANDLER_BRA:
+        case HANDLER_BRR:
+            {
+                // Without the branch, execution continues after the delay slots
+                x86_mov_imm32(b, NEXT, address + 3);
+                x86_emit_mem(b, false, 0x80, X86_CMP, CONTEXT, CONTEXT_OFFSET(flag));
+                x86_emit_u8(b, 0);                                  // cmp byte [flag], 0
+
+                if (inst->handler == HANDLER_BRA) {
+                    x86_emit_mem(b, false, 0x0f40 | X86_CC_NE, NEXT, REGS, REGISTER_OFFSET(inst->rs1));
+                } else {
+                    x86_mov_imm32(b, RAX, inst->imm + n_pc);
+                    x86_emit_reg(b, false, 0x0f40 | X86_CC_NE, NEXT, RAX);
+                }
+                break;
+            }
+
+        case HANDLER_LOAD:
+            emit_io_address(jit, b, inst, address, remaining);
+            x86_load_indexed(b, false, RAX, DATA, RAX);
+            break;
+        case HANDLER_STORE:
+            emit_io_address(jit, b, inst, address, remaining);
+            x86_emit_reg(b, false, 0x89, RAX, RSI);                 // mov esi, eax
+            x86_load32(b, RDX, REGS, REGISTER_OFFSET(inst->rd));
+            x86_load64(b, RDI, CONTEXT, CONTEXT_OFFSET(machine));
+            emit_call(b, &memory_store);
+            break;
+
+        case HANDLER_NOP:
+            break;
+
+        default:
+            assert(false && "Instruction can not be translated.");
+    }
+}
+
+/*
+    Leaves a block towards a statically known guest address. The exit
+    jumps to the block at target directly once that is translated.
+*/
+static void emit_static_exit(const struct jit * const jit, code_buffer_t * const b, const uint32_t target)
+{
+    const uint8_t * const known = (target < jit->ninstructions) ? jit->blocks[target] : NULL;
+    uint8_t * const site = x86_jmp(b, known);
+
+    // Until the jump is patched, it falls through into the dispatcher
+    x86_emit_mem(b, false, 0xc7, 0, CONTEXT, CONTEXT_OFFSET(next_pc));
+    x86_emit_u32(b, target);
+    x86_mov_imm64(b, RAX, (uint64_t)site);
+    x86_store64(b, CONTEXT, CONTEXT_OFFSET(exit_site), RAX);
+    x86_jmp(b, jit->exit);
+}
+
+/*
+    Leaves a block towards the guest address in r15d, jumping to the
+    block there directly if one has already been translated.
+*/
+static void emit_dynamic_exit(const struct jit * const jit, code_buffer_t * const b)
+{
+    x86_store32(b, CONTEXT, CONTEXT_OFFSET(next_pc), NEXT);
+    x86_emit_mem(b, true, 0xc7, 0, CONTEXT, CONTEXT_OFFSET(exit_site));
+    x86_emit_u32(b, 0);
+
+    x86_alu_imm(b, X86_CMP, NEXT, (uint32_t)jit->ninstructions);
+    x86_jcc(b, X86_CC_AE, jit->exit);
+
+    x86_mov_imm64(b, RAX, (uint64_t)jit->blocks);
+    x86_load_indexed(b, true, RAX, RAX, NEXT);
+    x86_emit_reg(b, true, 0x85, RAX, RAX);      // test rax, rax
+    x86_jcc(b, X86_CC_E, jit->exit);
+    x86_emit_reg(b, false, 0xff, 4, RAX);       // jmp rax
+}
+
+/*
+    Translates the block starting at guest address start.
+    Returns NULL if it can not be translated.
+*/
+static uint8_t * translate_block(struct jit * const jit, const uint32_t start)
+{
+    const decoded_instruction_t * const code = &jit->decoded[start];
+    const size_t n = block_length(jit->decoded, jit->ninstructions, start, JIT_MAX_BLOCK_LENGTH);
+
+    // Blocks hand the results of their last three instructions to
+    // the next one, so shorter blocks are left to the interpreter.
+    if (n < 3)
+        return NULL;
+
+    code_buffer_t * const b = &jit->code;
+    if (!code_buffer_has_room(b, n * JIT_MAX_INSTRUCTION_SIZE + JIT_MAX_BLOCK_OVERHEAD))
+        return NULL;
+
+    bool delayed[JIT_MAX_BLOCK_LENGTH];
+    block_schedule_write_backs(code, n, delayed);
+
+    uint8_t * const block = b->cursor;
+
+    // One instruction is decoded per cycle
+    x86_emit_mem(b, true, 0x81, X86_ADD, CONTEXT, CONTEXT_OFFSET(cycles));
+    x86_emit_u32(b, (uint32_t)n);
+
+    for (size_t j = 0; j < n; ++j) {
+        const decoded_instruction_t * const inst = &code[j];
+
+        // Write back the result of the instruction three before this one
+        if (j < 3) {
+            x86_load64(b, RAX, CONTEXT, CONTEXT_OFFSET(pending_dst[j]));
+            x86_load32(b, RCX, CONTEXT, CONTEXT_OFFSET(pending_value[j]));
+            x86_store32(b, RAX, 0, RCX);
+        } else if (delayed[j - 3]) {
+            x86_load32(b, RAX, CONTEXT, CONTEXT_OFFSET(temp[(j - 3) % 3]));
+            x86_store32(b, REGS, REGISTER_OFFSET(code[j - 3].rd), RAX);
+        }
+
+        emit_instruction(jit, b, inst, start + (uint32_t)j, (uint32_t)(n - j));
+
+        if (!instruction_writes_register(inst))
+            continue;
+
+        if (!delayed[j])
+            x86_store32(b, REGS, REGISTER_OFFSET(inst->rd), RAX);
+        else if (j + 3 >= n)
+            x86_store32(b, CONTEXT, CONTEXT_OFFSET(pending_value[j + 3 - n]), RAX);
+        else
+            x86_store32(b, CONTEXT, CONTEXT_OFFSET(temp[j % 3]), RAX);
+    }
+
+    // Hand the outstanding write backs to the next block
+    for (size_t i = 0; i < 3; ++i) {
+        const decoded_instruction_t * const inst = &code[n - 3 + i];
+
+        if (instruction_writes_register(inst))
+            x86_emit_mem(b, true, 0x8d, RAX, REGS, REGISTER_OFFSET(inst->rd));     // lea rax, [rd]
+        else
+            x86_emit_mem(b, true, 0x8d, RAX, CONTEXT, CONTEXT_OFFSET(sink));       // lea rax, [sink]
+        x86_store64(b, CONTEXT, CONTEXT_OFFSET(pending_dst[i]), RAX);
+    }
+
+    // Control flow can only be the third last instruction
+    const decoded_instruction_t * const last = &code[n - 3];
+    const uint32_t fallthrough = start + (uint32_t)n;
+
+    switch (last->handler) {
+        case HANDLER_JMPR:
+            emit_static_exit(jit, b, last->imm + (start + (uint32_t)n - 2));
+            break;
+        case HANDLER_BRR:
+            {
+                const uint32_t target = last->imm + (start + (uint32_t)n - 2);
+
+                x86_alu_imm(b, X86_CMP, NEXT, target);
+                uint8_t * const not_taken = x86_jcc(b, X86_CC_NE, NULL);
+                emit_static_exit(jit, b, target);
+                x86_patch_jump(not_taken, b->cursor);
+                emit_static_exit(jit, b, fallthrough);
+                break;
+            }
+        case HANDLER_JMP:
+        case HANDLER_BRA:
+            emit_dynamic_exit(jit, b);
+            break;
+        default:
+            emit_static_exit(jit, b, fallthrough);
+            break;
+    }
+
+    return block;
+}
+
+/*
+    Emits the code entering and leaving generated code.
+*/
+static void emit_trampolines(struct jit * const jit)
+{
+    code_buffer_t * const b = &jit->code;
+
+    // void enter(jit_context_t *context, const uint8_t *block)
+    jit->enter = (jit_enter_t)b->cursor;
+
+    x86_emit_u8(b, 0x53);                           // push rbx
+    x86_emit_u8(b, 0x41); x86_emit_u8(b, 0x54);     // push r12
+    x86_emit_u8(b, 0x41); x86_emit_u8(b, 0x55);     // push r13
+    x86_emit_u8(b, 0x41); x86_emit_u8(b, 0x56);     // push r14, unused but keeps the stack aligned
+    x86_emit_u8(b, 0x41); x86_emit_u8(b, 0x57);     // push r15
+
+    x86_emit_reg(b, true, 0x89, RDI, CONTEXT);      // mov rbx, rdi
+    x86_load64(b, RAX, CONTEXT, CONTEXT_OFFSET(machine));
+    x86_emit_mem(b, true, 0x8d, REGS, RAX, (int32_t)offsetof(rcpu_machine_t, registers));   // lea r12, [registers]
+    x86_load64(b, DATA, RAX, (int32_t)offsetof(rcpu_machine_t, memory.data));
+    x86_emit_reg(b, false, 0xff, 4, RSI);           // jmp rsi
+
+    jit->exit = b->cursor;
+
+    x86_emit_u8(b, 0x41); x86_emit_u8(b, 0x5f);     // pop r15
+    x86_emit_u8(b, 0x41); x86_emit_u8(b, 0x5e);     // pop r14
+    x86_emit_u8(b, 0x41); x86_emit_u8(b, 0x5d);     // pop r13
+    x86_emit_u8(b, 0x41); x86_emit_u8(b, 0x5c);     // pop r12
+    x86_emit_u8(b, 0x5b);                           // pop rbx
+    x86_emit_u8(b, 0xc3);                           // ret
+}
+
+/*
+    Creates the translation cache of machine.
+*/
+static struct jit * jit_create(const rcpu_machine_t * const machine)
+{
+    struct jit * const jit = calloc(1, sizeof(struct jit));
+    if (jit == NULL)
+        return NULL;
+
+    jit->checked = !machine->memory.guarded;
+    jit->decoded = machine->memory.decoded;
+    jit->ninstructions = machine->memory.code_size / sizeof(*machine->memory.code);
+    jit->blocks = calloc(jit->ninstructions, sizeof(*jit->blocks));
+    jit->untranslatable = calloc(jit->ninstructions, sizeof(*jit->untranslatable));
+
+    if ((jit->blocks == NULL) || (jit->untranslatable == NULL)
+        || !code_buffer_init(&jit->code, JIT_CODE_BUFFER_SIZE)) {
+        free(jit->blocks);
+        free(jit->untranslatable);
+        free(jit);
+        return NULL;
+    }
+
+    emit_trampolines(jit);
+    return jit;
+}
+
+void jit_free(rcpu_machine_t * const machine)
+{
+    struct jit * const jit = machine->jit;
+    if (jit == NULL)
+        return;
+
+    code_buffer_free(&jit->code);
+    free(jit->blocks);
+    free(jit->untranslatable);
+    free(jit);
+
+    machine->jit = NULL;
+}
+
+#pragma mark Dispatcher
+
+/*
+    Returns the block starting at address, translating it if needed.
+    Returns NULL if there is no such block.
+*/
+static const uint8_t * jit_lookup(struct jit * const jit, const uint32_t address)
+{
+    if (address >= jit->ninstructions)
+        return NULL;
+
+    if ((jit->blocks[address] == NULL) && !jit->untranslatable[address]) {
+        jit->blocks[address] = translate_block(jit, address);
+        jit->untranslatable[address] = (jit->blocks[address] == NULL);
+    }
+
+    return jit->blocks[address];
+}
+
+/*
+    Blocks can only be entered if the last instruction fetched has
+    not been executed yet, no fetch was skipped because of a HALT,
+    and neither a branch nor a pending write to the PC register is
+    about to change the PC.
+*/
+static bool can_enter(const functional_state_t * const state)
+{
+    const uint64_t cycle = state->cycles;
+
+    for (int i = 0; i < 3; ++i) {
+        const functional_slot_t * const slot = &state->slots[(cycle + i) & 3];
+
+        if ((slot->effect == EFFECT_WRITE) && (slot->rd == pc))
+            return false;
+    }
+
+    return (state->in_flight == 0xf)
+        && (state->slots[(cycle + 1) & 3].effect != EFFECT_BRANCH)
+        && (state->slots[(cycle + 2) & 3].effect != EFFECT_BRANCH);
+}
+
+/*
+    Locates the last LOAD or STORE of a block. Its cycles have been
+    counted when the block was entered, the instruction is decoded
+    remaining cycles before its end and accesses memory two cycles
+    after that.
+*/
+static machine_location_t locate_access(const rcpu_machine_t * const machine, const void * const state)
+{
+    const jit_context_t * const context = state;
+
+    return (machine_location_t){
+        .address = context->io_pc,
+        .cycle = context->cycles - context->io_remaining + 2
+    };
+}
+
+/*
+    Runs translated blocks, starting with block, for as long as
+    possible. Afterwards, state is as if the interpreter had
+    executed them.
+*/
+static void run_blocks(rcpu_machine_t * const machine, functional_state_t * const state,
+                       const uint8_t * block)
+{
+    struct jit * const jit = machine->jit;
+    uint32_t * const registers = machine->registers;
+    jit_context_t context;
+
+    context.machine = machine;
+
+    // The instructions fetched four, three and two cycles ago
+    // may not have been written back yet.
+    for (int i = 0; i < 3; ++i) {
+        const functional_slot_t * const slot = &state->slots[(state->cycles + i) & 3];
+
+        context.pending_dst[i] = (slot->effect == EFFECT_WRITE) ? &registers[slot->rd] : &context.sink;
+        context.pending_value[i] = slot->value;
+    }
+    context.flag = machine->flag;
+    context.cycles = state->cycles;
+    context.limit = machine->memory.limit;
+
+    machine_set_locator(machine, locate_access, &context);
+
+    do {
+        context.exit_site = NULL;
+        jit->enter(&context, block);
+
+        block = jit_lookup(jit, context.next_pc);
+        if ((block != NULL) && (context.exit_site != NULL))
+            x86_patch_jump(context.exit_site, block);
+    } while (block != NULL);
+
+    // The context goes away, the interpreter takes over again
+    functional_set_locator(machine, state);
+
+    for (int i = 0; i < 3; ++i) {
+        functional_slot_t * const slot = &state->slots[(context.cycles + i) & 3];
+
+        if (context.pending_dst[i] == &context.sink) {
+            slot->effect = EFFECT_NONE;
+        } else {
+            slot->effect = EFFECT_WRITE;
+            slot->rd = context.pending_dst[i] - registers;
+            slot->value = context.pending_value[i];
+        }
+    }
+    machine->flag = context.flag;
+    state->cycles = context.cycles;
+
+    // The last cycle of the last block still has to fetch next_pc
+    functional_slot_t * const fetch = &state->slots[(context.cycles + 3) & 3];
+    const decoded_instruction_t * const inst = &jit->decoded[context.next_pc];
+
+    registers[pc] = context.next_pc;
+    fetch->effect = EFFECT_NONE;
+
+    if (inst->opcode != OPCODE_HALT) {
+        fetch->inst = inst;
+        fetch->n_pc = ++registers[pc];
+        state->in_flight = 0xf;
+    } else {
+        fetch->inst = NULL;
+        state->in_flight = 0xe;
+        state->halts++;
+    }
+}
+
+void jit_run(rcpu_machine_t * const machine, functional_state_t * const state)
+{
+    // Blocks only check accesses if the data memory they were
+    // translated for had no guard region
+    if ((machine->jit != NULL) && (machine->jit->checked == machine->memory.guarded))
+        jit_free(machine);
+
+    if (machine->jit == NULL)
+        machine->jit = jit_create(machine);
+
+    if (machine->jit == NULL) {
+        functional_run(machine, state);
+        return;
+    }
+
+    functional_set_locator(machine, state);
+
+    for (;;) {
+        if (can_enter(state)) {
+            const functional_slot_t * const slot = &state->slots[(state->cycles + 3) & 3];
+            const uint8_t * const block = jit_lookup(machine->jit, slot->inst - machine->jit->decoded);
+
+            if (block != NULL) {
+                run_blocks(machine, state, block);
+                continue;
+            }
+        }
+
+        if (!functional_step(machine, state))
+            break;
+    }
+
+    machine_set_locator(machine, NULL, NULL);
+}
+
+#else
+
+void jit_run(rcpu_machine_t * const machine, functional_state_t * const state)
+{
+    // No code generator for this host
+    functional_run(machine, state);
+}
+
+void jit_free(rcpu_machine_t * const machine)
+{
+    // Nothing was ever allocated
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*!
+    @header Dynamic binary translation
+    The JIT translates basic blocks of the guest program into x86-64
+    code. It works on the state of the functional engine (see
+    Functional.h) and has exactly the same semantics.
+
+    A block starts at an arbitrary guest address and runs until the
+    first control flow instruction, which is translated together with
+    its two delay slots. Inside a block, the delays of the pipeline
+    are resolved at translation time: the result of an instruction is
+    written back right before the third instruction after it, unless
+    no instruction in between could tell the difference. Results still
+    pending at the end of a block are handed to the next block.
+
+    Code can never change (see memory_image_t), so translated blocks
+    are cached by guest address forever and are chained to each other
+    directly once their successor has been translated.
+
+    Everything the JIT can not translate (HALT, unknown instructions,
+    instructions accessing the PC register, control flow in delay
+    slots) is left to the interpreter, which runs until the JIT can
+    take over again.
+
+    On hosts other than x86-64, the interpreter runs the whole program.
+
+    @related Functional.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef JIT__JIT_H
+#define JIT__JIT_H
+
+#include "../Functional/Functional.h"
+
+/*!
+    @abstract
+        Runs the program until it has finished.
+    @discussion
+        The translation cache is created when the JIT runs on a machine
+        for the first time, and kept until jit_free is called.
+
+    @param machine
+        The machine the program runs on.
+    @param state
+        The state of the functional engine, which must have been
+        initialized using functional_init.
+*/
+void jit_run(rcpu_machine_t * const machine, functional_state_t * const state);
+
+/*!
+    @abstract
+        Releases the translation cache of a machine, if there is one.
+
+    @param machine
+        The machine whose translated blocks are released.
+*/
+void jit_free(rcpu_machine_t * const machine);
+
+#endif /* JIT__JIT_H */
@@ -0,0 +1,216 @@
+#ifdef __linux__
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+#endif
+
+#include "X86Emitter.h"
+
+#include <sys/mman.h>
+#include <string.h>  // memcpy
+#include <assert.h>
+
+bool code_buffer_init(code_buffer_t * const buffer, const size_t size)
+{
+    void * const start = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (start == MAP_FAILED)
+        return false;
+
+    buffer->start = start;
+    buffer->cursor = start;
+    buffer->end = buffer->start + size;
+    return true;
+}
+
+void code_buffer_free(code_buffer_t * const buffer)
+{
+    munmap(buffer->start, buffer->end - buffer->start);
+    buffer->start = buffer->cursor = buffer->end = NULL;
+}
+
+bool code_buffer_has_room(const code_buffer_t * const buffer, const size_t size)
+{
+    return (size_t)(buffer->end - buffer->cursor) >= size;
+}
+
+#pragma mark Raw data
+
+void x86_emit_u8(code_buffer_t * const buffer, const uint8_t value)
+{
+    assert((buffer->cursor < buffer->end) && "Code buffer overflow.");
+    *buffer->cursor++ = value;
+}
+
+void x86_emit_u32(code_buffer_t * const buffer, const uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        x86_emit_u8(buffer, (value >> (8 * i)) & 0xff);
+}
+
+void x86_emit_u64(code_buffer_t * const buffer, const uint64_t value)
+{
+    x86_emit_u32(buffer, value & 0xffffffff);
+    x86_emit_u32(buffer, value >> 32);
+}
+
+#pragma mark Generic encodings
+
+/*
+    Emits the REX prefix, if one is needed.
+*/
+static void emit_rex(code_buffer_t * const buffer, const bool wide,
+                     const unsigned int reg, const unsigned int index, const unsigned int base)
+{
+    const uint8_t rex = 0x40
+                      | (wide ? 0x8 : 0)
+                      | ((reg & 8) >> 1)
+                      | ((index & 8) >> 2)
+                      | ((base & 8) >> 3);
+
+    if (rex != 0x40)
+        x86_emit_u8(buffer, rex);
+}
+
+static void emit_opcode(code_buffer_t * const buffer, const uint16_t opcode)
+{
+    if (opcode > 0xff)
+        x86_emit_u8(buffer, opcode >> 8);
+    x86_emit_u8(buffer, opcode & 0xff);
+}
+
+void x86_emit_mem(code_buffer_t * const buffer, const bool wide, const uint16_t opcode,
+                  const unsigned int reg, const x86_register_t base, const int32_t disp)
+{
+    emit_rex(buffer, wide, reg, 0, base);
+    emit_opcode(buffer, opcode);
+
+    // mod = 10: [base + disp32]
+    x86_emit_u8(buffer, 0x80 | ((reg & 7) << 3) | (base & 7));
+
+    // RSP and R12 can only be used as base with a SIB byte
+    if ((base & 7) == RSP)
+        x86_emit_u8(buffer, 0x24);
+
+    x86_emit_u32(buffer, (uint32_t)disp);
+}
+
+void x86_emit_reg(code_buffer_t * const buffer, const bool wide, const uint16_t opcode,
+                  const unsigned int reg, const x86_register_t rm)
+{
+    emit_rex(buffer, wide, reg, 0, rm);
+    emit_opcode(buffer, opcode);
+
+    // mod = 11: register operand
+    x86_emit_u8(buffer, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+#pragma mark Instructions
+
+void x86_load32(code_buffer_t * const buffer, const x86_register_t dst,
+                const x86_register_t base, const int32_t disp)
+{
+    x86_emit_mem(buffer, false, 0x8b, dst, base, disp);
+}
+
+void x86_store32(code_buffer_t * const buffer, const x86_register_t base,
+                 const int32_t disp, const x86_register_t src)
+{
+    x86_emit_mem(buffer, false, 0x89, src, base, disp);
+}
+
+void x86_load64(code_buffer_t * const buffer, const x86_register_t dst,
+                const x86_register_t base, const int32_t disp)
+{
+    x86_emit_mem(buffer, true, 0x8b, dst, base, disp);
+}
+
+void x86_store64(code_buffer_t * const buffer, const x86_register_t base,
+                 const int32_t disp, const x86_register_t src)
+{
+    x86_emit_mem(buffer, true, 0x89, src, base, disp);
+}
+
+void x86_load_indexed(code_buffer_t * const buffer, const bool wide, const x86_register_t dst,
+                      const x86_register_t base, const x86_register_t index)
+{
+    assert(((index & 7) != RSP) && "RSP can not be used as index.");
+
+    emit_rex(buffer, wide, dst, index, base);
+    x86_emit_u8(buffer, 0x8b);
+
+    // mod = 01 with a zero disp8, because RBP and R13 can not be
+    // used as base with mod = 00
+    x86_emit_u8(buffer, 0x44 | ((dst & 7) << 3));
+    x86_emit_u8(buffer, (wide ? 0xc0 : 0x80) | ((index & 7) << 3) | (base & 7));
+    x86_emit_u8(buffer, 0);
+}
+
+void x86_mov_imm32(code_buffer_t * const buffer, const x86_register_t dst, const uint32_t imm)
+{
+    emit_rex(buffer, false, 0, 0, dst);
+    x86_emit_u8(buffer, 0xb8 | (dst & 7));
+    x86_emit_u32(buffer, imm);
+}
+
+void x86_mov_imm64(code_buffer_t * const buffer, const x86_register_t dst, const uint64_t imm)
+{
+    emit_rex(buffer, true, 0, 0, dst);
+    x86_emit_u8(buffer, 0xb8 | (dst & 7));
+    x86_emit_u64(buffer, imm);
+}
+
+void x86_alu_mem(code_buffer_t * const buffer, const x86_alu_t op, const x86_register_t dst,
+                 const x86_register_t base, const int32_t disp)
+{
+    // op r32, r/m32 is encoded as (op << 3) | 3
+    x86_emit_mem(buffer, false, (op << 3) | 3, dst, base, disp);
+}
+
+void x86_alu_imm(code_buffer_t * const buffer, const x86_alu_t op, const x86_register_t dst,
+                 const uint32_t imm)
+{
+    x86_emit_reg(buffer, false, 0x81, op, dst);
+    x86_emit_u32(buffer, imm);
+}
+
+void x86_shift_imm(code_buffer_t * const buffer, const x86_shift_t op, const x86_register_t dst,
+                   const uint8_t count)
+{
+    x86_emit_reg(buffer, false, 0xc1, op, dst);
+    x86_emit_u8(buffer, count);
+}
+
+uint8_t * x86_jmp(code_buffer_t * const buffer, const uint8_t * const target)
+{
+    uint8_t * const jump = buffer->cursor;
+
+    x86_emit_u8(buffer, 0xe9);
+    x86_emit_u32(buffer, 0);
+
+    if (target != NULL)
+        x86_patch_jump(jump, target);
+
+    return jump;
+}
+
+uint8_t * x86_jcc(code_buffer_t * const buffer, const x86_condition_t cc, const uint8_t * const target)
+{
+    uint8_t * const jump = buffer->cursor;
+
+    x86_emit_u8(buffer, 0x0f);
+    x86_emit_u8(buffer, 0x80 | cc);
+    x86_emit_u32(buffer, 0);
+
+    if (target != NULL)
+        x86_patch_jump(jump, target);
+
+    return jump;
+}
+
+void x86_patch_jump(uint8_t * const jump, const uint8_t * const target)
+{
+    // jmp rel32 is one byte long, jcc rel32 two bytes
+    uint8_t * const displacement = jump + ((jump[0] == 0x0f) ? 2 : 1);
+    const int32_t rel = (int32_t)(target - (displacement + 4));
+
+    memcpy(displacement, &rel, sizeof(rel));
+}
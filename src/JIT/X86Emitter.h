@@ -0,0 +1,211 @@
+/*!
+    @header x86-64 code emitter
+    A tiny assembler for the handful of x86-64 instructions the JIT
+    needs. Instructions are appended to a code buffer, which is
+    mapped readable, writable and executable.
+
+    Memory operands are always of the form [base + disp32].
+
+    @related JIT.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef JIT__X86EMITTER_H
+#define JIT__X86EMITTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*!
+    @abstract
+        A buffer holding generated machine code.
+*/
+typedef struct code_buffer {
+    uint8_t * start;
+    uint8_t * cursor;   // where the next instruction is emitted
+    uint8_t * end;
+} code_buffer_t;
+
+/*!
+    @abstract
+        General purpose registers, numbered as in their encoding.
+*/
+typedef enum {
+    RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+} x86_register_t;
+
+/*!
+    @abstract
+        Arithmetic operations sharing the classic 0x81 /n encoding.
+*/
+typedef enum {
+    X86_ADD = 0,
+    X86_OR  = 1,
+    X86_AND = 4,
+    X86_SUB = 5,
+    X86_CMP = 7
+} x86_alu_t;
+
+/*!
+    @abstract
+        Shift operations of the 0xC1 /n encoding.
+*/
+typedef enum {
+    X86_SHL = 4,
+    X86_SHR = 5,
+    X86_SAR = 7
+} x86_shift_t;
+
+/*!
+    @abstract
+        Condition codes, as used by jcc, setcc and cmovcc.
+*/
+typedef enum {
+    X86_CC_B  = 0x2,    // unsigned <
+    X86_CC_AE = 0x3,    // unsigned >=
+    X86_CC_E  = 0x4,
+    X86_CC_NE = 0x5,
+    X86_CC_A  = 0x7,    // unsigned >
+    X86_CC_L  = 0xC,    // signed <
+    X86_CC_G  = 0xF     // signed >
+} x86_condition_t;
+
+/*!
+    @abstract
+        Maps a new executable code buffer.
+
+    @param buffer
+        The buffer to initialize.
+    @param size
+        The size of the buffer in bytes.
+
+    @return
+        true on success.
+*/
+bool code_buffer_init(code_buffer_t * const buffer, const size_t size);
+
+/*!
+    @abstract
+        Releases the memory of a buffer initialized using code_buffer_init.
+*/
+void code_buffer_free(code_buffer_t * const buffer);
+
+/*!
+    @abstract
+        Checks whether at least size more bytes fit into the buffer.
+*/
+bool code_buffer_has_room(const code_buffer_t * const buffer, const size_t size);
+
+#pragma mark Raw data
+
+void x86_emit_u8(code_buffer_t * const buffer, const uint8_t value);
+void x86_emit_u32(code_buffer_t * const buffer, const uint32_t value);
+void x86_emit_u64(code_buffer_t * const buffer, const uint64_t value);
+
+#pragma mark Generic encodings
+
+/*!
+    @abstract
+        Emits an instruction with a memory operand [base + disp].
+
+    @param wide
+        true for 64 bit operands (REX.W)
+    @param opcode
+        The opcode. Opcodes greater than 0xff are emitted as two
+        bytes, e.g. 0x0fb6 for movzx.
+    @param reg
+        The register operand or the opcode extension.
+    @param base
+        The base register of the memory operand.
+    @param disp
+        The displacement of the memory operand.
+*/
+void x86_emit_mem(code_buffer_t * const buffer, const bool wide, const uint16_t opcode,
+                  const unsigned int reg, const x86_register_t base, const int32_t disp);
+
+/*!
+    @abstract
+        Emits an instruction with two register operands.
+
+    @param reg
+        The register encoded in the reg field of ModRM, or the
+        opcode extension.
+    @param rm
+        The register encoded in the rm field of ModRM.
+
+    @see x86_emit_mem
+*/
+void x86_emit_reg(code_buffer_t * const buffer, const bool wide, const uint16_t opcode,
+                  const unsigned int reg, const x86_register_t rm);
+
+#pragma mark Instructions
+
+// mov dst, [base + disp] (32 bit)
+void x86_load32(code_buffer_t * const buffer, const x86_register_t dst,
+                const x86_register_t base, const int32_t disp);
+
+// mov [base + disp], src (32 bit)
+void x86_store32(code_buffer_t * const buffer, const x86_register_t base,
+                 const int32_t disp, const x86_register_t src);
+
+// mov dst, [base + disp] (64 bit)
+void x86_load64(code_buffer_t * const buffer, const x86_register_t dst,
+                const x86_register_t base, const int32_t disp);
+
+// mov [base + disp], src (64 bit)
+void x86_store64(code_buffer_t * const buffer, const x86_register_t base,
+                 const int32_t disp, const x86_register_t src);
+
+// mov dst, [base + index * scale] for scale 4 (32 bit) or 8 (64 bit)
+void x86_load_indexed(code_buffer_t * const buffer, const bool wide, const x86_register_t dst,
+                      const x86_register_t base, const x86_register_t index);
+
+// mov dst, imm32
+void x86_mov_imm32(code_buffer_t * const buffer, const x86_register_t dst, const uint32_t imm);
+
+// mov dst, imm64
+void x86_mov_imm64(code_buffer_t * const buffer, const x86_register_t dst, const uint64_t imm);
+
+// op dst, [base + disp] (32 bit)
+void x86_alu_mem(code_buffer_t * const buffer, const x86_alu_t op, const x86_register_t dst,
+                 const x86_register_t base, const int32_t disp);
+
+// op dst, imm32 (32 bit)
+void x86_alu_imm(code_buffer_t * const buffer, const x86_alu_t op, const x86_register_t dst,
+                 const uint32_t imm);
+
+// shift dst, count (32 bit)
+void x86_shift_imm(code_buffer_t * const buffer, const x86_shift_t op, const x86_register_t dst,
+                   const uint8_t count);
+
+/*!
+    @abstract
+        Emits a jump with a 32 bit displacement.
+
+    @param target
+        The target of the jump. NULL leaves the displacement 0,
+        so the jump initially falls through.
+
+    @return
+        The address of the jump, to be used with x86_patch_jump.
+*/
+uint8_t * x86_jmp(code_buffer_t * const buffer, const uint8_t * const target);
+
+/*!
+    @abstract
+        Emits a conditional jump with a 32 bit displacement.
+
+    @see x86_jmp
+*/
+uint8_t * x86_jcc(code_buffer_t * const buffer, const x86_condition_t cc, const uint8_t * const target);
+
+/*!
+    @abstract
+        Changes the target of a jump emitted by x86_jmp or x86_jcc.
+*/
+void x86_patch_jump(uint8_t * const jump, const uint8_t * const target);
+
+#endif /* JIT__X86EMITTER_H */
@@ -0,0 +1,1397 @@
+#define _DEFAULT_SOURCE // sigjmp_buf, pthread_sigmask, must precede all includes
+#include "rcpu.h"
+
+#include "../Machine/Machine.h"
+#include "../Pipeline/Pipeline.h"
+#include "../Pipeline/PipelineState.h"
+#include "../Functional/Functional.h"
+#include "../Functional/Threaded.h"
+#include "../JIT/JIT.h"
+#include "../Tiered/Tiered.h"
+#include "../Functional/Transfer.h"
+#include "../Lockstep/Lockstep.h"
+#include "../Checkpoint/Checkpoint.h"
+
+#include "../Instruction/BasicBlock.h"
+#include "../Instruction/Disassemble.h"
+#include "../Instruction/Fusion.h"
+
+#include <assert.h> // assert
+#include <pthread.h> // pthread_sigmask
+#include <setjmp.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h> // memcpy
+#include <strings.h> // bzero
+#include <unistd.h> // close
+
+// Default number of iterations after which a loop is hot
+#define DEFAULT_HOT_THRESHOLD 1000
+
+struct rcpu {
+    rcpu_machine_t machine;
+    rcpu_options_t options;
+
+    // Only the state of the engine in use is ever touched
+    pipeline_state_t pipeline;
+    functional_state_t functional;
+    tiered_statistics_t tiers;
+
+    uint64_t cycles;
+    bool loaded;
+    bool running;
+
+    // Set once an access has faulted, which stops the program for good
+    bool faulted;
+    rcpu_fault_t fault;
+
+    // True if superinstructions have been fused into the code image,
+    // which only the threaded engine can run
+    bool fused;
+
+    // False once the tiered engine has run, which does not
+    // keep the pipeline up to date
+    bool latches_valid;
+
+    // True if the program has been run by another engine working on
+    // the state of the functional engine, but not handed back yet
+    bool in_functional;
+
+    // True if a restored program is still held by the pipeline latches
+    // although the engine works on the state of the functional engine,
+    // so it stays exactly as restored until it is run
+    bool in_latches;
+
+    // The last checkpoint saved, restored or applied, if any, which
+    // the next delta checkpoint is based on
+    checkpoint_base_t base;
+    bool has_base;
+
+    // The store trace while the program replays cycles after going
+    // back, up to the last cycle whose STOREs are traced already
+    store_trace_t * replayed_trace;
+    uint64_t traced_cycles;
+};
+
+_Static_assert(RCPU_LOCKSTEP_LANES == LOCKSTEP_LANES, "Lockstep lanes do not match.");
+_Static_assert(RCPU_PAGE_WORDS == MACHINE_PAGE_WORDS, "Pages do not match.");
+_Static_assert(RCPU_MAX_DATA_SIZE == MACHINE_MAX_DATA_SIZE, "Data memory sizes do not match.");
+_Static_assert(RCPU_FAULT_REPORT == MACHINE_FAULT_REPORT, "Fault reports do not match.");
+
+/*
+    Returns true iff an engine works on the state of the pipeline
+    rather than on the state of the functional engine.
+*/
+static bool uses_pipeline(const rcpu_engine_t engine)
+{
+    return (engine == RCPU_ENGINE_PIPELINE) || (engine == RCPU_ENGINE_TIERED);
+}
+
+rcpu_options_t rcpu_default_options(void)
+{
+    return (rcpu_options_t){
+        .engine = RCPU_ENGINE_PIPELINE,
+        .fuse = false,
+        .hot_threshold = DEFAULT_HOT_THRESHOLD,
+        .data_size = MACHINE_DEFAULT_DATA_SIZE
+    };
+}
+
+rcpu_t * rcpu_create(const rcpu_options_t * const options)
+{
+    // The register bank of the machine starts on a cache line
+    rcpu_t * const rcpu = aligned_alloc(_Alignof(rcpu_t), sizeof(rcpu_t));
+    if (rcpu == NULL)
+        return NULL;
+
+    bzero(rcpu, sizeof(*rcpu));
+    machine_init(&rcpu->machine);
+    pipeline_init(&rcpu->pipeline);
+    functional_init(&rcpu->functional);
+
+    rcpu->options = (options != NULL) ? *options : rcpu_default_options();
+    rcpu->latches_valid = uses_pipeline(rcpu->options.engine);
+
+    return rcpu;
+}
+
+void rcpu_destroy(rcpu_t * const rcpu)
+{
+    if (rcpu == NULL)
+        return;
+
+    rcpu_stop_tracing_stores(rcpu);
+    machine_free(&rcpu->machine);
+    free(rcpu->tiers.loops);
+    free(rcpu);
+}
+
+/*
+    Prepares a machine whose code has just been loaded for running.
+*/
+static void finish_loading(rcpu_t * const rcpu)
+{
+    const memory_image_t * const memory = &rcpu->machine.memory;
+
+    // Only the threaded engine knows about superinstructions
+    if (rcpu->options.fuse && (rcpu->options.engine == RCPU_ENGINE_THREADED)) {
+        instruction_fuse_program(memory->decoded, memory->code_size / sizeof(*memory->code));
+        rcpu->fused = true;
+    }
+
+    rcpu->loaded = true;
+    rcpu->running = true;
+}
+
+int rcpu_load_code(rcpu_t * const rcpu, const uint32_t * const code, const size_t ninstructions)
+{
+    if (rcpu->loaded)
+        return -1;
+
+    uint32_t * const copy = malloc(ninstructions * sizeof(*code));
+    if (copy == NULL)
+        return -1;
+
+    memcpy(copy, code, ninstructions * sizeof(*code));
+
+    if (machine_load_code(&rcpu->machine, copy, ninstructions, rcpu->options.data_size) != 0)
+        return -1;
+
+    finish_loading(rcpu);
+    return 0;
+}
+
+int rcpu_load_file(rcpu_t * const rcpu, const char * const path, const rcpu_format_t format)
+{
+    if (rcpu->loaded)
+        return -1;
+
+    const LOAD_OPTION option = (format == RCPU_FORMAT_TEXTUAL) ? OPT_TEXTUAL : OPT_BINARY;
+
+    const int error = machine_load_program(&rcpu->machine, option, path, rcpu->options.data_size);
+    if (error != 0)
+        return error;
+
+    finish_loading(rcpu);
+    return 0;
+}
+
+int rcpu_write_data(rcpu_t * const rcpu, const uint32_t address,
+                    const uint32_t * const words, const size_t nwords)
+{
+    if (!rcpu->loaded)
+        return -1;
+
+    const memory_image_t * const memory = &rcpu->machine.memory;
+    const size_t size = memory->data_size / sizeof(*memory->data);
+
+    if ((address > size) || (nwords > size - address))
+        return -1;
+
+    memcpy(&memory->data[address], words, nwords * sizeof(*words));
+    machine_mark_dirty(&rcpu->machine, address, nwords);
+    return 0;
+}
+
+int rcpu_load_data_file(rcpu_t * const rcpu, const char * const path, const rcpu_format_t format)
+{
+    uint32_t * words;
+    size_t size;
+
+    const LOAD_OPTION option = (format == RCPU_FORMAT_TEXTUAL) ? OPT_TEXTUAL : OPT_BINARY;
+
+    const int error = load_program_from_path(option, path, &words, &size);
+    if (error != 0)
+        return error;
+
+    const int result = rcpu_write_data(rcpu, 0, words, size / sizeof(*words));
+    free(words);
+
+    return result;
+}
+
+int rcpu_map_data_image(rcpu_t * const rcpu, const char * const path)
+{
+    if (!rcpu->loaded)
+        return -1;
+
+    // Deltas only cover dirty pages, which the image is not part of
+    rcpu->has_base = false;
+
+    return machine_map_data(&rcpu->machine, path);
+}
+
+int rcpu_dump_data(const rcpu_t * const rcpu, const char * const path, const bool dirty_only)
+{
+    if (!rcpu->loaded)
+        return -1;
+
+    return machine_dump_data(&rcpu->machine, path, dirty_only);
+}
+
+#pragma mark Running
+
+/*
+    Returns true iff the program is held by the pipeline rather than
+    by the state of the functional engine.
+*/
+static bool in_pipeline(const rcpu_t * const rcpu)
+{
+    return rcpu->in_latches
+           || (uses_pipeline(rcpu->options.engine) && rcpu->latches_valid && !rcpu->in_functional);
+}
+
+/*
+    Hands a restored program held by the pipeline latches to the
+    functional engine, before it is first run.
+*/
+static void leave_latches(rcpu_t * const rcpu)
+{
+    if (!rcpu->in_latches)
+        return;
+
+    // Always possible, unlike the other way round
+    transfer_to_functional(&rcpu->machine, &rcpu->pipeline, &rcpu->functional);
+    rcpu->in_latches = false;
+}
+
+/*
+    Returns true iff the instruction at address is fetched during the
+    next cycle, i.e. the PC holds it and nothing in flight is about to
+    change the PC before.
+*/
+static bool fetches_next(const rcpu_t * const rcpu, const uint32_t address)
+{
+    if (rcpu->machine.registers[pc] != address)
+        return false;
+
+    if (in_pipeline(rcpu)) {
+        const ex_result_t * const executed = pipeline_ex_mem(&rcpu->pipeline);
+        const mem_result_t * const accessed = pipeline_mem_wb(&rcpu->pipeline);
+
+        return ((executed == NULL) || !executed->branch_taken)
+               && ((accessed == NULL) || !instruction_writes_register(accessed->inst)
+                   || (accessed->inst->rd != pc));
+    }
+
+    const functional_state_t * const state = &rcpu->functional;
+    const functional_slot_t * const wb = &state->slots[state->cycles & 3];
+
+    return (state->slots[(state->cycles + 1) & 3].effect != EFFECT_BRANCH)
+           && ((wb->effect != EFFECT_WRITE) || (wb->rd != pc));
+}
+
+/*
+    Returns true iff a run should stop before the next cycle, as the
+    instruction at stop, if any, is fetched next.
+*/
+static bool reached(const rcpu_t * const rcpu, const uint32_t * const stop)
+{
+    return (stop != NULL) && fetches_next(rcpu, *stop);
+}
+
+/*
+    Runs the functional engine until the pipeline can take over again,
+    if a program has been run in lockstep before.
+    Returns false if the program has finished.
+*/
+static bool return_to_pipeline(rcpu_t * const rcpu, const uint64_t end_cycle, const uint32_t * const stop)
+{
+    bool running = true;
+    functional_set_locator(&rcpu->machine, &rcpu->functional);
+
+    while (rcpu->in_functional && running && (rcpu->functional.cycles < end_cycle) && !reached(rcpu, stop)) {
+        if (transfer_to_pipeline(&rcpu->machine, &rcpu->functional, &rcpu->pipeline))
+            rcpu->in_functional = false;
+        else
+            running = functional_step(&rcpu->machine, &rcpu->functional);
+    }
+
+    machine_set_locator(&rcpu->machine, NULL, NULL);
+
+    rcpu->cycles = rcpu->in_functional ? rcpu->functional.cycles : rcpu->pipeline.cycles;
+    return running;
+}
+
+/*
+    Runs the pipeline until it has finished, end_cycle has been reached
+    or the instruction at stop, if any, is fetched next.
+*/
+static bool run_pipeline(rcpu_t * const rcpu, const uint64_t end_cycle, const uint32_t * const stop)
+{
+    pipeline_state_t * const state = &rcpu->pipeline;
+
+    if (!return_to_pipeline(rcpu, end_cycle, stop) || rcpu->in_functional)
+        return rcpu->functional.in_flight != 0;
+
+    const pipeline_step_t step = pipeline_select_step(&rcpu->machine);
+    bool running = true;
+    pipeline_set_locator(&rcpu->machine, state);
+
+    while (running && (state->cycles < end_cycle) && !reached(rcpu, stop)) {
+        // Runs of NOPs are only skipped up to stop
+        uint64_t skip = end_cycle - state->cycles;
+        if ((stop != NULL) && ((uint32_t)(*stop - rcpu->machine.registers[pc]) < skip))
+            skip = (uint32_t)(*stop - rcpu->machine.registers[pc]);
+
+        running = (pipeline_skip_nops(&rcpu->machine, state, skip) > 0)
+                  || step(&rcpu->machine, state);
+    }
+
+    machine_set_locator(&rcpu->machine, NULL, NULL);
+    rcpu->cycles = state->cycles;
+    return running;
+}
+
+/*
+    Runs the functional engine until it has finished, end_cycle has been
+    reached or the instruction at stop, if any, is fetched next.
+*/
+static bool run_functional(rcpu_t * const rcpu, const uint64_t end_cycle, const uint32_t * const stop)
+{
+    functional_state_t * const state = &rcpu->functional;
+
+    const functional_step_t step = functional_select_step(&rcpu->machine);
+    bool running = true;
+    functional_set_locator(&rcpu->machine, state);
+
+    while (running && (state->cycles < end_cycle) && !reached(rcpu, stop))
+        running = step(&rcpu->machine, state);
+
+    machine_set_locator(&rcpu->machine, NULL, NULL);
+    rcpu->cycles = state->cycles;
+    return running;
+}
+
+/*
+    Runs the threaded interpreter until it has finished, end_cycle has
+    been reached or the instruction at stop, if any, is fetched next.
+*/
+static bool run_threaded(rcpu_t * const rcpu, const uint64_t end_cycle, const uint32_t * const stop)
+{
+    functional_state_t * const state = &rcpu->functional;
+
+    // The range of all addresses but stop. It is also left once the PC
+    // holds stop but is about to change, so it is entered again then.
+    const uint32_t first = (stop != NULL) ? *stop + 1 : 0;
+    const uint32_t last = (stop != NULL) ? *stop - 1 : UINT32_MAX;
+
+    bool running = true;
+    while (running && (state->cycles < end_cycle) && !reached(rcpu, stop)) {
+        threaded_run_range(&rcpu->machine, state, first, last, end_cycle);
+        running = (state->in_flight != 0);
+    }
+
+    rcpu->cycles = state->cycles;
+    return running;
+}
+
+/*
+    Stops a machine whose engine has returned to its recovery point,
+    as one of its accesses faulted (see machine_set_recovery). Returns
+    false, as the program can not be run any further.
+*/
+static bool stop_faulted(rcpu_t * const rcpu)
+{
+    rcpu_machine_t * const machine = &rcpu->machine;
+
+    machine_set_recovery(machine, NULL);
+    rcpu->running = false;
+
+    if (machine->faulted) {
+        rcpu->faulted = true;
+        rcpu->fault = (rcpu_fault_t){
+            .address = machine->fault.address,
+            .cycle = machine->fault.cycle,
+            .word = machine->fault.word,
+            .store = machine->fault.store
+        };
+        memcpy(rcpu->fault.report, machine->fault.report, sizeof(rcpu->fault.report));
+    }
+
+    return false;
+}
+
+/*
+    Unblocks SIGSEGV once a fault has returned to a recovery point,
+    which does not restore the signal mask to save a system call on
+    every run.
+*/
+static void unblock_faults(void)
+{
+    sigset_t faults;
+    sigemptyset(&faults);
+    sigaddset(&faults, SIGSEGV);
+
+    pthread_sigmask(SIG_UNBLOCK, &faults, NULL);
+}
+
+/*
+    Runs a program like rcpu_run, but stops before the instruction at
+    stop is fetched, unless stop is NULL.
+*/
+static bool run_engine(rcpu_t * const rcpu, const uint64_t max_cycles, const uint32_t * const stop)
+{
+    if (!rcpu->running || (max_cycles == 0))
+        return rcpu->running;
+
+    sigjmp_buf recovery;
+    if (sigsetjmp(recovery, 0) != 0) {
+        unblock_faults();
+        return stop_faulted(rcpu);
+    }
+
+    machine_set_recovery(&rcpu->machine, &recovery);
+
+    const bool until_halt = (max_cycles == RCPU_RUN_UNTIL_HALT)
+                            || (max_cycles > UINT64_MAX - rcpu->cycles);
+    const uint64_t end_cycle = until_halt ? UINT64_MAX : rcpu->cycles + max_cycles;
+
+    leave_latches(rcpu);
+
+    switch (rcpu->options.engine) {
+        case RCPU_ENGINE_PIPELINE:
+            rcpu->running = run_pipeline(rcpu, end_cycle, stop);
+            break;
+        case RCPU_ENGINE_FUNCTIONAL:
+            rcpu->running = run_functional(rcpu, end_cycle, stop);
+            break;
+        case RCPU_ENGINE_THREADED:
+            rcpu->running = run_threaded(rcpu, end_cycle, stop);
+            break;
+        case RCPU_ENGINE_JIT:
+            // Translated blocks can not stop at an arbitrary cycle or address
+            if (until_halt && (stop == NULL)) {
+                jit_run(&rcpu->machine, &rcpu->functional);
+                rcpu->cycles = rcpu->functional.cycles;
+                rcpu->running = false;
+            } else {
+                rcpu->running = run_threaded(rcpu, end_cycle, stop);
+            }
+            break;
+        case RCPU_ENGINE_TIERED:
+            // Neither can hot loops
+            if (!return_to_pipeline(rcpu, end_cycle, stop) || rcpu->in_functional) {
+                rcpu->running = (rcpu->functional.in_flight != 0);
+            } else if (until_halt && (stop == NULL)) {
+                rcpu->cycles = tiered_run(&rcpu->machine, &rcpu->pipeline,
+                                          rcpu->options.hot_threshold, &rcpu->tiers);
+                rcpu->running = false;
+                rcpu->latches_valid = false;
+            } else {
+                rcpu->running = run_pipeline(rcpu, end_cycle, stop);
+            }
+            break;
+    }
+
+    machine_set_recovery(&rcpu->machine, NULL);
+    return rcpu->running;
+}
+
+/*
+    Runs a program like run_engine. Cycles replayed after going back
+    run without the store trace, which has their STOREs already, and
+    it is attached again once the program has caught up.
+*/
+static bool run(rcpu_t * const rcpu, uint64_t max_cycles, const uint32_t * const stop)
+{
+    if (rcpu->replayed_trace == NULL)
+        return run_engine(rcpu, max_cycles, stop);
+
+    if (rcpu->cycles < rcpu->traced_cycles) {
+        const uint64_t replayed = rcpu->traced_cycles - rcpu->cycles;
+
+        if (max_cycles <= replayed)
+            return run_engine(rcpu, max_cycles, stop);
+
+        if (!run_engine(rcpu, replayed, stop) || (rcpu->cycles < rcpu->traced_cycles))
+            return rcpu->running;
+
+        if (max_cycles != RCPU_RUN_UNTIL_HALT)
+            max_cycles -= replayed;
+    }
+
+    rcpu->machine.trace = rcpu->replayed_trace;
+    rcpu->replayed_trace = NULL;
+
+    return run_engine(rcpu, max_cycles, stop);
+}
+
+bool rcpu_run(rcpu_t * const rcpu, const uint64_t max_cycles)
+{
+    return run(rcpu, max_cycles, NULL);
+}
+
+const rcpu_fault_t * rcpu_fault(const rcpu_t * const rcpu)
+{
+    return rcpu->faulted ? &rcpu->fault : NULL;
+}
+
+bool rcpu_run_profiled(rcpu_t * const rcpu, const uint64_t max_cycles, rcpu_profile_t * const profile)
+{
+    if ((rcpu->options.engine != RCPU_ENGINE_PIPELINE) || !rcpu->running || (max_cycles == 0))
+        return rcpu->running && (rcpu->options.engine == RCPU_ENGINE_PIPELINE);
+
+    const uint64_t end_cycle = (max_cycles > UINT64_MAX - rcpu->cycles) ? UINT64_MAX
+                                                                        : rcpu->cycles + max_cycles;
+    pipeline_state_t * const state = &rcpu->pipeline;
+
+    sigjmp_buf recovery;
+    if (sigsetjmp(recovery, 0) != 0) {
+        unblock_faults();
+        return stop_faulted(rcpu);
+    }
+
+    machine_set_recovery(&rcpu->machine, &recovery);
+
+    if (!return_to_pipeline(rcpu, end_cycle, NULL) || rcpu->in_functional) {
+        machine_set_recovery(&rcpu->machine, NULL);
+        rcpu->running = (rcpu->functional.in_flight != 0);
+        return rcpu->running;
+    }
+
+    pipeline_profile_t counted = { 0 };
+
+    bool running = true;
+    pipeline_set_locator(&rcpu->machine, state);
+
+    while (running && (state->cycles < end_cycle))
+        running = pipeline_step_profiled(&rcpu->machine, state, &counted);
+
+    machine_set_locator(&rcpu->machine, NULL, NULL);
+    machine_set_recovery(&rcpu->machine, NULL);
+    rcpu->cycles = state->cycles;
+    rcpu->running = running;
+
+    profile->cycles += counted.cycles;
+    profile->instructions += counted.instructions;
+    profile->nops += counted.nops;
+    profile->bubbles += counted.bubbles;
+    profile->loads += counted.loads;
+    profile->stores += counted.stores;
+    profile->branches += counted.branches;
+
+    return running;
+}
+
+/*
+    Returns the number of instructions other than HALT fetched so far.
+    It is reset along with the cycle counter by restoring a checkpoint,
+    so only the difference between two calls is meaningful.
+*/
+static uint64_t fetched_instructions(const rcpu_t * const rcpu)
+{
+    if (in_pipeline(rcpu))
+        return rcpu->pipeline.cycles - rcpu->pipeline.halts;
+
+    return rcpu->functional.cycles - rcpu->functional.halts;
+}
+
+bool rcpu_run_until(rcpu_t * const rcpu, const rcpu_until_t until, const uint64_t value)
+{
+    switch (until) {
+        case RCPU_UNTIL_CYCLE:
+            return (value > rcpu->cycles) ? rcpu_run(rcpu, value - rcpu->cycles) : rcpu->running;
+
+        case RCPU_UNTIL_ADDRESS:
+            {
+                if (value > UINT32_MAX)
+                    return rcpu_run(rcpu, RCPU_RUN_UNTIL_HALT);
+
+                const uint32_t address = (uint32_t)value;
+                return run(rcpu, RCPU_RUN_UNTIL_HALT, &address);
+            }
+
+        case RCPU_UNTIL_INSTRUCTIONS:
+            {
+                // At most one instruction is fetched per cycle, so running
+                // as many cycles as instructions are left never overshoots
+                uint64_t fetched = 0;
+
+                while (rcpu->running && (fetched < value)) {
+                    const uint64_t before = fetched_instructions(rcpu);
+
+                    rcpu_run(rcpu, value - fetched);
+                    fetched += fetched_instructions(rcpu) - before;
+                }
+
+                return rcpu->running;
+            }
+    }
+
+    return rcpu->running;
+}
+
+int rcpu_switch_engine(rcpu_t * const rcpu, const rcpu_engine_t engine)
+{
+    if (!rcpu->loaded || rcpu->fused)
+        return -1;
+
+    const bool from_pipeline = uses_pipeline(rcpu->options.engine);
+    rcpu->options.engine = engine;
+
+    // The pipeline and the tiered engine share their state
+    if (from_pipeline == uses_pipeline(engine))
+        return 0;
+
+    if (from_pipeline) {
+        // Drained into the functional engine once run, which is always possible
+        if (rcpu->in_functional)
+            rcpu->in_functional = false;
+        else if (rcpu->latches_valid)
+            rcpu->in_latches = true;
+
+        rcpu->latches_valid = false;
+    } else {
+        // Filled once the pipeline can take over, just as after running in lockstep
+        if (rcpu->in_latches)
+            rcpu->in_latches = false;
+        else
+            rcpu->in_functional = true;
+
+        rcpu->latches_valid = true;
+    }
+
+    return 0;
+}
+
+/*
+    Runs up to LOCKSTEP_LANES machines in lockstep, see rcpu_run_lockstep.
+    Returns the number of groups, or -1 if a machine faulted, which
+    leaves all of them stopped.
+*/
+static long run_lanes(rcpu_t * const * const rcpus, const size_t lanes, const uint64_t max_cycles)
+{
+    rcpu_machine_t * machines[LOCKSTEP_LANES];
+    functional_state_t * states[LOCKSTEP_LANES];
+
+    // All machines share the recovery point
+    sigjmp_buf recovery;
+    if (sigsetjmp(recovery, 0) != 0) {
+        unblock_faults();
+
+        for (size_t l = 0; l < lanes; ++l)
+            stop_faulted(rcpus[l]);
+
+        return -1;
+    }
+
+    for (size_t l = 0; l < lanes; ++l) {
+        leave_latches(rcpus[l]);
+        machines[l] = &rcpus[l]->machine;
+        states[l] = &rcpus[l]->functional;
+        machine_set_recovery(machines[l], &recovery);
+    }
+
+    const long groups = lockstep_run(machines, states, lanes, max_cycles);
+
+    for (size_t l = 0; l < lanes; ++l) {
+        rcpu_t * const rcpu = rcpus[l];
+
+        machine_set_recovery(&rcpu->machine, NULL);
+        rcpu->cycles = rcpu->functional.cycles;
+        rcpu->running = (rcpu->functional.in_flight != 0);
+        rcpu->in_functional = uses_pipeline(rcpu->options.engine);
+    }
+
+    return groups;
+}
+
+long rcpu_run_lockstep(rcpu_t * const * const rcpus, const size_t n, const uint64_t max_cycles)
+{
+    for (size_t i = 0; i < n; ++i) {
+        const memory_image_t * const memory = &rcpus[i]->machine.memory;
+        const memory_image_t * const first = &rcpus[0]->machine.memory;
+
+        if (!rcpus[i]->loaded || (rcpus[i]->cycles != 0) || (memory->code_size != first->code_size)
+            || (memcmp(memory->code, first->code, memory->code_size) != 0))
+            return -1;
+    }
+
+    if (max_cycles == 0)
+        return 0;
+
+    long groups = 0;
+    bool faulted = false;
+
+    for (size_t i = 0; i < n; i += LOCKSTEP_LANES) {
+        const size_t lanes = ((n - i) < LOCKSTEP_LANES) ? (n - i) : LOCKSTEP_LANES;
+        const long run = run_lanes(rcpus + i, lanes, max_cycles);
+
+        if (run < 0)
+            faulted = true;
+        else
+            groups += run;
+    }
+
+    return faulted ? -1 : groups;
+}
+
+#pragma mark Checkpoints
+
+/*
+    Picks the state of the engine holding the program, which is saved
+    along with the machine. finished is used once the program has
+    finished, as only the cycle counter is up to date after a tiered
+    run until HALT.
+*/
+static void state_to_save(const rcpu_t * const rcpu, const pipeline_state_t ** const pipeline,
+                          const functional_state_t ** const functional, functional_state_t * const finished)
+{
+    *pipeline = in_pipeline(rcpu) ? &rcpu->pipeline : NULL;
+    *functional = &rcpu->functional;
+
+    if (!rcpu->running && !in_pipeline(rcpu)) {
+        functional_init(finished);
+        finished->cycles = rcpu->cycles;
+        *functional = finished;
+    }
+}
+
+/*
+    Makes the current state the base of the next delta checkpoint.
+*/
+static void set_base(rcpu_t * const rcpu)
+{
+    rcpu->base = (checkpoint_base_t){
+        .cycles = rcpu->cycles,
+        .nstores = rcpu_memory_protocol(rcpu, NULL, 0)
+    };
+    rcpu->has_base = true;
+
+    machine_clear_dirty(&rcpu->machine);
+}
+
+/*
+    Saves a full checkpoint, or a delta if base is given.
+*/
+static int save_checkpoint(rcpu_t * const rcpu, const char * const path, const checkpoint_base_t * const base)
+{
+    const pipeline_state_t * pipeline;
+    const functional_state_t * functional;
+    functional_state_t finished;
+    state_to_save(rcpu, &pipeline, &functional, &finished);
+
+    if (checkpoint_save(path, &rcpu->machine, pipeline, functional, rcpu->running, base) != 0)
+        return -1;
+
+    set_base(rcpu);
+    return 0;
+}
+
+int rcpu_save_checkpoint(rcpu_t * const rcpu, const char * const path)
+{
+    if (!rcpu->loaded)
+        return -1;
+
+    return save_checkpoint(rcpu, path, NULL);
+}
+
+int rcpu_save_delta_checkpoint(rcpu_t * const rcpu, const char * const path)
+{
+    if (!rcpu->loaded || !rcpu->has_base)
+        return -1;
+
+    const checkpoint_base_t base = rcpu->base;
+    return save_checkpoint(rcpu, path, &base);
+}
+
+/*
+    Prepares a machine whose state has just been restored for running.
+*/
+static void finish_restoring(rcpu_t * const rcpu, const bool restored_pipeline, const bool running)
+{
+    // A delta is applied to a machine that has been prepared already
+    if (!rcpu->loaded)
+        finish_loading(rcpu);
+
+    rcpu->running = running;
+    rcpu->faulted = false;
+    rcpu->machine.faulted = false;
+    rcpu->in_functional = false;
+    rcpu->in_latches = false;
+    rcpu->latches_valid = uses_pipeline(rcpu->options.engine);
+
+    const bool wants_pipeline = in_pipeline(rcpu);
+
+    if (restored_pipeline && !wants_pipeline) {
+        // Handed to the functional engine once run, so a delta can still be applied
+        rcpu->in_latches = true;
+    } else if (!restored_pipeline && wants_pipeline) {
+        // Handed to the pipeline once possible, just as after running in lockstep
+        rcpu->in_functional = true;
+    }
+
+    rcpu->cycles = restored_pipeline ? rcpu->pipeline.cycles : rcpu->functional.cycles;
+    set_base(rcpu);
+}
+
+int rcpu_restore_checkpoint(rcpu_t * const rcpu, const char * const path, const bool map)
+{
+    if (rcpu->loaded)
+        return -1;
+
+    bool restored_pipeline, running;
+
+    if (checkpoint_restore(path, map, &rcpu->machine, &rcpu->pipeline, &rcpu->functional,
+                           &restored_pipeline, &running) != 0)
+        return -1;
+
+    finish_restoring(rcpu, restored_pipeline, running);
+    return 0;
+}
+
+int rcpu_apply_delta_checkpoint(rcpu_t * const rcpu, const char * const path)
+{
+    if (!rcpu->loaded || !rcpu->has_base)
+        return -1;
+
+    bool restored_pipeline, running;
+
+    if (checkpoint_apply(path, &rcpu->base, &rcpu->machine, &rcpu->pipeline, &rcpu->functional,
+                         &restored_pipeline, &running) != 0)
+        return -1;
+
+    finish_restoring(rcpu, restored_pipeline, running);
+    return 0;
+}
+
+#pragma mark Snapshots
+
+// A checkpoint in an anonymous file, which all forks map
+struct rcpu_snapshot {
+    int fd;
+    uint64_t cycles;
+};
+
+rcpu_snapshot_t * rcpu_snapshot_create(const rcpu_t * const rcpu)
+{
+    if (!rcpu->loaded)
+        return NULL;
+
+    rcpu_snapshot_t * const snapshot = malloc(sizeof(*snapshot));
+    if (snapshot == NULL)
+        return NULL;
+
+    const pipeline_state_t * pipeline;
+    const functional_state_t * functional;
+    functional_state_t finished;
+    state_to_save(rcpu, &pipeline, &functional, &finished);
+
+    snapshot->fd = checkpoint_save_anonymous(&rcpu->machine, pipeline, functional, rcpu->running);
+    snapshot->cycles = rcpu->cycles;
+
+    if (snapshot->fd < 0) {
+        free(snapshot);
+        return NULL;
+    }
+
+    return snapshot;
+}
+
+void rcpu_snapshot_destroy(rcpu_snapshot_t * const snapshot)
+{
+    if (snapshot == NULL)
+        return;
+
+    close(snapshot->fd);
+    free(snapshot);
+}
+
+uint64_t rcpu_snapshot_cycles(const rcpu_snapshot_t * const snapshot)
+{
+    return snapshot->cycles;
+}
+
+/*
+    Continues the program of a snapshot on a machine that has not
+    loaded a program yet.
+*/
+static int read_snapshot(rcpu_t * const rcpu, const rcpu_snapshot_t * const snapshot)
+{
+    bool restored_pipeline, running;
+
+    if (checkpoint_read(snapshot->fd, true, &rcpu->machine, &rcpu->pipeline, &rcpu->functional,
+                        &restored_pipeline, &running) != 0)
+        return -1;
+
+    finish_restoring(rcpu, restored_pipeline, running);
+    return 0;
+}
+
+rcpu_t * rcpu_fork(const rcpu_snapshot_t * const snapshot, const rcpu_options_t * const options)
+{
+    rcpu_t * const rcpu = rcpu_create(options);
+    if (rcpu == NULL)
+        return NULL;
+
+    if (read_snapshot(rcpu, snapshot) != 0) {
+        rcpu_destroy(rcpu);
+        return NULL;
+    }
+
+    return rcpu;
+}
+
+#pragma mark History
+
+// Cycles between two snapshots of a new history
+#define HISTORY_INTERVAL 1024
+
+struct rcpu_history {
+    rcpu_t * rcpu;
+
+    // Ordered by cycle, the first one taken when the history was created
+    rcpu_snapshot_t ** snapshots;
+    size_t nsnapshots;
+    size_t max_snapshots;
+
+    // Cycles between two snapshots, doubled whenever they are thinned out
+    uint64_t interval;
+};
+
+/*
+    Called by reverse searches after every cycle replayed. start is
+    true for the first state of every run of calls, which begins at a
+    snapshot. Returns true iff the machine should stop there.
+*/
+typedef bool (*history_condition_t)(const rcpu_t * const rcpu, const bool start, void * const context);
+
+/*
+    Takes a snapshot of the current cycle. Once all slots are taken,
+    every other snapshot but the first is dropped and the interval
+    doubled, so the snapshots keep covering the whole history.
+*/
+static int history_take_snapshot(rcpu_history_t * const history)
+{
+    if (history->nsnapshots == history->max_snapshots) {
+        size_t kept = 1;
+
+        for (size_t i = 1; i < history->nsnapshots; ++i) {
+            if (i % 2 == 0)
+                history->snapshots[kept++] = history->snapshots[i];
+            else
+                rcpu_snapshot_destroy(history->snapshots[i]);
+        }
+
+        history->nsnapshots = kept;
+        history->interval *= 2;
+    }
+
+    rcpu_snapshot_t * const snapshot = rcpu_snapshot_create(history->rcpu);
+    if (snapshot == NULL)
+        return -1;
+
+    history->snapshots[history->nsnapshots++] = snapshot;
+    return 0;
+}
+
+/*
+    Returns the index of the last snapshot taken at or before a cycle.
+*/
+static size_t history_snapshot_before(const rcpu_history_t * const history, const uint64_t cycle)
+{
+    size_t low = 0, high = history->nsnapshots;
+
+    // The first snapshot is at or before every cycle asked for
+    while (high - low > 1) {
+        const size_t middle = low + (high - low) / 2;
+
+        if (history->snapshots[middle]->cycles <= cycle)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/*
+    Replaces the program of the machine by that of a snapshot.
+*/
+static int history_restore(rcpu_history_t * const history, const rcpu_snapshot_t * const snapshot)
+{
+    rcpu_t * const rcpu = history->rcpu;
+
+    // The store trace is detached until the program is back where it
+    // was, so the STOREs replayed are not traced twice
+    if (rcpu->machine.trace != NULL) {
+        rcpu->replayed_trace = rcpu->machine.trace;
+        rcpu->traced_cycles = rcpu->cycles;
+        rcpu->machine.trace = NULL;
+    }
+
+    // Only the options and the detached store trace survive
+    machine_free(&rcpu->machine);
+    machine_init(&rcpu->machine);
+    pipeline_init(&rcpu->pipeline);
+    functional_init(&rcpu->functional);
+    free(rcpu->tiers.loops);
+    bzero(&rcpu->tiers, sizeof(rcpu->tiers));
+    rcpu->loaded = false;
+
+    return read_snapshot(rcpu, snapshot);
+}
+
+rcpu_history_t * rcpu_history_create(rcpu_t * const rcpu, const size_t max_snapshots)
+{
+    if (!rcpu->loaded || (max_snapshots < 2))
+        return NULL;
+
+    rcpu_history_t * const history = malloc(sizeof(*history));
+    if (history == NULL)
+        return NULL;
+
+    *history = (rcpu_history_t){
+        .rcpu = rcpu,
+        .snapshots = malloc(max_snapshots * sizeof(*history->snapshots)),
+        .max_snapshots = max_snapshots,
+        .interval = HISTORY_INTERVAL
+    };
+
+    if ((history->snapshots == NULL) || (history_take_snapshot(history) != 0)) {
+        rcpu_history_destroy(history);
+        return NULL;
+    }
+
+    return history;
+}
+
+void rcpu_history_destroy(rcpu_history_t * const history)
+{
+    if (history == NULL)
+        return;
+
+    for (size_t i = 0; i < history->nsnapshots; ++i)
+        rcpu_snapshot_destroy(history->snapshots[i]);
+
+    free(history->snapshots);
+    free(history);
+}
+
+uint64_t rcpu_history_first_cycle(const rcpu_history_t * const history)
+{
+    return history->snapshots[0]->cycles;
+}
+
+bool rcpu_history_run(rcpu_history_t * const history, const uint64_t max_cycles)
+{
+    rcpu_t * const rcpu = history->rcpu;
+
+    const uint64_t end_cycle = (max_cycles > UINT64_MAX - rcpu->cycles) ? UINT64_MAX
+                                                                        : rcpu->cycles + max_cycles;
+    bool running = rcpu->running;
+
+    while (running && (rcpu->cycles < end_cycle)) {
+        // Past the last snapshot, the next one is due an interval later
+        const uint64_t latest = history->snapshots[history->nsnapshots - 1]->cycles;
+        const uint64_t next = (rcpu->cycles < latest) ? latest : latest + history->interval;
+        const uint64_t stop = (next < end_cycle) ? next : end_cycle;
+
+        running = rcpu_run(rcpu, stop - rcpu->cycles);
+
+        // Without a snapshot, the history just ends earlier
+        if (running && (rcpu->cycles == latest + history->interval))
+            history_take_snapshot(history);
+    }
+
+    return running;
+}
+
+int rcpu_history_seek(rcpu_history_t * const history, const uint64_t cycle)
+{
+    rcpu_t * const rcpu = history->rcpu;
+
+    if (cycle >= rcpu->cycles) {
+        rcpu_history_run(history, cycle - rcpu->cycles);
+        return 0;
+    }
+
+    const rcpu_snapshot_t * const snapshot = history->snapshots[history_snapshot_before(history, cycle)];
+
+    if (history_restore(history, snapshot) != 0)
+        return -1;
+
+    // Replaying is deterministic, so it ends up where the program was before
+    if (cycle > rcpu->cycles)
+        rcpu_run(rcpu, cycle - rcpu->cycles);
+
+    return 0;
+}
+
+/*
+    Goes back to the last cycle before the current one after which a
+    condition held. Replays one interval after the other, starting with
+    the most recent one.
+    Returns 0 if the machine went back, 1 if the condition never held.
+*/
+static int history_reverse(rcpu_history_t * const history, const history_condition_t condition,
+                           void * const context)
+{
+    const uint64_t now = history->rcpu->cycles;
+
+    if (now == rcpu_history_first_cycle(history))
+        return 1;
+
+    for (size_t k = history_snapshot_before(history, now - 1) + 1; k-- > 0; ) {
+        const rcpu_snapshot_t * const snapshot = history->snapshots[k];
+
+        // Cycles up to the next snapshot, which the next interval starts with
+        uint64_t end = now - 1;
+        if ((k + 1 < history->nsnapshots) && (history->snapshots[k + 1]->cycles < end))
+            end = history->snapshots[k + 1]->cycles;
+
+        rcpu_t * const replay = rcpu_fork(snapshot, &history->rcpu->options);
+        if (replay == NULL)
+            return -1;
+
+        // The first state of an interval belongs to the previous one
+        bool found = condition(replay, true, context) && (k == 0);
+        uint64_t cycle = replay->cycles;
+
+        while (replay->running && (replay->cycles < end)) {
+            rcpu_run(replay, 1);
+
+            if (condition(replay, false, context)) {
+                found = true;
+                cycle = replay->cycles;
+            }
+        }
+
+        rcpu_destroy(replay);
+
+        if (found)
+            return (rcpu_history_seek(history, cycle) == 0) ? 0 : -1;
+    }
+
+    return 1;
+}
+
+// The breakpoints of a reverse search
+typedef struct history_breakpoints {
+    const uint32_t * addresses;
+    size_t count;
+} history_breakpoints_t;
+
+static bool reached_breakpoint(const rcpu_t * const rcpu, const bool start, void * const context)
+{
+    const history_breakpoints_t * const breakpoints = context;
+    const uint32_t address = rcpu->machine.registers[pc];
+
+    (void)start;
+
+    for (size_t i = 0; i < breakpoints->count; ++i) {
+        if (breakpoints->addresses[i] == address)
+            return true;
+    }
+
+    return false;
+}
+
+int rcpu_history_reverse_continue(rcpu_history_t * const history, const uint32_t * const breakpoints,
+                                  const size_t nbreakpoints)
+{
+    history_breakpoints_t context = { .addresses = breakpoints, .count = nbreakpoints };
+
+    const int result = history_reverse(history, &reached_breakpoint, &context);
+    if (result != 1)
+        return result;
+
+    // Without a breakpoint on the way, the program goes back to the start
+    return (rcpu_history_seek(history, rcpu_history_first_cycle(history)) == 0) ? 1 : -1;
+}
+
+// The address of a reverse search for a STORE
+typedef struct history_store {
+    uint32_t address;
+    uint64_t nstores;               // STOREs run up to the previous cycle
+} history_store_t;
+
+static bool stored_to(const rcpu_t * const rcpu, const bool start, void * const context)
+{
+    history_store_t * const store = context;
+    const store_log_t * const protocol = &rcpu->machine.memory_protocol;
+
+    // Every STORE is counted, even if its word is in the protocol already
+    const bool stored = !start && (protocol->nstores != store->nstores) && (protocol->last == store->address);
+
+    store->nstores = protocol->nstores;
+    return stored;
+}
+
+int rcpu_history_reverse_to_store(rcpu_history_t * const history, const uint32_t address)
+{
+    history_store_t context = { .address = address };
+
+    return history_reverse(history, &stored_to, &context);
+}
+
+#pragma mark Inspection
+
+uint64_t rcpu_cycles(const rcpu_t * const rcpu)
+{
+    return rcpu->cycles;
+}
+
+uint32_t rcpu_register(const rcpu_t * const rcpu, const unsigned int index)
+{
+    assert((index < 32) && "Invalid register.");
+
+    return rcpu->machine.registers[index];
+}
+
+const uint32_t * rcpu_data(const rcpu_t * const rcpu, size_t * const nwords)
+{
+    const memory_image_t * const memory = &rcpu->machine.memory;
+
+    if (nwords != NULL)
+        *nwords = memory->data_size / sizeof(*memory->data);
+
+    return memory->data;
+}
+
+size_t rcpu_memory_protocol(const rcpu_t * const rcpu, uint32_t * const addresses, const size_t max)
+{
+    const store_log_t * const protocol = &rcpu->machine.memory_protocol;
+
+    for (size_t i = 0; (i < protocol->count) && (i < max); ++i)
+        addresses[i] = protocol->addresses[i];
+
+    return protocol->count;
+}
+
+size_t rcpu_dirty_pages(const rcpu_t * const rcpu, uint32_t * const pages, const size_t max)
+{
+    size_t count = 0;
+
+    for (size_t page = 0; page < machine_page_count(&rcpu->machine); ++page) {
+        if (machine_page_dirty(&rcpu->machine, page)) {
+            if (count < max)
+                pages[count] = (uint32_t)page;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+size_t rcpu_memory_diff(const rcpu_t * const a, const rcpu_t * const b,
+                        uint32_t * const addresses, const size_t max)
+{
+    const memory_image_t * const memory = &a->machine.memory;
+    const size_t npages = machine_page_count(&a->machine);
+
+    assert(((b == NULL) || (b->machine.memory.data_size == memory->data_size))
+           && "Data memory of the machines differs in size.");
+
+    size_t count = 0;
+
+    // Pages neither machine has written to are still the same
+    for (size_t page = 0; page < npages; ++page) {
+        if ((b == NULL) ? !machine_page_used(&a->machine, page)
+                        : (!machine_page_dirty(&a->machine, page) && !machine_page_dirty(&b->machine, page)))
+            continue;
+
+        for (size_t i = page * MACHINE_PAGE_WORDS; i < (page + 1) * MACHINE_PAGE_WORDS; ++i) {
+            const uint32_t other = (b != NULL) ? b->machine.memory.data[i] : 0;
+
+            if (memory->data[i] != other) {
+                if (count < max)
+                    addresses[count] = (uint32_t)i;
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+void rcpu_print_memory_protocol(rcpu_t * const rcpu)
+{
+    dump_memory_protocol(&rcpu->machine);
+
+    // Deltas need the length of the protocol at their base
+    rcpu->has_base = false;
+}
+
+int rcpu_trace_stores(rcpu_t * const rcpu, const char * const path)
+{
+    store_trace_t * const trace = store_trace_open(path);
+    if (trace == NULL)
+        return -1;
+
+    const int result = rcpu_stop_tracing_stores(rcpu);
+    rcpu->machine.trace = trace;
+
+    return result;
+}
+
+int rcpu_stop_tracing_stores(rcpu_t * const rcpu)
+{
+    store_trace_t * const trace = (rcpu->replayed_trace != NULL) ? rcpu->replayed_trace : rcpu->machine.trace;
+    if (trace == NULL)
+        return 0;
+
+    rcpu->machine.trace = NULL;
+    rcpu->replayed_trace = NULL;
+    return store_trace_close(trace);
+}
+
+/*
+    Prints an instruction in one of the pipeline latches.
+*/
+static void print_instruction(FILE * const out, const char * const stage,
+                              const decoded_instruction_t * const inst, const uint32_t n_pc)
+{
+    const char * instruction_text = instruction_disassemble(inst->word);
+    fprintf(out, "%s:\n\tinstruction: \t[0x%08x]: \"%s\"\n", stage, n_pc - 1, instruction_text);
+    free((void *)instruction_text);
+}
+
+void rcpu_print_state(const rcpu_t * const rcpu, FILE * const out)
+{
+    const uint32_t * const registers = rcpu->machine.registers;
+
+    // Print register bank
+    fprintf(out, "--------------------------------------------------------------------------------\n");
+    for (int i = 0; i < sizeof(rcpu->machine.registers) / sizeof(*registers); ++i) {
+        if (i % 4 == 0)
+            fprintf(out, "======= ");
+
+        fprintf(out, "r%02d: 0x%08x\t", i, registers[i]);
+
+        if (i % 4 == 3)
+            fprintf(out, "========\n");
+    }
+    fprintf(out, "--------------------------------------------------------------------------------\n");
+
+    if (!rcpu->latches_valid || rcpu->in_functional)
+        return;
+
+    const if_result_t * const r1 = pipeline_if_id(&rcpu->pipeline);
+    const id_result_t * const r2 = pipeline_id_ex(&rcpu->pipeline);
+    const ex_result_t * const r3 = pipeline_ex_mem(&rcpu->pipeline);
+    const mem_result_t * const r4 = pipeline_mem_wb(&rcpu->pipeline);
+
+    if (r1)
+        print_instruction(out, "IF", r1->inst, r1->n_pc);
+    if (r2) {
+        print_instruction(out, "ID", r2->inst, r2->n_pc);
+        fprintf(out, "\tOperand 1:\t0x%08x\n\tOperand 2:\t0x%08x\n\tIO Operand:\t0x%08x\n", r2->op1, r2->op2, r2->io_op);
+    }
+    if (r3) {
+        print_instruction(out, "EX", r3->inst, r3->n_pc);
+        fprintf(out, "\tbranch_taken:\t0x%x\n\tresult:\t\t0x%08x\n", r3->branch_taken, r3->result);
+    }
+    if (r4)
+        print_instruction(out, "MEM", r4->inst, r4->n_pc);
+}
+
+void rcpu_print_statistics(const rcpu_t * const rcpu, FILE * const out)
+{
+    if (rcpu->options.fuse && (rcpu->options.engine == RCPU_ENGINE_THREADED))
+        fprintf(out, "fused:       %llu\n", (unsigned long long)rcpu->functional.fused);
+
+    if ((rcpu->options.engine == RCPU_ENGINE_TIERED) && !rcpu->latches_valid)
+        tiered_print_statistics(out, &rcpu->tiers);
+}
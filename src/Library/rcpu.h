@@ -0,0 +1,860 @@
+/*!
+    @header librcpu
+    librcpu embeds the simulator into other programs. A program is
+    loaded into a machine created using rcpu_create, optionally given
+    initial data, and then run either to completion or for a bounded
+    number of cycles at a time, so the host stays in control between
+    two calls. Registers and data memory can be inspected at any point
+    in between.
+
+    The machine itself is opaque; this header only depends on the C
+    standard library. Every machine is independent of all others, so
+    several of them can be run at once on different threads.
+
+    A LOAD or STORE beyond the end of data memory stops rcpu_run and
+    leaves the machine stopped for good; the fault is then returned by
+    rcpu_fault. Machines with 1 GB of data memory or more reserve 16 GB
+    of address space for it, so such an access faults rather than being
+    checked. The first of them installs a SIGSEGV handler for these
+    faults, which passes any other fault on to the handler installed
+    before. The user address space of 128 TB only holds a few thousand
+    such reservations, and a limit on the address space of the process
+    (e.g. ulimit -v) may allow none at all. Machines with less data
+    memory, or without room for a reservation, map only their data
+    memory and check every access against its end instead, with the
+    same result.
+
+    Build with `make lib`, which creates lib/librcpu.a and lib/librcpu.so.
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef LIBRARY__RCPU_H
+#define LIBRARY__RCPU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*!
+    @abstract
+        An opaque simulated machine.
+*/
+typedef struct rcpu rcpu_t;
+
+/*!
+    @abstract
+        The engines a program can be simulated with.
+    @discussion
+        All engines produce the same registers and cycle count, and
+        the same data memory and memory protocol once the program has
+        halted. In between, e.g. after a bounded rcpu_run, the engines
+        other than the pipeline and the tiered engine may have carried
+        out a STORE up to two cycles earlier than the pipeline, as they
+        write memory when decoding it. RCPU_ENGINE_PIPELINE simulates every
+        stage of the pipeline, RCPU_ENGINE_FUNCTIONAL only computes
+        what the pipeline makes visible. RCPU_ENGINE_THREADED does the
+        same using a faster interpreter core, RCPU_ENGINE_JIT by
+        translating the program to host code. RCPU_ENGINE_TIERED uses
+        the pipeline, but moves hot loops to the threaded interpreter.
+
+        The JIT and the tiered engine only run at full speed when run
+        until HALT; bounded runs use the threaded interpreter and the
+        pipeline respectively.
+*/
+typedef enum {
+    RCPU_ENGINE_PIPELINE = 0,
+    RCPU_ENGINE_FUNCTIONAL,
+    RCPU_ENGINE_THREADED,
+    RCPU_ENGINE_JIT,
+    RCPU_ENGINE_TIERED
+} rcpu_engine_t;
+
+/*!
+    @abstract
+        The formats a program file can be stored in.
+*/
+typedef enum {
+    RCPU_FORMAT_BINARY = 0,
+    RCPU_FORMAT_TEXTUAL
+} rcpu_format_t;
+
+/*!
+    @abstract
+        Options of a machine, see rcpu_default_options.
+*/
+typedef struct rcpu_options {
+    rcpu_engine_t engine;
+
+    // Run compare+BRR sequences and MOVI chains as superinstructions
+    // (RCPU_ENGINE_THREADED only)
+    bool fuse;
+
+    // Number of times a loop has to be taken before it becomes hot
+    // (RCPU_ENGINE_TIERED only)
+    uint32_t hot_threshold;
+
+    // Size of data memory in bytes, a multiple of RCPU_PAGE_WORDS words
+    // up to RCPU_MAX_DATA_SIZE. Only the pages touched by a program are
+    // ever allocated, so a large size costs nothing up front.
+    size_t data_size;
+} rcpu_options_t;
+
+// Passed to rcpu_run to run until the program has finished
+#define RCPU_RUN_UNTIL_HALT UINT64_MAX
+
+// Number of words in a page of data memory, see rcpu_dirty_pages
+#define RCPU_PAGE_WORDS 1024
+
+// Size of data memory covering all 2^32 word addresses (16 GB)
+#define RCPU_MAX_DATA_SIZE ((size_t)4 << 32)
+
+/*!
+    @abstract
+        Returns the default options: the pipeline, no fusion, a hot
+        threshold of 1000 and 1 MB of data memory.
+*/
+rcpu_options_t rcpu_default_options(void);
+
+/*!
+    @abstract
+        Creates a machine without a program.
+
+    @param options
+        The options of the machine, or NULL for the defaults.
+
+    @return
+        The machine, or NULL if memory could not be allocated.
+*/
+rcpu_t * rcpu_create(const rcpu_options_t * const options);
+
+/*!
+    @abstract
+        Releases a machine and everything it holds.
+*/
+void rcpu_destroy(rcpu_t * const rcpu);
+
+/*!
+    @abstract
+        Loads a program from memory.
+    @discussion
+        A program can only be loaded once per machine. The machine gets
+        data memory of the size given in its options, filled with
+        zeroes.
+
+    @param code
+        The instruction words of the program, which are copied.
+    @param ninstructions
+        The number of instructions.
+
+    @return
+        0 on success, -1 on error, e.g. if the size of data memory is
+        invalid.
+*/
+int rcpu_load_code(rcpu_t * const rcpu, const uint32_t * const code, const size_t ninstructions);
+
+/*!
+    @abstract
+        Loads a program from disk.
+    @see rcpu_load_code
+
+    @return
+        0 on success, -1 if memory could not be allocated or a program
+        has been loaded already, or another error code if the file
+        could not be read.
+*/
+int rcpu_load_file(rcpu_t * const rcpu, const char * const path, const rcpu_format_t format);
+
+/*!
+    @abstract
+        Writes words into data memory, e.g. to preload the input of a
+        program before running it.
+    @discussion
+        Unlike STOREs of the program, these writes do not show up in
+        the memory protocol.
+
+        Words written while the program is running are seen by every
+        LOAD fetched afterwards. LOADs already in flight may or may not
+        see them, as the engines other than the pipeline and the tiered
+        engine read memory when decoding a LOAD rather than two cycles
+        later.
+
+    @param address
+        The word address of the first word.
+    @param words
+        The words to write.
+    @param nwords
+        The number of words.
+
+    @return
+        0 on success, -1 if the words do not fit into data memory or no
+        program has been loaded.
+*/
+int rcpu_write_data(rcpu_t * const rcpu, const uint32_t address,
+                    const uint32_t * const words, const size_t nwords);
+
+/*!
+    @abstract
+        Loads a file of words, e.g. the input of a program, into data
+        memory starting at address 0.
+    @see rcpu_write_data
+
+    @param path
+        The file, in one of the formats a program can be stored in.
+
+    @return
+        0 on success, -1 if the words do not fit into data memory or no
+        program has been loaded, or another error code if the file
+        could not be read.
+*/
+int rcpu_load_data_file(rcpu_t * const rcpu, const char * const path, const rcpu_format_t format);
+
+/*!
+    @abstract
+        Maps a raw image of data memory, e.g. the input of a program,
+        over data memory starting at address 0.
+    @discussion
+        The image holds one word after the other in host byte order,
+        as written by rcpu_dump_data. It is mapped copy-on-write, so it
+        is neither copied nor read in full, however large it is, and
+        the file is never changed. Like the words written using
+        rcpu_write_data, the image does not show up in the memory
+        protocol, but unlike them, it does not count as written to by
+        the program (see rcpu_dirty_pages).
+
+        The image replaces whole pages of data memory, so it is best
+        mapped right after the program has been loaded. Words beyond
+        its end in its last page become zero.
+
+    @param path
+        The file, a multiple of 4 bytes long and at most as large as
+        data memory. It must not be changed while the machine exists.
+
+    @return
+        0 on success, -1 if no program has been loaded or the file
+        could not be mapped or is too large.
+*/
+int rcpu_map_data_image(rcpu_t * const rcpu, const char * const path);
+
+/*!
+    @abstract
+        Writes data memory to a file as a raw image, e.g. to hand the
+        output of a program to another one.
+    @discussion
+        The file holds one word after the other in host byte order, as
+        read by rcpu_map_data_image, and is as large as data memory.
+        Pages that are known to be zero are not written but left as
+        holes, so dumping a large, mostly untouched data memory is
+        cheap.
+
+    @param path
+        The path to the file, which is overwritten.
+    @param dirty_only
+        true to write only the pages written to since the last
+        checkpoint or since the program has been loaded (see
+        rcpu_dirty_pages), all others reading as zeroes, e.g. to get
+        just the output of a program that has been given a data
+        image. false to write all of data memory.
+
+    @return
+        0 on success, -1 if no program has been loaded or the file
+        could not be written.
+*/
+int rcpu_dump_data(const rcpu_t * const rcpu, const char * const path, const bool dirty_only);
+
+/*!
+    @abstract
+        Runs the program for a number of cycles.
+    @discussion
+        Bounded runs stop between two cycles, so running a program for
+        n and then for m cycles gives the same result as running it
+        for n + m cycles.
+
+        A LOAD or STORE beyond the end of data memory stops the program
+        for good, see rcpu_fault.
+
+    @param max_cycles
+        The maximum number of cycles to run, or RCPU_RUN_UNTIL_HALT.
+
+    @return
+        True iff the program has not finished yet.
+*/
+bool rcpu_run(rcpu_t * const rcpu, const uint64_t max_cycles);
+
+// Length of the report of a fault, including the terminating zero
+#define RCPU_FAULT_REPORT 128
+
+/*!
+    @abstract
+        A LOAD or STORE beyond the end of data memory.
+*/
+typedef struct rcpu_fault {
+    uint32_t address;               // of the instruction
+    uint64_t cycle;                 // in which the pipeline would access memory
+    uint64_t word;                  // the word address accessed
+    bool store;                     // false for a LOAD
+
+    // e.g. "Illegal offset: STORE to word 0xfffffffc by the instruction
+    // at 0x7, data memory has 0x40000 words", without a newline
+    char report[RCPU_FAULT_REPORT];
+} rcpu_fault_t;
+
+/*!
+    @abstract
+        Returns the access that stopped a program, if any.
+    @discussion
+        The access has not been carried out, and the program can not
+        be run any further; its registers and memory are those of the
+        engine in the middle of the cycle the access was made in. On
+        the engines other than the pipeline, which carry out LOADs and
+        STOREs when decoding them, that cycle is up to two cycles
+        before the one given by the fault.
+
+    @return
+        The fault, which stays valid until the machine is destroyed or
+        restored, or NULL if no access has faulted.
+*/
+const rcpu_fault_t * rcpu_fault(const rcpu_t * const rcpu);
+
+/*!
+    @abstract
+        What happened in the pipeline during a profiled run.
+    @discussion
+        Instructions and NOPs are counted once they leave the pipeline,
+        LOADs, STOREs and taken branches once they leave EX. A bubble
+        is a cycle in which no instruction leaves the pipeline.
+*/
+typedef struct rcpu_profile {
+    uint64_t cycles;
+    uint64_t instructions;          // retired instructions other than NOPs
+    uint64_t nops;
+    uint64_t bubbles;
+    uint64_t loads;
+    uint64_t stores;
+    uint64_t branches;              // taken branches
+} rcpu_profile_t;
+
+/*!
+    @abstract
+        Runs the program on the pipeline for a number of cycles, counting
+        what happens in every one of them.
+    @discussion
+        Only RCPU_ENGINE_PIPELINE can be profiled. Cycles it spends
+        before it can take over a program from the functional engine
+        (see rcpu_fork) are run, but not counted. NOPs are not skipped.
+
+    @param max_cycles
+        The maximum number of cycles to run, or RCPU_RUN_UNTIL_HALT.
+    @param profile
+        The counters, which are incremented.
+
+    @return
+        True iff the program has not finished yet, or false as well if
+        the machine does not use the pipeline.
+*/
+bool rcpu_run_profiled(rcpu_t * const rcpu, const uint64_t max_cycles, rcpu_profile_t * const profile);
+
+/*!
+    @abstract
+        The points rcpu_run_until can stop at.
+*/
+typedef enum {
+    RCPU_UNTIL_CYCLE = 0,           // the cycle count has reached the value
+    RCPU_UNTIL_ADDRESS,             // the instruction at the value is fetched next
+    RCPU_UNTIL_INSTRUCTIONS         // that many more instructions have been fetched
+} rcpu_until_t;
+
+/*!
+    @abstract
+        Runs the program until it reaches a point.
+    @discussion
+        Every point is checked by the engine itself, so it is reached
+        at about the speed of rcpu_run. Translated code and hot loops
+        can not stop at an arbitrary point, though, so the JIT runs the
+        threaded interpreter and the tiered engine the pipeline until
+        then. An address is only reached once no branch or jump in
+        flight is about to change the PC. HALT is not counted as an
+        instruction, while NOPs are.
+
+    @param until
+        The kind of point.
+    @param value
+        The cycle, the address (that is, the PC) or the number of
+        instructions, counted from the current cycle.
+
+    @return
+        True iff the program has not finished yet, so the point has
+        been reached.
+*/
+bool rcpu_run_until(rcpu_t * const rcpu, const rcpu_until_t until, const uint64_t value);
+
+/*!
+    @abstract
+        Hands a running program to another engine.
+    @discussion
+        Programs can switch between any two engines between two cycles,
+        for example to run only a region of interest on the pipeline.
+        The instructions in flight are drained from the pipeline latches
+        when the program is next run, which is always possible. They are
+        filled from the functional engine once the pipeline can take
+        over, so until then, the program is still run functionally (just
+        as after rcpu_fork).
+
+    @param engine
+        The engine to run the program with from now on.
+
+    @return
+        0 on success, -1 if no program has been loaded or superinstructions
+        have been fused into it (see rcpu_options_t), which only the
+        threaded engine can run.
+*/
+int rcpu_switch_engine(rcpu_t * const rcpu, const rcpu_engine_t engine);
+
+// The number of machines rcpu_run_lockstep runs in lockstep at most
+#define RCPU_LOCKSTEP_LANES 16
+
+/*!
+    @abstract
+        Runs several machines with the same program, e.g. on different
+        inputs, in lockstep.
+    @discussion
+        Up to RCPU_LOCKSTEP_LANES machines at a time share the decoding
+        and dispatch of every instruction, and the ALU operations are
+        carried out for all of them in SIMD fashion. Machines taking a
+        branch differently from the others are split off and continue
+        in lockstep among themselves.
+
+        The results are exactly those of running every machine using
+        rcpu_run. The machines can be run further using rcpu_run
+        afterwards.
+
+        Should a machine fault (see rcpu_fault), the other machines of
+        its run of up to RCPU_LOCKSTEP_LANES, i.e. those whose index in
+        rcpus divided by RCPU_LOCKSTEP_LANES is the same, are left in an
+        undefined state and must only be destroyed. All other machines
+        are run as usual.
+
+    @param rcpus
+        The machines, which must have loaded the same program, but not
+        run yet.
+    @param n
+        The number of machines.
+    @param max_cycles
+        The maximum number of cycles to run, or RCPU_RUN_UNTIL_HALT.
+
+    @return
+        The number of groups the machines ended up in, i.e. the number
+        of runs of up to RCPU_LOCKSTEP_LANES machines plus the number
+        of times a group was split, or -1 if the machines do not match
+        the requirements above or a machine faulted.
+*/
+long rcpu_run_lockstep(rcpu_t * const * const rcpus, const size_t n, const uint64_t max_cycles);
+
+/*!
+    @abstract
+        Saves the complete state of a machine to a checkpoint file.
+    @discussion
+        Checkpoints can be taken between any two cycles, and hold the
+        program, registers, flag, the instructions in flight, data
+        memory and the memory protocol. Only pages of data memory that
+        are not all zero are saved (see Checkpoint.h for the format).
+
+        The checkpoint becomes the base of the next delta checkpoint
+        (see rcpu_save_delta_checkpoint).
+
+    @param path
+        The path to the file, which is overwritten.
+
+    @return
+        0 on success, -1 if no program has been loaded or the file
+        could not be written.
+*/
+int rcpu_save_checkpoint(rcpu_t * const rcpu, const char * const path);
+
+/*!
+    @abstract
+        Saves the changes since the last checkpoint to a delta checkpoint file.
+    @discussion
+        Only the pages of data memory written to and the STOREs run
+        since the last checkpoint saved, restored or applied are saved,
+        so taking checkpoints at short intervals stays cheap however
+        large data memory is. The delta becomes the base of the next
+        one.
+
+    @param path
+        The path to the file, which is overwritten.
+
+    @return
+        0 on success, -1 if there is no earlier checkpoint (the memory
+        protocol printed using rcpu_print_memory_protocol forgets it as
+        well) or the file could not be written.
+*/
+int rcpu_save_delta_checkpoint(rcpu_t * const rcpu, const char * const path);
+
+/*!
+    @abstract
+        Restores the state of a machine from a checkpoint file.
+    @discussion
+        Instead of loading a program, a machine can continue a program
+        saved by rcpu_save_checkpoint, using any engine. Running it
+        gives exactly the same results as running the original machine.
+
+    @param path
+        The path to the file.
+    @param map
+        true to map data memory from the file copy-on-write instead of
+        copying it, which makes restoring large checkpoints much
+        faster. The file must not be changed while the machine exists.
+
+    @return
+        0 on success, -1 if a program has already been loaded or the
+        file is no valid checkpoint. The machine must be destroyed
+        after an error.
+*/
+int rcpu_restore_checkpoint(rcpu_t * const rcpu, const char * const path, const bool map);
+
+/*!
+    @abstract
+        Applies a delta checkpoint to a machine.
+    @discussion
+        The machine must be at the base of the delta, i.e. have
+        restored, saved or applied that checkpoint last and not have
+        run since. A chain of deltas is applied one after the other on
+        top of the full checkpoint it started with.
+
+    @param path
+        The path to the file.
+
+    @return
+        0 on success, -1 if the file is no valid delta checkpoint or
+        the machine is not at its base, in which case the machine is
+        unchanged, or if memory could not be allocated, in which case
+        the machine must be destroyed.
+*/
+int rcpu_apply_delta_checkpoint(rcpu_t * const rcpu, const char * const path);
+/*!
+    @abstract
+        A program frozen at some cycle, from which any number of
+        machines can be forked.
+*/
+typedef struct rcpu_snapshot rcpu_snapshot_t;
+
+/*!
+    @abstract
+        Takes a snapshot of a machine, e.g. once a program has run
+        through an initialization phase that every run shares.
+    @discussion
+        The snapshot is a checkpoint (see rcpu_save_checkpoint) kept in
+        memory. The machine is not changed and can be run further.
+
+    @return
+        The snapshot, or NULL if no program has been loaded or memory
+        could not be allocated.
+*/
+rcpu_snapshot_t * rcpu_snapshot_create(const rcpu_t * const rcpu);
+
+/*!
+    @abstract
+        Releases a snapshot. Machines forked from it are not affected.
+*/
+void rcpu_snapshot_destroy(rcpu_snapshot_t * const snapshot);
+
+/*!
+    @abstract
+        Returns the cycle at which a snapshot was taken.
+*/
+uint64_t rcpu_snapshot_cycles(const rcpu_snapshot_t * const snapshot);
+
+/*!
+    @abstract
+        Creates a machine continuing the program of a snapshot.
+    @discussion
+        All machines forked from a snapshot share its pages of data
+        memory copy-on-write: a machine only gets a copy of a page of
+        its own once it writes to it, e.g. using rcpu_write_data to
+        inject an input, or by a STORE. Forking is cheap compared to
+        loading and running the program up to the snapshot, and any
+        number of machines can be forked at once on different threads.
+
+    @param options
+        The options of the machine, or NULL for the defaults. The
+        engine need not be the one the snapshot was taken with; LOADs in
+        flight are then carried out as by the engine of the snapshot
+        (see rcpu_write_data).
+
+    @return
+        The machine, or NULL on error.
+*/
+rcpu_t * rcpu_fork(const rcpu_snapshot_t * const snapshot, const rcpu_options_t * const options);
+
+/*!
+    @abstract
+        The past of a running program, which it can be taken back to.
+    @discussion
+        A history takes snapshots of its machine at regular intervals
+        while running it. Going back to an earlier cycle restores the
+        last snapshot before it and replays the program from there,
+        which gives exactly the same state as the original run.
+
+        Once all slots for snapshots are taken, every other snapshot is
+        dropped and the interval doubled. The memory a history takes is
+        thus bounded by the number of snapshots, however long the
+        program runs, while going back replays at most two intervals.
+*/
+typedef struct rcpu_history rcpu_history_t;
+
+/*!
+    @abstract
+        Starts recording the history of a machine, at its current cycle.
+    @discussion
+        The machine must only be run through the history from now on,
+        and neither be written to using rcpu_write_data nor have its
+        memory protocol printed, as neither could be replayed. Bounded
+        runs of the JIT and the tiered engine fall back to the threaded
+        interpreter and the pipeline, respectively.
+
+    @param max_snapshots
+        The maximum number of snapshots kept, at least 2.
+
+    @return
+        The history, or NULL if no program has been loaded or memory
+        could not be allocated.
+*/
+rcpu_history_t * rcpu_history_create(rcpu_t * const rcpu, const size_t max_snapshots);
+
+/*!
+    @abstract
+        Releases a history. Its machine stays where it is.
+*/
+void rcpu_history_destroy(rcpu_history_t * const history);
+
+/*!
+    @abstract
+        Returns the earliest cycle a history can go back to.
+*/
+uint64_t rcpu_history_first_cycle(const rcpu_history_t * const history);
+
+/*!
+    @abstract
+        Runs the machine of a history forwards.
+    @see rcpu_run
+*/
+bool rcpu_history_run(rcpu_history_t * const history, const uint64_t max_cycles);
+
+/*!
+    @abstract
+        Takes the machine of a history to another cycle.
+    @discussion
+        Earlier cycles are replayed from the last snapshot before them,
+        later ones are run to. The machine keeps its address.
+
+    @param cycle
+        The cycle, which is clamped to the first cycle of the history
+        and, if the program finishes earlier, the cycle it finishes in.
+
+    @return
+        0 on success, -1 if memory could not be allocated, in which case
+        the machine must be destroyed.
+*/
+int rcpu_history_seek(rcpu_history_t * const history, const uint64_t cycle);
+
+/*!
+    @abstract
+        Takes the machine of a history back to the last cycle at which
+        the PC reached one of the given addresses.
+    @discussion
+        If no breakpoint has been reached since the first cycle of the
+        history, the machine goes back to that cycle.
+
+    @param breakpoints
+        The addresses, may be NULL if nbreakpoints is 0.
+    @param nbreakpoints
+        The number of addresses.
+
+    @return
+        0 if a breakpoint was reached, 1 if the machine went back to
+        the first cycle, -1 as for rcpu_history_seek.
+*/
+int rcpu_history_reverse_continue(rcpu_history_t * const history, const uint32_t * const breakpoints,
+                                  const size_t nbreakpoints);
+
+/*!
+    @abstract
+        Takes the machine of a history back to the cycle right after the
+        last STORE to an address.
+    @discussion
+        That is the cycle right after the STORE was carried out by the
+        engine of the machine: on the engines other than the pipeline,
+        which write memory when decoding a STORE, up to two cycles
+        earlier than on the pipeline (see rcpu_engine_t).
+
+    @param address
+        The word address in data memory.
+
+    @return
+        0 if the machine went back, 1 if there has been no STORE to the
+        address since the first cycle of the history, in which case the
+        machine stays where it is, -1 as for rcpu_history_seek.
+*/
+int rcpu_history_reverse_to_store(rcpu_history_t * const history, const uint32_t address);
+
+/*!
+    @abstract
+        Returns the number of cycles simulated so far.
+*/
+uint64_t rcpu_cycles(const rcpu_t * const rcpu);
+
+/*!
+    @abstract
+        Returns a register, where register 31 is the PC.
+    @discussion
+        Instructions still in flight between two cycles may not have
+        written back their results yet, just as in the pipeline.
+*/
+uint32_t rcpu_register(const rcpu_t * const rcpu, const unsigned int index);
+
+/*!
+    @abstract
+        Returns the data memory.
+    @discussion
+        Before the program has halted, the engines other than the
+        pipeline and the tiered engine may already show STOREs the
+        pipeline only carries out up to two cycles later, in data
+        memory as well as in the memory protocol (see rcpu_engine_t).
+
+    @param nwords
+        Output parameter for the number of words, may be NULL.
+
+    @return
+        The data memory, which stays valid until the machine is
+        destroyed, or NULL if no program has been loaded.
+*/
+const uint32_t * rcpu_data(const rcpu_t * const rcpu, size_t * const nwords);
+
+/*!
+    @abstract
+        Returns the addresses of the words stored to so far, each one
+        once, in the order they were first written to.
+
+    @param addresses
+        Output parameter for at most max addresses, may be NULL if max
+        is 0.
+    @param max
+        The maximum number of addresses to return. The ones written to
+        first are returned if there are more.
+
+    @return
+        The number of words stored to so far, which may exceed max.
+*/
+size_t rcpu_memory_protocol(const rcpu_t * const rcpu, uint32_t * const addresses, const size_t max);
+
+/*!
+    @abstract
+        Returns the pages of data memory written to since the last
+        checkpoint, or since the program has been loaded.
+    @discussion
+        A page is RCPU_PAGE_WORDS words long and counts as written to
+        even if its contents are the same again.
+
+    @param pages
+        Output parameter for the indices of at most max pages, in
+        ascending order, may be NULL if max is 0.
+    @param max
+        The maximum number of pages to return.
+
+    @return
+        The number of pages written to, which may exceed max.
+*/
+size_t rcpu_dirty_pages(const rcpu_t * const rcpu, uint32_t * const pages, const size_t max);
+
+/*!
+    @abstract
+        Compares the data memory of two machines.
+    @discussion
+        Both machines must have had the same data memory when their
+        pages were last clean, e.g. two forks of one snapshot, or a
+        machine and its checkpoint restored elsewhere. Only the pages
+        written to by either of them are compared, or only the pages
+        ever written to by a if it is compared against zeroes.
+
+    @param a
+        One machine.
+    @param b
+        The other machine, or NULL to compare against a freshly loaded
+        program, whose data memory is all zero.
+    @param addresses
+        Output parameter for the addresses of at most max differing
+        words, in ascending order, may be NULL if max is 0.
+    @param max
+        The maximum number of addresses to return.
+
+    @return
+        The number of differing words, which may exceed max.
+*/
+size_t rcpu_memory_diff(const rcpu_t * const a, const rcpu_t * const b,
+                        uint32_t * const addresses, const size_t max);
+
+/*!
+    @abstract
+        Prints the address of every word stored to so far, once and in
+        ascending order, together with its current contents to stdout,
+        and forgets about the STOREs afterwards.
+*/
+void rcpu_print_memory_protocol(rcpu_t * const rcpu);
+
+/*!
+    @abstract
+        Starts streaming every STORE of the machine to a trace file.
+    @discussion
+        Each STORE is recorded with the address of its instruction, the
+        cycle in which the pipeline accesses memory for it, the word
+        address and the value, in the format described in
+        Misc/StoreTrace.h. Every engine records the same trace. The
+        file is written by a thread of its own and only complete once
+        tracing has been stopped.
+
+        Forks of the machine do not trace their STOREs. After going
+        back in a history, the cycles replayed up to where the machine
+        was are not traced again, so the trace stays the same as that
+        of a run that never went back.
+
+    @param path
+        The path to the trace file, which is overwritten.
+
+    @return
+        0 on success, or -1 if the file could not be created, or if the
+        previous trace, which is stopped in any case once the new one
+        has been created, could not be written completely.
+*/
+int rcpu_trace_stores(rcpu_t * const rcpu, const char * const path);
+
+/*!
+    @abstract
+        Writes all outstanding STOREs to the trace file and closes it.
+    @discussion
+        Destroying the machine stops tracing as well, without reporting
+        errors.
+
+    @return
+        0 on success or if STOREs are not traced, -1 if the trace file
+        could not be written completely.
+*/
+int rcpu_stop_tracing_stores(rcpu_t * const rcpu);
+
+/*!
+    @abstract
+        Prints the register bank and, for the pipeline, the contents of
+        all pipeline latches.
+*/
+void rcpu_print_state(const rcpu_t * const rcpu, FILE * const out);
+
+/*!
+    @abstract
+        Prints statistics of the engine, if it collects any: the number
+        of fused instructions and how the cycles were split between
+        tiers.
+*/
+void rcpu_print_statistics(const rcpu_t * const rcpu, FILE * const out);
+
+#endif /* LIBRARY__RCPU_H */
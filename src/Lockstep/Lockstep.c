@@ -0,0 +1,479 @@
+#define _DEFAULT_SOURCE // sigjmp_buf, must precede all includes
+#include "Lockstep.h"
+
+#include "../Instruction/ISA.h"
+
+#include <assert.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <strings.h> // bzero
+
+/*
+    An instruction fetched during one of the last four cycles, see
+    functional_slot_t. Only the results differ between lanes.
+*/
+typedef struct lockstep_slot {
+    _Alignas(64) uint32_t value[LOCKSTEP_LANES];
+    uint32_t taken[LOCKSTEP_LANES];             // lanes taking a branch
+
+    const decoded_instruction_t * inst;         // NULL for a bubble
+    uint32_t n_pc;
+    uint8_t  effect;                            // functional_effect_t
+    uint8_t  rd;
+} lockstep_slot_t;
+
+/*
+    Lanes running in lockstep. Lane i is the machine lanes[i];
+    the lanes from nlanes on compute garbage.
+*/
+typedef struct lockstep_group {
+    _Alignas(64) uint32_t registers[32][LOCKSTEP_LANES];
+    uint32_t flag[LOCKSTEP_LANES];
+    lockstep_slot_t slots[4];
+
+    uint32_t program_counter;                   // the PC of all lanes
+    uint8_t in_flight;
+    uint64_t cycles;
+    uint64_t halts;
+
+    // True if the group has been split off in the middle of a cycle,
+    // after WB and MEM
+    bool resume;
+
+    size_t nlanes;
+    size_t lanes[LOCKSTEP_LANES];
+} lockstep_group_t;
+
+typedef struct lockstep {
+    rcpu_machine_t * const * machines;
+    const decoded_instruction_t * decoded;      // of machines[0]
+
+    lockstep_group_t * groups;
+    size_t ngroups;
+
+    // The last LOAD or STORE and its group, for reporting faults
+    // and tracing STOREs
+    const lockstep_slot_t * io;
+    const lockstep_group_t * io_group;
+} lockstep_t;
+
+#pragma mark Lanes
+
+/*
+    The ALU operations of ALUOps.c, inlined so loops over the lanes
+    can be vectorized.
+*/
+#define LANE_add(a, b)      ((a) + (b))
+#define LANE_sub(a, b)      ((a) - (b))
+#define LANE_and(a, b)      ((a) & (b))
+#define LANE_or(a, b)       ((a) | (b))
+#define LANE_shl(a, b)      ((b) ? (a) << 8 : (a) << 1)
+#define LANE_shrl(a, b)     ((b) ? (a) >> 8 : (a) >> 1)
+#define LANE_shra(a, b)     ((b) ? ((a) >> 8) | (~(((a) >> 31) - 1) << (31 - 8))          \
+                                 : ((a) >> 1) | ((a) & (1u << 31)))
+#define LANE_not(a)         (~(a))
+#define LANE_mov(a)         (a)
+#define LANE_ceq(a, b)      ((a) == (b))
+#define LANE_cltu(a, b)     ((a) < (b))
+#define LANE_clts(a, b)     ((int32_t)(a) < (int32_t)(b))
+#define LANE_cgtu(a, b)     ((a) > (b))
+#define LANE_cgts(a, b)     ((int32_t)(a) > (int32_t)(b))
+
+// Applies op to both operands of inst in every lane
+#define FOR_LANES(out, op)                                                      \
+    do {                                                                        \
+        const uint32_t * const a = registers[inst->rs1];                        \
+        if (inst->is_immediate) {                                               \
+            for (size_t l = 0; l < LOCKSTEP_LANES; ++l)                         \
+                (out)[l] = op(a[l], inst->imm);                                 \
+        } else {                                                                \
+            const uint32_t * const b = registers[inst->rs2];                    \
+            for (size_t l = 0; l < LOCKSTEP_LANES; ++l)                         \
+                (out)[l] = op(a[l], b[l]);                                      \
+        }                                                                       \
+    } while (0)
+
+#define BINARY_CASE(name, opcode, type, alu, rd, op1, op2)                      \
+    case OPCODE_##name: FOR_LANES(slot->value, LANE_##alu); break;
+
+#define COMPARE_CASE(name, opcode, type, alu, rd, op1, op2)                     \
+    case OPCODE_##name: FOR_LANES(group->flag, LANE_##alu); break;
+
+#define UNARY_CASE(name, opcode, type, alu, rd, op1, op2)                       \
+    case OPCODE_##name:                                                         \
+        if (inst->is_immediate) {                                               \
+            for (size_t l = 0; l < LOCKSTEP_LANES; ++l)                         \
+                slot->value[l] = LANE_##alu(inst->imm);                         \
+        } else {                                                                \
+            for (size_t l = 0; l < LOCKSTEP_LANES; ++l)                         \
+                slot->value[l] = LANE_##alu(registers[inst->rs1][l]);           \
+        }                                                                       \
+        break;
+
+/*
+    Executes the instruction in slot in every lane, as far as this is
+    visible at the time the pipeline would decode it (see execute_slot
+    in Functional.c). LOADs and STOREs are checked against the end of
+    data memory iff checked is true.
+*/
+static inline void execute_slot(lockstep_t * const lockstep, lockstep_group_t * const group,
+                                lockstep_slot_t * const slot, const bool checked)
+{
+    uint32_t (* const registers)[LOCKSTEP_LANES] = group->registers;
+    const decoded_instruction_t * const inst = slot->inst;
+
+    switch (inst->type) {
+        case BINARY_ARITHMETIC:
+            slot->effect = EFFECT_WRITE;
+            slot->rd = inst->rd;
+            switch (inst->opcode) {
+                ISA_BINARY_ARITHMETIC(BINARY_CASE)
+                default:
+                    assert(false && "Instruction not supported.");
+            }
+            break;
+        case UNARY_ARITHMETIC:
+            slot->effect = EFFECT_WRITE;
+            slot->rd = inst->rd;
+            switch (inst->opcode) {
+                ISA_UNARY_ARITHMETIC(UNARY_CASE)
+                default:
+                    assert(false && "Instruction not supported.");
+            }
+            break;
+        case COMPARE:
+            switch (inst->opcode) {
+                ISA_COMPARE(COMPARE_CASE)
+                default:
+                    assert(false && "Instruction not supported.");
+            }
+            break;
+        case BRANCH:
+        case JUMP:
+            {
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l)
+                    slot->taken[l] = (inst->type == JUMP) || group->flag[l];
+
+                uint32_t taken = 0;
+                for (size_t l = 0; l < group->nlanes; ++l)
+                    taken |= slot->taken[l];
+
+                if (inst->is_immediate) {
+                    for (size_t l = 0; l < LOCKSTEP_LANES; ++l)
+                        slot->value[l] = inst->imm + slot->n_pc;
+                } else {
+                    for (size_t l = 0; l < LOCKSTEP_LANES; ++l)
+                        slot->value[l] = registers[inst->rs1][l];
+                }
+
+                slot->effect = taken ? EFFECT_BRANCH : EFFECT_NONE;
+                break;
+            }
+        case IO:
+            lockstep->io = slot;
+            lockstep->io_group = group;
+
+            // Every lane has a memory of its own
+            for (size_t l = 0; l < group->nlanes; ++l) {
+                rcpu_machine_t * const machine = lockstep->machines[group->lanes[l]];
+                const uint32_t address = registers[inst->rs1][l] + inst->imm;
+                if (checked && (address >= machine->memory.limit))
+                    machine_access_fault(machine, address);
+
+                if (inst->opcode == OPCODE_LOAD) {
+                    slot->value[l] = machine->memory.data[address];
+                } else if (inst->opcode == OPCODE_STORE) {
+                    memory_store(machine, address, registers[inst->rd][l]);
+                } else {
+                    assert(false && "Instruction not supported.");
+                }
+            }
+
+            if (inst->opcode == OPCODE_LOAD) {
+                slot->effect = EFFECT_WRITE;
+                slot->rd = inst->rd;
+            }
+            break;
+        case MISC:
+            ; // NOP
+              // HALT never gets past the fetch stage.
+            break;
+        case UNKNOWN:
+        default:
+            assert(false && "Instruction not supported.");
+    }
+}
+
+#pragma mark Groups
+
+/*
+    Keeps only the lanes of a group whose entry in targets is target.
+*/
+static void keep_lanes(lockstep_group_t * const group, const uint32_t * const targets, const uint32_t target)
+{
+    size_t n = 0;
+
+    for (size_t l = 0; l < group->nlanes; ++l) {
+        if (targets[l] != target)
+            continue;
+
+        for (unsigned int r = 0; r < 32; ++r)
+            group->registers[r][n] = group->registers[r][l];
+
+        for (unsigned int s = 0; s < 4; ++s) {
+            group->slots[s].value[n] = group->slots[s].value[l];
+            group->slots[s].taken[n] = group->slots[s].taken[l];
+        }
+
+        group->flag[n] = group->flag[l];
+        group->lanes[n] = group->lanes[l];
+        n++;
+    }
+
+    group->nlanes = n;
+    group->program_counter = target;
+}
+
+/*
+    Splits a group by the PC every lane continues at. The group keeps
+    the lanes continuing where the first one does.
+*/
+static void split_group(lockstep_t * const lockstep, lockstep_group_t * const group,
+                        const uint32_t * const targets)
+{
+    bool moved[LOCKSTEP_LANES] = { false };
+
+    for (size_t l = 1; l < group->nlanes; ++l) {
+        if (moved[l] || (targets[l] == targets[0]))
+            continue;
+
+        for (size_t k = l; k < group->nlanes; ++k)
+            moved[k] |= (targets[k] == targets[l]);
+
+        assert((lockstep->ngroups < LOCKSTEP_LANES) && "Every group has at least one lane.");
+
+        lockstep_group_t * const split = &lockstep->groups[lockstep->ngroups++];
+        *split = *group;
+        split->resume = true;
+        keep_lanes(split, targets, targets[l]);
+    }
+
+    keep_lanes(group, targets, targets[0]);
+}
+
+/*
+    Simulates one cycle of a group, see functional_step.
+*/
+static inline bool step(lockstep_t * const lockstep, lockstep_group_t * const group, const bool checked)
+{
+    uint64_t cycle;
+
+    if (group->resume) {
+        group->resume = false;
+        cycle = group->cycles - 1;
+    } else {
+        cycle = group->cycles++;
+
+        // WB of the instruction fetched four cycles ago
+        const lockstep_slot_t * const wb = &group->slots[cycle & 3];
+        if (wb->effect == EFFECT_WRITE) {
+            for (size_t l = 0; l < LOCKSTEP_LANES; ++l)
+                group->registers[wb->rd][l] = wb->value[l];
+        }
+
+        // MEM of the instruction fetched three cycles ago
+        const lockstep_slot_t * const mem = &group->slots[(cycle + 1) & 3];
+        const bool wb_pc = (wb->effect == EFFECT_WRITE) && (wb->rd == pc);
+
+        if (wb_pc || (mem->effect == EFFECT_BRANCH)) {
+            uint32_t targets[LOCKSTEP_LANES];
+            bool diverged = false;
+
+            for (size_t l = 0; l < group->nlanes; ++l) {
+                targets[l] = wb_pc ? wb->value[l] : group->program_counter;
+                if ((mem->effect == EFFECT_BRANCH) && mem->taken[l])
+                    targets[l] = mem->value[l];
+
+                diverged |= (targets[l] != targets[0]);
+            }
+
+            if (diverged)
+                split_group(lockstep, group, targets);
+            else
+                group->program_counter = targets[0];
+        }
+    }
+
+    // ID of the instruction fetched during the last cycle
+    lockstep_slot_t * const id = &group->slots[(cycle + 3) & 3];
+    if (id->inst != NULL) {
+        for (size_t l = 0; l < LOCKSTEP_LANES; ++l)
+            group->registers[pc][l] = group->program_counter;
+
+        execute_slot(lockstep, group, id, checked);
+    }
+
+    // IF reuses the slot that has just been written back
+    lockstep_slot_t * const fetch = &group->slots[cycle & 3];
+    const decoded_instruction_t * const inst = &lockstep->decoded[group->program_counter];
+
+    fetch->effect = EFFECT_NONE;
+    if (inst->opcode != OPCODE_HALT) {
+        fetch->inst = inst;
+        fetch->n_pc = ++group->program_counter;
+        group->in_flight = ((group->in_flight << 1) | 1) & 0xf;
+    } else {
+        fetch->inst = NULL;
+        group->in_flight = (group->in_flight << 1) & 0xf;
+        group->halts++;
+    }
+
+    return group->in_flight != 0;
+}
+
+/*
+    Hands every lane of a group back to its machine.
+*/
+static void finish_group(const lockstep_t * const lockstep, const lockstep_group_t * const group,
+                         functional_state_t * const * const states)
+{
+    for (size_t l = 0; l < group->nlanes; ++l) {
+        rcpu_machine_t * const machine = lockstep->machines[group->lanes[l]];
+        functional_state_t * const state = states[group->lanes[l]];
+
+        for (unsigned int r = 0; r < 32; ++r)
+            machine->registers[r] = group->registers[r][l];
+
+        machine->registers[pc] = group->program_counter;
+        machine->flag = group->flag[l];
+
+        for (unsigned int s = 0; s < 4; ++s) {
+            const lockstep_slot_t * const from = &group->slots[s];
+            functional_slot_t * const to = &state->slots[s];
+
+            // Every machine has its own copy of the decoded program
+            to->inst = (from->inst != NULL) ? machine->memory.decoded + (from->inst - lockstep->decoded) : NULL;
+            to->n_pc = from->n_pc;
+            to->effect = ((from->effect == EFFECT_BRANCH) && !from->taken[l]) ? EFFECT_NONE : from->effect;
+            to->rd = from->rd;
+            to->value = from->value[l];
+        }
+
+        state->in_flight = group->in_flight;
+        state->cycles = group->cycles;
+        state->halts = group->halts;
+    }
+}
+
+#pragma mark Running
+
+/*
+    Locates the last LOAD or STORE of any group, whose group has already
+    counted the cycle it is decoded in, see Functional.c.
+*/
+static machine_location_t locate_access(const rcpu_machine_t * const machine, const void * const state)
+{
+    const lockstep_t * const lockstep = state;
+
+    return (machine_location_t){
+        .address = lockstep->io->n_pc - 1,
+        .cycle = lockstep->io_group->cycles + 1
+    };
+}
+
+/*
+    Runs all groups, see lockstep_run. LOADs and STOREs are checked
+    against the end of data memory iff checked is true.
+*/
+static inline void run_groups(lockstep_t * const lockstep, functional_state_t * const * const states,
+                              const uint64_t end_cycle, const bool checked)
+{
+    // Groups split off are appended, so this runs all of them
+    for (size_t i = 0; i < lockstep->ngroups; ++i) {
+        lockstep_group_t * const group = &lockstep->groups[i];
+
+        // A group split off finishes its cycle in any case
+        bool running = group->resume ? step(lockstep, group, checked) : true;
+        while (running && (group->cycles < end_cycle))
+            running = step(lockstep, group, checked);
+
+        finish_group(lockstep, group, states);
+    }
+}
+
+size_t lockstep_run(rcpu_machine_t * const * const machines, functional_state_t * const * const states,
+                    const size_t n, const uint64_t end_cycle)
+{
+    assert((n > 0) && (n <= LOCKSTEP_LANES) && "Invalid number of machines.");
+
+    lockstep_t lockstep = {
+        .machines = machines,
+        .decoded = machines[0]->memory.decoded,
+        .groups = aligned_alloc(_Alignof(lockstep_group_t), LOCKSTEP_LANES * sizeof(lockstep_group_t)),
+        .ngroups = 1
+    };
+    assert((lockstep.groups != NULL) && "Failed to allocate memory");
+
+    // All machines start out in one group
+    lockstep_group_t * const first = &lockstep.groups[0];
+    bzero(first, sizeof(*first));
+
+    first->program_counter = machines[0]->registers[pc];
+    first->nlanes = n;
+
+    for (size_t l = 0; l < n; ++l) {
+        assert((machines[l]->registers[pc] == first->program_counter) && (states[l]->cycles == 0)
+               && "Machines have to start out in the same state.");
+
+        for (unsigned int r = 0; r < 32; ++r)
+            first->registers[r][l] = machines[l]->registers[r];
+
+        first->flag[l] = machines[l]->flag;
+        first->lanes[l] = l;
+
+        machine_set_locator(machines[l], locate_access, &lockstep);
+    }
+
+    // A fault releases the groups before it returns to the recovery
+    // point all machines share, if any (see machine_set_recovery)
+    void * const outer = machines[0]->recovery;
+    sigjmp_buf recovery;
+
+    if (outer != NULL) {
+        if (sigsetjmp(recovery, 0) != 0) {
+            free(lockstep.groups);
+
+            for (size_t l = 0; l < n; ++l) {
+                machine_set_locator(machines[l], NULL, NULL);
+                machine_set_recovery(machines[l], outer);
+            }
+
+            siglongjmp(*(sigjmp_buf *)outer, 1);
+        }
+
+        for (size_t l = 0; l < n; ++l)
+            machine_set_recovery(machines[l], &recovery);
+    }
+
+    // Accesses are only checked if a machine has no guard region
+    bool guarded = true;
+    for (size_t l = 0; l < n; ++l)
+        guarded &= machines[l]->memory.guarded;
+
+    if (guarded)
+        run_groups(&lockstep, states, end_cycle, false);
+    else
+        run_groups(&lockstep, states, end_cycle, true);
+
+    // The locators point at lockstep, which goes away now
+    for (size_t l = 0; l < n; ++l) {
+        machine_set_locator(machines[l], NULL, NULL);
+
+        if (outer != NULL)
+            machine_set_recovery(machines[l], outer);
+    }
+
+    free(lockstep.groups);
+
+    return lockstep.ngroups;
+}
@@ -0,0 +1,64 @@
+/*!
+    @header Lockstep execution
+    Runs up to LOCKSTEP_LANES machines with the same program, e.g. on
+    different inputs, at once. As long as they fetch the same
+    instructions, one instruction is decoded and dispatched for all of
+    them, and carried out for every lane in a loop over the register
+    banks, which are laid out as structure of arrays: registers[r][lane].
+    Built with optimization and for a host with SIMD instructions (e.g.
+    -O3 -march=native), the compiler turns these loops into vector
+    instructions.
+
+    The semantics are exactly those of the functional engine (see
+    Functional.h). Lanes whose PC differs from that of the others after
+    a branch, a jump or a write to the PC are split off into a group of
+    their own, which continues in lockstep on its own. Groups never
+    merge again.
+
+    @related Functional.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef LOCKSTEP__LOCKSTEP_H
+#define LOCKSTEP__LOCKSTEP_H
+
+#include "../Functional/Functional.h"
+
+// The number of machines run in lockstep at most,
+// enough for one AVX-512 vector of 32-bit registers
+#define LOCKSTEP_LANES 16
+
+/*!
+    @abstract
+        Runs machines in lockstep until they have finished or a given
+        cycle has been reached.
+    @discussion
+        Afterwards, every machine and its state are just as if it had
+        been run on the functional engine on its own, so it can be run
+        further from there.
+
+        Should an access fault, lockstep_run releases what it allocated
+        and returns to the recovery point of the machines, which they
+        all have to share (see machine_set_recovery). The machines are
+        left in an undefined state then.
+
+    @param machines
+        The machines, which must all have loaded the same code image
+        and have the same PC.
+    @param states
+        The states of the functional engine of the machines, which must
+        have been initialized using functional_init.
+    @param n
+        The number of machines, at most LOCKSTEP_LANES.
+    @param end_cycle
+        The cycle counter at which to stop at the latest.
+
+    @return
+        The number of groups the machines ended up in, 1 if they never
+        diverged.
+*/
+size_t lockstep_run(rcpu_machine_t * const * const machines, functional_state_t * const * const states,
+                    const size_t n, const uint64_t end_cycle);
+
+#endif /* LOCKSTEP__LOCKSTEP_H */
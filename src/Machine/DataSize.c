@@ -0,0 +1,30 @@
+#include "Machine.h"
+
+#include <stdint.h> // SIZE_MAX
+#include <stdlib.h> // strtoull
+
+int machine_parse_data_size(const char * const string, size_t * const size)
+{
+    char *end;
+    const unsigned long long value = strtoull(string, &end, 0);
+
+    unsigned int shift = 0;
+    switch (*end) {
+        case 'K': case 'k': shift = 10; break;
+        case 'M': case 'm': shift = 20; break;
+        case 'G': case 'g': shift = 30; break;
+    }
+
+    const char * const suffix_end = (shift != 0) ? end + 1 : end;
+    if ((end == string) || (*suffix_end != '\0') || (value > (SIZE_MAX >> shift)))
+        return -1;
+
+    const size_t bytes = (size_t)value << shift;
+    const size_t page_size = MACHINE_PAGE_WORDS * sizeof(uint32_t);
+
+    if ((bytes == 0) || ((bytes % page_size) != 0) || (bytes > MACHINE_MAX_DATA_SIZE))
+        return -1;
+
+    *size = bytes;
+    return 0;
+}
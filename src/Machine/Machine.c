@@ -0,0 +1,479 @@
+#define _GNU_SOURCE // MAP_ANONYMOUS, MAP_NORESERVE, must precede all includes
+#include "Machine.h"
+
+#include "../JIT/JIT.h"
+#include "../Instruction/Opcodes.h"
+
+#include <fcntl.h> // open
+#include <pthread.h>
+#include <setjmp.h> // siglongjmp
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <strings.h> // bzero
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#include <unistd.h> // write, pwrite, ftruncate
+
+void machine_init(rcpu_machine_t * const machine)
+{
+    bzero(machine, sizeof(*machine));
+}
+
+int machine_load_code(rcpu_machine_t * const machine, uint32_t * const code, const size_t ninstructions,
+                      const size_t data_size)
+{
+    memory_image_t * const memory = &machine->memory;
+
+    memory->code = code;
+    memory->code_size = ninstructions * sizeof(*code);
+
+    // The code image never changes, so decode it only once.
+    memory->decoded = instruction_predecode_program(code, ninstructions);
+    if (memory->decoded == NULL)
+        return -1;
+
+    memory->nop_runs = instruction_find_nop_runs(memory->decoded, ninstructions);
+    if (memory->nop_runs == NULL)
+        return -1;
+
+    return machine_alloc_data(machine, data_size);
+}
+
+int machine_load_program(rcpu_machine_t * const machine, const LOAD_OPTION option, const char * path,
+                         const size_t data_size)
+{
+    uint32_t * code;
+    size_t size;
+
+    const int error = load_program_from_path(option, path, &code, &size);
+    if (error != 0)
+        return error;
+
+    return machine_load_code(machine, code, size / sizeof(*code), data_size);
+}
+
+#pragma mark Guard region
+
+// A reservation spans all word addresses from the start of data memory.
+// User space spans 2^47 bytes, so it holds at most this many of them.
+#define RESERVATION_COUNT ((size_t)1 << (47 - 34))
+
+_Static_assert(MACHINE_MAX_DATA_SIZE == (size_t)1 << 34, "A reservation has to span the whole address space.");
+
+// Machines owning a reservation, NULL for unused slots
+static _Atomic(rcpu_machine_t *) reservations[RESERVATION_COUNT];
+
+static pthread_once_t handler_installed = PTHREAD_ONCE_INIT;
+static struct sigaction previous_handler;
+
+/*
+    Appends a string to the report of a fault. Only functions that are
+    safe to call from a signal handler can be used to build it.
+*/
+static char * append_string(char * out, const char * string)
+{
+    while (*string != '\0')
+        *out++ = *string++;
+
+    return out;
+}
+
+static char * append_hex(char * out, uint64_t value)
+{
+    char digits[16];
+    int ndigits = 0;
+
+    do {
+        digits[ndigits++] = "0123456789abcdef"[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+
+    out = append_string(out, "0x");
+    while (ndigits > 0)
+        *out++ = digits[--ndigits];
+
+    return out;
+}
+
+/*
+    Passes a fault the guard region is not responsible for on to the
+    handler installed before, which stays in place for later faults.
+*/
+static void chain_fault(const int signal, siginfo_t * const info, void * const context)
+{
+    if (previous_handler.sa_flags & SA_SIGINFO) {
+        previous_handler.sa_sigaction(signal, info, context);
+    } else if ((previous_handler.sa_handler != SIG_DFL) && (previous_handler.sa_handler != SIG_IGN)) {
+        previous_handler.sa_handler(signal);
+    } else {
+        // The instruction faults again once this returns, which then
+        // terminates the process, so there are no later faults
+        struct sigaction action;
+        bzero(&action, sizeof(action));
+
+        action.sa_handler = SIG_DFL;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, NULL);
+    }
+}
+
+/*
+    Records an access to a word beyond the end of data memory and
+    returns to the recovery point of its machine, or reports it and
+    aborts if there is none. Called from the handler of the fault, too.
+*/
+_Noreturn static void stop_machine(rcpu_machine_t * const machine, const uint64_t word)
+{
+    const memory_image_t * const memory = &machine->memory;
+    machine_fault_t * const fault = &machine->fault;
+
+    bzero(fault, sizeof(*fault));
+    fault->word = word;
+
+    char * out = append_string(fault->report, "Illegal offset: ");
+
+    if (machine->locator != NULL) {
+        const machine_location_t location = machine->locator(machine, machine->locator_state);
+
+        fault->address = location.address;
+        fault->cycle = location.cycle;
+        fault->store = (fault->address < memory->code_size / sizeof(*memory->code))
+                       && (memory->decoded[fault->address].opcode == OPCODE_STORE);
+
+        out = append_string(out, fault->store ? "STORE to word " : "LOAD from word ");
+        out = append_hex(out, fault->word);
+        out = append_string(out, " by the instruction at ");
+        out = append_hex(out, fault->address);
+    } else {
+        out = append_string(out, "access to word ");
+        out = append_hex(out, fault->word);
+    }
+
+    out = append_string(out, ", data memory has ");
+    out = append_hex(out, memory->data_size / sizeof(*memory->data));
+    out = append_string(out, " words");
+
+    // The engine does not return to clear it
+    machine->faulted = true;
+    machine_set_locator(machine, NULL, NULL);
+
+    if (machine->recovery != NULL)
+        siglongjmp(*(sigjmp_buf *)machine->recovery, 1);
+
+    *out++ = '\n';
+    write(STDERR_FILENO, fault->report, out - fault->report);
+    abort();
+}
+
+/*
+    Stops the machine whose guard region an access faulted in.
+    Any other fault is left to the handler installed before.
+*/
+static void handle_fault(const int signal, siginfo_t * const info, void * const context)
+{
+    const uintptr_t address = (uintptr_t)info->si_addr;
+
+    for (size_t i = 0; i < RESERVATION_COUNT; ++i) {
+        rcpu_machine_t * const machine = atomic_load(&reservations[i]);
+        if (machine == NULL)
+            continue;
+
+        const uintptr_t data = (uintptr_t)machine->memory.data;
+
+        if ((address >= data + machine->memory.data_size) && (address - data < MACHINE_MAX_DATA_SIZE))
+            stop_machine(machine, (address - data) / sizeof(*machine->memory.data));
+    }
+
+    chain_fault(signal, info, context);
+}
+
+void machine_access_fault(rcpu_machine_t * const machine, const uint32_t address)
+{
+    stop_machine(machine, address);
+}
+
+static void install_handler(void)
+{
+    struct sigaction action;
+    bzero(&action, sizeof(action));
+
+    action.sa_sigaction = handle_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGSEGV, &action, &previous_handler);
+}
+
+/*
+    Reserves the whole address space of a machine and makes the first
+    size bytes of it accessible. Returns NULL if there is no room for
+    the reservation or no slot left to record it in.
+*/
+static uint32_t * reserve_data(rcpu_machine_t * const machine, const size_t size)
+{
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+    uint8_t * const base = mmap(NULL, MACHINE_MAX_DATA_SIZE, PROT_NONE, flags, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    if (mmap(base, size, PROT_READ | PROT_WRITE, flags | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        munmap(base, MACHINE_MAX_DATA_SIZE);
+        return NULL;
+    }
+
+    pthread_once(&handler_installed, install_handler);
+
+    // Data memory has to be in place before the handler can find it
+    machine->memory.data = (uint32_t *)base;
+    machine->memory.data_size = size;
+
+    for (size_t i = 0; i < RESERVATION_COUNT; ++i) {
+        rcpu_machine_t * expected = NULL;
+
+        if (atomic_compare_exchange_strong(&reservations[i], &expected, machine))
+            return (uint32_t *)base;
+    }
+
+    machine->memory.data = NULL;
+    machine->memory.data_size = 0;
+
+    munmap(base, MACHINE_MAX_DATA_SIZE);
+    return NULL;
+}
+
+/*
+    Releases the reservation of a machine.
+*/
+static void release_data(rcpu_machine_t * const machine)
+{
+    for (size_t i = 0; i < RESERVATION_COUNT; ++i) {
+        rcpu_machine_t * expected = machine;
+
+        if (atomic_compare_exchange_strong(&reservations[i], &expected, NULL))
+            break;
+    }
+
+    munmap(machine->memory.data, MACHINE_MAX_DATA_SIZE);
+}
+
+void machine_set_locator(rcpu_machine_t * const machine, const machine_locator_t locator,
+                         const void * const state)
+{
+    machine->locator = locator;
+    machine->locator_state = state;
+}
+
+void machine_set_recovery(rcpu_machine_t * const machine, void * const recovery)
+{
+    machine->recovery = recovery;
+}
+
+#pragma mark Data memory
+
+/*
+    Releases data memory along with its dirty and used bits.
+*/
+static void free_data(rcpu_machine_t * const machine)
+{
+    memory_image_t * const memory = &machine->memory;
+
+    if ((memory->data != NULL) && memory->guarded) {
+        release_data(machine);
+    } else if (memory->data != NULL) {
+        munmap(memory->data, memory->data_size);
+    }
+
+    free(memory->dirty);
+    free(memory->used);
+
+    memory->data = NULL;
+    memory->data_size = 0;
+    memory->limit = 0;
+    memory->guarded = false;
+    memory->dirty = NULL;
+    memory->used = NULL;
+}
+
+#pragma mark Dirty pages
+
+// Number of words of dirty bits, one bit per page
+static inline size_t dirty_words(const size_t npages)
+{
+    return (npages + 63) / 64;
+}
+
+size_t machine_page_count(const rcpu_machine_t * const machine)
+{
+    const size_t page_size = MACHINE_PAGE_WORDS * sizeof(*machine->memory.data);
+
+    return (machine->memory.data_size + page_size - 1) / page_size;
+}
+
+int machine_alloc_data(rcpu_machine_t * const machine, const size_t size)
+{
+    memory_image_t * const memory = &machine->memory;
+    const size_t page_size = MACHINE_PAGE_WORDS * sizeof(*memory->data);
+
+    free_data(machine);
+    store_log_free(&machine->memory_protocol);
+
+    if ((size == 0) || ((size % page_size) != 0) || (size > MACHINE_MAX_DATA_SIZE))
+        return -1;
+
+    // Without a guard region, every access is checked instead
+    uint32_t * data = (size >= MACHINE_GUARD_DATA_SIZE) ? reserve_data(machine, size) : NULL;
+    memory->guarded = (data != NULL);
+
+    if (data == NULL) {
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (data == MAP_FAILED)
+            return -1;
+    }
+
+    memory->data = data;
+    memory->data_size = size;
+    memory->limit = memory->guarded ? MACHINE_MAX_DATA_SIZE / sizeof(*data) : size / sizeof(*data);
+
+    const size_t nwords = dirty_words(machine_page_count(machine));
+    memory->dirty = calloc(nwords, sizeof(*memory->dirty));
+    memory->used = calloc(nwords, sizeof(*memory->used));
+
+    if ((memory->dirty == NULL) || (memory->used == NULL))
+        return -1;
+
+    return store_log_init(&machine->memory_protocol, size / sizeof(*memory->data));
+}
+
+void machine_mark_dirty(rcpu_machine_t * const machine, const uint32_t address, const size_t nwords)
+{
+    if (nwords == 0)
+        return;
+
+    const size_t last = (address + nwords - 1) / MACHINE_PAGE_WORDS;
+
+    for (size_t page = address / MACHINE_PAGE_WORDS; page <= last; ++page)
+        machine->memory.dirty[page / 64] |= (uint64_t)1 << (page % 64);
+}
+
+void machine_clear_dirty(rcpu_machine_t * const machine)
+{
+    memory_image_t * const memory = &machine->memory;
+
+    for (size_t i = 0; i < dirty_words(machine_page_count(machine)); ++i) {
+        memory->used[i] |= memory->dirty[i];
+        memory->dirty[i] = 0;
+    }
+}
+
+bool machine_page_dirty(const rcpu_machine_t * const machine, const size_t page)
+{
+    return (machine->memory.dirty[page / 64] >> (page % 64)) & 1;
+}
+
+bool machine_page_used(const rcpu_machine_t * const machine, const size_t page)
+{
+    return ((machine->memory.dirty[page / 64] | machine->memory.used[page / 64]) >> (page % 64)) & 1;
+}
+
+#pragma mark Data images
+
+int machine_map_data(rcpu_machine_t * const machine, const char * const path)
+{
+    memory_image_t * const memory = &machine->memory;
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || ((st.st_size % sizeof(*memory->data)) != 0)
+        || ((size_t)st.st_size > memory->data_size)) {
+        close(fd);
+        return -1;
+    }
+
+    // The kernel fills the rest of the last page with zeroes
+    if ((st.st_size > 0)
+        && (mmap(memory->data, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+        close(fd);
+        return -1;
+    }
+
+    // The mapping stays valid once the file is closed
+    close(fd);
+
+    const size_t page_size = MACHINE_PAGE_WORDS * sizeof(*memory->data);
+    for (size_t page = 0; page < (st.st_size + page_size - 1) / page_size; ++page)
+        memory->used[page / 64] |= (uint64_t)1 << (page % 64);
+
+    return 0;
+}
+
+/*
+    Writes a run of bytes to a file at an offset, however many calls
+    it takes. Returns false if the file could not be written.
+*/
+static bool write_at(const int fd, const uint8_t * bytes, size_t size, off_t offset)
+{
+    while (size > 0) {
+        const ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written <= 0)
+            return false;
+
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+
+    return true;
+}
+
+int machine_dump_data(const rcpu_machine_t * const machine, const char * const path, const bool dirty_only)
+{
+    const memory_image_t * const memory = &machine->memory;
+    const size_t page_size = MACHINE_PAGE_WORDS * sizeof(*memory->data);
+    const size_t npages = machine_page_count(machine);
+
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+
+    // Pages not written are left as holes, which read as zeroes
+    bool written = (ftruncate(fd, memory->data_size) == 0);
+
+    for (size_t first = 0, last; written && (first < npages); first = last + 1) {
+        if (!(dirty_only ? machine_page_dirty(machine, first) : machine_page_used(machine, first))) {
+            last = first;
+            continue;
+        }
+
+        // Consecutive pages need only one write
+        for (last = first; last + 1 < npages; ++last) {
+            if (!(dirty_only ? machine_page_dirty(machine, last + 1) : machine_page_used(machine, last + 1)))
+                break;
+        }
+
+        written = write_at(fd, (const uint8_t *)memory->data + first * page_size,
+                           (last + 1 - first) * page_size, first * page_size);
+    }
+
+    return ((close(fd) == 0) && written) ? 0 : -1;
+}
+
+#pragma mark Releasing
+
+void machine_free(rcpu_machine_t * const machine)
+{
+    jit_free(machine);
+
+    store_log_free(&machine->memory_protocol);
+
+    free(machine->memory.decoded);
+    free_data(machine);
+    free(machine->memory.nop_runs);
+    free(machine->memory.code);
+    bzero(&machine->memory, sizeof(machine->memory));
+}
@@ -0,0 +1,448 @@
+/*!
+    @header Machine
+    A machine holds everything that makes up the state of a simulated
+    processor: the register bank, the flag, the memory image and the
+    memory protocol. Every stage of the pipeline and every engine takes
+    the machine it works on as an explicit parameter, so any number of
+    machines can be simulated in one process, also on several threads
+    at once, as long as no machine is used by two threads at a time.
+
+    @related Pipeline.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef MACHINE__MACHINE_H
+#define MACHINE__MACHINE_H
+
+#include "../Instruction/Predecode.h"
+#include "../Misc/StoreLog.h"
+#include "../Misc/StoreTrace.h"
+#include "../ProgramLoading.h"
+
+#include <stddef.h>
+
+/*!
+    @abstract
+        Type of the memory image of the processor
+    @discussion
+        Data and code are separated to allow for
+        pipelining. There is no way to load or otherwise
+        access code as data, so there is no way to write
+        self-modifying code.
+
+        Because of that, the code image is predecoded once
+        after loading. The pipeline only ever fetches from
+        decoded, which holds one entry per instruction in code.
+        nop_runs holds the length of the run of NOPs starting
+        at every address (see instruction_find_nop_runs).
+
+        The members needed by every LOAD, STORE and fetch come first.
+        Data memory is always mapped, e.g. from a checkpoint (see
+        Checkpoint.h), and may span the whole address space of 2^32
+        words. No swap space is reserved for the mapping, and the
+        kernel only provides a page once it is first touched, so the
+        memory used grows with the pages a program touches rather
+        than with the size of data memory.
+
+        Data memory of at least MACHINE_GUARD_DATA_SIZE bytes lies at
+        the start of a reservation of the whole address space,
+        MACHINE_MAX_DATA_SIZE bytes, the rest of which can not be
+        accessed (guarded is true). As every word address lies within
+        it, LOADs and STOREs are not checked against the size of data
+        memory. Instead, an access beyond its end
+        faults, and is recorded along with the instruction carrying it
+        out (see machine_set_locator) before the machine returns to its
+        recovery point (see machine_set_recovery), or the process is
+        aborted if it has none.
+
+        Smaller data memory, or data memory without room for the
+        reservation, e.g. as the address space of the process is
+        limited, is mapped on its own. Engines then check every word address against limit,
+        which is the number of words in data memory, and pass those
+        beyond it to machine_access_fault, which has the same effect as
+        the fault. With the reservation, limit is 2^32, so no word
+        address is ever beyond it, and engines do not check at all.
+        They tell both cases apart once per run, not on every access.
+
+        Data memory is divided into pages of MACHINE_PAGE_WORDS words.
+        dirty has one bit per page, which is set by every STORE to the
+        page and every write from outside (see machine_mark_dirty), so
+        pages that have not changed since the bits were last cleared
+        need not be looked at, e.g. when taking a checkpoint. Clearing
+        them moves them to used, so all other pages are still zero.
+*/
+typedef struct memory_image {
+    decoded_instruction_t * decoded;
+    uint32_t * data;
+    size_t     data_size;
+    size_t     limit;
+    bool       guarded;
+    uint64_t * dirty;
+    uint64_t * used;
+    uint32_t * nop_runs;
+    uint32_t * code;
+    size_t     code_size;
+} memory_image_t;
+
+// Number of words in a page of data memory (4 KB)
+#define MACHINE_PAGE_WORDS 1024
+
+// Default size of data memory in bytes
+#define MACHINE_DEFAULT_DATA_SIZE (1024 * 1024)
+
+// Size of data memory spanning the whole address space in bytes (16 GB)
+#define MACHINE_MAX_DATA_SIZE ((size_t)4 << 32)
+
+// Size of the smallest data memory lying in a guard region in bytes (1 GB).
+// Every reservation takes 16 GB of address space, so a process only
+// holds a few thousand of them. Smaller data memory does not take up a
+// reservation, so any number of machines can be created.
+#define MACHINE_GUARD_DATA_SIZE ((size_t)1 << 30)
+
+/*!
+    @abstract
+        Parses the size of data memory from a command line argument.
+    @discussion
+        The size is given in bytes and may end in K, M or G. It lives
+        in its own translation unit, DataSize.c, so the ahead-of-time
+        compiler shares it without linking the rest of the machine.
+
+    @param string
+        The argument.
+    @param size
+        Receives the size in bytes.
+
+    @return
+        0 on success, or -1 if the argument is malformed or no valid
+        size of data memory (see machine_alloc_data).
+*/
+int machine_parse_data_size(const char * const string, size_t * const size);
+
+// Translation cache of the JIT (see JIT.h)
+struct jit;
+
+struct rcpu_machine;
+
+/*!
+    @abstract
+        Where a LOAD or STORE is carried out.
+*/
+typedef struct machine_location {
+    uint32_t address;               // of the instruction
+    uint64_t cycle;                 // in which the pipeline runs its MEM stage
+} machine_location_t;
+
+/*!
+    @abstract
+        Type of a function returning the location of the LOAD or STORE
+        a machine currently carries out.
+    @discussion
+        It is only called once an access has faulted, or for STOREs
+        while they are traced, and is passed the state given to
+        machine_set_locator.
+*/
+typedef machine_location_t (*machine_locator_t)(const struct rcpu_machine * machine, const void * state);
+
+// Length of the report of a fault, including the terminating zero
+#define MACHINE_FAULT_REPORT 128
+
+/*!
+    @abstract
+        A LOAD or STORE beyond the end of data memory.
+*/
+typedef struct machine_fault {
+    uint32_t address;               // of the instruction
+    uint64_t cycle;                 // in which the pipeline runs its MEM stage
+    uint64_t word;                  // the word address accessed
+    bool store;                     // false for a LOAD
+
+    // e.g. "Illegal offset: STORE to word 0x40000 by the instruction at 0x7, ..."
+    char report[MACHINE_FAULT_REPORT];
+} machine_fault_t;
+
+/*!
+    @abstract
+        Type of a simulated processor.
+    @discussion
+        The register bank is accessed by almost every instruction and
+        starts on a cache line of its own. The flag and the memory image
+        share the cache line following it. Everything else is only
+        touched by LOADs and STOREs or not at all while running.
+*/
+typedef struct rcpu_machine {
+    // PC is the only special register, saved at index 31
+    _Alignas(64) uint32_t registers[32];
+
+    // True iff the previous comparison was true
+    bool flag;
+
+    memory_image_t memory;
+
+    // Addresses of all words stored to
+    store_log_t memory_protocol;
+
+    // Created when the JIT runs first, NULL before
+    struct jit * jit;
+
+    // Set by the engine running the machine, NULL otherwise
+    machine_locator_t locator;
+    const void * locator_state;
+
+    // The sigjmp_buf a fault returns to, NULL to abort instead
+    void * recovery;
+
+    // Set once an access has faulted
+    bool faulted;
+    machine_fault_t fault;
+
+    // Receives every STORE if not NULL
+    store_trace_t * trace;
+} rcpu_machine_t;
+
+/*!
+    @abstract
+        Resets a machine.
+    @discussion
+        Afterwards, all registers and the flag are 0, and the machine
+        has neither code nor data memory.
+
+    @param machine
+        The machine to reset.
+*/
+void machine_init(rcpu_machine_t * const machine);
+
+/*!
+    @abstract
+        Loads a code image into a machine.
+    @discussion
+        The code image is predecoded, and the machine gets data memory
+        filled with zeroes (see machine_alloc_data).
+
+    @param machine
+        The machine, which must have been reset using machine_init.
+    @param code
+        The code image, which must have been allocated using malloc.
+        The machine takes ownership of it.
+    @param ninstructions
+        The number of instructions in the code image.
+    @param data_size
+        The size of data memory in bytes.
+
+    @return
+        0 on success, or -1 if memory could not be allocated.
+*/
+int machine_load_code(rcpu_machine_t * const machine, uint32_t * const code, const size_t ninstructions,
+                      const size_t data_size);
+
+/*!
+    @abstract
+        Loads a program from disk into a machine.
+    @see machine_load_code
+
+    @param machine
+        The machine, which must have been reset using machine_init.
+    @param option
+        The format of the program (see ProgramLoading.h).
+    @param path
+        The path to the program.
+    @param data_size
+        The size of data memory in bytes.
+
+    @return
+        An error code (0 on success)
+*/
+int machine_load_program(rcpu_machine_t * const machine, const LOAD_OPTION option, const char * path,
+                         const size_t data_size);
+
+/*!
+    @abstract
+        Replaces the data memory of a machine by a new one filled with
+        zeroes, all pages of which are neither dirty nor used.
+    @discussion
+        The memory protocol is emptied as well. The memory is only
+        reserved; it is allocated page by page once the pages are
+        touched. If it is at least MACHINE_GUARD_DATA_SIZE bytes
+        large, the address space following it, up to
+        MACHINE_MAX_DATA_SIZE bytes, is reserved as well, but can not
+        be accessed, unless there is no room for it (see
+        memory_image_t).
+
+    @param machine
+        The machine.
+    @param size
+        The size of data memory in bytes, a multiple of the size of a
+        page up to MACHINE_MAX_DATA_SIZE.
+
+    @return
+        0 on success, or -1 if the size is invalid or memory could not
+        be mapped.
+*/
+int machine_alloc_data(rcpu_machine_t * const machine, const size_t size);
+
+/*!
+    @abstract
+        Tells a machine how to find the instruction carrying out a
+        LOAD or STORE, should the access fault or the STORE be traced.
+    @discussion
+        Every engine sets its locator once before it runs a program,
+        and clears it by passing NULL before it returns, so state only
+        has to stay valid for as long as the engine runs. Engines that
+        simulate a single cycle at a time leave this to their caller.
+        A fault clears the locator as well.
+
+    @param machine
+        The machine.
+    @param locator
+        The function returning the location of the instruction.
+    @param state
+        The state passed to locator, e.g. that of the engine.
+*/
+void machine_set_locator(rcpu_machine_t * const machine, const machine_locator_t locator,
+                         const void * const state);
+
+/*!
+    @abstract
+        Stops a machine whose data memory lies outside of a guard region,
+        as a LOAD or STORE accesses a word beyond memory.limit.
+    @discussion
+        The access is handled just like one that faulted: it is recorded
+        and the machine returns to its recovery point, or the process is
+        aborted (see machine_set_recovery).
+
+    @param machine
+        The machine.
+    @param address
+        The word address accessed.
+*/
+_Noreturn void machine_access_fault(rcpu_machine_t * const machine, const uint32_t address);
+
+/*!
+    @abstract
+        Lets a machine return to a recovery point once an access
+        faults, instead of aborting the process.
+    @discussion
+        The fault is recorded in the machine, which is marked as faulted,
+        and siglongjmp returns 1 to recovery on the thread running it.
+        The engine is left in the middle of a cycle, so the machine can
+        not be run any further. As the handler of the fault is left this
+        way, SIGSEGV stays blocked unless recovery saved the signal mask
+        or it is unblocked afterwards.
+
+        recovery is a sigjmp_buf, which is only declared by POSIX, and
+        has to stay valid for as long as the machine may run.
+
+    @param machine
+        The machine.
+    @param recovery
+        The sigjmp_buf set by sigsetjmp, or NULL to abort once an access
+        faults.
+*/
+void machine_set_recovery(rcpu_machine_t * const machine, void * const recovery);
+
+/*!
+    @abstract
+        Marks the pages holding a range of words of data memory as dirty.
+
+    @param machine
+        The machine.
+    @param address
+        The word address of the first word.
+    @param nwords
+        The number of words, all of which must be in data memory.
+*/
+void machine_mark_dirty(rcpu_machine_t * const machine, const uint32_t address, const size_t nwords);
+
+/*!
+    @abstract
+        Clears the dirty bits of all pages of data memory.
+*/
+void machine_clear_dirty(rcpu_machine_t * const machine);
+
+/*!
+    @abstract
+        Checks whether a page of data memory is dirty.
+
+    @param machine
+        The machine.
+    @param page
+        The index of the page.
+*/
+bool machine_page_dirty(const rcpu_machine_t * const machine, const size_t page);
+
+/*!
+    @abstract
+        Checks whether a page of data memory may have been written to at
+        all, so only pages for which this is true can hold anything but
+        zeroes.
+
+    @param machine
+        The machine.
+    @param page
+        The index of the page.
+*/
+bool machine_page_used(const rcpu_machine_t * const machine, const size_t page);
+
+/*!
+    @abstract
+        Returns the number of pages of data memory.
+*/
+size_t machine_page_count(const rcpu_machine_t * const machine);
+
+/*!
+    @abstract
+        Maps a file holding an image of data memory over the start of
+        data memory.
+    @discussion
+        The file is mapped copy-on-write, so it is neither copied nor
+        changed by STOREs, and its pages are only read once they are
+        touched. The image holds the words in host byte order, the
+        first one at address 0. Its pages are marked as used, but not
+        as dirty. Words beyond the image in its last page become zero.
+
+    @param machine
+        The machine.
+    @param path
+        The file, a multiple of 4 bytes long and at most as large as
+        data memory. It must not be changed while the machine exists.
+
+    @return
+        0 on success, -1 if the file could not be opened or mapped or
+        is no valid image.
+*/
+int machine_map_data(rcpu_machine_t * const machine, const char * const path);
+
+/*!
+    @abstract
+        Writes data memory to a file, as an image in the format read by
+        machine_map_data.
+    @discussion
+        The file is as large as data memory. Only the pages selected
+        are written, all others are left as holes reading as zeroes,
+        so a mostly untouched data memory takes little time and space
+        even if it is large.
+
+    @param machine
+        The machine.
+    @param path
+        The path to the file, which is overwritten.
+    @param dirty_only
+        true to write only the dirty pages, false to write all pages
+        that can hold anything but zeroes, i.e. all of data memory.
+
+    @return
+        0 on success, -1 if the file could not be written.
+*/
+int machine_dump_data(const rcpu_machine_t * const machine, const char * const path, const bool dirty_only);
+
+/*!
+    @abstract
+        Releases all memory held by a machine.
+
+    @param machine
+        The machine, which must not be used afterwards, unless it is
+        reset using machine_init.
+*/
+void machine_free(rcpu_machine_t * const machine);
+
+#endif /* MACHINE__MACHINE_H */
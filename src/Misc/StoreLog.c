@@ -0,0 +1,67 @@
+#include "StoreLog.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <strings.h> // bzero
+
+int store_log_init(store_log_t * const log, const size_t nwords)
+{
+    bzero(log, sizeof(*log));
+
+    log->recorded = calloc((nwords + 63) / 64, sizeof(*log->recorded));
+    log->nwords = nwords;
+
+    return (log->recorded != NULL) ? 0 : -1;
+}
+
+void store_log_add(store_log_t * const log, const uint32_t address)
+{
+    log->nstores++;
+    log->last = address;
+
+    uint64_t * const word = &log->recorded[address / 64];
+    const uint64_t bit = (uint64_t)1 << (address % 64);
+
+    if (*word & bit)
+        return;
+
+    *word |= bit;
+
+    if (log->count == log->capacity) {
+        log->capacity = (log->capacity > 0) ? 2 * log->capacity : 1024;
+        log->addresses = realloc(log->addresses, log->capacity * sizeof(*log->addresses));
+        assert((log->addresses != NULL) && "Failed to allocate memory");
+    }
+
+    log->addresses[log->count++] = address;
+}
+
+static int compare_addresses(const void * const a, const void * const b)
+{
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+void store_log_sort(store_log_t * const log)
+{
+    qsort(log->addresses, log->count, sizeof(*log->addresses), compare_addresses);
+}
+
+void store_log_clear(store_log_t * const log)
+{
+    for (size_t i = 0; i < log->count; ++i)
+        log->recorded[log->addresses[i] / 64] = 0;
+
+    log->count = 0;
+    log->nstores = 0;
+    log->last = 0;
+}
+
+void store_log_free(store_log_t * const log)
+{
+    free(log->recorded);
+    free(log->addresses);
+    bzero(log, sizeof(*log));
+}
@@ -0,0 +1,91 @@
+/*!
+    @header Store log
+    A store log records the word addresses written to by STOREs, each
+    one only once, in the order they were first written to.
+
+    Whether an address has been recorded already is looked up in a
+    bitmap with one bit per word, so adding an address takes constant
+    time, and the log never grows beyond one entry per word written
+    to, however often a program stores to the same words.
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef MISC__STORE_LOG_H
+#define MISC__STORE_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+    @abstract
+        Type of a store log.
+*/
+typedef struct store_log {
+    // One bit per word, set iff the word is in addresses
+    uint64_t * recorded;
+    size_t     nwords;
+
+    // Addresses in the order they were first written to
+    uint32_t * addresses;
+    size_t     count;
+    size_t     capacity;
+
+    // Number of STOREs, including those to words already recorded,
+    // and the address of the most recent one
+    uint64_t   nstores;
+    uint32_t   last;
+} store_log_t;
+
+/*!
+    @abstract
+        Creates an empty store log.
+
+    @param log
+        The log.
+    @param nwords
+        The number of words addresses can refer to.
+
+    @return
+        0 on success, or -1 if memory could not be allocated.
+*/
+int store_log_init(store_log_t * const log, const size_t nwords);
+
+/*!
+    @abstract
+        Records a STORE.
+
+    @param log
+        The log.
+    @param address
+        The word address written to, which must be less than the
+        number of words the log has been created for.
+*/
+void store_log_add(store_log_t * const log, const uint32_t address);
+
+/*!
+    @abstract
+        Sorts the addresses of a store log in ascending order, which
+        loses the order they were first written to.
+*/
+void store_log_sort(store_log_t * const log);
+
+/*!
+    @abstract
+        Forgets all STOREs.
+    @discussion
+        Only the bits of recorded addresses are cleared, so this takes
+        time proportional to the length of the log, not to the number
+        of words.
+*/
+void store_log_clear(store_log_t * const log);
+
+/*!
+    @abstract
+        Releases all memory held by a store log, which is empty
+        afterwards and can not be added to until it is created again.
+*/
+void store_log_free(store_log_t * const log);
+
+#endif /* MISC__STORE_LOG_H */
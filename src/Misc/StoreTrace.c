@@ -0,0 +1,210 @@
+#define _POSIX_C_SOURCE 200809L // nanosleep, must precede all includes
+#include "StoreTrace.h"
+
+#include <pthread.h>
+#include <sched.h> // sched_yield
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // memset
+#include <time.h> // nanosleep
+
+// Number of records in the ring buffer, a power of two
+#define STORE_TRACE_CAPACITY (1 << 16)
+
+// Records the writer drains before making room for the simulation
+#define STORE_TRACE_BATCH 4096
+
+// Size of the buffer the writer encodes records into
+#define STORE_TRACE_BUFFER_SIZE (64 * 1024)
+
+// Upper bound for the size of an encoded record
+#define STORE_TRACE_MAX_RECORD_SIZE (10 + 3 * 5)
+
+// Time the writer sleeps for once it has drained the ring buffer
+#define STORE_TRACE_IDLE_NS 100000
+
+typedef struct store_trace_record {
+    uint64_t cycle;
+    uint32_t instruction;
+    uint32_t address;
+    uint32_t value;
+} store_trace_record_t;
+
+/*
+    The simulation and the writer each own a cache line of their own,
+    so appending a record does not touch the line the writer updates
+    while draining.
+*/
+struct store_trace {
+    store_trace_record_t * ring;
+    FILE * out;
+    pthread_t writer;
+
+    // Written by the simulation
+    _Alignas(64) _Atomic(size_t) head;      // records appended
+    size_t known_tail;                      // tail as last read by the simulation
+    _Atomic(bool) finished;                 // nothing is appended any more
+
+    // Written by the writer
+    _Alignas(64) _Atomic(size_t) tail;      // records written
+    bool failed;
+
+    // The previous record written, which the next one is relative to
+    store_trace_record_t previous;
+};
+
+#pragma mark Encoding
+
+static uint8_t * encode_number(uint8_t * out, uint64_t value)
+{
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+
+    return out;
+}
+
+static uint8_t * encode_difference(uint8_t * const out, const uint32_t value, const uint32_t previous)
+{
+    const int32_t difference = (int32_t)(value - previous);
+    const uint32_t zigzag = ((uint32_t)difference << 1) ^ (uint32_t)(difference >> 31);
+
+    return encode_number(out, zigzag);
+}
+
+static uint8_t * encode_record(store_trace_t * const trace, uint8_t * out, const store_trace_record_t * const record)
+{
+    const store_trace_record_t * const previous = &trace->previous;
+
+    out = encode_number(out, record->cycle - previous->cycle);
+    out = encode_difference(out, record->instruction, previous->instruction);
+    out = encode_difference(out, record->address, previous->address);
+    out = encode_difference(out, record->value, previous->value);
+
+    trace->previous = *record;
+    return out;
+}
+
+#pragma mark Writer
+
+static void * writer_main(void * const argument)
+{
+    store_trace_t * const trace = argument;
+
+    uint8_t * const buffer = malloc(STORE_TRACE_BUFFER_SIZE);
+    uint8_t * out = buffer;
+    trace->failed = (buffer == NULL);
+
+    for (;;) {
+        // The final head is visible once finished is
+        const bool finished = atomic_load_explicit(&trace->finished, memory_order_acquire);
+        const size_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+
+        if (tail == head) {
+            if (finished)
+                break;
+
+            const struct timespec idle = { .tv_sec = 0, .tv_nsec = STORE_TRACE_IDLE_NS };
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        const size_t end = (head - tail > STORE_TRACE_BATCH) ? tail + STORE_TRACE_BATCH : head;
+
+        for (; tail != end; ++tail) {
+            if (trace->failed)
+                continue;
+
+            if (out + STORE_TRACE_MAX_RECORD_SIZE > buffer + STORE_TRACE_BUFFER_SIZE) {
+                trace->failed |= (fwrite(buffer, out - buffer, 1, trace->out) != 1);
+                out = buffer;
+            }
+
+            out = encode_record(trace, out, &trace->ring[tail & (STORE_TRACE_CAPACITY - 1)]);
+        }
+
+        atomic_store_explicit(&trace->tail, tail, memory_order_release);
+    }
+
+    if (!trace->failed && (out > buffer))
+        trace->failed = (fwrite(buffer, out - buffer, 1, trace->out) != 1);
+
+    free(buffer);
+    return NULL;
+}
+
+#pragma mark Tracing
+
+store_trace_t * store_trace_open(const char * const path)
+{
+    store_trace_t * const trace = aligned_alloc(_Alignof(store_trace_t), sizeof(store_trace_t));
+    if (trace == NULL)
+        return NULL;
+
+    memset(trace, 0, sizeof(*trace));
+    atomic_init(&trace->head, 0);
+    atomic_init(&trace->tail, 0);
+    atomic_init(&trace->finished, false);
+
+    trace->ring = malloc(STORE_TRACE_CAPACITY * sizeof(*trace->ring));
+    trace->out = fopen(path, "wb");
+
+    if ((trace->ring == NULL) || (trace->out == NULL)) {
+        if (trace->out != NULL)
+            fclose(trace->out);
+        free(trace->ring);
+        free(trace);
+        return NULL;
+    }
+
+    const uint32_t header[2] = { STORE_TRACE_VERSION, 0 };
+    fwrite(STORE_TRACE_MAGIC, 8, 1, trace->out);
+    fwrite(header, sizeof(header), 1, trace->out);
+
+    if (pthread_create(&trace->writer, NULL, writer_main, trace) != 0) {
+        fclose(trace->out);
+        free(trace->ring);
+        free(trace);
+        return NULL;
+    }
+
+    return trace;
+}
+
+void store_trace_add(store_trace_t * const trace, const uint64_t cycle, const uint32_t instruction,
+                     const uint32_t address, const uint32_t value)
+{
+    const size_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+
+    // Wait for the writer to make room, only reading its tail again once
+    // the ring buffer seems full
+    while (head - trace->known_tail == STORE_TRACE_CAPACITY) {
+        trace->known_tail = atomic_load_explicit(&trace->tail, memory_order_acquire);
+        if (head - trace->known_tail == STORE_TRACE_CAPACITY)
+            sched_yield();
+    }
+
+    trace->ring[head & (STORE_TRACE_CAPACITY - 1)] = (store_trace_record_t){
+        .cycle = cycle, .instruction = instruction, .address = address, .value = value
+    };
+    atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+}
+
+int store_trace_close(store_trace_t * const trace)
+{
+    atomic_store_explicit(&trace->finished, true, memory_order_release);
+    pthread_join(trace->writer, NULL);
+
+    const bool failed = trace->failed || ferror(trace->out);
+    const bool closed = (fclose(trace->out) == 0);
+
+    free(trace->ring);
+    free(trace);
+
+    return (!failed && closed) ? 0 : -1;
+}
@@ -0,0 +1,94 @@
+/*!
+    @header Store trace
+    A store trace streams every STORE of a run to a file, in the order
+    the STOREs are run, together with the instruction, the cycle and
+    the value stored. Unlike the memory protocol (see StoreLog.h), it
+    keeps repeated STOREs to the same word.
+
+    The simulation only appends records to a ring buffer in memory. A
+    writer thread of its own drains the buffer, encodes the records and
+    writes them to the file, so the simulation never waits for I/O,
+    only for room in the buffer should the writer fall behind. The ring
+    buffer has a single producer and a single consumer and needs no
+    locks.
+
+    A trace file consists of
+        - the magic number STORE_TRACE_MAGIC, not terminated,
+        - the version STORE_TRACE_VERSION as a 32 bit number,
+        - 32 bits of zeroes,
+        - one record per STORE, oldest first.
+    A record is a sequence of four numbers, each one encoded as an
+    unsigned LEB128 number, i.e. seven bits per byte, least significant
+    first, with the high bit set in all but the last byte:
+        - the cycle minus that of the previous record,
+        - the difference of the address of the instruction to that of
+          the previous record,
+        - the difference of the word address to that of the previous
+          record,
+        - the difference of the value to that of the previous record.
+    The first record is relative to zeroes. All differences but that of
+    the cycle are taken modulo 2^32 as signed 32 bit numbers and
+    zigzag-encoded, i.e. n is stored as 2n and -n as 2n - 1. Numbers in
+    the header are stored in host byte order.
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef MISC__STORE_TRACE_H
+#define MISC__STORE_TRACE_H
+
+#include <stdint.h>
+
+#define STORE_TRACE_MAGIC "RCPUSTRC"
+#define STORE_TRACE_VERSION 1
+
+/*!
+    @abstract
+        An opaque store trace.
+*/
+typedef struct store_trace store_trace_t;
+
+/*!
+    @abstract
+        Creates a trace file and starts the thread writing to it.
+
+    @param path
+        The path to the file, which is overwritten.
+
+    @return
+        The trace, or NULL if the file could not be created or the
+        thread could not be started.
+*/
+store_trace_t * store_trace_open(const char * const path);
+
+/*!
+    @abstract
+        Appends a STORE to a trace.
+    @discussion
+        Only one thread at a time may append to a trace.
+
+    @param trace
+        The trace.
+    @param cycle
+        The cycle in which the STORE is run.
+    @param instruction
+        The address of the STORE instruction.
+    @param address
+        The word address stored to.
+    @param value
+        The value stored.
+*/
+void store_trace_add(store_trace_t * const trace, const uint64_t cycle, const uint32_t instruction,
+                     const uint32_t address, const uint32_t value);
+
+/*!
+    @abstract
+        Writes all STOREs appended to a trace to its file, closes the
+        file and releases the trace.
+
+    @return
+        0 on success, or -1 if the file could not be written completely.
+*/
+int store_trace_close(store_trace_t * const trace);
+
+#endif /* MISC__STORE_TRACE_H */
@@ -2,33 +2,25 @@
 
 #include "../Instruction/ALUOps.h"
 
-#include <stdlib.h>
 #include <assert.h>
+#include <stddef.h> // NULL
 
-/*
-    our only flag.
-    True iff the previous comparison was true
-*/
-static bool flag = false;
-
-ex_result_t * execute(const id_result_t * const in)
+bool execute(rcpu_machine_t * const machine, const id_result_t * const in, ex_result_t * const res)
 {
     // if no input, return no output
     if (in == NULL)
-        return NULL;
-
-    ex_result_t * const res = calloc(1, sizeof(ex_result_t));
+        return false;
 
     res->n_pc = in->n_pc;
     res->inst = in->inst;
     res->branch_taken = 0;
+    res->result = 0;
 
     res->io_op = in->io_op;
 
-    const uint8_t opcode = instruction_decode_opcode(res->inst);
-    const instruction_type_t type = instruction_decode_type(res->inst);
+    const uint8_t opcode = res->inst->opcode;
 
-    switch (type) {
+    switch (res->inst->type) {
         case BINARY_ARITHMETIC:
             {
                 res->result = binary_functions[opcode](in->op1, in->op2);
@@ -41,12 +33,12 @@ ex_result_t * execute(const id_result_t * const in)
             }
         case COMPARE:
             {
-                flag = compare_functions[opcode](in->op1, in->op2);
+                machine->flag = compare_functions[opcode](in->op1, in->op2);
                 break;
             }
         case BRANCH:
             {
-                res->branch_taken = flag ? 1 : 0;
+                res->branch_taken = machine->flag ? 1 : 0;
                 res->result = in->op1 + in->op2;
                 break;
             }
@@ -57,12 +49,8 @@ ex_result_t * execute(const id_result_t * const in)
                 break;
             }
         case IO:
+            // Accesses beyond data memory fault in MEM (see Machine.h)
             res->result = in->op1 + in->op2;
-
-            assert((res->result >= 0)
-               && ((res->result * 4) < memory.data_size)
-               && "Illegal offset.");
-
             break;
         case MISC:
             ; // NOP
@@ -73,6 +61,5 @@ ex_result_t * execute(const id_result_t * const in)
             assert(false && "Instruction not supported.");
     }
 
-    free((void *)in);
-    return res;
+    return true;
 }
@@ -20,7 +20,7 @@
 */
 typedef struct ex_result {
     uint32_t n_pc;
-    uint32_t inst;
+    const decoded_instruction_t * inst;
 
     // 1 iff inst is branch and branch is taken, 
     // otherwise 0.
@@ -42,17 +42,21 @@ typedef struct id_result id_result_t;
     @abstract
         Execute the third stage of the pipeline.
 
+    @param machine
+        The machine the instruction is executed on.
     @param in
         The result of the previous stage.
         This parameter can be NULL. In that case,
-        no calculation is performed and NULL is
+        no calculation is performed and false is
         returned.
+    @param out
+        The latch to which the results of this
+        stage are written.
 
     @return
-        A pointer to a structure containing the
-        results of this stage or NULL, if no
+        true iff out has been written, false if no
         input was available.
 */
-ex_result_t * execute(const id_result_t * const in);
+bool execute(rcpu_machine_t * const machine, const id_result_t * const in, ex_result_t * const out);
 
 #endif // _EXECUTE_H
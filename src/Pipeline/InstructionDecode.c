@@ -6,65 +6,61 @@
 /*
     Returns the contents of register op
 */
-static uint32_t fetch_operand(const uint32_t op)
+static uint32_t fetch_operand(const rcpu_machine_t * const machine, const uint32_t op)
 {
     assert(op <= pc);
 
-    return registers[op];
+    return machine->registers[op];
 }
 
-id_result_t * instruction_decode(const if_result_t * const in)
+bool instruction_decode(const rcpu_machine_t * const machine,
+                        const if_result_t * const in, id_result_t * const res)
 {
     if (in == NULL)
-        return NULL;
+        return false;
 
-    const instruction_type_t type = instruction_decode_type(in->inst);
-
-    id_result_t * const res = calloc(1, sizeof(id_result_t));
+    const decoded_instruction_t * const inst = in->inst;
 
     res->n_pc = in->n_pc;
-    res->inst = in->inst;
+    res->inst = inst;
     res->op1 = res->op2 = 0;
+    res->io_op = 0;
 
-    switch (type) {
+    switch (inst->type) {
         case BINARY_ARITHMETIC:
         case COMPARE:
             {
-                res->op1 = fetch_operand(instruction_decode_operand(1, res->inst));
-                res->op2 = instruction_decode_operand(2, res->inst);
-                res->op2 = (instruction_is_immediate_variant(res->inst)) ? res->op2 : fetch_operand(res->op2);
+                res->op1 = fetch_operand(machine, inst->rs1);
+                res->op2 = (inst->is_immediate) ? inst->imm : fetch_operand(machine, inst->rs2);
                 break;
             }
         case UNARY_ARITHMETIC:
             {
-                res->op1 = instruction_decode_operand(1, res->inst);
-                res->op1 = (instruction_is_immediate_variant(res->inst)) ? res->op1 : fetch_operand(res->op1);
+                res->op1 = (inst->is_immediate) ? inst->imm : fetch_operand(machine, inst->rs1);
                 break;
             }
         case BRANCH:
         case JUMP:
             {
-                res->op1 = instruction_decode_operand(1, res->inst);
-                if (instruction_is_immediate_variant(res->inst))
-                    res->op1 += res->n_pc;
+                if (inst->is_immediate)
+                    res->op1 = inst->imm + res->n_pc;
                 else
-                    res->op1 = fetch_operand(res->op1);
+                    res->op1 = fetch_operand(machine, inst->rs1);
                 break;
             }
         case IO:
             {
-                const uint8_t opcode = instruction_decode_opcode(res->inst);
-                if (opcode == OPCODE_LOAD) {
-                    res->op1 = fetch_operand(instruction_decode_operand(1, res->inst));
-                    res->op2 = instruction_decode_operand(2, res->inst);
+                if (inst->opcode == OPCODE_LOAD) {
+                    res->op1 = fetch_operand(machine, inst->rs1);
+                    res->op2 = inst->imm;
 
-                    res->io_op = instruction_decode_destination(res->inst);
+                    res->io_op = inst->rd;
 
-                } else if (opcode == OPCODE_STORE) {
-                    res->op1 = fetch_operand(instruction_decode_operand(1, res->inst));
-                    res->op2 = instruction_decode_operand(2, res->inst);
+                } else if (inst->opcode == OPCODE_STORE) {
+                    res->op1 = fetch_operand(machine, inst->rs1);
+                    res->op2 = inst->imm;
 
-                    res->io_op = fetch_operand(instruction_decode_destination(res->inst));
+                    res->io_op = fetch_operand(machine, inst->rd);
                 } else {
                     assert(false && "Instruction not supported.");
                 }
@@ -76,7 +72,5 @@ id_result_t * instruction_decode(const if_result_t * const in)
             assert(false && "Instruction not supported.");
     }
 
-    // The input is no longer needed, so free the memory
-    free((void *)in);
-    return res;
+    return true;
 }
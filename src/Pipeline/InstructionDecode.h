@@ -18,7 +18,7 @@
 */
 typedef struct id_result {
     uint32_t n_pc;
-    uint32_t inst;
+    const decoded_instruction_t * inst;
 
     uint32_t op1; // Contents of first register parameter
     uint32_t op2; // Can either be register contents or an immediate value
@@ -36,15 +36,19 @@ typedef struct if_result if_result_t;
     @abstract
         Execute the second stage of the pipeline.
 
+    @param machine
+        The machine the instruction is executed on.
     @param in
         The output of the previous pipeline stage.
-        The memory for this input is released upon completion.
+    @param out
+        The latch to which the results of this stage are written.
 
     @result
-        Returns a pointer to a structure containing the results
-        of this stage. If the input was NULL, the output is also
-        NULL and the function returns immediately.
+        Returns true iff out has been written. If the input was
+        NULL, out is left untouched and the function returns false
+        immediately.
 */
-id_result_t * instruction_decode(const if_result_t * const in);
+bool instruction_decode(const rcpu_machine_t * const machine,
+                        const if_result_t * const in, id_result_t * const out);
 
 #endif // _INSTRUCTION_DECODE_H
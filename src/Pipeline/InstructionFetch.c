@@ -2,18 +2,18 @@
 
 #include <stdlib.h>
 
-if_result_t * instruction_fetch()
+bool instruction_fetch(rcpu_machine_t * const machine, if_result_t * const out)
 {
-    if_result_t * const res = calloc(1, sizeof(if_result_t));
-    res->n_pc = registers[pc] + 1;
-    res->inst = memory.code[registers[pc]];
+    uint32_t * const registers = machine->registers;
+    const decoded_instruction_t * const inst = &machine->memory.decoded[registers[pc]];
 
-    if (instruction_decode_opcode(res->inst) != OPCODE_HALT)
-        registers[pc]++;
-    else {
-        free(res);
-        // Return NULL on failure or if end was found
-        return NULL;
-    }
-    return res;
+    // Return false on failure or if end was found
+    if (inst->opcode == OPCODE_HALT)
+        return false;
+
+    out->n_pc = registers[pc] + 1;
+    out->inst = inst;
+
+    registers[pc]++;
+    return true;
 }
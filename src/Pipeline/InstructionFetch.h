@@ -17,17 +17,23 @@
 */
 typedef struct if_result {
     uint32_t n_pc;
-    uint32_t inst;
+    const decoded_instruction_t * inst;
 } if_result_t;
 
 /*!
     @abstract
         Execute the first stage of the pipeline.
+
+    @param machine
+        The machine the instruction is executed on.
+    @param out
+        The latch to which the loaded instruction and the
+        new PC are written.
     
     @return
-        Returns a pointer to a structure containing the loaded instruction
-        and the new PC, or NULL, if the loaded instruction was HALT.
+        Returns true iff an instruction was loaded into out, or
+        false, if the loaded instruction was HALT.
 */
-if_result_t * instruction_fetch();
+bool instruction_fetch(rcpu_machine_t * const machine, if_result_t * const out);
 
 #endif // _INSTRUCTION_FETCH_H
\ No newline at end of file
@@ -1,49 +1,67 @@
 #include "MemoryAccess.h"
-#include "../Misc/LinkedList.h"
 
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 
-static linked_list_t * memory_protocol = NULL;
-
-static void print_element(const void * element)
+void dump_memory_protocol(rcpu_machine_t * const machine)
 {
-    uint32_t addr = (uint32_t)element;
-    printf("[0x%x]: 0x%x\n", addr, memory.data[addr]);
+    store_log_t * const log = &machine->memory_protocol;
+
+    // The log is cleared anyway, so it can be sorted in place
+    store_log_sort(log);
+
+    for (size_t i = 0; i < log->count; ++i) {
+        const uint32_t addr = log->addresses[i];
+        printf("[0x%x]: 0x%x\n", addr, machine->memory.data[addr]);
+    }
+
+    store_log_clear(log);
 }
 
-void dump_memory_protocol()
+void memory_store(rcpu_machine_t * const machine, const uint32_t address, const uint32_t value)
 {
-    ll_map(memory_protocol, &print_element, 1);
-    ll_free(memory_protocol, 0);
+    machine->memory.data[address] = value;
+
+    const uint32_t page = address / MACHINE_PAGE_WORDS;
+    machine->memory.dirty[page / 64] |= (uint64_t)1 << (page % 64);
+
+    store_log_add(&machine->memory_protocol, address);
+
+    if (machine->trace != NULL) {
+        const machine_location_t location = machine->locator(machine, machine->locator_state);
+        store_trace_add(machine->trace, location.cycle, location.address, address, value);
+    }
 }
 
-mem_result_t * memory_access(const ex_result_t * const in)
+/*
+    Carries out the MEM stage. Word addresses are only checked against
+    the end of data memory if checked is true, which is only needed for
+    machines without a guard region (see memory_image_t).
+*/
+static inline bool access_memory(rcpu_machine_t * const machine, const ex_result_t * const in,
+                                 mem_result_t * const res, const bool checked)
 {
     if (in == NULL)
-        return NULL;
-
-    mem_result_t * const res = calloc(1, sizeof(mem_result_t));
+        return false;
 
     res->n_pc = in->n_pc;
     res->inst = in->inst;
     res->result = in->result;
     res->io_op = in->io_op;
 
-    const uint8_t type = instruction_decode_type(res->inst);
-
-    switch(type) {
+    switch(res->inst->type) {
         case IO:
             {
-                const uint32_t opcode = instruction_decode_opcode(res->inst);
+                const uint32_t opcode = res->inst->opcode;
+
+                if (checked && (in->result >= machine->memory.limit))
+                    machine_access_fault(machine, in->result);
+
                 if (opcode == OPCODE_LOAD) {
-                    res->result = memory.data[in->result];
+                    res->result = machine->memory.data[in->result];
                 } else if (opcode == OPCODE_STORE) {
-                    memory.data[in->result] = in->io_op;
-
-                    // Search for duplicates would be nice
-                    memory_protocol = ll_prepend_element(memory_protocol, (void *)((uint64_t)in->result));
+                    memory_store(machine, in->result, in->io_op);
                 }
                 break;
             }
@@ -62,7 +80,7 @@ mem_result_t * memory_access(const ex_result_t * const in)
         case JUMP:
             {
                 res->n_pc = in->result;
-                registers[pc] = res->n_pc;
+                machine->registers[pc] = res->n_pc;
 
                 break;
             }
@@ -71,6 +89,48 @@ mem_result_t * memory_access(const ex_result_t * const in)
             assert(false && "Instruction not supported.");
     }
 
-    free((void *)in);
-    return res;
+    return true;
+}
+
+bool memory_access(rcpu_machine_t * const machine, const ex_result_t * const in, mem_result_t * const out)
+{
+    return access_memory(machine, in, out, !machine->memory.guarded);
+}
+
+bool memory_access_guarded(rcpu_machine_t * const machine, const ex_result_t * const in, mem_result_t * const out)
+{
+    return access_memory(machine, in, out, false);
+}
+
+bool memory_access_checked(rcpu_machine_t * const machine, const ex_result_t * const in, mem_result_t * const out)
+{
+    return access_memory(machine, in, out, true);
+}
+
+// A LOAD or STORE outside of the EX/MEM latch
+typedef struct memory_site {
+    const ex_result_t * executed;
+    uint64_t cycle;
+} memory_site_t;
+
+static machine_location_t locate_site(const rcpu_machine_t * const machine, const void * const state)
+{
+    const memory_site_t * const site = state;
+    return (machine_location_t){ .address = site->executed->n_pc - 1, .cycle = site->cycle };
+}
+
+bool memory_access_at(rcpu_machine_t * const machine, const ex_result_t * const in, mem_result_t * const out,
+                      const uint64_t cycle)
+{
+    const machine_locator_t locator = machine->locator;
+    const void * const state = machine->locator_state;
+
+    // Only for this access, a fault clears the locator anyway
+    const memory_site_t site = { .executed = in, .cycle = cycle };
+    machine_set_locator(machine, locate_site, &site);
+
+    const bool written = memory_access(machine, in, out);
+
+    machine_set_locator(machine, locator, state);
+    return written;
 }
@@ -19,7 +19,7 @@
 */
 typedef struct mem_result {
     uint32_t n_pc;
-    uint32_t inst;
+    const decoded_instruction_t * inst;
 
     uint32_t result;
 
@@ -38,25 +38,83 @@ typedef struct ex_result ex_result_t;
     @discussion
         This function can be used to print a precise
         description of memory stores. Memory loads are
-        not logged.
+        not logged. Every word stored to is printed
+        once, in ascending order of addresses.
         This is useful both for debugging and for
         reading out values after calculation, as there
         is no console or something comparable.
+        Afterwards, the memory protocol is empty.
+
+    @param machine
+        The machine whose stores are printed.
+*/
+void dump_memory_protocol(rcpu_machine_t * const machine);
+
+/*!
+    @abstract
+        Store a value in data memory
+    @discussion
+        The store is recorded in the memory protocol and the trace of
+        the machine, if any, and the page written to is marked as
+        dirty.
+
+    @param machine
+        The machine whose data memory is written to.
+    @param address
+        The word address to write to.
+    @param value
+        The value to store.
 */
-void dump_memory_protocol();
+void memory_store(rcpu_machine_t * const machine, const uint32_t address, const uint32_t value);
 
 /*!
     @abstract Execute forth stage of pipeline
+    @discussion
+        The instruction is the one held by the EX/MEM latch, so the
+        locator set for the whole run finds it, should its access
+        fault or its STORE be traced (see pipeline_set_locator).
 
+    @param machine
+        The machine the instruction is executed on.
     @param in
         The output of the third stage: Execute (EX)
-        Can also be NULL, in which case the output will also be NULL.
+        Can also be NULL, in which case no output is written.
+    @param out
+        The latch to which the results of this stage are written.
 
     @return
-        Returns a pointer to a structure containing the results of this
-        stage. Iff the input is NULL, no calculation is performed and NULL is returned.
-        Otherwise, the returned pointer has to be released by the caller.
+        Returns true iff out has been written. Iff the input is NULL,
+        no calculation is performed and false is returned.
+*/
+bool memory_access(rcpu_machine_t * const machine, const ex_result_t * const in, mem_result_t * const out);
+
+/*!
+    @abstract
+        Variants of memory_access for a machine whose data memory lies
+        in a guard region, which never check the word address accessed,
+        and for one without, which always do (see memory_image_t).
+    @discussion
+        memory_access tells both cases apart on every call. A pipeline
+        running many cycles picks one of the variants once instead
+        (see pipeline_select_step).
+*/
+bool memory_access_guarded(rcpu_machine_t * const machine, const ex_result_t * const in, mem_result_t * const out);
+bool memory_access_checked(rcpu_machine_t * const machine, const ex_result_t * const in, mem_result_t * const out);
+
+/*!
+    @abstract
+        Executes the forth stage for an instruction outside of the
+        EX/MEM latch, e.g. one completed early when skipping NOPs.
+    @discussion
+        The locator of the machine points at the instruction only
+        for the duration of the access, and is restored afterwards.
+
+    @param cycle
+        The cycle the pipeline would run the stage in, which a fault
+        is reported and STOREs are traced with.
+    @see memory_access
 */
-mem_result_t * memory_access(const ex_result_t * const in);
+bool memory_access_at(rcpu_machine_t * const machine, const ex_result_t * const in, mem_result_t * const out,
+                      const uint64_t cycle);
 
 #endif
\ No newline at end of file
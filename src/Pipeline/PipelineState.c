@@ -0,0 +1,226 @@
+#include "PipelineState.h"
+#include "../Instruction/BasicBlock.h"
+
+#include <stdlib.h>
+#include <strings.h> // bzero
+
+/*
+    Returns a pointer to copy i of the latch `name`,
+    or NULL iff that copy does not hold an instruction.
+*/
+#define LATCH(state, name, i) \
+    ((state)->name##_valid[i] ? &(state)->name[i] : NULL)
+
+void pipeline_init(pipeline_state_t * const state)
+{
+    bzero(state, sizeof(*state));
+}
+
+/*
+    Locates the instruction in the EX/MEM latch, which pipeline_step
+    passes to the MEM stage before it counts the cycle.
+*/
+static machine_location_t locate_access(const rcpu_machine_t * const machine, const void * const state)
+{
+    const pipeline_state_t * const pipeline = state;
+
+    return (machine_location_t){
+        .address = pipeline->ex_mem[pipeline->current].n_pc - 1,
+        .cycle = pipeline->cycles
+    };
+}
+
+void pipeline_set_locator(rcpu_machine_t * const machine, const pipeline_state_t * const state)
+{
+    machine_set_locator(machine, locate_access, state);
+}
+
+// Number of instructions in flight after a fetch
+#define PIPELINE_DEPTH 4
+
+/*
+    Simulates a single cycle, see pipeline_step. LOADs and STOREs are
+    checked against the end of data memory iff checked is true.
+*/
+static inline bool step(rcpu_machine_t * const machine, pipeline_state_t * const state, const bool checked)
+{
+    const unsigned int cur = state->current;
+    const unsigned int next = cur ^ 1;
+    const ex_result_t * const executed = LATCH(state, ex_mem, cur);
+
+    // By going the 'wrong' way,
+    // we don't have to deal with
+    // mutexes etc
+    write_back(machine, LATCH(state, mem_wb, cur));
+    state->mem_wb_valid[next] = checked ? memory_access_checked(machine, executed, &state->mem_wb[next])
+                                        : memory_access_guarded(machine, executed, &state->mem_wb[next]);
+    state->ex_mem_valid[next] = execute(machine, LATCH(state, id_ex, cur), &state->ex_mem[next]);
+    state->id_ex_valid[next]  = instruction_decode(machine, LATCH(state, if_id, cur), &state->id_ex[next]);
+    state->if_id_valid[next]  = instruction_fetch(machine, &state->if_id[next]);
+
+    state->current = next;
+    state->cycles++;
+    state->halts += !state->if_id_valid[next];
+
+    return state->if_id_valid[next] || state->id_ex_valid[next]
+        || state->ex_mem_valid[next] || state->mem_wb_valid[next];
+}
+
+static bool step_guarded(rcpu_machine_t * const machine, pipeline_state_t * const state)
+{
+    return step(machine, state, false);
+}
+
+static bool step_checked(rcpu_machine_t * const machine, pipeline_state_t * const state)
+{
+    return step(machine, state, true);
+}
+
+bool pipeline_step(rcpu_machine_t * const machine, pipeline_state_t * const state)
+{
+    return machine->memory.guarded ? step_guarded(machine, state) : step_checked(machine, state);
+}
+
+pipeline_step_t pipeline_select_step(const rcpu_machine_t * const machine)
+{
+    return machine->memory.guarded ? step_guarded : step_checked;
+}
+
+static inline bool is_nop(const decoded_instruction_t * const inst)
+{
+    return inst->handler == HANDLER_NOP;
+}
+
+bool pipeline_step_profiled(rcpu_machine_t * const machine, pipeline_state_t * const state,
+                            pipeline_profile_t * const profile)
+{
+    const ex_result_t * const executed = pipeline_ex_mem(state);
+    const mem_result_t * const accessed = pipeline_mem_wb(state);
+
+    if (accessed == NULL)
+        profile->bubbles++;
+    else if (is_nop(accessed->inst))
+        profile->nops++;
+    else
+        profile->instructions++;
+
+    if (executed != NULL) {
+        profile->loads += (executed->inst->handler == HANDLER_LOAD);
+        profile->stores += (executed->inst->handler == HANDLER_STORE);
+        profile->branches += (executed->branch_taken != 0);
+    }
+
+    profile->cycles++;
+    return pipeline_step(machine, state);
+}
+
+/*
+    Checks whether an instruction writes its result to the PC register.
+*/
+static bool writes_pc(const decoded_instruction_t * const inst)
+{
+    return instruction_writes_register(inst) && (inst->rd == pc);
+}
+
+uint32_t pipeline_skip_nops(rcpu_machine_t * const machine, pipeline_state_t * const state,
+                            const uint64_t max_cycles)
+{
+    const memory_image_t * const memory = &machine->memory;
+    const uint32_t address = machine->registers[pc];
+
+    if (address >= memory->code_size / sizeof(*memory->code))
+        return 0;
+
+    // The first NOPs of a run are a run of their own
+    const uint32_t run = (memory->nop_runs[address] > max_cycles) ? (uint32_t)max_cycles
+                                                                   : memory->nop_runs[address];
+    if (run < PIPELINE_DEPTH)
+        return 0;
+
+    const if_result_t * fetched = pipeline_if_id(state);
+    const id_result_t * decoded = pipeline_id_ex(state);
+    const ex_result_t * executed = pipeline_ex_mem(state);
+    const mem_result_t * accessed = pipeline_mem_wb(state);
+
+    // NOPs in flight are no different from bubbles
+    if (fetched && is_nop(fetched->inst))
+        fetched = NULL;
+    if (decoded && is_nop(decoded->inst))
+        decoded = NULL;
+    if (executed && is_nop(executed->inst))
+        executed = NULL;
+    if (accessed && is_nop(accessed->inst))
+        accessed = NULL;
+
+    // Only the instruction yet to be decoded can still read the PC
+    if (fetched && (instruction_is_control_flow(fetched->inst) || writes_pc(fetched->inst)
+                    || instruction_reads_register(fetched->inst, pc)))
+        return 0;
+
+    if (decoded && (instruction_is_control_flow(decoded->inst) || writes_pc(decoded->inst)))
+        return 0;
+
+    // Whether a branch is taken is known after EX
+    if (executed && (executed->branch_taken || writes_pc(executed->inst)))
+        return 0;
+
+    // Branches in MEM have already changed the PC
+    if (accessed && writes_pc(accessed->inst))
+        return 0;
+
+    // Let all instructions in flight complete, the NOPs taking their
+    // place would not have any effect. Apart from the registers read
+    // by the instruction yet to be decoded, which may not see results
+    // written back later, only the order of the stages matters.
+    id_result_t id;
+    ex_result_t ex;
+    mem_result_t mem;
+
+    write_back(machine, accessed);
+    const bool has_id = instruction_decode(machine, fetched, &id);
+    const uint64_t cycle = state->cycles;
+
+    if (memory_access_at(machine, executed, &mem, cycle))
+        write_back(machine, &mem);
+    if (execute(machine, decoded, &ex) && memory_access_at(machine, &ex, &mem, cycle + 1))
+        write_back(machine, &mem);
+    if (has_id && execute(machine, &id, &ex) && memory_access_at(machine, &ex, &mem, cycle + 2))
+        write_back(machine, &mem);
+
+    // The latches hold the last NOPs of the run
+    const unsigned int cur = state->current;
+    const uint32_t last = address + run - 1;
+
+    state->if_id[cur] = (if_result_t){ .n_pc = last + 1, .inst = &memory->decoded[last] };
+    state->id_ex[cur] = (id_result_t){ .n_pc = last, .inst = &memory->decoded[last - 1] };
+    state->ex_mem[cur] = (ex_result_t){ .n_pc = last - 1, .inst = &memory->decoded[last - 2] };
+    state->mem_wb[cur] = (mem_result_t){ .n_pc = last - 2, .inst = &memory->decoded[last - 3] };
+
+    state->if_id_valid[cur] = state->id_ex_valid[cur] = true;
+    state->ex_mem_valid[cur] = state->mem_wb_valid[cur] = true;
+
+    machine->registers[pc] = last + 1;
+    state->cycles += run;
+
+    return run;
+}
+
+const if_result_t * pipeline_if_id(const pipeline_state_t * const state)
+{
+    return LATCH(state, if_id, state->current);
+}
+
+const id_result_t * pipeline_id_ex(const pipeline_state_t * const state)
+{
+    return LATCH(state, id_ex, state->current);
+}
+
+const ex_result_t * pipeline_ex_mem(const pipeline_state_t * const state)
+{
+    return LATCH(state, ex_mem, state->current);
+}
+
+const mem_result_t * pipeline_mem_wb(const pipeline_state_t * const state)
+{
+    return LATCH(state, mem_wb, state->current);
+}
@@ -0,0 +1,199 @@
+/*!
+    @header Pipeline state
+    The pipeline state holds the four latches sitting between the
+    five stages of the pipeline (IF/ID, ID/EX, EX/MEM and MEM/WB).
+
+    Every latch exists twice: One copy is read by the following
+    stage during the current cycle, the other one is written to by
+    the preceding stage. Both copies are swapped at the end of every
+    cycle. Each copy carries a valid bit, which is cleared iff the
+    stage writing to it had no input (a bubble).
+
+    All latches are allocated together with the state, so simulating
+    a cycle does not need to allocate any memory.
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef _PIPELINE_STATE_H
+#define _PIPELINE_STATE_H
+
+#include "Pipeline.h"
+
+/*!
+    @abstract
+        Type of the pipeline state.
+*/
+typedef struct pipeline_state {
+    // Index of the latch copies read during the current cycle.
+    // The other copies (current ^ 1) are written to.
+    unsigned int current;
+
+    if_result_t  if_id[2];
+    id_result_t  id_ex[2];
+    ex_result_t  ex_mem[2];
+    mem_result_t mem_wb[2];
+
+    bool if_id_valid[2];
+    bool id_ex_valid[2];
+    bool ex_mem_valid[2];
+    bool mem_wb_valid[2];
+
+    // Number of cycles simulated so far
+    uint64_t cycles;
+
+    // Number of those cycles in which HALT was fetched, so no
+    // instruction was
+    uint64_t halts;
+} pipeline_state_t;
+
+/*!
+    @abstract
+        Resets the pipeline state.
+    @discussion
+        Afterwards, all latches are empty and the cycle counter is 0.
+
+    @param state
+        The state to reset.
+*/
+void pipeline_init(pipeline_state_t * const state);
+
+/*!
+    @abstract
+        Lets a machine find the LOAD or STORE the pipeline carries
+        out, should it fault or be traced (see machine_set_locator).
+    @discussion
+        Whoever runs the pipeline sets the locator once before the
+        first cycle and clears it once it stops, instead of on every
+        cycle.
+
+    @param machine
+        The machine the program runs on.
+    @param state
+        The state of the pipeline, which has to stay valid until the
+        locator is cleared.
+*/
+void pipeline_set_locator(rcpu_machine_t * const machine, const pipeline_state_t * const state);
+
+/*!
+    @abstract
+        Simulates a single cycle.
+    @discussion
+        All five stages are executed in reverse order, so the
+        register bank is written to before it is read in the same
+        cycle, and changes to the PC are seen by the fetch stage
+        immediately. The locator of the machine has to be set using
+        pipeline_set_locator.
+
+    @param machine
+        The machine the program runs on.
+    @param state
+        The state of the pipeline.
+
+    @return
+        true iff at least one latch holds an instruction after
+        this cycle, i.e. the program has not finished yet.
+*/
+bool pipeline_step(rcpu_machine_t * const machine, pipeline_state_t * const state);
+
+/*!
+    @abstract
+        Type of pipeline_step and its variants.
+*/
+typedef bool (*pipeline_step_t)(rcpu_machine_t * const machine, pipeline_state_t * const state);
+
+/*!
+    @abstract
+        Picks the variant of pipeline_step for a machine.
+    @discussion
+        pipeline_step tells on every cycle whether LOADs and STOREs have
+        to be checked against the end of data memory, which is only the
+        case without a guard region (see memory_image_t). The variant
+        returned is specialised on that instead, so whoever runs many
+        cycles picks it once before the first one.
+
+    @param machine
+        The machine the program runs on. The variant stays valid until
+        its data memory is replaced.
+
+    @return
+        A function simulating a single cycle just like pipeline_step.
+*/
+pipeline_step_t pipeline_select_step(const rcpu_machine_t * const machine);
+
+/*!
+    @abstract
+        Events counted while profiling the pipeline.
+    @discussion
+        Every instruction spends exactly one cycle in each latch, so
+        the events are counted by looking at the latches before every
+        cycle: instructions and NOPs when they leave MEM/WB, bubbles
+        when MEM/WB is empty, and the other events in EX/MEM.
+*/
+typedef struct pipeline_profile {
+    uint64_t cycles;
+    uint64_t instructions;      // retired instructions other than NOPs
+    uint64_t nops;              // retired NOPs
+    uint64_t bubbles;           // cycles without an instruction to retire
+    uint64_t loads;
+    uint64_t stores;
+    uint64_t branches;          // taken branches
+} pipeline_profile_t;
+
+/*!
+    @abstract
+        Simulates a single cycle, counting what happens in it.
+    @see pipeline_step
+
+    @param profile
+        The counters, which are incremented.
+*/
+bool pipeline_step_profiled(rcpu_machine_t * const machine, pipeline_state_t * const state,
+                            pipeline_profile_t * const profile);
+
+/*!
+    @abstract
+        Skips a run of NOPs that is about to be fetched.
+    @discussion
+        NOPs have no effect, so fetching a run of n NOPs only lets the
+        instructions already in flight complete. If the run is at
+        least as long as the pipeline, those are completed right away
+        and the pipeline is left in the state it would have after
+        fetching all n NOPs, which takes constant time instead of n
+        cycles. The cycle counter still advances by n.
+
+        Nothing is skipped if an instruction in flight may change the
+        PC (taken branches, jumps and writes to the PC register) or
+        reads it, as the NOPs would not be fetched as expected then.
+
+    @param machine
+        The machine the program runs on.
+    @param state
+        The state of the pipeline.
+    @param max_cycles
+        The maximum number of cycles to skip. Longer runs are only
+        skipped in part.
+
+    @return
+        The number of cycles skipped, which may be 0.
+*/
+uint32_t pipeline_skip_nops(rcpu_machine_t * const machine, pipeline_state_t * const state,
+                            const uint64_t max_cycles);
+
+/*!
+    @abstract
+        Accessors for the latches that are read in the next cycle.
+
+    @param state
+        The state of the pipeline.
+
+    @return
+        A pointer to the respective latch, or NULL iff the latch
+        does not hold an instruction.
+*/
+const if_result_t * pipeline_if_id(const pipeline_state_t * const state);
+const id_result_t * pipeline_id_ex(const pipeline_state_t * const state);
+const ex_result_t * pipeline_ex_mem(const pipeline_state_t * const state);
+const mem_result_t * pipeline_mem_wb(const pipeline_state_t * const state);
+
+#endif // _PIPELINE_STATE_H
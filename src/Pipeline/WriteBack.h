@@ -24,11 +24,12 @@ typedef struct mem_result mem_result_t;
         either calculated in the Execute phase, or were loaded
         from memory in the Memory Access phase.
 
+    @param machine
+        The machine the instruction is executed on.
     @param in
         The output of the forth stage: Memory Access or
-        NULL if there is no such output. After processing,
-        the memory for this object is freed.
+        NULL if there is no such output.
 */
-void write_back(const mem_result_t * const in);
+void write_back(rcpu_machine_t * const machine, const mem_result_t * const in);
 
 #endif // _WRITE_BACK_H
\ No newline at end of file
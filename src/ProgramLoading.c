@@ -39,12 +39,12 @@ static uint32_t read_instruction_from_file(FILE * input)
     // Skip the first number
     while (isdigit(currentChar = fgetc(input)))
         ;
-    ungetc(currentChar, stdin);
+    ungetc(currentChar, input);
 
     // Skip whitespace between number and bit vector
     while (isspace(currentChar = fgetc(input)))
         ;
-    ungetc(currentChar, stdin);
+    ungetc(currentChar, input);
 
     while (isbinary(currentChar = fgetc(input))) {
         result = (result << 1) + (currentChar - '0');
@@ -120,7 +120,7 @@ int load_program_from_file(const LOAD_OPTION option, FILE * input,
             return 1;
 
         *code_out = code;
-        *size_out = cinst;
+        *size_out = cinst * sizeof(uint32_t);
 
         return 0;
     }
@@ -60,7 +60,7 @@ int load_program_from_path(const LOAD_OPTION option, const char * input_file,
         Output parameter for the code image. 
         The caller is responsible to release the memory returned in this parameter.
     @param size_out
-        Output parameter for the size of the code image.
+        Output parameter for the size of the code image in bytes.
 
     @return
         An error code (0 on success)
@@ -0,0 +1,279 @@
+#include "Sampling.h"
+
+#include <assert.h>
+#include <math.h> // sqrt, INFINITY
+#include <pthread.h>
+#include <stddef.h> // offsetof
+#include <stdlib.h>
+#include <unistd.h> // sysconf
+
+// Quantile of the normal distribution for a 95% confidence interval
+#define CONFIDENCE_QUANTILE 1.96
+
+/*
+    An interval to be profiled, which starts warmup cycles after its
+    snapshot was taken.
+*/
+typedef struct sampling_sample {
+    rcpu_snapshot_t * snapshot;     // released once the interval has been profiled
+    uint64_t warmup;
+    uint64_t begin;                 // the first cycle of the interval
+    rcpu_profile_t profile;
+} sampling_sample_t;
+
+typedef struct sampling {
+    const sampling_options_t * options;
+
+    // Appended to by the fast-forward, taken by the workers in order
+    pthread_mutex_t lock;
+    pthread_cond_t added;
+    sampling_sample_t * samples;
+    size_t nsamples;
+    size_t capacity;
+    size_t next;                    // the first sample no worker has taken yet
+    bool finished;                  // no more samples are added
+} sampling_t;
+
+#pragma mark Workers
+
+/*
+    Takes the next sample, waiting for the fast-forward to add one.
+    Returns false once all samples have been taken.
+*/
+static bool take_sample(sampling_t * const sampling, size_t * const index, sampling_sample_t * const sample)
+{
+    pthread_mutex_lock(&sampling->lock);
+
+    while ((sampling->next == sampling->nsamples) && !sampling->finished)
+        pthread_cond_wait(&sampling->added, &sampling->lock);
+
+    const bool found = (sampling->next < sampling->nsamples);
+    if (found) {
+        *index = sampling->next++;
+        *sample = sampling->samples[*index];
+    }
+
+    pthread_mutex_unlock(&sampling->lock);
+    return found;
+}
+
+static void * worker_main(void * const argument)
+{
+    sampling_t * const sampling = argument;
+
+    rcpu_options_t options = rcpu_default_options();
+    options.engine = RCPU_ENGINE_PIPELINE;
+
+    size_t index;
+    sampling_sample_t sample;
+
+    while (take_sample(sampling, &index, &sample)) {
+        rcpu_t * const rcpu = rcpu_fork(sample.snapshot, &options);
+        assert((rcpu != NULL) && "Failed to allocate memory");
+
+        rcpu_profile_t profile = { 0 };
+
+        // The pipeline takes over from the functional engine during the warm-up
+        if (rcpu_run(rcpu, sample.warmup))
+            rcpu_run_profiled(rcpu, sampling->options->interval, &profile);
+
+        rcpu_destroy(rcpu);
+        rcpu_snapshot_destroy(sample.snapshot);
+
+        // The array may have been moved by the fast-forward in the meantime
+        pthread_mutex_lock(&sampling->lock);
+        sampling->samples[index].snapshot = NULL;
+        sampling->samples[index].profile = profile;
+        pthread_mutex_unlock(&sampling->lock);
+    }
+
+    return NULL;
+}
+
+#pragma mark Fast-forward
+
+static void add_sample(sampling_t * const sampling, rcpu_snapshot_t * const snapshot,
+                       const uint64_t warmup, const uint64_t begin)
+{
+    pthread_mutex_lock(&sampling->lock);
+
+    if (sampling->nsamples == sampling->capacity) {
+        sampling->capacity = (sampling->capacity > 0) ? 2 * sampling->capacity : 64;
+        sampling->samples = realloc(sampling->samples, sampling->capacity * sizeof(*sampling->samples));
+        assert((sampling->samples != NULL) && "Failed to allocate memory");
+    }
+
+    sampling->samples[sampling->nsamples++] = (sampling_sample_t){
+        .snapshot = snapshot, .warmup = warmup, .begin = begin
+    };
+
+    pthread_cond_signal(&sampling->added);
+    pthread_mutex_unlock(&sampling->lock);
+}
+
+/*
+    Runs the program to the end, taking a snapshot before every
+    interval that is sampled. Returns the number of intervals.
+*/
+static size_t fast_forward(sampling_t * const sampling, rcpu_t * const rcpu)
+{
+    const sampling_options_t * const options = sampling->options;
+    const uint64_t start = rcpu_cycles(rcpu);
+
+    // The sampled intervals lie in the middle of every run of intervals,
+    // not at the start, which often is an initialization phase
+    for (uint64_t i = options->every / 2; ; i += options->every) {
+        const uint64_t begin = start + i * options->interval;
+        const uint64_t warmup = (begin - start < options->warmup) ? begin - start : options->warmup;
+
+        if (rcpu_cycles(rcpu) < begin - warmup)
+            rcpu_run(rcpu, begin - warmup - rcpu_cycles(rcpu));
+
+        if (!rcpu_run(rcpu, 0))
+            break;
+
+        rcpu_snapshot_t * const snapshot = rcpu_snapshot_create(rcpu);
+        assert((snapshot != NULL) && "Failed to allocate memory");
+
+        add_sample(sampling, snapshot, warmup, begin);
+    }
+
+    pthread_mutex_lock(&sampling->lock);
+    sampling->finished = true;
+    pthread_cond_broadcast(&sampling->added);
+    pthread_mutex_unlock(&sampling->lock);
+
+    const uint64_t cycles = rcpu_cycles(rcpu) - start;
+    return (cycles + options->interval - 1) / options->interval;
+}
+
+#pragma mark Estimates
+
+/*
+    Estimates the total of an event from the samples. member is the
+    offset of its counter in rcpu_profile_t.
+*/
+static sampling_estimate_t estimate(const sampling_t * const sampling, const size_t member,
+                                    const uint64_t cycles, const size_t intervals)
+{
+    const size_t n = sampling->nsamples;
+    double events = 0, sampled = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        const rcpu_profile_t * const profile = &sampling->samples[i].profile;
+
+        events += *(const uint64_t *)((const char *)profile + member);
+        sampled += profile->cycles;
+    }
+
+    if (sampled == 0)
+        return (sampling_estimate_t){ .total = 0, .error = INFINITY };
+
+    // Ratio estimator: events happen at the sampled rate throughout the run
+    const double rate = events / sampled;
+    const sampling_estimate_t result = { .total = rate * cycles, .error = 0 };
+
+    if (n >= intervals)
+        return result;
+    if (n < 2)
+        return (sampling_estimate_t){ .total = result.total, .error = INFINITY };
+
+    double variance = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const rcpu_profile_t * const profile = &sampling->samples[i].profile;
+        const double residual = *(const uint64_t *)((const char *)profile + member) - rate * profile->cycles;
+
+        variance += residual * residual;
+    }
+    variance /= (n - 1);
+
+    // With the correction for sampling without replacement
+    const double error = CONFIDENCE_QUANTILE * intervals * sqrt((1.0 - (double)n / intervals) * variance / n);
+    return (sampling_estimate_t){ .total = result.total, .error = error };
+}
+
+#pragma mark Sampled runs
+
+int sampling_run(rcpu_t * const rcpu, const sampling_options_t * const options,
+                 sampling_result_t * const result)
+{
+    if ((options->interval == 0) || (options->every == 0) || (rcpu_data(rcpu, NULL) == NULL))
+        return -1;
+
+    sampling_t sampling = { .options = options };
+    pthread_mutex_init(&sampling.lock, NULL);
+    pthread_cond_init(&sampling.added, NULL);
+
+    const uint64_t start = rcpu_cycles(rcpu);
+
+    // The calling thread fast-forwards while the workers profile
+    long nworkers = (options->threads != 0) ? options->threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers < 1)
+        nworkers = 1;
+
+    pthread_t * const threads = calloc(nworkers, sizeof(*threads));
+    assert((threads != NULL) && "Failed to allocate memory");
+
+    long started = 0;
+    while ((started < nworkers) && (pthread_create(&threads[started], NULL, worker_main, &sampling) == 0))
+        started++;
+
+    const size_t intervals = fast_forward(&sampling, rcpu);
+
+    // Without any worker thread, the calling thread profiles as well
+    if (started == 0)
+        worker_main(&sampling);
+
+    for (long i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    // The program may finish during the warm-up of the last sample
+    while ((sampling.nsamples > 0) && (sampling.samples[sampling.nsamples - 1].begin >= rcpu_cycles(rcpu)))
+        sampling.nsamples--;
+
+    *result = (sampling_result_t){
+        .cycles = rcpu_cycles(rcpu) - start,
+        .intervals = intervals,
+        .samples = sampling.nsamples,
+        .threads = (started > 0) ? (unsigned int)started : 1
+    };
+
+    for (size_t i = 0; i < sampling.nsamples; ++i)
+        result->profiled_cycles += sampling.samples[i].profile.cycles;
+
+    const uint64_t cycles = result->cycles;
+
+    result->instructions = estimate(&sampling, offsetof(rcpu_profile_t, instructions), cycles, intervals);
+    result->nops = estimate(&sampling, offsetof(rcpu_profile_t, nops), cycles, intervals);
+    result->bubbles = estimate(&sampling, offsetof(rcpu_profile_t, bubbles), cycles, intervals);
+    result->loads = estimate(&sampling, offsetof(rcpu_profile_t, loads), cycles, intervals);
+    result->stores = estimate(&sampling, offsetof(rcpu_profile_t, stores), cycles, intervals);
+    result->branches = estimate(&sampling, offsetof(rcpu_profile_t, branches), cycles, intervals);
+
+    free(threads);
+    free(sampling.samples);
+    pthread_cond_destroy(&sampling.added);
+    pthread_mutex_destroy(&sampling.lock);
+
+    return 0;
+}
+
+static void print_estimate(FILE * const out, const char * const name, const sampling_estimate_t * const estimate,
+                           const uint64_t cycles)
+{
+    fprintf(out, "%-13s%.0f +- %.0f (%.4f per cycle)\n", name, estimate->total, estimate->error,
+            (cycles > 0) ? estimate->total / cycles : 0.0);
+}
+
+void sampling_print_result(FILE * const out, const sampling_result_t * const result)
+{
+    fprintf(out, "sampled:     %zu of %zu intervals, %llu cycles profiled on %u threads\n",
+            result->samples, result->intervals, (unsigned long long)result->profiled_cycles, result->threads);
+
+    print_estimate(out, "retired:", &result->instructions, result->cycles);
+    print_estimate(out, "nops:", &result->nops, result->cycles);
+    print_estimate(out, "bubbles:", &result->bubbles, result->cycles);
+    print_estimate(out, "loads:", &result->loads, result->cycles);
+    print_estimate(out, "stores:", &result->stores, result->cycles);
+    print_estimate(out, "branches:", &result->branches, result->cycles);
+}
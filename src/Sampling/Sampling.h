@@ -0,0 +1,100 @@
+/*!
+    @header Interval sampling
+    Estimates what happens in the pipeline during a long run without
+    simulating all of it stage by stage.
+
+    The run is split into intervals of a fixed number of cycles. A fast
+    engine runs the program from start to end once, taking a snapshot
+    (see rcpu_snapshot_create) shortly before every n-th interval.
+    Meanwhile, a pool of worker threads forks a pipeline from each
+    snapshot, runs it through a short warm-up and then profiles the
+    interval (see rcpu_run_profiled). Starting from a snapshot of the
+    functional engine, the warm-up lets the pipeline take over before
+    the interval starts.
+
+    The profiles of all sampled intervals are combined into estimates
+    for the whole run using a ratio estimator: every event is assumed
+    to happen at the rate it happened at in the sampled cycles. The
+    error bound is the half-width of a 95% confidence interval of that
+    estimate, which shrinks as more intervals are sampled and is 0 if
+    all of them are. The number of cycles itself is always exact, as
+    every engine counts cycles just like the pipeline.
+
+    @related rcpu.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef SAMPLING__SAMPLING_H
+#define SAMPLING__SAMPLING_H
+
+#include "../Library/rcpu.h"
+
+/*!
+    @abstract
+        Settings of a sampled run.
+*/
+typedef struct sampling_options {
+    uint64_t interval;              // cycles per interval
+    uint64_t every;                 // every n-th interval is sampled, 1 for all of them
+    uint64_t warmup;                // cycles the pipeline runs before an interval, not profiled
+    unsigned int threads;           // number of worker threads, 0 for one per core
+} sampling_options_t;
+
+/*!
+    @abstract
+        An estimate of the number of times an event happened in a run.
+*/
+typedef struct sampling_estimate {
+    double total;
+    double error;                   // half-width of the 95% confidence interval, INFINITY if unknown
+} sampling_estimate_t;
+
+/*!
+    @abstract
+        The results of a sampled run.
+*/
+typedef struct sampling_result {
+    uint64_t cycles;                // cycles run, exact
+    size_t intervals;               // intervals of the whole run
+    size_t samples;                 // intervals that were profiled
+    uint64_t profiled_cycles;       // cycles that were profiled
+    unsigned int threads;
+
+    sampling_estimate_t instructions;
+    sampling_estimate_t nops;
+    sampling_estimate_t bubbles;
+    sampling_estimate_t loads;
+    sampling_estimate_t stores;
+    sampling_estimate_t branches;
+} sampling_result_t;
+
+/*!
+    @abstract
+        Runs a program until it has finished, profiling a sample of its
+        intervals on the pipeline in parallel.
+
+    @param rcpu
+        The machine, which has loaded (or restored) the program and is
+        run to the end by its own engine. Intervals are counted from its
+        current cycle. Afterwards, it can be inspected as after rcpu_run.
+    @param options
+        The settings of the sampled run.
+    @param result
+        Output parameter for the estimates.
+
+    @return
+        0 on success, -1 if the interval or sampling rate is 0, or no
+        program has been loaded.
+*/
+int sampling_run(rcpu_t * const rcpu, const sampling_options_t * const options,
+                 sampling_result_t * const result);
+
+/*!
+    @abstract
+        Prints the results of a sampled run, one line per event with its
+        estimated total, error bound and rate per cycle.
+*/
+void sampling_print_result(FILE * const out, const sampling_result_t * const result);
+
+#endif /* SAMPLING__SAMPLING_H */
@@ -1,7 +1,7 @@
-#include "Pipeline/Pipeline.h"
-
-#include "Instruction/Disassemble.h"
-#include "ProgramLoading.h"
+#include "Library/rcpu.h"
+#include "Batch/Batch.h"
+#include "Sampling/Sampling.h"
+#include "Machine/Machine.h" // machine_parse_data_size
 
 #include <stdlib.h> // EXIT_SUCCESS
 
@@ -11,143 +11,596 @@
 #endif
 
 #include <assert.h> // assert
-#include <strings.h> // bzero
+#include <time.h> // timespec_get
+
+void print_usage(const char *program)
+{
+    printf("[Usage:] %s --program-kind [textual | binary] --program binary [--mode [pipeline | functional | threaded | jit | tiered]] [--hot-threshold n] [--fuse] [--data-size bytes] [--data-image file] [--checkpoint file [--checkpoint-cycle n]] [--delta-checkpoint file [--delta-cycle n]] [--sample interval [--sample-every n] [--sample-warmup n] [--threads n]] [--detail-from point] [--detail-until point] [--store-trace file] [--dump-memory file [--dump-dirty]] [--single-stepping] [--statistics]\n", program);
+    printf("[Usage:] %s --restore checkpoint [--mmap] [--apply delta ...] [--mode ...] [--hot-threshold n] [--fuse] [--checkpoint file [--checkpoint-cycle n]] [--delta-checkpoint file [--delta-cycle n]] [--sample interval ...] [--detail-from point] [--detail-until point] [--store-trace file] [--dump-memory file [--dump-dirty]] [--single-stepping] [--statistics]\n", program);
+    printf("[Points:] cycle:n | pc:address | instructions:n\n");
+    printf("[Usage:] %s --program-kind [textual | binary] --batch manifest [--output file] [--threads n] [--max-cycles n] [--warmup n] [--lockstep] [--changes] [--mode ...] [--hot-threshold n] [--fuse] [--data-size bytes] [--statistics]\n", program);
+}
 
 /*
-    Register file.
-    PC is the only special register, saved at index 31 
+    Returns the current time in seconds.
 */
-uint32_t registers[32];
+static double current_time()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
 /*
-    memory is the memory image of our processor.
+    Parses a point to run until, written as cycle:n, pc:address or
+    instructions:n. Returns false if it is malformed.
 */
-memory_image_t memory;
+static bool parse_point(const char * const string, rcpu_until_t * const until, uint64_t * const value)
+{
+    const char * const colon = strchr(string, ':');
+    if ((colon == NULL) || (colon[1] == '\0'))
+        return false;
 
-void print_usage(const char *program)
+    const size_t length = colon - string;
+    if ((length == strlen("cycle")) && (strncmp(string, "cycle", length) == 0))
+        *until = RCPU_UNTIL_CYCLE;
+    else if ((length == strlen("pc")) && (strncmp(string, "pc", length) == 0))
+        *until = RCPU_UNTIL_ADDRESS;
+    else if ((length == strlen("instructions")) && (strncmp(string, "instructions", length) == 0))
+        *until = RCPU_UNTIL_INSTRUCTIONS;
+    else
+        return false;
+
+    char *end;
+    *value = strtoull(colon + 1, &end, 0);
+    return *end == '\0';
+}
+
+// Snapshots kept for going back while single stepping
+#define HISTORY_SNAPSHOTS 64
+
+// Breakpoints for going back while single stepping
+#define MAX_BREAKPOINTS 16
+
+/*
+    Single steps through a program, forwards and backwards. Commands:
+        <Enter> or s    step one cycle forwards
+        b [n]           step n cycles backwards (default 1)
+        break address   set a breakpoint, where address is a PC
+        rc              go back to the last cycle a breakpoint was reached
+        w address       go back to the last STORE to a word address
+        c               continue without single stepping
+    Single stepping ends once the program has finished and is stepped
+    forwards once more, or with CTRL+D.
+*/
+static void single_step(rcpu_t * const rcpu)
 {
-    printf("[Usage:] %s --program-kind [textual | binary] --program binary [--single-stepping]\n", program);
+    rcpu_history_t * const history = rcpu_history_create(rcpu, HISTORY_SNAPSHOTS);
+    assert((history != NULL) && "Failed to allocate memory");
+
+    uint32_t breakpoints[MAX_BREAKPOINTS];
+    size_t nbreakpoints = 0;
+    const char * message = "";
+
+    bool stepping = true;
+    bool running = rcpu_history_run(history, 1);
+
+    while (stepping) {
+        // Escape sequence that makes the terminal window look like its empty
+        fprintf(stdout, "\033[2J\033[1;1H");
+        rcpu_print_state(rcpu, stdout);
+        fprintf(stdout, "%s\ncycle %llu> ", message, (unsigned long long)rcpu_cycles(rcpu));
+        message = "";
+
+        // Wait for user input, hit CTRL+D to stop
+        char line[128];
+        if (fgets(line, sizeof(line), stdin) == NULL)
+            break;
+
+        // strtoll, unlike sscanf, handles arguments out of range
+        char command[16] = "s";
+        int length = 0;
+        sscanf(line, "%15s%n", command, &length);
+
+        char *end;
+        const long long argument = strtoll(line + length, &end, 0);
+        const int nfields = (end != line + length) ? 2 : 1;
+
+        int result = 0;
+        if ((nfields == 2) && (argument < 0)) {
+            message = "Arguments can not be negative.";
+        } else if (strcmp(command, "s") == 0) {
+            stepping = running;
+            running = rcpu_history_run(history, 1);
+        } else if (strcmp(command, "b") == 0) {
+            const uint64_t steps = (nfields == 2) ? argument : 1;
+            const uint64_t cycles = rcpu_cycles(rcpu);
+
+            result = rcpu_history_seek(history, (steps < cycles) ? cycles - steps : 0);
+        } else if ((strcmp(command, "break") == 0) && (nfields == 2) && (nbreakpoints < MAX_BREAKPOINTS)) {
+            breakpoints[nbreakpoints++] = (uint32_t)argument;
+        } else if (strcmp(command, "rc") == 0) {
+            result = rcpu_history_reverse_continue(history, breakpoints, nbreakpoints);
+            if (result == 1)
+                message = "No breakpoint reached, back at the start.";
+        } else if ((strcmp(command, "w") == 0) && (nfields == 2)) {
+            result = rcpu_history_reverse_to_store(history, (uint32_t)argument);
+            if (result == 1)
+                message = "No STORE to that address.";
+        } else if (strcmp(command, "c") == 0) {
+            stepping = false;
+        } else {
+            message = "Unknown command.";
+        }
+
+        assert((result >= 0) && "Failed to allocate memory");
+
+        // The program stays where it went back to, so it may run again
+        running = rcpu_run(rcpu, 0);
+    }
+
+    rcpu_history_destroy(history);
+}
+
+/*
+    Runs all jobs of a manifest, writing the results to the output file
+    or to stdout.
+*/
+static int run_batch(const char * manifest, const char * output,
+                     const batch_options_t * const options, const bool statistics)
+{
+    FILE * const out = (output != NULL) ? fopen(output, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "Could not open %s\n", output);
+        return EXIT_FAILURE;
+    }
+
+    const double start_time = current_time();
+    batch_statistics_t totals;
+
+    const int error = batch_run(manifest, out, options, &totals);
+
+    const double elapsed = current_time() - start_time;
+
+    if (out != stdout)
+        fclose(out);
+
+    if (error != 0) {
+        fprintf(stderr, "Could not read %s\n", manifest);
+        return EXIT_FAILURE;
+    }
+
+    if (statistics) {
+        fprintf(stderr, "jobs:        %zu (%zu not loaded, %zu stopped at the cycle limit, %zu faulted)\n",
+                totals.jobs, totals.failed, totals.stopped, totals.faulted);
+        fprintf(stderr, "threads:     %u, %zu steals\n", totals.threads, totals.steals);
+        if (options->lockstep)
+            fprintf(stderr, "lockstep:    %zu groups\n", totals.groups);
+        fprintf(stderr, "cycles:      %llu\n", (unsigned long long)totals.cycles);
+        fprintf(stderr, "time:        %.6f s\n", elapsed);
+        fprintf(stderr, "jobs/sec:    %.0f\n", totals.jobs / elapsed);
+        fprintf(stderr, "cycles/sec:  %.0f\n", totals.cycles / elapsed);
+    }
+
+    return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[])
 {
     bool programKindSet = false;
-    LOAD_OPTION programKind = OPT_BINARY;
     bool singleStepping = false;
+    bool statistics = false;
+    bool lockstep = false;
+    bool changes = false;
+    bool modeSet = false;
+    rcpu_options_t options = rcpu_default_options();
+    rcpu_format_t programKind = RCPU_FORMAT_BINARY;
     char *programString = NULL;
+    char *batchString = NULL;
+    char *outputString = NULL;
+    char *restoreString = NULL;
+    char *checkpointString = NULL;
+    uint64_t checkpointCycle = 0;
+    char *deltaString = NULL;
+    uint64_t deltaCycle = 0;
+    char **applyStrings = malloc(argc * sizeof(*applyStrings));
+    unsigned int applyCount = 0;
+    bool mapCheckpoint = false;
+    unsigned int threads = 0;
+    uint64_t maxCycles = RCPU_RUN_UNTIL_HALT;
+    uint64_t warmup = 0;
+    sampling_options_t sampling = { .every = 10, .warmup = 100 };
+    char *dataSizeString = NULL;
+    char *detailFromString = NULL;
+    char *detailUntilString = NULL;
+    char *storeTraceString = NULL;
+    char *dataImageString = NULL;
+    char *dumpMemoryString = NULL;
+    bool dumpDirty = false;
+    rcpu_until_t detailFrom = RCPU_UNTIL_CYCLE, detailUntil = RCPU_UNTIL_CYCLE;
+    uint64_t detailFromValue = 0, detailUntilValue = 0;
 
     // preliminary parameter parsing
     for (unsigned int i = 1; i < argc; ++i) {
         if (strcmp("--single-stepping", argv[i]) == 0)
             singleStepping = true;
+        else if (strcmp("--statistics", argv[i]) == 0)
+            statistics = true;
+        else if (strcmp("--fuse", argv[i]) == 0)
+            options.fuse = true;
+        else if (strcmp("--lockstep", argv[i]) == 0)
+            lockstep = true;
+        else if (strcmp("--mmap", argv[i]) == 0)
+            mapCheckpoint = true;
+        else if (strcmp("--changes", argv[i]) == 0)
+            changes = true;
+        else if (strcmp("--dump-dirty", argv[i]) == 0)
+            dumpDirty = true;
+        else if (strcmp("--hot-threshold", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                options.hot_threshold = strtoul(argv[i+1], NULL, 0);
+            }
+        }
         else if (strcmp("--program-kind", argv[i]) == 0) {
             if ((i + 1) < argc) {
                 if (strcmp("binary", argv[i+1]) == 0) {
                     programKindSet = true;
-                    programKind = OPT_BINARY;
+                    programKind = RCPU_FORMAT_BINARY;
                 } else if (strcmp("textual", argv[i+1]) == 0) {
                     programKindSet = true;
-                    programKind = OPT_TEXTUAL;
+                    programKind = RCPU_FORMAT_TEXTUAL;
                 } else {
                     print_usage(argv[0]);
                     return EXIT_FAILURE;
                 }
             }
         }
+        else if (strcmp("--batch", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                batchString = argv[i+1];
+            }
+        }
+        else if (strcmp("--output", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                outputString = argv[i+1];
+            }
+        }
+        else if (strcmp("--threads", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                threads = strtoul(argv[i+1], NULL, 0);
+            }
+        }
+        else if (strcmp("--max-cycles", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                maxCycles = strtoull(argv[i+1], NULL, 0);
+            }
+        }
+        else if (strcmp("--restore", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                restoreString = argv[i+1];
+            }
+        }
+        else if (strcmp("--checkpoint", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                checkpointString = argv[i+1];
+            }
+        }
+        else if (strcmp("--checkpoint-cycle", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                checkpointCycle = strtoull(argv[i+1], NULL, 0);
+            }
+        }
+        else if (strcmp("--delta-checkpoint", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                deltaString = argv[i+1];
+            }
+        }
+        else if (strcmp("--delta-cycle", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                deltaCycle = strtoull(argv[i+1], NULL, 0);
+            }
+        }
+        else if (strcmp("--apply", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                applyStrings[applyCount++] = argv[i+1];
+            }
+        }
+        else if (strcmp("--sample", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                sampling.interval = strtoull(argv[i+1], NULL, 0);
+            }
+        }
+        else if (strcmp("--sample-every", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                sampling.every = strtoull(argv[i+1], NULL, 0);
+            }
+        }
+        else if (strcmp("--sample-warmup", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                sampling.warmup = strtoull(argv[i+1], NULL, 0);
+            }
+        }
+        else if (strcmp("--data-size", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                dataSizeString = argv[i+1];
+            }
+        }
+        else if (strcmp("--detail-from", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                detailFromString = argv[i+1];
+            }
+        }
+        else if (strcmp("--detail-until", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                detailUntilString = argv[i+1];
+            }
+        }
+        else if (strcmp("--store-trace", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                storeTraceString = argv[i+1];
+            }
+        }
+        else if (strcmp("--data-image", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                dataImageString = argv[i+1];
+            }
+        }
+        else if (strcmp("--dump-memory", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                dumpMemoryString = argv[i+1];
+            }
+        }
+        else if (strcmp("--warmup", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                warmup = strtoull(argv[i+1], NULL, 0);
+            }
+        }
         else if (strcmp("--program", argv[i]) == 0) {
             if ((i + 1) < argc) {
                 programString = argv[i+1];
             }
         }
+        else if (strcmp("--mode", argv[i]) == 0) {
+            if ((i + 1) < argc) {
+                modeSet = true;
+                if (strcmp("pipeline", argv[i+1]) == 0) {
+                    options.engine = RCPU_ENGINE_PIPELINE;
+                } else if (strcmp("functional", argv[i+1]) == 0) {
+                    options.engine = RCPU_ENGINE_FUNCTIONAL;
+                } else if (strcmp("threaded", argv[i+1]) == 0) {
+                    options.engine = RCPU_ENGINE_THREADED;
+                } else if (strcmp("jit", argv[i+1]) == 0) {
+                    options.engine = RCPU_ENGINE_JIT;
+                } else if (strcmp("tiered", argv[i+1]) == 0) {
+                    options.engine = RCPU_ENGINE_TIERED;
+                } else {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+            }
+        }
     }
 
     // If not all required parameters have been set
-    if (!programKindSet || !programString) {
+    if ((!!programString + !!batchString + !!restoreString) != 1
+        || (!programKindSet && !restoreString)) {
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    // Read in program
-    if (load_program_from_path(programKind, programString, &memory.code, &memory.code_size) != 0) {
+    // Restored programs keep the data memory they were saved with
+    if ((dataSizeString && ((machine_parse_data_size(dataSizeString, &options.data_size) != 0) || restoreString))
+        || (dataImageString && !programString)) {
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    // Initialize data memory with 1 MB of zeroes.
-    memory.data_size = 1024 * 1024; // One MB for now
-    memory.data = malloc(memory.data_size);
-    assert((memory.data != NULL) && "Failed to allocate memory");
+    // Data memory is dumped for a single program only
+    if ((dumpMemoryString && batchString) || (dumpDirty && !dumpMemoryString)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
 
-    bzero(memory.data, memory.data_size);
+    // Checkpoints are taken and STOREs traced of a single program only
+    if ((batchString && (checkpointString || storeTraceString)) || (mapCheckpoint && !restoreString)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
 
-    if_result_t * r1 = NULL;
-    id_result_t * r2 = NULL;
-    ex_result_t * r3 = NULL;
-    mem_result_t * r4 = NULL;
+    // Deltas need a checkpoint to base on, either taken or restored
+    if ((deltaString && !checkpointString && !restoreString) || (applyCount > 0 && !restoreString)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
 
-    do {
-        // By going the 'wrong' way,
-        // we don't have to deal with
-        // mutexes etc
+    // Single stepping through thousands of programs makes no sense,
+    // neither does sampling them or a run that is stepped through
+    if ((batchString && singleStepping) || (sampling.interval && (batchString || singleStepping))
+        || (sampling.every == 0)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
 
-        write_back(r4);
-        r4 = memory_access(r3);
-        r3 = execute(r2);
-        r2 = instruction_decode(r1);
-        r1 = instruction_fetch();
+    // Sampling runs the program on the pipeline only for the intervals
+    // sampled, so the rest of it runs on the functional engine unless
+    // another mode is selected
+    if (sampling.interval && !modeSet)
+        options.engine = RCPU_ENGINE_FUNCTIONAL;
 
-        if (singleStepping) {
-            // Debug print
-            
-            // Escape sequence that makes the terminal window look like its empty
-            fprintf(stdout, "\033[2J\033[1;1H");
+    // The pipeline runs a region of interest of a single program, which
+    // superinstructions must not be fused into
+    const bool detailed = detailFromString || detailUntilString;
+    if ((detailFromString && !parse_point(detailFromString, &detailFrom, &detailFromValue))
+        || (detailUntilString && !parse_point(detailUntilString, &detailUntil, &detailUntilValue))
+        || (detailed && (batchString || singleStepping || sampling.interval || options.fuse))) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
 
-            // Print register bank
-            fprintf(stdout, "--------------------------------------------------------------------------------\n");
-            for (int i = 0; i < sizeof(registers) / sizeof(*registers); ++i) {
-                if (i % 4 == 0)
-                    fprintf(stdout, "======= ");
+    // Lockstep execution and warm-ups need many instances of a program
+    if ((lockstep || warmup || changes) && !batchString) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
 
-                fprintf(stdout, "r%02d: 0x%08x\t", i, registers[i]);
+    // Only the pipeline has stages that could be printed
+    if (singleStepping && options.engine != RCPU_ENGINE_PIPELINE) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
 
-                if (i % 4 == 3)
-                    fprintf(stdout, "========\n");
-            }
-            fprintf(stdout, "--------------------------------------------------------------------------------\n");
+    // Only the threaded engine knows about superinstructions
+    if (options.fuse && options.engine != RCPU_ENGINE_THREADED) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
 
-            if (r1) {
-                const char * instruction_text = instruction_disassemble(r1->inst);
-                fprintf(stdout, "IF:\n\tinstruction: \t[0x%08x]: \"%s\"\n", r1->n_pc - 1, instruction_text);
-                free((void *)instruction_text);
-            }
-            if (r2) {
-                const char * instruction_text = instruction_disassemble(r2->inst);
-                fprintf(stdout, "ID:\n\tinstruction: \t[0x%08x]: \"%s\"\n", r2->n_pc - 1, instruction_text);
-                fprintf(stdout, "\tOperand 1:\t0x%08x\n\tOperand 2:\t0x%08x\n\tIO Operand:\t0x%08x\n", r2->op1, r2->op2, r2->io_op);
-                free((void *)instruction_text);
-            }
-            if (r3) {
-                const char * instruction_text = instruction_disassemble(r3->inst);
-                fprintf(stdout, "EX:\n\tinstruction: \t[0x%08x]: \"%s\"\n", r3->n_pc - 1, instruction_text);
-                fprintf(stdout, "\tbranch_taken:\t0x%x\n\tresult:\t\t0x%08x\n", r3->branch_taken, r3->result);
-                free((void *)instruction_text);
-            }
-            if (r4) {
-                const char * instruction_text = instruction_disassemble(r4->inst);
-                fprintf(stdout, "MEM:\n\tinstruction: \t[0x%08x]: \"%s\"\n", r4->n_pc - 1, instruction_text);
-                free((void *)instruction_text);
+    if (batchString)
+        return run_batch(batchString, outputString, &(batch_options_t){
+            .machine = options,
+            .format = programKind,
+            .max_cycles = maxCycles,
+            .warmup = warmup,
+            .threads = threads,
+            .lockstep = lockstep,
+            .changes = changes
+        }, statistics);
+
+    // Read in program, with zeroed data memory (1 MB by default), or continue one
+    rcpu_t * const rcpu = rcpu_create(&options);
+    assert((rcpu != NULL) && "Failed to allocate memory");
+
+    if (restoreString) {
+        if (rcpu_restore_checkpoint(rcpu, restoreString, mapCheckpoint) != 0) {
+            fprintf(stderr, "Could not restore %s\n", restoreString);
+            return EXIT_FAILURE;
+        }
+
+        // Deltas are applied in the order they were taken
+        for (unsigned int i = 0; i < applyCount; ++i) {
+            if (rcpu_apply_delta_checkpoint(rcpu, applyStrings[i]) != 0) {
+                fprintf(stderr, "Could not apply %s\n", applyStrings[i]);
+                return EXIT_FAILURE;
             }
-            
-            // Wait for user input
-            int c = getchar();
-            if (c == EOF) // Hit CTRL+D to invoke this.
-                singleStepping = false;
         }
+    } else {
+        const int error = rcpu_load_file(rcpu, programString, programKind);
+
+        if (error == -1) {
+            fprintf(stderr, "Could not allocate memory for %s\n", programString);
+            return EXIT_FAILURE;
+        } else if (error != 0) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (dataImageString && rcpu_map_data_image(rcpu, dataImageString) != 0) {
+        fprintf(stderr, "Could not map %s\n", dataImageString);
+        return EXIT_FAILURE;
+    }
+
+    if (storeTraceString && rcpu_trace_stores(rcpu, storeTraceString) != 0) {
+        fprintf(stderr, "Could not create %s\n", storeTraceString);
+        return EXIT_FAILURE;
+    }
+
+    const double start_time = current_time();
+
+    // The checkpoint is taken at the given cycle, or once the program has finished
+    if (checkpointString) {
+        if (checkpointCycle > rcpu_cycles(rcpu))
+            rcpu_run(rcpu, checkpointCycle - rcpu_cycles(rcpu));
+
+        if (rcpu_save_checkpoint(rcpu, checkpointString) != 0) {
+            fprintf(stderr, "Could not write %s\n", checkpointString);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The delta holds what changed since the checkpoint taken or restored
+    if (deltaString) {
+        if (deltaCycle > rcpu_cycles(rcpu))
+            rcpu_run(rcpu, deltaCycle - rcpu_cycles(rcpu));
+
+        if (rcpu_save_delta_checkpoint(rcpu, deltaString) != 0) {
+            fprintf(stderr, "Could not write %s\n", deltaString);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Only the region of interest is run on the pipeline, then the
+    // program is handed back to the engine selected
+    uint64_t detailStart = 0, detailCycles = 0;
+
+    if (detailed) {
+        if (detailFromString)
+            rcpu_run_until(rcpu, detailFrom, detailFromValue);
+
+        detailStart = rcpu_cycles(rcpu);
+        rcpu_switch_engine(rcpu, RCPU_ENGINE_PIPELINE);
+
+        if (detailUntilString) {
+            rcpu_run_until(rcpu, detailUntil, detailUntilValue);
+            rcpu_switch_engine(rcpu, options.engine);
+        } else {
+            rcpu_run(rcpu, RCPU_RUN_UNTIL_HALT);
+        }
+
+        detailCycles = rcpu_cycles(rcpu) - detailStart;
+    }
+
+    if (singleStepping)
+        single_step(rcpu);
+
+    sampling_result_t sampled;
+    sampling.threads = threads;
+
+    if (sampling.interval)
+        sampling_run(rcpu, &sampling, &sampled);
+    else
+        rcpu_run(rcpu, RCPU_RUN_UNTIL_HALT);
+
+    const double elapsed = current_time() - start_time;
+    const uint64_t cycles = rcpu_cycles(rcpu);
+
+    if (storeTraceString && rcpu_stop_tracing_stores(rcpu) != 0) {
+        fprintf(stderr, "Could not write %s\n", storeTraceString);
+        return EXIT_FAILURE;
+    }
+
+    const rcpu_fault_t * const fault = rcpu_fault(rcpu);
+    if (fault != NULL) {
+        fprintf(stderr, "%s\n", fault->report);
+        return EXIT_FAILURE;
+    }
 
-    } while (r1 || r2 || r3 || r4);
+    if (dumpMemoryString && rcpu_dump_data(rcpu, dumpMemoryString, dumpDirty) != 0) {
+        fprintf(stderr, "Could not write %s\n", dumpMemoryString);
+        return EXIT_FAILURE;
+    }
 
     printf("Printing results: \n");
-    dump_memory_protocol();
+    rcpu_print_memory_protocol(rcpu);
+
+    if (statistics) {
+        fprintf(stderr, "cycles:      %llu\n", (unsigned long long)cycles);
+        fprintf(stderr, "time:        %.6f s\n", elapsed);
+        fprintf(stderr, "cycles/sec:  %.0f\n", cycles / elapsed);
+
+        rcpu_print_statistics(rcpu, stderr);
+
+        if (detailed)
+            fprintf(stderr, "detailed:    %llu cycles from cycle %llu\n",
+                    (unsigned long long)detailCycles, (unsigned long long)detailStart);
+    }
+
+    if (sampling.interval)
+        sampling_print_result(stderr, &sampled);
+
+    rcpu_destroy(rcpu);
+    free(applyStrings);
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,176 @@
+#include "Tiered.h"
+
+#include "../Functional/Threaded.h"
+#include "../Functional/Transfer.h"
+#include "../Instruction/BasicBlock.h"
+
+#include <stdlib.h>
+#include <strings.h> // bzero
+#include <assert.h>
+#include <time.h> // timespec_get
+
+static const char * const tier_names[TIER_COUNT] = {
+    [TIER_PIPELINE] = "pipeline",
+    [TIER_THREADED] = "threaded"
+};
+
+/*
+    Returns the current time in seconds.
+*/
+static double current_time()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+    Returns the address the pipeline fetches from during the next cycle.
+*/
+static uint32_t next_fetch(const rcpu_machine_t * const machine, const pipeline_state_t * const state)
+{
+    // Taken branches change the PC in MEM, right before IF
+    const ex_result_t * const branch = pipeline_ex_mem(state);
+
+    if (branch && branch->branch_taken)
+        return branch->result;
+
+    return machine->registers[pc];
+}
+
+/*
+    Records that the loop from first to last has become hot.
+    hot[first] is the index of the loop plus one.
+*/
+static void mark_hot(tiered_statistics_t * const statistics, uint32_t * const hot,
+                     const uint32_t first, const uint32_t last, const uint64_t cycle)
+{
+    // Another branch back to the same loop
+    if (hot[first] != 0) {
+        tiered_loop_t * const loop = &statistics->loops[hot[first] - 1];
+
+        if (last > loop->last)
+            loop->last = last;
+        return;
+    }
+
+    statistics->loops = realloc(statistics->loops, (statistics->nloops + 1) * sizeof(tiered_loop_t));
+    assert((statistics->loops != NULL) && "Failed to allocate memory");
+
+    statistics->loops[statistics->nloops] = (tiered_loop_t){
+        .first = first,
+        .last = last,
+        .hot_cycle = cycle
+    };
+    hot[first] = ++statistics->nloops;
+}
+
+uint64_t tiered_run(rcpu_machine_t * const machine, pipeline_state_t * const state,
+                    const uint32_t threshold, tiered_statistics_t * const statistics)
+{
+    const memory_image_t * const memory = &machine->memory;
+    const size_t ninstructions = memory->code_size / sizeof(*memory->code);
+
+    // Taken backward branches per target, and hot loops per first address
+    uint32_t * const counters = calloc(ninstructions, sizeof(uint32_t));
+    uint32_t * const hot = calloc(ninstructions, sizeof(uint32_t));
+    assert((counters != NULL) && (hot != NULL) && "Failed to allocate memory");
+
+    bzero(statistics, sizeof(*statistics));
+
+    functional_state_t functional;
+    uint64_t cycles;
+
+    const pipeline_step_t step = pipeline_select_step(machine);
+
+    for (;;) {
+        double start = current_time();
+        uint64_t start_cycle = state->cycles;
+
+        // Run on the pipeline until a hot loop is entered
+        tiered_loop_t * loop = NULL;
+        bool running = true;
+
+        pipeline_set_locator(machine, state);
+
+        while (running) {
+            const uint32_t address = next_fetch(machine, state);
+
+            if ((address < ninstructions) && (hot[address] != 0)) {
+                loop = &statistics->loops[hot[address] - 1];
+                break;
+            }
+
+            running = (pipeline_skip_nops(machine, state, UINT64_MAX) > 0) || step(machine, state);
+
+            // Branches have taken effect once they are past MEM
+            const mem_result_t * const branch = pipeline_mem_wb(state);
+
+            if (branch && instruction_is_control_flow(branch->inst)) {
+                const uint32_t source = branch->inst - memory->decoded;
+                const uint32_t target = branch->n_pc;
+
+                if ((target <= source) && (++counters[target] >= threshold))
+                    mark_hot(statistics, hot, target, source + 2, state->cycles);
+            }
+        }
+
+        statistics->cycles[TIER_PIPELINE] += state->cycles - start_cycle;
+        statistics->time[TIER_PIPELINE] += current_time() - start;
+
+        if (!running) {
+            cycles = state->cycles;
+            break;
+        }
+
+        // Run the loop on the threaded engine, then go back
+        // to the pipeline as soon as it can take over.
+        start = current_time();
+        start_cycle = state->cycles;
+
+        loop->promotions++;
+
+        transfer_to_functional(machine, state, &functional);
+        threaded_run_range(machine, &functional, loop->first, loop->last, UINT64_MAX);
+
+        running = (functional.in_flight != 0);
+        functional_set_locator(machine, &functional);
+
+        while (running && !transfer_to_pipeline(machine, &functional, state))
+            running = functional_step(machine, &functional);
+
+        statistics->cycles[TIER_THREADED] += functional.cycles - start_cycle;
+        statistics->time[TIER_THREADED] += current_time() - start;
+
+        if (!running) {
+            cycles = functional.cycles;
+            break;
+        }
+    }
+
+    // The locator may point at functional
+    machine_set_locator(machine, NULL, NULL);
+
+    free(counters);
+    free(hot);
+
+    return cycles;
+}
+
+void tiered_print_statistics(FILE * const out, const tiered_statistics_t * const statistics)
+{
+    for (int tier = 0; tier < TIER_COUNT; ++tier) {
+        fprintf(out, "%-13s%llu cycles, %.6f s\n", tier_names[tier],
+                (unsigned long long)statistics->cycles[tier], statistics->time[tier]);
+    }
+
+    fprintf(out, "hot loops:   %zu\n", statistics->nloops);
+    for (size_t i = 0; i < statistics->nloops; ++i) {
+        const tiered_loop_t * const loop = &statistics->loops[i];
+
+        fprintf(out, "    [0x%x - 0x%x]: hot at cycle %llu, promoted %llu times\n",
+                loop->first, loop->last, (unsigned long long)loop->hot_cycle,
+                (unsigned long long)loop->promotions);
+    }
+}
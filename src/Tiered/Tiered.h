@@ -0,0 +1,89 @@
+/*!
+    @header Tiered execution
+    Runs a program on the reference pipeline (see PipelineState.h) and
+    moves hot loops to the threaded engine (see Threaded.h), which
+    computes the same results much faster.
+
+    The pipeline counts how often every taken backward branch or jump
+    lands on each target. Once a target has been reached that often,
+    the code from the target up to the delay slots of the branch is
+    considered a hot loop. Whenever the pipeline is about to fetch the
+    first instruction of a hot loop afterwards, the program is handed
+    to the threaded engine (see Transfer.h), which runs it until it
+    leaves the loop. Everything else stays on the pipeline.
+
+    @related Transfer.h
+
+    @language c
+    @author Jakob Rieck
+*/
+#ifndef TIERED__TIERED_H
+#define TIERED__TIERED_H
+
+#include "../Pipeline/PipelineState.h"
+
+#include <stdio.h>
+
+/*!
+    @abstract
+        The engines of tiered execution, from slowest to fastest.
+*/
+typedef enum {
+    TIER_PIPELINE = 0,
+    TIER_THREADED,
+    TIER_COUNT
+} tier_t;
+
+/*!
+    @abstract
+        A loop that has become hot.
+*/
+typedef struct tiered_loop {
+    uint32_t first;         // address of the first instruction
+    uint32_t last;          // address of the last delay slot of the branch back
+    uint64_t hot_cycle;     // cycle at which the loop became hot
+    uint64_t promotions;    // number of times it has been handed to a faster tier
+} tiered_loop_t;
+
+/*!
+    @abstract
+        Statistics about the decisions of tiered execution.
+*/
+typedef struct tiered_statistics {
+    uint64_t cycles[TIER_COUNT];    // cycles simulated by each tier
+    double   time[TIER_COUNT];      // time spent in each tier, in seconds
+
+    tiered_loop_t * loops;          // all hot loops, in the order they became hot
+    size_t          nloops;
+} tiered_statistics_t;
+
+/*!
+    @abstract
+        Runs the program until it has finished.
+
+    @param machine
+        The machine the program runs on.
+    @param state
+        The state of the pipeline, which must have been initialized
+        using pipeline_init. It is not up to date afterwards if the
+        program finished on a faster tier.
+    @param threshold
+        The number of times a loop has to be run on the pipeline
+        before it becomes hot.
+    @param statistics
+        Output parameter for the statistics. The caller is responsible
+        to release the loops.
+
+    @return
+        The number of cycles simulated.
+*/
+uint64_t tiered_run(rcpu_machine_t * const machine, pipeline_state_t * const state,
+                    const uint32_t threshold, tiered_statistics_t * const statistics);
+
+/*!
+    @abstract
+        Prints the statistics of a tiered run.
+*/
+void tiered_print_statistics(FILE * const out, const tiered_statistics_t * const statistics);
+
+#endif /* TIERED__TIERED_H */